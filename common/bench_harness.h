@@ -0,0 +1,270 @@
+/******************************************************************************
+ * bench_harness.h
+ *
+ * 各驱动程序共用的计时框架 (C/C++ 通用):
+ *   - 先做 warmup 次预热 (不计时), 再重复 reps 次计时
+ *   - 每次计时前可调用 reset 恢复输入 (如把累加型的 C 清零), reset 不计入时间
+ *   - 可选的同步钩子: begin 在计时起点前调用 (MPI 中为 MPI_Barrier),
+ *     combine 把本进程的耗时合并为全局耗时 (MPI 中为所有进程取最大值),
+ *     见 gemm_mpi.h 中的 bench_mpi_sync
+ *   - 统计 min / median / p95 / max / mean, GFLOPS 与 GB/s 均按 SI 单位 (1e9)
+ *   - 结果可追加写入 JSON Lines (每次运行一个 JSON 对象占一行) 与 CSV 文件,
+ *     记录编译器、编译时间和构建标识 (-DBENCH_BUILD_ID="...", 如 git 提交号),
+ *     便于跨构建追踪性能回退
+ ******************************************************************************/
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef BENCH_BUILD_ID
+#define BENCH_BUILD_ID "unknown"
+#endif
+
+#define BENCH_MAX_PARAMS 16
+
+typedef struct {
+    int warmup;
+    int reps;
+    const char *json_path;   /* NULL 表示不输出 */
+    const char *csv_path;
+} bench_config;
+
+/* 同步钩子, 各成员均可为 NULL */
+typedef struct {
+    void (*begin)(void *arg);
+    double (*combine)(double local_seconds, void *arg);
+    void *arg;
+} bench_sync;
+
+typedef struct {
+    int n;
+    double min, median, p95, max, mean;
+} bench_stats;
+
+typedef struct {
+    char key[32];
+    char value[64];
+} bench_param;
+
+typedef struct {
+    const char *name;
+    int warmup;
+    int reps;
+    double flops;            /* 每次运行的浮点运算数, 0 表示不报告 GFLOPS */
+    double bytes;            /* 每次运行的访存/传输字节数, 0 表示不报告带宽 */
+    bench_stats time;        /* 合并后的耗时 (MPI 中为各进程最大值) */
+    bench_stats local;       /* 本进程自己的耗时 */
+    bench_param params[BENCH_MAX_PARAMS];
+    int nparams;
+} bench_result;
+
+static inline double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static inline int bench_cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* 对 samples 排序后计算统计量; p95 取最近秩 (nearest-rank) 定义 */
+static inline bench_stats bench_stats_compute(double *samples, int n)
+{
+    bench_stats s = {n, 0.0, 0.0, 0.0, 0.0, 0.0};
+    double sum = 0.0;
+    int idx;
+
+    if (n <= 0)
+        return s;
+    qsort(samples, n, sizeof(double), bench_cmp_double);
+    for (int i = 0; i < n; i++)
+        sum += samples[i];
+    idx = (int)ceil(0.95 * n) - 1;
+    s.min = samples[0];
+    s.max = samples[n - 1];
+    s.median = n % 2 ? samples[n / 2] : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+    s.p95 = samples[idx < 0 ? 0 : idx];
+    s.mean = sum / n;
+    return s;
+}
+
+/* 预热 + 重复计时, 结果写入 out 的 time/local/warmup/reps (name/flops/bytes/参数由调用方填写) */
+static inline void bench_run(const bench_config *cfg, const bench_sync *sync,
+                             void (*reset)(void *ctx), void (*fn)(void *ctx), void *ctx,
+                             bench_result *out)
+{
+    const int reps = cfg->reps > 0 ? cfg->reps : 1;
+    double *global = (double *)malloc(sizeof(double) * reps);
+    double *local = (double *)malloc(sizeof(double) * reps);
+
+    for (int i = 0; i < cfg->warmup + reps; i++) {
+        double t0, t;
+
+        if (reset)
+            reset(ctx);
+        if (sync && sync->begin)
+            sync->begin(sync->arg);
+        t0 = bench_now();
+        fn(ctx);
+        t = bench_now() - t0;
+        if (i < cfg->warmup)
+            continue;
+        local[i - cfg->warmup] = t;
+        global[i - cfg->warmup] = sync && sync->combine ? sync->combine(t, sync->arg) : t;
+    }
+
+    out->warmup = cfg->warmup;
+    out->reps = reps;
+    out->time = bench_stats_compute(global, reps);
+    out->local = bench_stats_compute(local, reps);
+    free(global);
+    free(local);
+}
+
+/******************************************************************************
+ * 结果参数
+ ******************************************************************************/
+
+static inline void bench_param_str(bench_result *r, const char *key, const char *value)
+{
+    if (r->nparams >= BENCH_MAX_PARAMS)
+        return;
+    snprintf(r->params[r->nparams].key, sizeof(r->params[0].key), "%s", key);
+    snprintf(r->params[r->nparams].value, sizeof(r->params[0].value), "%s", value ? value : "");
+    r->nparams++;
+}
+
+static inline void bench_param_int(bench_result *r, const char *key, long value)
+{
+    char buf[32];
+
+    snprintf(buf, sizeof(buf), "%ld", value);
+    bench_param_str(r, key, buf);
+}
+
+/* 以秒计的耗时对应的速率 (SI), 耗时为 0 时返回 0 */
+static inline double bench_rate(double amount, double seconds)
+{
+    return seconds > 0.0 ? amount / seconds * 1e-9 : 0.0;
+}
+
+/******************************************************************************
+ * 输出
+ ******************************************************************************/
+
+static inline void bench_print(const bench_result *r)
+{
+    const bench_stats *t = &r->time;
+
+    printf("计时 (%s): 预热 %d 次, 重复 %d 次\n", r->name, r->warmup, r->reps);
+    printf("运行时间 (秒): 最小 %.6f, 中位数 %.6f, p95 %.6f, 最大 %.6f\n",
+           t->min, t->median, t->p95, t->max);
+    if (r->bytes > 0.0)
+        printf("内存带宽: %.3f GB/s (中位数), %.3f GB/s (最佳)\n",
+               bench_rate(r->bytes, t->median), bench_rate(r->bytes, t->min));
+    if (r->flops > 0.0)
+        printf("浮点运算性能: %.3f GFLOPS (中位数), %.3f GFLOPS (最佳)\n",
+               bench_rate(r->flops, t->median), bench_rate(r->flops, t->min));
+}
+
+/* 输出 JSON 字符串, 转义引号、反斜杠和控制字符 */
+static inline void bench_json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(f, "\\u%04x", (unsigned char)*s);
+        else
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static inline void bench_json_stats(FILE *f, const char *key, const bench_stats *s)
+{
+    fprintf(f, "\"%s\":{\"min\":%.9g,\"median\":%.9g,\"p95\":%.9g,\"max\":%.9g,\"mean\":%.9g}",
+            key, s->min, s->median, s->p95, s->max, s->mean);
+}
+
+static inline long bench_timestamp(void)
+{
+    return (long)time(NULL);
+}
+
+/* 追加一行 JSON; 成功返回 0 */
+static inline int bench_write_json(const char *path, const bench_result *r)
+{
+    FILE *f = fopen(path, "a");
+
+    if (!f)
+        return -1;
+    fprintf(f, "{\"name\":");
+    bench_json_string(f, r->name);
+    fprintf(f, ",\"timestamp\":%ld,\"build\":{\"id\":", bench_timestamp());
+    bench_json_string(f, BENCH_BUILD_ID);
+#ifdef __VERSION__
+    fprintf(f, ",\"compiler\":");
+    bench_json_string(f, __VERSION__);
+#endif
+    fprintf(f, ",\"date\":");
+    bench_json_string(f, __DATE__ " " __TIME__);
+    fprintf(f, "},\"params\":{");
+    for (int i = 0; i < r->nparams; i++) {
+        if (i)
+            fputc(',', f);
+        bench_json_string(f, r->params[i].key);
+        fputc(':', f);
+        bench_json_string(f, r->params[i].value);
+    }
+    fprintf(f, "},\"warmup\":%d,\"reps\":%d,", r->warmup, r->reps);
+    bench_json_stats(f, "seconds", &r->time);
+    fprintf(f, ",\"gflops\":{\"median\":%.6g,\"best\":%.6g}",
+            bench_rate(r->flops, r->time.median), bench_rate(r->flops, r->time.min));
+    fprintf(f, ",\"gbps\":{\"median\":%.6g,\"best\":%.6g}}\n",
+            bench_rate(r->bytes, r->time.median), bench_rate(r->bytes, r->time.min));
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/* 追加一行 CSV, 新文件先写表头; 参数合并为一列 "k=v;k=v" 以保持列固定; 成功返回 0 */
+static inline int bench_write_csv(const char *path, const bench_result *r)
+{
+    FILE *f = fopen(path, "a");
+
+    if (!f)
+        return -1;
+    if (ftell(f) == 0)
+        fprintf(f, "name,timestamp,build_id,params,warmup,reps,"
+                   "t_min,t_median,t_p95,t_max,t_mean,gflops_median,gflops_best,gbps_median,gbps_best\n");
+    fprintf(f, "%s,%ld,%s,\"", r->name, bench_timestamp(), BENCH_BUILD_ID);
+    for (int i = 0; i < r->nparams; i++)
+        fprintf(f, "%s%s=%s", i ? ";" : "", r->params[i].key, r->params[i].value);
+    fprintf(f, "\",%d,%d,%.9g,%.9g,%.9g,%.9g,%.9g,%.6g,%.6g,%.6g,%.6g\n", r->warmup, r->reps,
+            r->time.min, r->time.median, r->time.p95, r->time.max, r->time.mean,
+            bench_rate(r->flops, r->time.median), bench_rate(r->flops, r->time.min),
+            bench_rate(r->bytes, r->time.median), bench_rate(r->bytes, r->time.min));
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/* 打印并按配置写文件 (MPI 程序只在进程 0 调用) */
+static inline void bench_report(const bench_config *cfg, const bench_result *r)
+{
+    bench_print(r);
+    if (cfg->json_path && bench_write_json(cfg->json_path, r) != 0)
+        printf("警告: 无法写入 %s\n", cfg->json_path);
+    if (cfg->csv_path && bench_write_csv(cfg->csv_path, r) != 0)
+        printf("警告: 无法写入 %s\n", cfg->csv_path);
+}
+
+#endif /* BENCH_HARNESS_H */
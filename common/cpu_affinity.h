@@ -0,0 +1,208 @@
+/******************************************************************************
+ * cpu_affinity.h
+ *
+ * 进程/线程绑核与 NUMA 拓扑查询 (C/C++ 通用, 仅 Linux):
+ *   - NUMA 节点及其 CPU 列表读取 /sys/devices/system/node/nodeN/cpulist,
+ *     没有该目录 (未启用 NUMA 的内核) 时视为单节点, 包含全部可用 CPU;
+ *     节点编号按 node/has_cpu (或 node/possible) 列举, 可以不连续 (分区或
+ *     CXL 系统上常见 0,2 这样的编号), 只计 CPU 列表非空的节点
+ *   - 物理核与 L3 域读取 /sys/devices/system/cpu/cpuN/{topology,cache}
+ *   - 绑定使用 sched_setaffinity(0, ...), 在 Linux 上只作用于调用线程,
+ *     因此可以在 OpenMP 并行区内逐线程绑定
+ *
+ * 依赖 glibc 的 CPU_SET 系列宏, C 程序需在包含任何系统头文件之前定义
+ * _GNU_SOURCE (g++ 默认已定义)。
+ ******************************************************************************/
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AFFINITY_MAX_NODES 64
+
+/* 解析 "0-3,8,10-11" 形式的 CPU 列表; 成功返回 0 */
+static inline int affinity_parse_cpulist(const char *s, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    while (*s && *s != '\n') {
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+
+        if (end == s)
+            return -1;
+        if (*end == '-')
+            hi = strtol(end + 1, &end, 10);
+        for (long c = lo; c <= hi && c < CPU_SETSIZE; c++)
+            CPU_SET((int)c, set);
+        s = *end == ',' ? end + 1 : end;
+    }
+    return 0;
+}
+
+/* 把 CPU 集合格式化为紧凑的列表写入 buf */
+static inline void affinity_format_cpulist(const cpu_set_t *set, char *buf, size_t len)
+{
+    size_t used = 0;
+
+    buf[0] = '\0';
+    for (int c = 0; c < CPU_SETSIZE && used < len; c++) {
+        int hi = c;
+
+        if (!CPU_ISSET(c, set))
+            continue;
+        while (hi + 1 < CPU_SETSIZE && CPU_ISSET(hi + 1, set))
+            hi++;
+        used += (size_t)snprintf(buf + used, len - used, used ? ",%d" : "%d", c);
+        if (hi > c && used < len)
+            used += (size_t)snprintf(buf + used, len - used, "-%d", hi);
+        c = hi;
+    }
+}
+
+/* 读取 NUMA 节点 node 的 CPU 列表; 节点不存在返回 -1 */
+static inline int affinity_node_cpus(int node, cpu_set_t *set)
+{
+    char path[96], line[4096];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+    if (!fgets(line, sizeof(line), f))
+        line[0] = '\0';
+    fclose(f);
+    return affinity_parse_cpulist(line, set);
+}
+
+/* 有 CPU 的 NUMA 节点编号按升序写入 ids (最多 max 个), 返回个数;
+ * 一个也查不到时 (未启用 NUMA) 返回节点 0 */
+static inline int affinity_cpu_node_ids(int *ids, int max)
+{
+    const char *paths[] = {"/sys/devices/system/node/has_cpu", "/sys/devices/system/node/possible"};
+    char line[4096];
+    cpu_set_t nodes, set;
+    int n = 0;
+
+    CPU_ZERO(&nodes);
+    for (int i = 0; i < 2 && CPU_COUNT(&nodes) == 0; i++) {
+        FILE *f = fopen(paths[i], "r");
+
+        if (!f)
+            continue;
+        if (!fgets(line, sizeof(line), f) || affinity_parse_cpulist(line, &nodes) != 0)
+            CPU_ZERO(&nodes);
+        fclose(f);
+    }
+    for (int node = 0; node < CPU_SETSIZE && n < max; node++) {
+        if (CPU_ISSET(node, &nodes) && affinity_node_cpus(node, &set) == 0 && CPU_COUNT(&set) > 0)
+            ids[n++] = node;
+    }
+    if (n == 0)
+        ids[n++] = 0;
+    return n;
+}
+
+/* 有 CPU 的 NUMA 节点个数, 至少为 1 */
+static inline int affinity_numa_nodes(void)
+{
+    int ids[AFFINITY_MAX_NODES];
+
+    return affinity_cpu_node_ids(ids, AFFINITY_MAX_NODES);
+}
+
+/* cpu 所在的 NUMA 节点, 查不到时返回 0 */
+static inline int affinity_cpu_node(int cpu)
+{
+    int ids[AFFINITY_MAX_NODES], n = affinity_cpu_node_ids(ids, AFFINITY_MAX_NODES);
+    cpu_set_t set;
+
+    for (int i = 0; i < n; i++) {
+        if (affinity_node_cpus(ids[i], &set) == 0 && CPU_ISSET(cpu, &set))
+            return ids[i];
+    }
+    return 0;
+}
+
+/* 集合中第 idx 个 CPU (从 0 开始), 越界返回 -1 */
+static inline int affinity_nth_cpu(const cpu_set_t *set, int idx)
+{
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, set) && idx-- == 0)
+            return c;
+    }
+    return -1;
+}
+
+/* 读取 /sys/devices/system/cpu/cpuN/ 下的一个整数, 读不到返回 fallback */
+static inline int affinity_cpu_sysfs_int(int cpu, const char *file, int fallback)
+{
+    char path[192];
+    FILE *f;
+    int v;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/%s", cpu, file);
+    f = fopen(path, "r");
+    if (!f)
+        return fallback;
+    if (fscanf(f, "%d", &v) != 1)
+        v = fallback;
+    fclose(f);
+    return v;
+}
+
+/* 物理核编号 (封装号 << 16 | core_id), SMT 兄弟线程相同 */
+static inline int affinity_cpu_core(int cpu)
+{
+    return affinity_cpu_sysfs_int(cpu, "topology/physical_package_id", 0) << 16 |
+           affinity_cpu_sysfs_int(cpu, "topology/core_id", cpu);
+}
+
+/* cpu 所在的末级缓存 (L3) 域, 以共享该缓存的最小 CPU 编号表示;
+ * 没有 L3 信息时退回所在的 NUMA 节点的第一个 CPU */
+static inline int affinity_cpu_l3(int cpu)
+{
+    char path[128], line[4096];
+    cpu_set_t set;
+
+    for (int idx = 0; idx < 8; idx++) {
+        FILE *f;
+
+        snprintf(path, sizeof(path), "cache/index%d/level", idx);
+        if (affinity_cpu_sysfs_int(cpu, path, 0) != 3)
+            continue;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, idx);
+        f = fopen(path, "r");
+        if (!f)
+            break;
+        if (!fgets(line, sizeof(line), f))
+            line[0] = '\0';
+        fclose(f);
+        if (affinity_parse_cpulist(line, &set) == 0 && CPU_COUNT(&set) > 0)
+            return affinity_nth_cpu(&set, 0);
+        break;
+    }
+    if (affinity_node_cpus(affinity_cpu_node(cpu), &set) == 0 && CPU_COUNT(&set) > 0)
+        return affinity_nth_cpu(&set, 0);
+    return cpu;
+}
+
+/* 把调用线程绑定到集合中的 CPU; 成功返回 0 */
+static inline int affinity_bind_set(const cpu_set_t *set)
+{
+    return sched_setaffinity(0, sizeof(cpu_set_t), set);
+}
+
+static inline int affinity_bind_cpu(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return affinity_bind_set(&set);
+}
+
+#endif /* CPU_AFFINITY_H */
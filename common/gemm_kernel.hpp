@@ -0,0 +1,446 @@
+/******************************************************************************
+ * gemm_kernel.hpp
+ *
+ * GotoBLAS/BLIS 风格的分块 SGEMM (C += A * B), 微内核按指令集分后端:
+ *   - scalar : 可移植 C++ 实现, 任何平台可用, 作为回退
+ *   - neon   : aarch64 Advanced SIMD, 8x12
+ *   - sve    : aarch64 SVE, 8 x (3*VL), 与向量长度无关 (需以 +sve 编译)
+ *   - avx2   : x86-64 AVX2 + FMA, 6x16
+ *   - avx512 : x86-64 AVX-512F, 12x32
+ *
+ * x86 后端通过函数级 target 属性编译, 无需改变整体编译选项;
+ * 运行时根据 CPUID (x86) 或 HWCAP (aarch64) 选择最优的可用后端,
+ * 也可以通过名字强制指定。
+ ******************************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#if defined(__ARM_FEATURE_SVE)
+#include <arm_sve.h>
+#endif
+#ifndef HWCAP_ASIMD
+#define HWCAP_ASIMD (1 << 1)
+#endif
+#ifndef HWCAP_SVE
+#define HWCAP_SVE (1 << 22)
+#endif
+#endif
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "matrix.hpp"
+
+/******************************************************************************
+ * 0. 后端描述
+ ******************************************************************************/
+
+/// 微内核: C[0:mr, 0:nr] += Ap * Bp
+///   Ap: kc 组, 每组 mr 个连续的 A 列元素
+///   Bp: kc 组, 每组 nr 个连续的 B 行元素
+using GemmMicroKernel = void (*)(int kc, const float *Ap, const float *Bp, float *C, size_t ldc);
+
+struct GemmBackend {
+    const char *name;
+    int mr;                    // 微内核行数
+    int nr;                    // 微内核列数
+    GemmMicroKernel kernel;
+};
+
+/// 缓存分块参数 (单位: 元素)
+struct GemmBlocking {
+    int mc = 128;   // A 块行数, 打包 A 驻留 L2
+    int kc = 256;   // k 方向分块, 一个 B 面板驻留 L1
+    int nc = 3072;  // B 块列数, 打包 B 驻留 L3
+};
+
+/******************************************************************************
+ * 1. 微内核
+ ******************************************************************************/
+
+// 可移植标量实现, 4x8; 常量边界的内层循环可被编译器自动向量化
+static void gemm_kernel_scalar_4x8(int kc, const float *Ap, const float *Bp, float *C, size_t ldc) {
+    const int MR = 4, NR = 8;
+    float acc[MR][NR];
+
+    for (int r = 0; r < MR; r++)
+        for (int c = 0; c < NR; c++)
+            acc[r][c] = C[r * ldc + c];
+
+    for (int p = 0; p < kc; p++) {
+        for (int r = 0; r < MR; r++) {
+            float a = Ap[r];
+            for (int c = 0; c < NR; c++)
+                acc[r][c] += a * Bp[c];
+        }
+        Ap += MR;
+        Bp += NR;
+    }
+
+    for (int r = 0; r < MR; r++)
+        for (int c = 0; c < NR; c++)
+            C[r * ldc + c] = acc[r][c];
+}
+
+#if defined(__aarch64__)
+// 8x12 NEON 微内核: C 块占 24 个 q 寄存器, 在整个 k 循环中常驻寄存器
+static void gemm_kernel_neon_8x12(int kc, const float *Ap, const float *Bp, float *C, size_t ldc) {
+    float *C0 = C,           *C1 = C + ldc,     *C2 = C + 2 * ldc, *C3 = C + 3 * ldc;
+    float *C4 = C + 4 * ldc, *C5 = C + 5 * ldc, *C6 = C + 6 * ldc, *C7 = C + 7 * ldc;
+
+    float32x4_t c00 = vld1q_f32(C0), c01 = vld1q_f32(C0 + 4), c02 = vld1q_f32(C0 + 8);
+    float32x4_t c10 = vld1q_f32(C1), c11 = vld1q_f32(C1 + 4), c12 = vld1q_f32(C1 + 8);
+    float32x4_t c20 = vld1q_f32(C2), c21 = vld1q_f32(C2 + 4), c22 = vld1q_f32(C2 + 8);
+    float32x4_t c30 = vld1q_f32(C3), c31 = vld1q_f32(C3 + 4), c32 = vld1q_f32(C3 + 8);
+    float32x4_t c40 = vld1q_f32(C4), c41 = vld1q_f32(C4 + 4), c42 = vld1q_f32(C4 + 8);
+    float32x4_t c50 = vld1q_f32(C5), c51 = vld1q_f32(C5 + 4), c52 = vld1q_f32(C5 + 8);
+    float32x4_t c60 = vld1q_f32(C6), c61 = vld1q_f32(C6 + 4), c62 = vld1q_f32(C6 + 8);
+    float32x4_t c70 = vld1q_f32(C7), c71 = vld1q_f32(C7 + 4), c72 = vld1q_f32(C7 + 8);
+
+    for (int p = 0; p < kc; p++) {
+        float32x4_t a0 = vld1q_f32(Ap);
+        float32x4_t a1 = vld1q_f32(Ap + 4);
+        float32x4_t b0 = vld1q_f32(Bp);
+        float32x4_t b1 = vld1q_f32(Bp + 4);
+        float32x4_t b2 = vld1q_f32(Bp + 8);
+
+        c00 = vfmaq_laneq_f32(c00, b0, a0, 0); c01 = vfmaq_laneq_f32(c01, b1, a0, 0); c02 = vfmaq_laneq_f32(c02, b2, a0, 0);
+        c10 = vfmaq_laneq_f32(c10, b0, a0, 1); c11 = vfmaq_laneq_f32(c11, b1, a0, 1); c12 = vfmaq_laneq_f32(c12, b2, a0, 1);
+        c20 = vfmaq_laneq_f32(c20, b0, a0, 2); c21 = vfmaq_laneq_f32(c21, b1, a0, 2); c22 = vfmaq_laneq_f32(c22, b2, a0, 2);
+        c30 = vfmaq_laneq_f32(c30, b0, a0, 3); c31 = vfmaq_laneq_f32(c31, b1, a0, 3); c32 = vfmaq_laneq_f32(c32, b2, a0, 3);
+        c40 = vfmaq_laneq_f32(c40, b0, a1, 0); c41 = vfmaq_laneq_f32(c41, b1, a1, 0); c42 = vfmaq_laneq_f32(c42, b2, a1, 0);
+        c50 = vfmaq_laneq_f32(c50, b0, a1, 1); c51 = vfmaq_laneq_f32(c51, b1, a1, 1); c52 = vfmaq_laneq_f32(c52, b2, a1, 1);
+        c60 = vfmaq_laneq_f32(c60, b0, a1, 2); c61 = vfmaq_laneq_f32(c61, b1, a1, 2); c62 = vfmaq_laneq_f32(c62, b2, a1, 2);
+        c70 = vfmaq_laneq_f32(c70, b0, a1, 3); c71 = vfmaq_laneq_f32(c71, b1, a1, 3); c72 = vfmaq_laneq_f32(c72, b2, a1, 3);
+
+        Ap += 8;
+        Bp += 12;
+    }
+
+    vst1q_f32(C0, c00); vst1q_f32(C0 + 4, c01); vst1q_f32(C0 + 8, c02);
+    vst1q_f32(C1, c10); vst1q_f32(C1 + 4, c11); vst1q_f32(C1 + 8, c12);
+    vst1q_f32(C2, c20); vst1q_f32(C2 + 4, c21); vst1q_f32(C2 + 8, c22);
+    vst1q_f32(C3, c30); vst1q_f32(C3 + 4, c31); vst1q_f32(C3 + 8, c32);
+    vst1q_f32(C4, c40); vst1q_f32(C4 + 4, c41); vst1q_f32(C4 + 8, c42);
+    vst1q_f32(C5, c50); vst1q_f32(C5 + 4, c51); vst1q_f32(C5 + 8, c52);
+    vst1q_f32(C6, c60); vst1q_f32(C6 + 4, c61); vst1q_f32(C6 + 8, c62);
+    vst1q_f32(C7, c70); vst1q_f32(C7 + 4, c71); vst1q_f32(C7 + 8, c72);
+}
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_SVE)
+// 8 x (3*VL) SVE 微内核: 与 NEON 版结构相同, 列宽随硬件向量长度伸缩
+// A 用 ld1rq 把 4 个元素复制到每个 128 位段, 再按 lane 做 fmla
+#define GEMM_SVE_LOAD_ROW(r)                                               \
+    svfloat32_t c##r##0 = svld1_f32(pg, C + (r) * ldc);                    \
+    svfloat32_t c##r##1 = svld1_f32(pg, C + (r) * ldc + vl);               \
+    svfloat32_t c##r##2 = svld1_f32(pg, C + (r) * ldc + 2 * vl);
+#define GEMM_SVE_FMA_ROW(r, a, lane)                                       \
+    c##r##0 = svmla_lane_f32(c##r##0, b0, a, lane);                        \
+    c##r##1 = svmla_lane_f32(c##r##1, b1, a, lane);                        \
+    c##r##2 = svmla_lane_f32(c##r##2, b2, a, lane);
+#define GEMM_SVE_STORE_ROW(r)                                              \
+    svst1_f32(pg, C + (r) * ldc, c##r##0);                                 \
+    svst1_f32(pg, C + (r) * ldc + vl, c##r##1);                            \
+    svst1_f32(pg, C + (r) * ldc + 2 * vl, c##r##2);
+
+static void gemm_kernel_sve_8xv(int kc, const float *Ap, const float *Bp, float *C, size_t ldc) {
+    const size_t vl = svcntw();
+    const svbool_t pg = svptrue_b32();
+
+    GEMM_SVE_LOAD_ROW(0) GEMM_SVE_LOAD_ROW(1) GEMM_SVE_LOAD_ROW(2) GEMM_SVE_LOAD_ROW(3)
+    GEMM_SVE_LOAD_ROW(4) GEMM_SVE_LOAD_ROW(5) GEMM_SVE_LOAD_ROW(6) GEMM_SVE_LOAD_ROW(7)
+
+    for (int p = 0; p < kc; p++) {
+        svfloat32_t a0 = svld1rq_f32(pg, Ap);
+        svfloat32_t a1 = svld1rq_f32(pg, Ap + 4);
+        svfloat32_t b0 = svld1_f32(pg, Bp);
+        svfloat32_t b1 = svld1_f32(pg, Bp + vl);
+        svfloat32_t b2 = svld1_f32(pg, Bp + 2 * vl);
+
+        GEMM_SVE_FMA_ROW(0, a0, 0) GEMM_SVE_FMA_ROW(1, a0, 1) GEMM_SVE_FMA_ROW(2, a0, 2) GEMM_SVE_FMA_ROW(3, a0, 3)
+        GEMM_SVE_FMA_ROW(4, a1, 0) GEMM_SVE_FMA_ROW(5, a1, 1) GEMM_SVE_FMA_ROW(6, a1, 2) GEMM_SVE_FMA_ROW(7, a1, 3)
+
+        Ap += 8;
+        Bp += 3 * vl;
+    }
+
+    GEMM_SVE_STORE_ROW(0) GEMM_SVE_STORE_ROW(1) GEMM_SVE_STORE_ROW(2) GEMM_SVE_STORE_ROW(3)
+    GEMM_SVE_STORE_ROW(4) GEMM_SVE_STORE_ROW(5) GEMM_SVE_STORE_ROW(6) GEMM_SVE_STORE_ROW(7)
+}
+
+#undef GEMM_SVE_LOAD_ROW
+#undef GEMM_SVE_FMA_ROW
+#undef GEMM_SVE_STORE_ROW
+#endif
+
+#if defined(__x86_64__)
+// 6x16 AVX2 微内核: 12 个 ymm 累加器 + 2 个 B 向量 + 1 个 A 广播
+#define GEMM_AVX2_LOAD_ROW(r)                                              \
+    __m256 c##r##0 = _mm256_loadu_ps(C + (r) * ldc);                       \
+    __m256 c##r##1 = _mm256_loadu_ps(C + (r) * ldc + 8);
+#define GEMM_AVX2_FMA_ROW(r)                                               \
+    a = _mm256_broadcast_ss(Ap + (r));                                     \
+    c##r##0 = _mm256_fmadd_ps(a, b0, c##r##0);                             \
+    c##r##1 = _mm256_fmadd_ps(a, b1, c##r##1);
+#define GEMM_AVX2_STORE_ROW(r)                                             \
+    _mm256_storeu_ps(C + (r) * ldc, c##r##0);                              \
+    _mm256_storeu_ps(C + (r) * ldc + 8, c##r##1);
+
+__attribute__((target("avx2,fma")))
+static void gemm_kernel_avx2_6x16(int kc, const float *Ap, const float *Bp, float *C, size_t ldc) {
+    GEMM_AVX2_LOAD_ROW(0) GEMM_AVX2_LOAD_ROW(1) GEMM_AVX2_LOAD_ROW(2)
+    GEMM_AVX2_LOAD_ROW(3) GEMM_AVX2_LOAD_ROW(4) GEMM_AVX2_LOAD_ROW(5)
+
+    for (int p = 0; p < kc; p++) {
+        __m256 b0 = _mm256_loadu_ps(Bp);
+        __m256 b1 = _mm256_loadu_ps(Bp + 8);
+        __m256 a;
+
+        GEMM_AVX2_FMA_ROW(0) GEMM_AVX2_FMA_ROW(1) GEMM_AVX2_FMA_ROW(2)
+        GEMM_AVX2_FMA_ROW(3) GEMM_AVX2_FMA_ROW(4) GEMM_AVX2_FMA_ROW(5)
+
+        Ap += 6;
+        Bp += 16;
+    }
+
+    GEMM_AVX2_STORE_ROW(0) GEMM_AVX2_STORE_ROW(1) GEMM_AVX2_STORE_ROW(2)
+    GEMM_AVX2_STORE_ROW(3) GEMM_AVX2_STORE_ROW(4) GEMM_AVX2_STORE_ROW(5)
+}
+
+#undef GEMM_AVX2_LOAD_ROW
+#undef GEMM_AVX2_FMA_ROW
+#undef GEMM_AVX2_STORE_ROW
+
+// 12x32 AVX-512 微内核: 24 个 zmm 累加器 + 2 个 B 向量 + 1 个 A 广播
+#define GEMM_AVX512_LOAD_ROW(r)                                            \
+    __m512 c##r##0 = _mm512_loadu_ps(C + (r) * ldc);                       \
+    __m512 c##r##1 = _mm512_loadu_ps(C + (r) * ldc + 16);
+#define GEMM_AVX512_FMA_ROW(r)                                             \
+    a = _mm512_set1_ps(Ap[r]);                                             \
+    c##r##0 = _mm512_fmadd_ps(a, b0, c##r##0);                             \
+    c##r##1 = _mm512_fmadd_ps(a, b1, c##r##1);
+#define GEMM_AVX512_STORE_ROW(r)                                           \
+    _mm512_storeu_ps(C + (r) * ldc, c##r##0);                              \
+    _mm512_storeu_ps(C + (r) * ldc + 16, c##r##1);
+
+__attribute__((target("avx512f")))
+static void gemm_kernel_avx512_12x32(int kc, const float *Ap, const float *Bp, float *C, size_t ldc) {
+    GEMM_AVX512_LOAD_ROW(0) GEMM_AVX512_LOAD_ROW(1) GEMM_AVX512_LOAD_ROW(2)  GEMM_AVX512_LOAD_ROW(3)
+    GEMM_AVX512_LOAD_ROW(4) GEMM_AVX512_LOAD_ROW(5) GEMM_AVX512_LOAD_ROW(6)  GEMM_AVX512_LOAD_ROW(7)
+    GEMM_AVX512_LOAD_ROW(8) GEMM_AVX512_LOAD_ROW(9) GEMM_AVX512_LOAD_ROW(10) GEMM_AVX512_LOAD_ROW(11)
+
+    for (int p = 0; p < kc; p++) {
+        __m512 b0 = _mm512_loadu_ps(Bp);
+        __m512 b1 = _mm512_loadu_ps(Bp + 16);
+        __m512 a;
+
+        GEMM_AVX512_FMA_ROW(0) GEMM_AVX512_FMA_ROW(1) GEMM_AVX512_FMA_ROW(2)  GEMM_AVX512_FMA_ROW(3)
+        GEMM_AVX512_FMA_ROW(4) GEMM_AVX512_FMA_ROW(5) GEMM_AVX512_FMA_ROW(6)  GEMM_AVX512_FMA_ROW(7)
+        GEMM_AVX512_FMA_ROW(8) GEMM_AVX512_FMA_ROW(9) GEMM_AVX512_FMA_ROW(10) GEMM_AVX512_FMA_ROW(11)
+
+        Ap += 12;
+        Bp += 32;
+    }
+
+    GEMM_AVX512_STORE_ROW(0) GEMM_AVX512_STORE_ROW(1) GEMM_AVX512_STORE_ROW(2)  GEMM_AVX512_STORE_ROW(3)
+    GEMM_AVX512_STORE_ROW(4) GEMM_AVX512_STORE_ROW(5) GEMM_AVX512_STORE_ROW(6)  GEMM_AVX512_STORE_ROW(7)
+    GEMM_AVX512_STORE_ROW(8) GEMM_AVX512_STORE_ROW(9) GEMM_AVX512_STORE_ROW(10) GEMM_AVX512_STORE_ROW(11)
+}
+
+#undef GEMM_AVX512_LOAD_ROW
+#undef GEMM_AVX512_FMA_ROW
+#undef GEMM_AVX512_STORE_ROW
+#endif
+
+/******************************************************************************
+ * 2. 后端枚举与运行时选择
+ ******************************************************************************/
+
+/// 当前 CPU 支持的全部后端, 按优先级从高到低排列 (最后一个总是 scalar)
+inline const std::vector<GemmBackend> &gemm_supported_backends() {
+    static const std::vector<GemmBackend> backends = [] {
+        std::vector<GemmBackend> list;
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            list.push_back({"avx512", 12, 32, gemm_kernel_avx512_12x32});
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            list.push_back({"avx2", 6, 16, gemm_kernel_avx2_6x16});
+#elif defined(__aarch64__)
+        unsigned long hwcap = getauxval(AT_HWCAP);
+#if defined(__ARM_FEATURE_SVE)
+        if (hwcap & HWCAP_SVE)
+            list.push_back({"sve", 8, 3 * static_cast<int>(svcntw()), gemm_kernel_sve_8xv});
+#endif
+        if (hwcap & HWCAP_ASIMD)
+            list.push_back({"neon", 8, 12, gemm_kernel_neon_8x12});
+#endif
+        list.push_back({"scalar", 4, 8, gemm_kernel_scalar_4x8});
+        return list;
+    }();
+    return backends;
+}
+
+/// 按名字查找后端; 未编译进来或当前 CPU 不支持时返回 nullptr
+inline const GemmBackend *gemm_find_backend(const char *name) {
+    for (const GemmBackend &be : gemm_supported_backends()) {
+        if (std::strcmp(be.name, name) == 0)
+            return &be;
+    }
+    return nullptr;
+}
+
+/// 当前 CPU 上最优的后端
+inline const GemmBackend &gemm_detect_backend() {
+    return gemm_supported_backends().front();
+}
+
+/******************************************************************************
+ * 3. 打包与宏内核
+ ******************************************************************************/
+
+// 打包 mc x kc 的 A 子块为 mr 行一组的面板, 面板内按 k 连续存放 mr 个元素
+// 不足 mr 行的尾部面板补 0, 微内核无需处理边界
+inline void gemm_pack_A(MatrixView<const float> A, int mr, float *Ap) {
+    const int mc = A.rows(), kc = A.cols();
+    for (int ir = 0; ir < mc; ir += mr) {
+        int m = std::min(mr, mc - ir);
+        for (int p = 0; p < kc; p++) {
+            for (int r = 0; r < m; r++) {
+                *Ap++ = A(ir + r, p);
+            }
+            for (int r = m; r < mr; r++) {
+                *Ap++ = 0.0f;
+            }
+        }
+    }
+}
+
+// 打包 kc x n 的 B 子块为一个 nr 列面板, 面板内按 k 连续存放 nr 个元素
+inline void gemm_pack_B_panel(MatrixView<const float> B, int nr, float *Bp) {
+    const int kc = B.rows(), n = B.cols();
+    for (int p = 0; p < kc; p++) {
+        const float *b_row = B.row(p);
+        for (int c = 0; c < n; c++) {
+            Bp[c] = b_row[c];
+        }
+        for (int c = n; c < nr; c++) {
+            Bp[c] = 0.0f;
+        }
+        Bp += nr;
+    }
+}
+
+// 宏内核: 对已打包的 mc x kc 的 A 块和 kc x nc 的 B 块, 逐个 mr x nr 块调用微内核
+// 边界块先拷入临时块计算再写回, 保证微内核始终处理完整块
+inline void gemm_macro_kernel(const GemmBackend &be, int kc, const float *Ap, const float *Bp,
+                              MatrixView<float> C, float *tile) {
+    const int mr = be.mr, nr = be.nr;
+    const int mc = C.rows(), nc = C.cols();
+
+    for (int jr = 0; jr < nc; jr += nr) {
+        int n = std::min(nr, nc - jr);
+        for (int ir = 0; ir < mc; ir += mr) {
+            int m = std::min(mr, mc - ir);
+            const float *a_panel = Ap + static_cast<size_t>(ir) * kc;
+            const float *b_panel = Bp + static_cast<size_t>(jr) * kc;
+
+            if (m == mr && n == nr) {
+                be.kernel(kc, a_panel, b_panel, &C(ir, jr), C.ld());
+            } else {
+                for (int r = 0; r < mr; r++) {
+                    for (int c = 0; c < nr; c++) {
+                        tile[r * nr + c] = (r < m && c < n) ? C(ir + r, jr + c) : 0.0f;
+                    }
+                }
+                be.kernel(kc, a_panel, b_panel, tile, nr);
+                for (int r = 0; r < m; r++) {
+                    for (int c = 0; c < n; c++) {
+                        C(ir + r, jr + c) = tile[r * nr + c];
+                    }
+                }
+            }
+        }
+    }
+}
+
+/******************************************************************************
+ * 4. 分块 GEMM 入口
+ ******************************************************************************/
+
+enum GemmScratchSlot { GEMM_SCRATCH_B, GEMM_SCRATCH_A, GEMM_SCRATCH_TILE, GEMM_SCRATCH_SLOTS };
+
+/// 线程私有的打包缓冲, 只增不减并跨调用复用: SUMMA 每个 nb 面板调用一次
+/// gemm_blocked, 不必每次重新分配; 内容不清零, 打包会写满之后读到的每个元素
+inline float *gemm_scratch(GemmScratchSlot slot, size_t elems) {
+    static thread_local Matrix<float> bufs[GEMM_SCRATCH_SLOTS];
+    Matrix<float> &buf = bufs[slot];
+    if (buf.elems() < elems)
+        buf = Matrix<float>(1, static_cast<int>(elems), MATRIX_PAD_NONE, MATRIX_ALIGNMENT,
+                            MatrixStorage::Scratch);
+    return buf.data();
+}
+
+/// C += A * B, A 为 M x K, B 为 K x N, C 为 M x N
+///   jc -> pc -> ic 三层分块, B 块由所有线程协作打包后共享, A 块由各线程私有打包
+inline void gemm_blocked(const GemmBackend &be, MatrixView<const float> A, MatrixView<const float> B,
+                         MatrixView<float> C, const GemmBlocking &blocking = GemmBlocking()) {
+    const int M = C.rows(), N = C.cols(), K = A.cols();
+    const int mr = be.mr, nr = be.nr;
+    auto round_up = [](int x, int r) { return (x + r - 1) / r * r; };
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    // MC 取 mr 的整数倍, NC 取 nr 的整数倍, 避免块内出现多余的边界微块;
+    // 小问题不超过问题本身, 缓冲按实际用到的大小分配。只有 ic 循环并行,
+    // MC 也不超过 M 均分给各线程的行数, 否则行块数少于线程数, 多余线程空闲
+    const int MC = std::max(mr, std::min(blocking.mc / mr * mr,
+                                         round_up((M + threads - 1) / threads, mr)));
+    const int NC = std::max(nr, std::min(blocking.nc / nr * nr, round_up(N, nr)));
+    const int KC = std::max(1, std::min(blocking.kc, K));
+
+    // 打包缓冲是临时存储, 不随 --pages 映射大页
+    float *Bp = gemm_scratch(GEMM_SCRATCH_B, static_cast<size_t>(KC) * NC);
+
+    #pragma omp parallel
+    {
+        float *Ap = gemm_scratch(GEMM_SCRATCH_A, static_cast<size_t>(MC) * KC);
+        float *tile = gemm_scratch(GEMM_SCRATCH_TILE, static_cast<size_t>(mr) * nr);
+
+        for (int jc = 0; jc < N; jc += NC) {
+            int nc = std::min(NC, N - jc);
+            for (int pc = 0; pc < K; pc += KC) {
+                int kc = std::min(KC, K - pc);
+
+                // 协作打包 B 块, for 结束处的隐式屏障保证打包完成后再计算
+                #pragma omp for schedule(static)
+                for (int jr = 0; jr < nc; jr += nr) {
+                    int n = std::min(nr, nc - jr);
+                    gemm_pack_B_panel(B.block(pc, jc + jr, kc, n), nr, Bp + static_cast<size_t>(jr) * kc);
+                }
+
+                // 各线程处理不同的 MC 行块, 隐式屏障保证下一轮覆盖 Bp 前计算已结束
+                #pragma omp for schedule(dynamic)
+                for (int ic = 0; ic < M; ic += MC) {
+                    int mc = std::min(MC, M - ic);
+                    gemm_pack_A(A.block(ic, pc, mc, kc), mr, Ap);
+                    gemm_macro_kernel(be, kc, Ap, Bp, C.block(ic, jc, mc, nc), tile);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,421 @@
+/******************************************************************************
+ * gemm_mpi.h
+ *
+ * MPI GEMM 驱动程序共用部分 (C/C++ 通用):
+ *   - SUMMA: 在 MPI_Cart_create 建立的 Pr x Pc 二维进程网格上做分布式 GEMM,
+ *            A、B、C 均按 nb x nb 块循环 (block-cyclic) 分布。每一步由持有
+ *            第 k 个块列的进程沿进程行广播 A 面板, 持有第 k 个块行的进程沿
+ *            进程列广播 B 面板, 各进程用本地 C 块累加。每个进程的内存和通信量
+ *            都只随 N^2 / P (以及 N^2 / sqrt(P)) 增长, 而 1D 划分需要每个进程
+ *            持有完整的 B。
+ *   - 每进程内存占用和通信量统计, 在进程 0 汇总打印, 用于对比 1D 与 SUMMA。
+ *   - 每进程计算性能 (GFLOPS), 并按主机名汇总为每节点性能。
+ *   - bench_harness.h 的 MPI 同步钩子: 计时前 MPI_Barrier, 耗时取各进程最大值。
+ *   - --perf 时各进程计时区域的 dTLB 读缺失 (perf_counters.h), 汇总到进程 0。
+ ******************************************************************************/
+#ifndef GEMM_MPI_H
+#define GEMM_MPI_H
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench_harness.h"
+#include "matrix_layout.h"
+#include "matrix_rng.h"
+#include "perf_counters.h"
+
+/* 本地 GEMM: C(m x n) += A(m x k) * B(k x n) */
+typedef void (*gemm_local_fn)(int m, int n, int k,
+                              const float *A, size_t lda,
+                              const float *B, size_t ldb,
+                              float *C, size_t ldc);
+
+/* 每进程资源统计 (字节) */
+typedef struct {
+    double mem_bytes;       /* 计算阶段常驻的矩阵与面板内存 */
+    double dist_bytes;      /* 分发 A/B 与收集 C 的收发量 */
+    double compute_bytes;   /* 计算阶段的通信量 (SUMMA 面板广播 / 1D 无) */
+} gemm_mpi_stats;
+
+/* 每进程计算性能, 按字节收集到进程 0 */
+typedef struct {
+    char host[64];
+    char cpus[64];          /* 绑定的 CPU 列表 */
+    int numa_node;
+    int threads;
+    double flops;           /* 本进程完成的浮点运算数 */
+    double seconds;         /* 本进程的计算时间 */
+} gemm_mpi_perf;
+
+/* 本进程的硬件计数区域: 前 warmup 次运行 (预热) 不计入; pc 为 NULL 时不计数 */
+typedef struct {
+    perf_counters *pc;
+    perf_region region;
+    int calls;
+    int warmup;
+} gemm_mpi_probe;
+
+/* 朴素的 i-k-j 顺序本地乘法, B 和 C 均按行连续访问 */
+static inline void gemm_local_naive(int m, int n, int k,
+                                    const float *A, size_t lda,
+                                    const float *B, size_t ldb,
+                                    float *C, size_t ldc)
+{
+    for (int i = 0; i < m; i++) {
+        float *c_row = C + (size_t)i * ldc;
+        for (int p = 0; p < k; p++) {
+            float a = A[(size_t)i * lda + p];
+            const float *b_row = B + (size_t)p * ldb;
+            for (int j = 0; j < n; j++) {
+                c_row[j] += a * b_row[j];
+            }
+        }
+    }
+}
+
+/******************************************************************************
+ * 二维进程网格与块循环分布
+ ******************************************************************************/
+
+typedef struct {
+    MPI_Comm grid;      /* 笛卡尔通信子, reorder=0, 进程号与 MPI_COMM_WORLD 一致 */
+    MPI_Comm row_comm;  /* 同一进程行, 进程号 == mycol */
+    MPI_Comm col_comm;  /* 同一进程列, 进程号 == myrow */
+    int nprow, npcol;
+    int myrow, mycol;
+    int nb;             /* 分布块大小 */
+} summa_grid;
+
+static inline void summa_grid_create(summa_grid *g, MPI_Comm comm, int nb)
+{
+    int size, dims[2] = {0, 0}, periods[2] = {0, 0}, coords[2], rank;
+    int keep_row[2] = {0, 1}, keep_col[2] = {1, 0};
+
+    MPI_Comm_size(comm, &size);
+    MPI_Dims_create(size, 2, dims);
+    MPI_Cart_create(comm, 2, dims, periods, 0, &g->grid);
+    MPI_Comm_rank(g->grid, &rank);
+    MPI_Cart_coords(g->grid, rank, 2, coords);
+    MPI_Cart_sub(g->grid, keep_row, &g->row_comm);
+    MPI_Cart_sub(g->grid, keep_col, &g->col_comm);
+
+    g->nprow = dims[0];
+    g->npcol = dims[1];
+    g->myrow = coords[0];
+    g->mycol = coords[1];
+    g->nb = nb;
+}
+
+static inline void summa_grid_free(summa_grid *g)
+{
+    MPI_Comm_free(&g->row_comm);
+    MPI_Comm_free(&g->col_comm);
+    MPI_Comm_free(&g->grid);
+}
+
+/* 块循环分布下进程 iproc 持有的行 (列) 数, 同 ScaLAPACK 的 NUMROC */
+static inline int summa_numroc(int n, int nb, int iproc, int nprocs)
+{
+    int nblocks = n / nb;
+    int count = (nblocks / nprocs) * nb;
+    int extra = nblocks % nprocs;
+
+    if (iproc < extra)
+        count += nb;
+    else if (iproc == extra)
+        count += n % nb;
+    return count;
+}
+
+/* 本地下标 -> 全局下标 */
+static inline int summa_l2g(int l, int nb, int iproc, int nprocs)
+{
+    return (l / nb) * nprocs * nb + iproc * nb + l % nb;
+}
+
+/* 在 (prow, pcol) 进程上分配 rows x cols 全局矩阵对应的本地块 */
+static inline int summa_local_alloc(const summa_grid *g, matrix_f32 *local,
+                                    int rows, int cols, int prow, int pcol)
+{
+    return matrix_f32_alloc(local,
+                            summa_numroc(rows, g->nb, prow, g->nprow),
+                            summa_numroc(cols, g->nb, pcol, g->npcol),
+                            MATRIX_PAD_AUTO);
+}
+
+/* 在本地块与全局矩阵之间拷贝; to_global 为 0 时全局 -> 本地 */
+static inline void summa_copy_local(const summa_grid *g, matrix_f32 *global, matrix_f32 *local,
+                                    int prow, int pcol, int to_global)
+{
+    for (int li = 0; li < local->rows; li++) {
+        int gi = summa_l2g(li, g->nb, prow, g->nprow);
+        for (int lj = 0; lj < local->cols; lj++) {
+            int gj = summa_l2g(lj, g->nb, pcol, g->npcol);
+            if (to_global)
+                MAT_AT(*global, gi, gj) = MAT_AT(*local, li, lj);
+            else
+                MAT_AT(*local, li, lj) = MAT_AT(*global, gi, gj);
+        }
+    }
+}
+
+/* 本进程原地生成全局矩阵 id 的本地块 (matrix_rng.h): 元素值只取决于全局下标,
+ * 与进程 0 用 matrix_rng_fill 生成整个矩阵后按块循环分布取出的块相同 */
+static inline void summa_rng_fill(const summa_grid *g, matrix_f32 *local, uint64_t seed, int id)
+{
+    const uint64_t key = matrix_rng_key(seed, id);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (int li = 0; li < local->rows; li++) {
+        int gi = summa_l2g(li, g->nb, g->myrow, g->nprow);
+        for (int lj = 0; lj < local->cols; lj++)
+            MAT_AT(*local, li, lj) = matrix_rng_value(key, gi, summa_l2g(lj, g->nb, g->mycol, g->npcol));
+    }
+}
+
+/* 各进程把本地块发回进程 0 拼成全局矩阵 */
+static inline void summa_gather(const summa_grid *g, matrix_f32 *global, matrix_f32 *local,
+                                int rows, int cols, gemm_mpi_stats *stats)
+{
+    int rank, size;
+
+    MPI_Comm_rank(g->grid, &rank);
+    MPI_Comm_size(g->grid, &size);
+
+    if (rank == 0) {
+        for (int r = 0; r < size; r++) {
+            int coords[2];
+            matrix_f32 buf;
+
+            MPI_Cart_coords(g->grid, r, 2, coords);
+            if (r == 0) {
+                summa_copy_local(g, global, local, coords[0], coords[1], 1);
+                continue;
+            }
+            if (summa_local_alloc(g, &buf, rows, cols, coords[0], coords[1]) != 0)
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            MPI_Recv(buf.data, (int)matrix_f32_elems(&buf), MPI_FLOAT, r, 11, g->grid, MPI_STATUS_IGNORE);
+            summa_copy_local(g, global, &buf, coords[0], coords[1], 1);
+            stats->dist_bytes += (double)matrix_f32_elems(&buf) * sizeof(float);
+            matrix_f32_free(&buf);
+        }
+    } else {
+        MPI_Send(local->data, (int)matrix_f32_elems(local), MPI_FLOAT, 0, 11, g->grid);
+        stats->dist_bytes += (double)matrix_f32_elems(local) * sizeof(float);
+    }
+}
+
+/******************************************************************************
+ * SUMMA 主循环
+ ******************************************************************************/
+
+/* C_local += A * B, 三者均已按块循环分布; K 为全局内积维度; stats 可为 NULL (重复计时时只统计一次) */
+static inline void summa_multiply(const summa_grid *g, int K,
+                                  const matrix_f32 *A, const matrix_f32 *B, matrix_f32 *C,
+                                  gemm_local_fn local_gemm, gemm_mpi_stats *stats)
+{
+    const int nb = g->nb;
+    const int mloc = C->rows, nloc = C->cols;
+    float *a_panel = (float *)matrix_alloc((size_t)(mloc > 0 ? mloc : 1) * nb * sizeof(float), MATRIX_ALIGNMENT);
+    float *b_panel = (float *)matrix_alloc((size_t)(nloc > 0 ? nloc : 1) * nb * sizeof(float), MATRIX_ALIGNMENT);
+
+    if (stats)
+        stats->mem_bytes += (double)(mloc + nloc) * nb * sizeof(float);
+
+    for (int k = 0; k < K; k += nb) {
+        int kb = K - k < nb ? K - k : nb;
+        int kblk = k / nb;
+        int a_owner = kblk % g->npcol;   /* 持有该 A 块列的进程列 */
+        int b_owner = kblk % g->nprow;   /* 持有该 B 块行的进程行 */
+        int a_off = (kblk / g->npcol) * nb;
+        int b_off = (kblk / g->nprow) * nb;
+
+        /* A 面板 mloc x kb, 按行连续打包 */
+        if (g->mycol == a_owner) {
+            for (int i = 0; i < mloc; i++)
+                memcpy(a_panel + (size_t)i * kb, &MAT_AT(*A, i, a_off), kb * sizeof(float));
+        }
+        /* B 面板 kb x nloc */
+        if (g->myrow == b_owner) {
+            for (int p = 0; p < kb; p++)
+                memcpy(b_panel + (size_t)p * nloc, &MAT_AT(*B, b_off + p, 0), nloc * sizeof(float));
+        }
+
+        MPI_Bcast(a_panel, mloc * kb, MPI_FLOAT, a_owner, g->row_comm);
+        MPI_Bcast(b_panel, kb * nloc, MPI_FLOAT, b_owner, g->col_comm);
+        if (stats)
+            stats->compute_bytes += (double)(mloc + nloc) * kb * sizeof(float);
+
+        local_gemm(mloc, nloc, kb, a_panel, kb, b_panel, nloc, C->data, C->ld);
+    }
+
+    matrix_free(a_panel);
+    matrix_free(b_panel);
+}
+
+/******************************************************************************
+ * 计时同步: 所有进程在栅栏后同时开始, 以最慢进程的耗时作为本次运行时间
+ ******************************************************************************/
+
+static inline void bench_mpi_begin(void *arg)
+{
+    MPI_Barrier(*(MPI_Comm *)arg);
+}
+
+static inline double bench_mpi_combine(double local_seconds, void *arg)
+{
+    double global = 0.0;
+
+    MPI_Allreduce(&local_seconds, &global, 1, MPI_DOUBLE, MPI_MAX, *(MPI_Comm *)arg);
+    return global;
+}
+
+/* comm 需在计时期间保持有效 */
+static inline bench_sync bench_mpi_sync(MPI_Comm *comm)
+{
+    bench_sync s = {bench_mpi_begin, bench_mpi_combine, comm};
+    return s;
+}
+
+/******************************************************************************
+ * 每进程资源统计汇总
+ ******************************************************************************/
+
+/* 在进程 0 打印每个进程的内存和通信量, 以及最大值/平均值 */
+static inline void gemm_mpi_report(const gemm_mpi_stats *stats, MPI_Comm comm)
+{
+    int rank, size;
+    double mine[3] = {stats->mem_bytes, stats->dist_bytes, stats->compute_bytes};
+    double *all = NULL;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    if (rank == 0)
+        all = (double *)malloc(sizeof(double) * 3 * size);
+    MPI_Gather(mine, 3, MPI_DOUBLE, all, 3, MPI_DOUBLE, 0, comm);
+
+    if (rank == 0) {
+        double max[3] = {0, 0, 0}, sum[3] = {0, 0, 0};
+        const double MiB = 1024.0 * 1024.0;
+
+        printf("进程   内存(MiB)   分发/收集(MiB)   计算期通信(MiB)\n");
+        for (int r = 0; r < size; r++) {
+            printf("%4d %11.2f %16.2f %17.2f\n", r,
+                   all[3 * r] / MiB, all[3 * r + 1] / MiB, all[3 * r + 2] / MiB);
+            for (int j = 0; j < 3; j++) {
+                sum[j] += all[3 * r + j];
+                if (all[3 * r + j] > max[j])
+                    max[j] = all[3 * r + j];
+            }
+        }
+        printf(" 最大 %11.2f %16.2f %17.2f\n", max[0] / MiB, max[1] / MiB, max[2] / MiB);
+        printf(" 平均 %11.2f %16.2f %17.2f\n", sum[0] / size / MiB, sum[1] / size / MiB, sum[2] / size / MiB);
+        free(all);
+    }
+}
+
+/* 在进程 0 打印每个进程的 GFLOPS, 并按主机汇总: 节点性能 = 节点总运算量 / 节点内最慢进程的时间 */
+static inline void gemm_mpi_perf_report(const gemm_mpi_perf *mine, MPI_Comm comm)
+{
+    int rank, size;
+    gemm_mpi_perf *all = NULL;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    if (rank == 0)
+        all = (gemm_mpi_perf *)malloc(sizeof(gemm_mpi_perf) * size);
+    MPI_Gather(mine, (int)sizeof(gemm_mpi_perf), MPI_BYTE,
+               all, (int)sizeof(gemm_mpi_perf), MPI_BYTE, 0, comm);
+
+    if (rank == 0) {
+        int *done = (int *)calloc(size, sizeof(int));
+
+        printf("进程  主机             NUMA  线程  CPU            时间(秒)     GFLOPS\n");
+        for (int r = 0; r < size; r++) {
+            const gemm_mpi_perf *p = &all[r];
+            printf("%4d  %-16s %4d %5d  %-14s %8.3f %10.2f\n", r, p->host, p->numa_node, p->threads,
+                   p->cpus, p->seconds, p->seconds > 0.0 ? p->flops / p->seconds * 1e-9 : 0.0);
+        }
+
+        printf("节点              进程数  线程数     GFLOPS\n");
+        for (int r = 0; r < size; r++) {
+            double flops = 0.0, seconds = 0.0;
+            int ranks = 0, threads = 0;
+
+            if (done[r])
+                continue;
+            for (int q = r; q < size; q++) {
+                if (done[q] || strcmp(all[q].host, all[r].host) != 0)
+                    continue;
+                done[q] = 1;
+                ranks++;
+                threads += all[q].threads;
+                flops += all[q].flops;
+                if (all[q].seconds > seconds)
+                    seconds = all[q].seconds;
+            }
+            printf("%-16s %7d %7d %10.2f\n", all[r].host, ranks, threads,
+                   seconds > 0.0 ? flops / seconds * 1e-9 : 0.0);
+        }
+        free(done);
+        free(all);
+    }
+}
+
+/******************************************************************************
+ * 硬件计数: dTLB 读缺失
+ ******************************************************************************/
+
+static inline gemm_mpi_probe gemm_mpi_probe_init(perf_counters *pc, const char *name, int warmup)
+{
+    gemm_mpi_probe p;
+
+    memset(&p, 0, sizeof(p));
+    p.pc = pc;
+    p.region.name = name;
+    p.warmup = warmup;
+    return p;
+}
+
+/* 进入一次运行的计数区域, 返回值交给 gemm_mpi_probe_end */
+static inline perf_counters *gemm_mpi_probe_begin(gemm_mpi_probe *p)
+{
+    perf_counters *pc = p->calls++ >= p->warmup ? p->pc : NULL;
+
+    perf_region_begin(pc);
+    return pc;
+}
+
+static inline void gemm_mpi_probe_end(gemm_mpi_probe *p, perf_counters *pc)
+{
+    perf_region_end(pc, &p->region, 0.0, 0.0, 0.0);
+}
+
+/* 各进程每次运行的平均 dTLB 读缺失, 在进程 0 上返回所有进程之和, *worst 为
+ * 单进程最大值; 任一进程的事件不可用时返回 -1。所有进程都须调用 */
+static inline double gemm_mpi_dtlb(const gemm_mpi_probe *p, double *worst, MPI_Comm comm)
+{
+    double mine = perf_region_avg(p->pc, &p->region, PERF_EV_DTLB_MISS);
+    double lo = 0.0, sum = 0.0;
+
+    *worst = 0.0;
+    MPI_Reduce(&mine, &lo, 1, MPI_DOUBLE, MPI_MIN, 0, comm);
+    MPI_Reduce(&mine, &sum, 1, MPI_DOUBLE, MPI_SUM, 0, comm);
+    MPI_Reduce(&mine, worst, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    return lo < 0.0 ? -1.0 : sum;
+}
+
+/* 进程 0 打印 gemm_mpi_dtlb 的结果; flops 为一次运行的总浮点运算数 */
+static inline void gemm_mpi_dtlb_print(double dtlb, double worst, double flops, int pages)
+{
+    if (dtlb < 0.0)
+        return;
+    printf("dTLB 读缺失: %.4g 次/运行 (所有进程之和, 单进程最多 %.4g), %.4g 次/百万 FLOP (页面: %s)\n",
+           dtlb, worst, flops > 0.0 ? dtlb / flops * 1e6 : 0.0, matrix_pages_name(pages));
+}
+
+#endif /* GEMM_MPI_H */
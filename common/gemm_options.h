@@ -0,0 +1,202 @@
+/******************************************************************************
+ * gemm_options.h
+ *
+ * GEMM 驱动程序共用的命令行参数 (C/C++ 通用), 统一使用 --key=value 形式:
+ *   --m= --n= --k=       问题规模, C(MxN) += A(MxK) * B(KxN)
+ *   --size=              同时设置 M、N、K
+ *   --mc= --kc= --nc=    缓存分块参数, 未指定时取调优文件或按缓存大小估算
+ *   --backend=           强制指定 SIMD 后端
+ *   --verify[=...]       结果校验, 见 gemm_verify.h
+ *   --autotune           扫描分块参数并把最优配置写入调优文件
+ *   --tune-file=         调优文件路径
+ *   --check-backends     各后端一致性检查
+ *   --mode=1d|summa|pipeline
+ *                        MPI 驱动的分布方式: 1D 行划分、2D SUMMA 或
+ *                        计算与通信重叠的 1D 流水线 (仅 matrix.c)
+ *   --nb=                SUMMA 块循环分布的块大小; 流水线模式下为 B 列面板宽度
+ *                        (--mode 与 --nb 只有在驱动设置了 modes 时才接受,
+ *                         用法文本也只对这些驱动列出)
+ *   --warmup= --reps=    预热与计时重复次数, 见 bench_harness.h
+ *   --json= --csv=       把计时结果追加写入 JSON Lines / CSV 文件
+ *   --perf               用硬件计数器测量 GEMM 区域, 见 perf_counters.h
+ *                        (含 dTLB 读缺失, 与计时一并输出)
+ *   --pages=default|thp|nothp|hugetlb|hugetlb1g
+ *                        矩阵的页面类型, 大页不足时逐级退回, 见 matrix_layout.h
+ *   --seed=              A、B 的随机种子, 结果与线程数、进程数无关, 见 matrix_rng.h
+ ******************************************************************************/
+#ifndef GEMM_OPTIONS_H
+#define GEMM_OPTIONS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench_harness.h"
+#include "gemm_verify.h"
+#include "matrix_layout.h"
+#include "matrix_rng.h"
+
+#define GEMM_DEFAULT_SIZE      2048
+#define GEMM_DEFAULT_TUNE_FILE "gemm_tune.conf"
+#define GEMM_DEFAULT_NB        64
+#define GEMM_DEFAULT_WARMUP    1
+#define GEMM_DEFAULT_REPS      5
+
+#define GEMM_MODE_1D       0
+#define GEMM_MODE_SUMMA    1
+#define GEMM_MODE_PIPELINE 2
+
+typedef struct {
+    int m, n, k;
+    int mc, kc, nc;          /* 0 表示未指定 */
+    const char *backend;     /* NULL 表示自动选择 */
+    int verify_mode;
+    int autotune;
+    int check_backends;
+    const char *tune_file;
+    const char *modes;       /* 驱动支持的 --mode 取值, 如 "1d|summa"; NULL 表示不接受 --mode/--nb */
+    int mode;                /* GEMM_MODE_1D / GEMM_MODE_SUMMA / GEMM_MODE_PIPELINE */
+    int nb;
+    bench_config bench;      /* 预热/重复次数与结果文件 */
+    int perf;
+    int pages;               /* NUMA_PAGES_*, 由驱动传给 matrix_set_pages */
+    int seed;
+} gemm_options;
+
+static inline void gemm_options_init(gemm_options *opt)
+{
+    memset(opt, 0, sizeof(*opt));
+    opt->m = opt->n = opt->k = GEMM_DEFAULT_SIZE;
+    opt->verify_mode = GEMM_VERIFY_OFF;
+    opt->tune_file = GEMM_DEFAULT_TUNE_FILE;
+    opt->mode = GEMM_MODE_1D;
+    opt->nb = GEMM_DEFAULT_NB;
+    opt->bench.warmup = GEMM_DEFAULT_WARMUP;
+    opt->bench.reps = GEMM_DEFAULT_REPS;
+    opt->seed = MATRIX_RNG_DEFAULT_SEED;
+}
+
+/* modes 为 gemm_options.modes, NULL 时不列出 --mode/--nb */
+static inline void gemm_options_usage(const char *prog, const char *modes)
+{
+    printf("用法: %s [--m=M] [--n=N] [--k=K] [--size=N] [--mc=MC] [--kc=KC] [--nc=NC]\n"
+           "          [--backend=scalar|neon|sve|avx2|avx512] [--verify[=full|freivalds]]\n"
+           "          [--autotune] [--tune-file=PATH] [--check-backends]\n", prog);
+    if (modes)
+        printf("          [--mode=%s] [--nb=NB]\n", modes);
+    printf("          [--warmup=W] [--reps=R] [--json=PATH] [--csv=PATH] [--perf]\n"
+           "          [--pages=default|thp|nothp|hugetlb|hugetlb1g] [--seed=S]\n");
+}
+
+/* name 是否为 "|" 分隔的列表 modes 中的一项 */
+static inline int gemm_options_has_mode(const char *modes, const char *name)
+{
+    size_t len = strlen(name);
+
+    while (modes && *modes) {
+        const char *end = strchr(modes, '|');
+        size_t n = end ? (size_t)(end - modes) : strlen(modes);
+
+        if (n == len && strncmp(modes, name, len) == 0)
+            return 1;
+        modes = end ? end + 1 : NULL;
+    }
+    return 0;
+}
+
+/* 若 arg 以 key 开头, 解析其后不小于 min 的整数到 *out; 返回 1 表示匹配, -1 表示值非法 */
+static inline int gemm_options_int_min(const char *arg, const char *key, int min, int *out)
+{
+    size_t len = strlen(key);
+    char *end;
+    long v;
+
+    if (strncmp(arg, key, len) != 0)
+        return 0;
+    v = strtol(arg + len, &end, 10);
+    if (*end != '\0' || v < min || v > 1 << 30)
+        return -1;
+    *out = (int)v;
+    return 1;
+}
+
+/* 正整数参数 */
+static inline int gemm_options_int(const char *arg, const char *key, int *out)
+{
+    return gemm_options_int_min(arg, key, 1, out);
+}
+
+/* 解析全部参数; 成功返回 0, 遇到未知或非法参数返回 -1 (调用方负责打印用法) */
+static inline int gemm_options_parse(gemm_options *opt, int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        int size = 0, rc;
+
+        if ((rc = gemm_options_int(arg, "--size=", &size)) != 0) {
+            if (rc < 0)
+                return -1;
+            opt->m = opt->n = opt->k = size;
+        } else if ((rc = gemm_options_int(arg, "--m=", &opt->m)) != 0 ||
+                   (rc = gemm_options_int(arg, "--n=", &opt->n)) != 0 ||
+                   (rc = gemm_options_int(arg, "--k=", &opt->k)) != 0 ||
+                   (rc = gemm_options_int(arg, "--mc=", &opt->mc)) != 0 ||
+                   (rc = gemm_options_int(arg, "--kc=", &opt->kc)) != 0 ||
+                   (rc = gemm_options_int(arg, "--nc=", &opt->nc)) != 0 ||
+                   (rc = gemm_options_int_min(arg, "--warmup=", 0, &opt->bench.warmup)) != 0 ||
+                   (rc = gemm_options_int(arg, "--reps=", &opt->bench.reps)) != 0 ||
+                   (rc = gemm_options_int_min(arg, "--seed=", 0, &opt->seed)) != 0) {
+            if (rc < 0)
+                return -1;
+        } else if (strncmp(arg, "--backend=", 10) == 0) {
+            opt->backend = arg + 10;
+        } else if (strncmp(arg, "--verify", 8) == 0) {
+            if ((opt->verify_mode = gemm_verify_parse(arg)) < 0)
+                return -1;
+        } else if (strcmp(arg, "--autotune") == 0) {
+            opt->autotune = 1;
+        } else if (strncmp(arg, "--tune-file=", 12) == 0) {
+            opt->tune_file = arg + 12;
+        } else if (strncmp(arg, "--json=", 7) == 0) {
+            opt->bench.json_path = arg + 7;
+        } else if (strncmp(arg, "--csv=", 6) == 0) {
+            opt->bench.csv_path = arg + 6;
+        } else if (strcmp(arg, "--perf") == 0) {
+            opt->perf = 1;
+        } else if (strncmp(arg, "--pages=", 8) == 0) {
+            if ((opt->pages = matrix_pages_parse(arg + 8)) < 0)
+                return -1;
+        } else if (strcmp(arg, "--check-backends") == 0) {
+            opt->check_backends = 1;
+        } else if ((rc = gemm_options_int(arg, "--nb=", &opt->nb)) != 0) {
+            if (rc < 0 || !opt->modes)
+                return -1;
+        } else if (strncmp(arg, "--mode=", 7) == 0) {
+            if (!gemm_options_has_mode(opt->modes, arg + 7))
+                return -1;
+            if (strcmp(arg + 7, "summa") == 0)
+                opt->mode = GEMM_MODE_SUMMA;
+            else if (strcmp(arg + 7, "pipeline") == 0)
+                opt->mode = GEMM_MODE_PIPELINE;
+            else
+                opt->mode = GEMM_MODE_1D;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* 1D 行划分: 把 rows 行尽量均匀地分给 size 个进程, 前 rows % size 个进程多分一行 */
+static inline int gemm_rows_of(int rows, int size, int rank)
+{
+    return rows / size + (rank < rows % size ? 1 : 0);
+}
+
+static inline int gemm_row_start(int rows, int size, int rank)
+{
+    int extra = rows % size;
+    return rank * (rows / size) + (rank < extra ? rank : extra);
+}
+
+#endif /* GEMM_OPTIONS_H */
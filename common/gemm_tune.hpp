@@ -0,0 +1,207 @@
+/******************************************************************************
+ * gemm_tune.hpp
+ *
+ * 分块参数 (MC/KC/NC) 的确定:
+ *   1) 命令行显式指定的值优先
+ *   2) 其次读取调优文件中本机 + 本后端的记录
+ *   3) 最后按检测到的 L1/L2/L3 大小解析估算 (BLIS 的经验规则):
+ *        KC x NR 的 B 面板占 L1 的一半
+ *        MC x KC 的 A 块占 L2 的一半
+ *        KC x NC 的 B 块占 L3 的一半
+ *
+ * --autotune 在解析估算值附近扫描若干组合, 实测 GFLOPS 取最优,
+ * 并以 "主机名 后端 MC KC NC GFLOPS" 一行的格式写回调优文件。
+ ******************************************************************************/
+#pragma once
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gemm_kernel.hpp"
+#include "gemm_options.h"
+#include "matrix.hpp"
+
+/// 各级数据缓存大小 (字节), 0 表示未检测到
+struct CacheInfo {
+    size_t l1d = 0;
+    size_t l2 = 0;
+    size_t l3 = 0;
+};
+
+// 解析 sysfs 中形如 "48K" / "2048K" / "32M" 的大小
+inline size_t parse_cache_size(const std::string &text) {
+    char *end = nullptr;
+    unsigned long long v = std::strtoull(text.c_str(), &end, 10);
+    if (end && (*end == 'K' || *end == 'k')) v <<= 10;
+    else if (end && (*end == 'M' || *end == 'm')) v <<= 20;
+    return static_cast<size_t>(v);
+}
+
+/// 优先读取 /sys/devices/system/cpu/cpu0/cache (aarch64 上 sysconf 常返回 0), 缺失的再用 sysconf
+inline CacheInfo detect_cache_info() {
+    CacheInfo info;
+    for (int idx = 0; idx < 8; idx++) {
+        std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(idx) + "/";
+        std::ifstream level_f(dir + "level"), type_f(dir + "type"), size_f(dir + "size");
+        if (!level_f || !type_f || !size_f) break;
+        int level = 0;
+        std::string type, size;
+        level_f >> level;
+        type_f >> type;
+        size_f >> size;
+        if (type == "Instruction") continue;
+        size_t bytes = parse_cache_size(size);
+        if (level == 1) info.l1d = bytes;
+        else if (level == 2) info.l2 = bytes;
+        else if (level == 3) info.l3 = bytes;
+    }
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    if (!info.l1d) info.l1d = std::max(0L, sysconf(_SC_LEVEL1_DCACHE_SIZE));
+    if (!info.l2) info.l2 = std::max(0L, sysconf(_SC_LEVEL2_CACHE_SIZE));
+    if (!info.l3) info.l3 = std::max(0L, sysconf(_SC_LEVEL3_CACHE_SIZE));
+#endif
+    // 检测失败时取保守值
+    if (!info.l1d) info.l1d = 32 << 10;
+    if (!info.l2) info.l2 = 512 << 10;
+    if (!info.l3) info.l3 = info.l2 * 4;
+    return info;
+}
+
+/// 按缓存大小解析估算分块参数; 与问题规模、线程数有关的上限 (MC 不超过
+/// M 均分给各线程的行数等) 由 gemm_blocked 按实际问题施加
+inline GemmBlocking gemm_blocking_from_cache(const GemmBackend &be, const CacheInfo &cache) {
+    GemmBlocking b;
+    b.kc = static_cast<int>(cache.l1d / 2 / (be.nr * sizeof(float)));
+    b.kc = std::max(64, std::min(1024, b.kc / 8 * 8));
+    b.mc = static_cast<int>(cache.l2 / 2 / (b.kc * sizeof(float)));
+    b.mc = std::max(be.mr, b.mc / be.mr * be.mr);
+    b.nc = static_cast<int>(cache.l3 / 2 / (b.kc * sizeof(float)));
+    b.nc = std::max(be.nr, std::min(16384, b.nc / be.nr * be.nr));
+    return b;
+}
+
+/******************************************************************************
+ * 调优文件
+ ******************************************************************************/
+
+inline std::string gemm_tune_host() {
+    char host[256] = {0};
+    if (gethostname(host, sizeof(host) - 1) != 0) return "unknown";
+    return host;
+}
+
+/// 读取本机 + 本后端的记录; 没有时返回 false
+inline bool gemm_tune_load(const char *path, const GemmBackend &be, GemmBlocking &out) {
+    std::ifstream in(path);
+    std::string line, host = gemm_tune_host();
+    bool found = false;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ss(line);
+        std::string h, name;
+        GemmBlocking b;
+        if (!(ss >> h >> name >> b.mc >> b.kc >> b.nc)) continue;
+        if (h == host && name == be.name && b.mc > 0 && b.kc > 0 && b.nc > 0) {
+            out = b;  // 以最后一条为准
+            found = true;
+        }
+    }
+    return found;
+}
+
+/// 写入 (替换) 本机 + 本后端的记录, 保留其他机器的记录
+inline bool gemm_tune_save(const char *path, const GemmBackend &be, const GemmBlocking &b, double gflops) {
+    std::vector<std::string> kept;
+    std::string line, host = gemm_tune_host();
+    {
+        std::ifstream in(path);
+        while (std::getline(in, line)) {
+            std::istringstream ss(line);
+            std::string h, name;
+            if (ss >> h >> name && h == host && name == be.name) continue;
+            kept.push_back(line);
+        }
+    }
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) return false;
+    if (kept.empty()) out << "# host backend MC KC NC GFLOPS\n";
+    for (const std::string &l : kept) out << l << "\n";
+    out << host << " " << be.name << " " << b.mc << " " << b.kc << " " << b.nc << " " << gflops << "\n";
+    return static_cast<bool>(out);
+}
+
+/// 依次应用: 解析估算 -> 调优文件 -> 命令行, 得到最终分块参数
+inline GemmBlocking gemm_resolve_blocking(const GemmBackend &be, const gemm_options &opt, const char **source) {
+    GemmBlocking b = gemm_blocking_from_cache(be, detect_cache_info());
+    *source = "缓存大小估算";
+    if (gemm_tune_load(opt.tune_file, be, b)) *source = opt.tune_file;
+    if (opt.mc || opt.kc || opt.nc) *source = "命令行";
+    if (opt.mc) b.mc = opt.mc;
+    if (opt.kc) b.kc = opt.kc;
+    if (opt.nc) b.nc = opt.nc;
+    return b;
+}
+
+/******************************************************************************
+ * 自动调优
+ ******************************************************************************/
+
+/// 在解析估算值附近扫描 MC/KC/NC, 问题规模取实际规模但每维不超过 1536 以控制耗时
+inline GemmBlocking gemm_autotune(const GemmBackend &be, int M, int N, int K, double *best_gflops) {
+    using clock = std::chrono::steady_clock;
+    const CacheInfo cache = detect_cache_info();
+    const GemmBlocking base = gemm_blocking_from_cache(be, cache);
+    const int m = std::min(M, 1536), n = std::min(N, 1536), k = std::min(K, 1536);
+
+    Matrix<float> A(m, k), B(k, n), C(m, n);
+    for (int i = 0; i < m; i++)
+        for (int j = 0; j < k; j++)
+            A(i, j) = static_cast<float>(rand()) / RAND_MAX;
+    for (int i = 0; i < k; i++)
+        for (int j = 0; j < n; j++)
+            B(i, j) = static_cast<float>(rand()) / RAND_MAX;
+
+    std::printf("自动调优: L1d %zuKB, L2 %zuKB, L3 %zuKB, 调优规模 %d x %d x %d\n",
+                cache.l1d >> 10, cache.l2 >> 10, cache.l3 >> 10, m, n, k);
+
+    GemmBlocking best = base;
+    *best_gflops = 0.0;
+    const double kc_scale[] = {0.5, 1.0, 2.0};
+    const double mc_scale[] = {0.5, 1.0, 2.0};
+    const double nc_scale[] = {0.5, 1.0};
+
+    for (double ks : kc_scale) {
+        for (double ms : mc_scale) {
+            for (double ns : nc_scale) {
+                GemmBlocking b;
+                b.kc = std::max(16, static_cast<int>(base.kc * ks));
+                b.mc = std::max(be.mr, static_cast<int>(base.mc * ms) / be.mr * be.mr);
+                b.nc = std::max(be.nr, static_cast<int>(base.nc * ns) / be.nr * be.nr);
+
+                // 预热一次, 再取两次中的较快者
+                double t_best = 1e30;
+                for (int rep = 0; rep < 3; rep++) {
+                    auto t0 = clock::now();
+                    gemm_blocked(be, A.view(), B.view(), C.view(), b);
+                    double t = std::chrono::duration<double>(clock::now() - t0).count();
+                    if (rep > 0) t_best = std::min(t_best, t);
+                }
+                double gflops = 2.0 * m * n * k / t_best * 1e-9;
+                std::printf("  MC=%-5d KC=%-5d NC=%-6d %8.2f GFLOPS\n", b.mc, b.kc, b.nc, gflops);
+                if (gflops > *best_gflops) {
+                    *best_gflops = gflops;
+                    best = b;
+                }
+            }
+        }
+    }
+    return best;
+}
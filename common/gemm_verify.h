@@ -0,0 +1,195 @@
+/******************************************************************************
+ * gemm_verify.h
+ *
+ * GEMM 结果校验 (C/C++ 通用), 检查 C ?= A * B:
+ *   - full      : 分块双精度参考实现, O(M*N*K), 逐元素比较
+ *   - freivalds : 随机向量 x, 比较 C*x 与 A*(B*x), O(M*K + K*N + M*N),
+ *                 大规模时校验开销远小于一次乘法
+ *
+ * 误差以分量形式的相对误差衡量:
+ *     |C - A*B|_ij / (|A| * |B|)_ij
+ * 该量对 float 累加的舍入误差有上界 K * eps, 据此设置默认容差,
+ * 与具体数据范围无关, 同时对真正的计算错误 (量级 O(1)) 十分敏感。
+ * Freivalds 把一行的误差投影到一个数上, 单个元素的相对误差需超过约 N*K*eps
+ * 才能被发现; 需要逐元素精度时使用 full。
+ ******************************************************************************/
+#ifndef GEMM_VERIFY_H
+#define GEMM_VERIFY_H
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GEMM_VERIFY_OFF       0
+#define GEMM_VERIFY_AUTO      1
+#define GEMM_VERIFY_FULL      2
+#define GEMM_VERIFY_FREIVALDS 3
+
+/* AUTO 模式下 M*N*K 不超过该值时做完整比较 */
+#define GEMM_VERIFY_FULL_LIMIT (512.0 * 512.0 * 512.0)
+#define GEMM_VERIFY_TRIALS     2   /* Freivalds 随机向量个数 */
+#define GEMM_VERIFY_BLOCK      64  /* 参考实现的分块大小 */
+
+typedef struct {
+    const char *method;
+    double max_abs_err;
+    double max_rel_err;
+    double tolerance;
+    int passed;
+} gemm_verify_result;
+
+/* 解析 --verify / --verify=full|freivalds|auto|off, 无法识别时返回 -1 */
+static inline int gemm_verify_parse(const char *arg)
+{
+    if (strcmp(arg, "--verify") == 0 || strcmp(arg, "--verify=auto") == 0)
+        return GEMM_VERIFY_AUTO;
+    if (strcmp(arg, "--verify=full") == 0)
+        return GEMM_VERIFY_FULL;
+    if (strcmp(arg, "--verify=freivalds") == 0)
+        return GEMM_VERIFY_FREIVALDS;
+    if (strcmp(arg, "--verify=off") == 0)
+        return GEMM_VERIFY_OFF;
+    return -1;
+}
+
+static inline double gemm_verify_tolerance(int K)
+{
+    return (double)K * FLT_EPSILON;
+}
+
+static inline void gemm_verify_update(gemm_verify_result *r, double err, double bound)
+{
+    if (err > r->max_abs_err)
+        r->max_abs_err = err;
+    if (bound > 0.0 && err / bound > r->max_rel_err)
+        r->max_rel_err = err / bound;
+    else if (bound == 0.0 && err > 0.0)
+        r->max_rel_err = INFINITY;
+}
+
+/* 分块双精度参考: 对每个 C 块计算 A*B 和 |A|*|B|, 逐元素比较 */
+static inline gemm_verify_result gemm_verify_full(int M, int N, int K,
+                                                  const float *A, size_t lda,
+                                                  const float *B, size_t ldb,
+                                                  const float *C, size_t ldc)
+{
+    gemm_verify_result r = {"full", 0.0, 0.0, gemm_verify_tolerance(K), 0};
+    const int BS = GEMM_VERIFY_BLOCK;
+    double *ref = (double *)malloc(sizeof(double) * BS * BS);
+    double *mag = (double *)malloc(sizeof(double) * BS * BS);
+
+    for (int i0 = 0; i0 < M; i0 += BS) {
+        int mb = M - i0 < BS ? M - i0 : BS;
+        for (int j0 = 0; j0 < N; j0 += BS) {
+            int nb = N - j0 < BS ? N - j0 : BS;
+            memset(ref, 0, sizeof(double) * BS * BS);
+            memset(mag, 0, sizeof(double) * BS * BS);
+
+            for (int k0 = 0; k0 < K; k0 += BS) {
+                int kb = K - k0 < BS ? K - k0 : BS;
+                for (int i = 0; i < mb; i++) {
+                    for (int k = 0; k < kb; k++) {
+                        double a = A[(size_t)(i0 + i) * lda + k0 + k];
+                        const float *b_row = B + (size_t)(k0 + k) * ldb + j0;
+                        for (int j = 0; j < nb; j++) {
+                            ref[i * BS + j] += a * b_row[j];
+                            mag[i * BS + j] += fabs(a) * fabs((double)b_row[j]);
+                        }
+                    }
+                }
+            }
+
+            for (int i = 0; i < mb; i++) {
+                for (int j = 0; j < nb; j++) {
+                    double c = C[(size_t)(i0 + i) * ldc + j0 + j];
+                    gemm_verify_update(&r, fabs(c - ref[i * BS + j]), mag[i * BS + j]);
+                }
+            }
+        }
+    }
+
+    free(ref);
+    free(mag);
+    r.passed = r.max_rel_err <= r.tolerance;
+    return r;
+}
+
+/* Freivalds 随机投影校验: y = B*x, 比较 A*y 与 C*x
+ * 误差界同样用 |A|*(|B|*|x|) 归一化 */
+static inline gemm_verify_result gemm_verify_freivalds(int M, int N, int K,
+                                                       const float *A, size_t lda,
+                                                       const float *B, size_t ldb,
+                                                       const float *C, size_t ldc,
+                                                       uint64_t seed)
+{
+    gemm_verify_result r = {"freivalds", 0.0, 0.0, gemm_verify_tolerance(K), 0};
+    double *x = (double *)malloc(sizeof(double) * N);
+    double *y = (double *)malloc(sizeof(double) * K);
+    double *y_mag = (double *)malloc(sizeof(double) * K);
+    uint64_t s = seed ? seed : 0x9E3779B97F4A7C15ULL;
+
+    for (int t = 0; t < GEMM_VERIFY_TRIALS; t++) {
+        /* x 取 [-1, 1) 均匀分布, xorshift64 生成, 不扰动 rand() 的状态 */
+        for (int j = 0; j < N; j++) {
+            s ^= s << 13;
+            s ^= s >> 7;
+            s ^= s << 17;
+            x[j] = (double)(s >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+        }
+
+        for (int k = 0; k < K; k++) {
+            const float *b_row = B + (size_t)k * ldb;
+            double acc = 0.0, acc_mag = 0.0;
+            for (int j = 0; j < N; j++) {
+                acc += b_row[j] * x[j];
+                acc_mag += fabs((double)b_row[j]) * fabs(x[j]);
+            }
+            y[k] = acc;
+            y_mag[k] = acc_mag;
+        }
+
+        for (int i = 0; i < M; i++) {
+            const float *a_row = A + (size_t)i * lda;
+            const float *c_row = C + (size_t)i * ldc;
+            double ay = 0.0, ay_mag = 0.0, cx = 0.0;
+            for (int k = 0; k < K; k++) {
+                ay += a_row[k] * y[k];
+                ay_mag += fabs((double)a_row[k]) * y_mag[k];
+            }
+            for (int j = 0; j < N; j++) {
+                cx += c_row[j] * x[j];
+            }
+            gemm_verify_update(&r, fabs(cx - ay), ay_mag);
+        }
+    }
+
+    free(x);
+    free(y);
+    free(y_mag);
+    r.passed = r.max_rel_err <= r.tolerance;
+    return r;
+}
+
+/* 按模式选择校验方法; AUTO 在小规模时做完整比较, 否则用 Freivalds */
+static inline gemm_verify_result gemm_verify(int mode, int M, int N, int K,
+                                             const float *A, size_t lda,
+                                             const float *B, size_t ldb,
+                                             const float *C, size_t ldc)
+{
+    if (mode == GEMM_VERIFY_FULL ||
+        (mode == GEMM_VERIFY_AUTO && (double)M * N * K <= GEMM_VERIFY_FULL_LIMIT))
+        return gemm_verify_full(M, N, K, A, lda, B, ldb, C, ldc);
+    return gemm_verify_freivalds(M, N, K, A, lda, B, ldb, C, ldc, 0);
+}
+
+static inline void gemm_verify_print(const gemm_verify_result *r)
+{
+    printf("结果校验 (%s): 最大绝对误差 %.3e, 最大相对误差 %.3e, 容差 %.3e -> %s\n",
+           r->method, r->max_abs_err, r->max_rel_err, r->tolerance,
+           r->passed ? "通过" : "失败");
+}
+
+#endif /* GEMM_VERIFY_H */
@@ -0,0 +1,105 @@
+/******************************************************************************
+ * matrix.hpp
+ *
+ * 连续存储的行主序矩阵 Matrix<T> 与子块视图 MatrixView<T>。
+ * 存储约定 (对齐、行跨度填充) 与 matrix_layout.h 一致, C 程序可直接共享同一内存布局。
+ ******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include "matrix_layout.h"
+
+/// 非拥有的矩阵视图, 可指向整个矩阵或其中一个子块
+template <typename T>
+class MatrixView {
+public:
+    MatrixView() = default;
+    MatrixView(T *data, int rows, int cols, size_t ld)
+        : data_(data), rows_(rows), cols_(cols), ld_(ld) {}
+
+    // 允许 MatrixView<float> -> MatrixView<const float>
+    template <typename U, typename = typename std::enable_if<
+                              std::is_same<const U, T>::value && !std::is_same<U, T>::value>::type>
+    MatrixView(const MatrixView<U> &other)
+        : data_(other.data()), rows_(other.rows()), cols_(other.cols()), ld_(other.ld()) {}
+
+    T &operator()(int i, int j) const { return data_[static_cast<size_t>(i) * ld_ + j]; }
+    T *row(int i) const { return data_ + static_cast<size_t>(i) * ld_; }
+
+    T *data() const { return data_; }
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+    size_t ld() const { return ld_; }
+
+    /// 以 (i, j) 为左上角的 rows x cols 子块, 行跨度不变
+    MatrixView block(int i, int j, int rows, int cols) const {
+        return MatrixView(row(i) + j, rows, cols, ld_);
+    }
+
+private:
+    T *data_ = nullptr;
+    int rows_ = 0;
+    int cols_ = 0;
+    size_t ld_ = 0;
+};
+
+/// 存储来源: Pages 按 --pages 的页面类型分配并清零 (A/B/C 等大矩阵);
+/// Scratch 总用 posix_memalign 且不清零, 供线程私有的打包缓冲等临时存储
+enum class MatrixStorage { Pages, Scratch };
+
+/// 拥有存储的矩阵: 单次对齐分配, 只可移动不可拷贝
+template <typename T>
+class Matrix {
+public:
+    Matrix() = default;
+    Matrix(int rows, int cols, int pad = MATRIX_PAD_AUTO, size_t alignment = MATRIX_ALIGNMENT,
+           MatrixStorage storage = MatrixStorage::Pages)
+        : rows_(rows), cols_(cols), ld_(matrix_padded_ld(cols, sizeof(T), pad)) {
+        static_assert(std::is_trivially_copyable<T>::value, "Matrix<T> 只支持平凡类型");
+        T *p = static_cast<T *>(storage == MatrixStorage::Scratch
+                                    ? matrix_alloc_scratch(size_bytes(), alignment)
+                                    : matrix_alloc(size_bytes(), alignment));
+        if (!p) throw std::bad_alloc();
+        if (storage != MatrixStorage::Scratch)
+            matrix_zero_rows(p, rows_, ld_ * sizeof(T));
+        data_.reset(p);
+    }
+
+    Matrix(Matrix &&) noexcept = default;
+    Matrix &operator=(Matrix &&) noexcept = default;
+
+    T &operator()(int i, int j) { return data_.get()[static_cast<size_t>(i) * ld_ + j]; }
+    const T &operator()(int i, int j) const { return data_.get()[static_cast<size_t>(i) * ld_ + j]; }
+    T *row(int i) { return data_.get() + static_cast<size_t>(i) * ld_; }
+    const T *row(int i) const { return data_.get() + static_cast<size_t>(i) * ld_; }
+
+    T *data() { return data_.get(); }
+    const T *data() const { return data_.get(); }
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+    size_t ld() const { return ld_; }
+
+    /// 连续存放的元素个数 (含填充), 整块 MPI 通信时使用
+    size_t elems() const { return static_cast<size_t>(rows_) * ld_; }
+    size_t size_bytes() const { return elems() * sizeof(T); }
+
+    MatrixView<T> view() { return MatrixView<T>(data(), rows_, cols_, ld_); }
+    MatrixView<const T> view() const { return MatrixView<const T>(data(), rows_, cols_, ld_); }
+    MatrixView<T> block(int i, int j, int rows, int cols) { return view().block(i, j, rows, cols); }
+    MatrixView<const T> block(int i, int j, int rows, int cols) const { return view().block(i, j, rows, cols); }
+
+private:
+    struct Deleter {
+        void operator()(T *p) const { matrix_free(p); }
+    };
+
+    std::unique_ptr<T, Deleter> data_;
+    int rows_ = 0;
+    int cols_ = 0;
+    size_t ld_ = 0;
+};
@@ -0,0 +1,254 @@
+/******************************************************************************
+ * matrix_layout.h
+ *
+ * GEMM 驱动程序共用的行主序矩阵存储约定 (C/C++ 通用):
+ *   - 整个矩阵一次分配, 起始地址按缓存行 (或大页) 对齐
+ *   - 行跨度 ld (leading dimension) 可大于列数, 用于填充
+ *   - 页面类型 (--pages) 对之后的全部矩阵分配生效: 默认用 posix_memalign;
+ *     thp / nothp / hugetlb / hugetlb1g 经 numa_alloc.h 映射, 大页不足时
+ *     逐级退回, matrix_pages_describe 给出实际得到的页面; mmap 表由互斥锁
+ *     保护, 可在 OpenMP 并行区内分配/释放
+ *   - 线程私有的小块临时存储 (GEMM 打包缓冲) 用 matrix_alloc_scratch, 总是
+ *     posix_memalign, 不为每块单独映射大页, 也不占 mmap 表
+ *
+ * N=2048 的 float 矩阵 (16MB) 用 4KB 页时占 4096 页, 沿列访问 B 几乎每行
+ * 换一页, 远超 dTLB 容量; 2MB 大页只需 8 项。
+ *
+ * N=2048 的 float 矩阵每行恰好 8KB, 同一列的元素全部映射到相同的 cache set,
+ * 沿列访问 (打包 A、朴素内积中的 B[k][j]) 会产生严重的组冲突;
+ * 自动填充在这种情况下给每行多留一个缓存行。
+ ******************************************************************************/
+#ifndef MATRIX_LAYOUT_H
+#define MATRIX_LAYOUT_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "numa_alloc.h"
+
+#define MATRIX_CACHE_LINE         64
+#define MATRIX_ALIGNMENT          MATRIX_CACHE_LINE   /* 默认: 缓存行对齐 */
+#define MATRIX_HUGEPAGE_ALIGNMENT (2UL << 20)         /* 2MB 大页对齐 */
+#define MATRIX_ALIAS_STRIDE       4096                /* 行字节数为其倍数时视为会组冲突 */
+
+#define MATRIX_PAD_AUTO (-1)  /* 自动填充 */
+#define MATRIX_PAD_NONE 0     /* 不填充, ld == cols */
+
+#define MATRIX_MAX_MAPPED 64  /* 同时存在的 mmap 矩阵个数上限, 超出时退回 posix_memalign */
+
+/* 分配状态: 页面类型与 mmap 得到的矩阵 (matrix_free 据此 munmap) */
+typedef struct {
+    int pages;               /* NUMA_PAGES_*, 默认 NUMA_PAGES_DEFAULT */
+    numa_region mapped[MATRIX_MAX_MAPPED];
+} matrix_alloc_state;
+
+static inline matrix_alloc_state *matrix_state(void)
+{
+    static matrix_alloc_state state;
+    return &state;
+}
+
+/* 保护 mapped[] 与 pages: 并行区内的线程可能同时分配/释放 */
+static inline pthread_mutex_t *matrix_state_lock(void)
+{
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    return &lock;
+}
+
+/* 解析 --pages 的取值: default | thp | nothp | hugetlb | hugetlb1g; 非法返回 -1 */
+static inline int matrix_pages_parse(const char *s)
+{
+    numa_spec spec;
+
+    if (strcmp(s, "default") == 0)
+        return NUMA_PAGES_DEFAULT;
+    if (*s == '\0' || numa_parse_spec(s, &spec) != 0 || spec.place != NUMA_PLACE_FIRSTTOUCH)
+        return -1;
+    return spec.pages;
+}
+
+static inline const char *matrix_pages_name(int pages)
+{
+    static const char *names[] = {"default", "thp", "nothp", "hugetlb", "hugetlb1g"};
+    return names[pages];
+}
+
+/* 设置之后分配的矩阵使用的页面类型 */
+static inline void matrix_set_pages(int pages)
+{
+    matrix_state()->pages = pages;
+}
+
+/* 计算行跨度 (单位: 元素)
+ *   pad >= 0 : ld = cols + pad
+ *   pad <  0 : 先向上取整到整缓存行, 若行字节数为 4KB 倍数再追加一个缓存行 */
+static inline size_t matrix_padded_ld(size_t cols, size_t elem_size, int pad)
+{
+    size_t line_elems, ld;
+
+    if (pad >= 0)
+        return cols + (size_t)pad;
+
+    line_elems = MATRIX_CACHE_LINE / elem_size;
+    if (line_elems == 0)
+        line_elems = 1;
+    ld = (cols + line_elems - 1) / line_elems * line_elems;
+    if ((ld * elem_size) % MATRIX_ALIAS_STRIDE == 0)
+        ld += line_elems;
+    return ld;
+}
+
+/* 大小向上取整到对齐粒度 (0 行的矩阵也分配一个粒度) */
+static inline size_t matrix_round_bytes(size_t bytes, size_t *alignment)
+{
+    if (*alignment < sizeof(void *))
+        *alignment = sizeof(void *);
+    bytes = (bytes + *alignment - 1) / *alignment * *alignment;
+    return bytes ? bytes : *alignment;
+}
+
+/* 临时存储: 总用 posix_memalign, 同样由 matrix_free 释放; 失败返回 NULL */
+static inline void *matrix_alloc_scratch(size_t bytes, size_t alignment)
+{
+    void *p = NULL;
+
+    bytes = matrix_round_bytes(bytes, &alignment);
+    if (posix_memalign(&p, alignment, bytes) != 0)
+        return NULL;
+    return p;
+}
+
+/* 对齐分配; 失败返回 NULL
+ * 设置了页面类型时按页映射, 起始地址至少页对齐 */
+static inline void *matrix_alloc(size_t bytes, size_t alignment)
+{
+    matrix_alloc_state *st = matrix_state();
+    void *p = NULL;
+
+    bytes = matrix_round_bytes(bytes, &alignment);
+    pthread_mutex_lock(matrix_state_lock());
+    if (st->pages != NUMA_PAGES_DEFAULT && alignment <= (size_t)sysconf(_SC_PAGESIZE)) {
+        numa_spec spec = {NUMA_PLACE_FIRSTTOUCH, 0, st->pages};
+
+        for (int i = 0; i < MATRIX_MAX_MAPPED; i++) {
+            if (st->mapped[i].base)
+                continue;
+            if (numa_alloc(&st->mapped[i], bytes, &spec) != 0)
+                st->mapped[i].base = NULL;
+            else
+                st->pages = st->mapped[i].spec.pages;  /* 大页不足时之后的分配直接用退回后的类型 */
+            p = st->mapped[i].base;
+            pthread_mutex_unlock(matrix_state_lock());
+            return p;
+        }
+    }
+    pthread_mutex_unlock(matrix_state_lock());
+    if (posix_memalign(&p, alignment, bytes) != 0)
+        return NULL;
+    return p;
+}
+
+static inline void matrix_free(void *p)
+{
+    matrix_alloc_state *st = matrix_state();
+
+    if (!p)
+        return;
+    pthread_mutex_lock(matrix_state_lock());
+    for (int i = 0; i < MATRIX_MAX_MAPPED; i++) {
+        if (st->mapped[i].base == p) {
+            numa_free(&st->mapped[i]);
+            pthread_mutex_unlock(matrix_state_lock());
+            return;
+        }
+    }
+    pthread_mutex_unlock(matrix_state_lock());
+    free(p);
+}
+
+/* 矩阵 p (bytes 字节, 已初始化) 实际使用的页面, 如 "hugetlb 2MB 页 16.0 MiB"
+ * 或 "4KB 页, 透明大页 14.0 / 16.0 MiB" */
+static inline void matrix_pages_describe(const void *p, size_t bytes, char *buf, size_t len)
+{
+    const matrix_alloc_state *st = matrix_state();
+
+    pthread_mutex_lock(matrix_state_lock());
+    for (int i = 0; i < MATRIX_MAX_MAPPED; i++) {
+        const numa_region *r = &st->mapped[i];
+
+        if (r->base == p && r->spec.pages >= NUMA_PAGES_HUGETLB) {
+            snprintf(buf, len, "hugetlb %s 页 %.1f MiB",
+                     r->spec.pages == NUMA_PAGES_HUGETLB_1G ? "1GB" : "2MB", r->bytes / 1048576.0);
+            pthread_mutex_unlock(matrix_state_lock());
+            return;
+        }
+    }
+    pthread_mutex_unlock(matrix_state_lock());
+    snprintf(buf, len, "4KB 页, 透明大页 %.1f / %.1f MiB",
+             numa_thp_bytes(p) / 1048576.0, bytes / 1048576.0);
+}
+
+/* 按行清零 rows 行, 每行 row_bytes 字节; 与 matrix_rng_fill 同样按行静态划分给
+ * OpenMP 线程, 首次访问使每段页面落在之后初始化这些行的线程所在的节点 */
+static inline void matrix_zero_rows(void *p, size_t rows, size_t row_bytes)
+{
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (long i = 0; i < (long)rows; i++)
+        memset((char *)p + (size_t)i * row_bytes, 0, row_bytes);
+}
+
+/* 指定了页面类型时打印矩阵 name 实际得到的页面 */
+static inline void matrix_pages_log(const char *name, const void *p, size_t bytes)
+{
+    char buf[96];
+
+    if (matrix_state()->pages == NUMA_PAGES_DEFAULT || p == NULL)
+        return;
+    matrix_pages_describe(p, bytes, buf, sizeof(buf));
+    printf("矩阵 %s 页面: %s\n", name, buf);
+}
+
+/* C 语言使用的 float 矩阵 (matrix.c) */
+typedef struct {
+    float *data;
+    int rows;
+    int cols;
+    size_t ld;
+} matrix_f32;
+
+#define MAT_AT(m, i, j) ((m).data[(size_t)(i) * (m).ld + (size_t)(j)])
+
+/* 按给定填充策略分配 rows x cols 的矩阵并清零; 成功返回 0 */
+static inline int matrix_f32_alloc(matrix_f32 *m, int rows, int cols, int pad)
+{
+    size_t bytes;
+
+    m->rows = rows;
+    m->cols = cols;
+    m->ld = matrix_padded_ld((size_t)cols, sizeof(float), pad);
+    bytes = (size_t)rows * m->ld * sizeof(float);
+    m->data = (float *)matrix_alloc(bytes, MATRIX_ALIGNMENT);
+    if (m->data == NULL)
+        return -1;
+    matrix_zero_rows(m->data, (size_t)rows, m->ld * sizeof(float));
+    return 0;
+}
+
+static inline void matrix_f32_free(matrix_f32 *m)
+{
+    matrix_free(m->data);
+    m->data = NULL;
+}
+
+/* 连续存放的元素个数 (含填充), 用于整块 MPI 通信 */
+static inline size_t matrix_f32_elems(const matrix_f32 *m)
+{
+    return (size_t)m->rows * m->ld;
+}
+
+#endif /* MATRIX_LAYOUT_H */
@@ -0,0 +1,63 @@
+/******************************************************************************
+ * matrix_rng.h
+ *
+ * 基于计数器的矩阵随机初始化 (C/C++ 通用):
+ *   - 元素 (i, j) 的值只由种子、矩阵编号和全局下标决定 (splitmix64 混合),
+ *     与线程数、进程数和数据划分无关, 同一种子在任何并行配置下得到相同的矩阵
+ *   - 无共享状态, 各线程/各进程可直接在自己持有的行块上原地生成,
+ *     页面由真正使用它的线程首次写入; 不再需要 rand() (glibc 内部加锁,
+ *     在 OpenMP 并行区内串行化且结果不可复现) 或由进程 0 生成后分发
+ *   - 取值为 [0, 1) 上 2^-24 的整数倍, float 可精确表示
+ ******************************************************************************/
+#ifndef MATRIX_RNG_H
+#define MATRIX_RNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MATRIX_RNG_DEFAULT_SEED 42
+
+/* 矩阵编号, 使 A 与 B 在同一种子下互不相关 */
+#define MATRIX_RNG_A 1
+#define MATRIX_RNG_B 2
+
+/* splitmix64 的混合函数 */
+static inline uint64_t matrix_rng_mix(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/* 矩阵 id 的密钥, 每个矩阵只需计算一次 */
+static inline uint64_t matrix_rng_key(uint64_t seed, int id)
+{
+    return matrix_rng_mix(matrix_rng_mix(seed) ^ (uint64_t)id);
+}
+
+/* 全局下标 (i, j) 处的值, [0, 1) */
+static inline float matrix_rng_value(uint64_t key, int64_t i, int64_t j)
+{
+    uint64_t x = matrix_rng_mix(key ^ ((uint64_t)i << 32 | (uint32_t)j));
+    return (float)(x >> 40) * (1.0f / 16777216.0f);
+}
+
+/* 填充行跨度为 ld 的 rows x cols 块, 其左上角位于全局矩阵的 (row0, col0);
+ * 按行静态划分给 OpenMP 线程 (未启用 OpenMP 时串行) */
+static inline void matrix_rng_fill(float *data, size_t ld, int rows, int cols,
+                                   int row0, int col0, uint64_t seed, int id)
+{
+    const uint64_t key = matrix_rng_key(seed, id);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (int i = 0; i < rows; i++) {
+        float *row = data + (size_t)i * ld;
+        for (int j = 0; j < cols; j++)
+            row[j] = matrix_rng_value(key, (int64_t)row0 + i, (int64_t)col0 + j);
+    }
+}
+
+#endif /* MATRIX_RNG_H */
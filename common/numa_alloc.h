@@ -0,0 +1,363 @@
+/******************************************************************************
+ * numa_alloc.h
+ *
+ * NUMA 感知的大块内存分配 (C/C++ 通用, 仅 Linux), 直接使用 mbind / move_pages
+ * 系统调用, 不依赖 libnuma:
+ *   放置策略  firsttouch      默认策略, 由调用方的并行初始化决定页面位置
+ *             serial          同 firsttouch, 提示调用方在主线程初始化 (全部落在主线程所在节点)
+ *             interleave[:L]  在节点列表 L (默认所有有内存的节点) 上按页交错
+ *             bind:L          严格绑定到节点列表 L
+ *             preferred:N     优先节点 N, 内存不足时回退到其他节点
+ *   页面类型  thp             madvise(MADV_HUGEPAGE), 透明大页
+ *             nothp           madvise(MADV_NOHUGEPAGE)
+ *             hugetlb         mmap(MAP_HUGETLB), 需预留 2MB 大页, 失败时退回 thp
+ *             hugetlb1g       mmap(MAP_HUGETLB | MAP_HUGE_1GB), 需预留 1GB 大页,
+ *                             失败时依次退回 hugetlb、thp
+ * 策略串由逗号分隔, 如 "bind:1,thp"、"interleave:0-3"。
+ *
+ * 分配后可用 numa_region_describe 查询实际效果: 按页采样 move_pages 得到各节点占比,
+ * 并从 /proc/self/smaps 读取透明大页覆盖的字节数。
+ ******************************************************************************/
+#ifndef NUMA_ALLOC_H
+#define NUMA_ALLOC_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MPOL_DEFAULT
+#define MPOL_DEFAULT    0
+#define MPOL_PREFERRED  1
+#define MPOL_BIND       2
+#define MPOL_INTERLEAVE 3
+#endif
+#ifndef MPOL_MF_STRICT
+#define MPOL_MF_STRICT  (1 << 0)
+#define MPOL_MF_MOVE    (1 << 1)
+#endif
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB     0x40000
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB    (30 << 26)  /* log2(1GB) << MAP_HUGE_SHIFT */
+#endif
+
+#define NUMA_MAX_NODES     64
+#define NUMA_HUGEPAGE_SIZE (2UL << 20)
+#define NUMA_GIGAPAGE_SIZE (1UL << 30)
+#define NUMA_SAMPLE_PAGES  4096     /* 查询放置时最多采样的页数 */
+
+enum {
+    NUMA_PLACE_FIRSTTOUCH,
+    NUMA_PLACE_SERIAL,
+    NUMA_PLACE_INTERLEAVE,
+    NUMA_PLACE_BIND,
+    NUMA_PLACE_PREFERRED
+};
+
+enum {
+    NUMA_PAGES_DEFAULT,
+    NUMA_PAGES_THP,
+    NUMA_PAGES_NOTHP,
+    NUMA_PAGES_HUGETLB,
+    NUMA_PAGES_HUGETLB_1G
+};
+
+typedef struct {
+    int place;
+    uint64_t nodes;          /* 节点位图, 0 表示所有有内存的节点 */
+    int pages;
+} numa_spec;
+
+typedef struct {
+    void *base;
+    size_t bytes;            /* 映射长度 (已按页大小取整) */
+    numa_spec spec;          /* 实际生效的策略 (hugetlb 失败时 pages 为退回后的类型) */
+} numa_region;
+
+/* 解析 "0-3,5" 形式的节点列表为位图; 失败返回 -1 */
+static inline int numa_parse_nodes(const char *s, uint64_t *mask)
+{
+    *mask = 0;
+    while (*s && *s != '\n' && *s != ',') {
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+
+        if (end == s)
+            return -1;
+        if (*end == '-')
+            hi = strtol(end + 1, &end, 10);
+        if (lo < 0 || hi >= NUMA_MAX_NODES || hi < lo)
+            return -1;
+        for (long n = lo; n <= hi; n++)
+            *mask |= 1ULL << n;
+        /* 节点列表内部用 '+' 分隔多个区间, 与策略串的 ',' 区分 */
+        s = *end == '+' ? end + 1 : end;
+    }
+    return 0;
+}
+
+/* 有内存的节点位图 (读取 sysfs), 读不到时视为只有节点 0 */
+static inline uint64_t numa_memory_nodes(void)
+{
+    const char *paths[] = {"/sys/devices/system/node/has_memory", "/sys/devices/system/node/online"};
+    char line[256];
+    uint64_t mask = 0;
+
+    for (int i = 0; i < 2 && mask == 0; i++) {
+        FILE *f = fopen(paths[i], "r");
+        if (!f)
+            continue;
+        if (fgets(line, sizeof(line), f)) {
+            /* sysfs 用 ',' 分隔区间, 转成 numa_parse_nodes 的 '+' */
+            for (char *p = line; *p; p++)
+                if (*p == ',')
+                    *p = '+';
+            if (numa_parse_nodes(line, &mask) != 0)
+                mask = 0;
+        }
+        fclose(f);
+    }
+    return mask ? mask : 1;
+}
+
+/* 解析策略串, 如 "interleave:0-1,thp"; 失败返回 -1 */
+static inline int numa_parse_spec(const char *s, numa_spec *spec)
+{
+    spec->place = NUMA_PLACE_FIRSTTOUCH;
+    spec->nodes = 0;
+    spec->pages = NUMA_PAGES_DEFAULT;
+
+    while (*s) {
+        const char *tok = s, *arg = NULL;
+        size_t len;
+
+        while (*s && *s != ',')
+            s++;
+        len = (size_t)(s - tok);
+        if (*s == ',')
+            s++;
+        for (size_t i = 0; i < len; i++) {
+            if (tok[i] == ':') {
+                arg = tok + i + 1;
+                len = i;
+                break;
+            }
+        }
+
+#define NUMA_TOKEN(name) (len == strlen(name) && strncmp(tok, name, len) == 0)
+        if (NUMA_TOKEN("firsttouch") && !arg) {
+            spec->place = NUMA_PLACE_FIRSTTOUCH;
+        } else if (NUMA_TOKEN("serial") && !arg) {
+            spec->place = NUMA_PLACE_SERIAL;
+        } else if (NUMA_TOKEN("interleave")) {
+            spec->place = NUMA_PLACE_INTERLEAVE;
+            if (arg && numa_parse_nodes(arg, &spec->nodes) != 0)
+                return -1;
+        } else if ((NUMA_TOKEN("bind") || NUMA_TOKEN("preferred")) && arg) {
+            spec->place = NUMA_TOKEN("bind") ? NUMA_PLACE_BIND : NUMA_PLACE_PREFERRED;
+            if (numa_parse_nodes(arg, &spec->nodes) != 0 || spec->nodes == 0)
+                return -1;
+        } else if (NUMA_TOKEN("thp") && !arg) {
+            spec->pages = NUMA_PAGES_THP;
+        } else if (NUMA_TOKEN("nothp") && !arg) {
+            spec->pages = NUMA_PAGES_NOTHP;
+        } else if (NUMA_TOKEN("hugetlb") && !arg) {
+            spec->pages = NUMA_PAGES_HUGETLB;
+        } else if (NUMA_TOKEN("hugetlb1g") && !arg) {
+            spec->pages = NUMA_PAGES_HUGETLB_1G;
+        } else {
+            return -1;
+        }
+#undef NUMA_TOKEN
+    }
+    return 0;
+}
+
+static inline void numa_format_nodes(uint64_t mask, char *buf, size_t len)
+{
+    size_t used = 0;
+
+    buf[0] = '\0';
+    for (int n = 0; n < NUMA_MAX_NODES && used < len; n++) {
+        int hi = n;
+
+        if (!(mask >> n & 1))
+            continue;
+        while (hi + 1 < NUMA_MAX_NODES && (mask >> (hi + 1) & 1))
+            hi++;
+        used += (size_t)snprintf(buf + used, len - used, used ? "+%d" : "%d", n);
+        if (hi > n && used < len)
+            used += (size_t)snprintf(buf + used, len - used, "-%d", hi);
+        n = hi;
+    }
+}
+
+/* 策略的文字描述, 与 numa_parse_spec 的输入格式一致 */
+static inline void numa_format_spec(const numa_spec *spec, char *buf, size_t len)
+{
+    static const char *place[] = {"firsttouch", "serial", "interleave", "bind", "preferred"};
+    static const char *pages[] = {"", ",thp", ",nothp", ",hugetlb", ",hugetlb1g"};
+    char nodes[96] = "";
+
+    if (spec->nodes)
+        numa_format_nodes(spec->nodes, nodes, sizeof(nodes));
+    snprintf(buf, len, "%s%s%s%s", place[spec->place], spec->nodes ? ":" : "", nodes, pages[spec->pages]);
+}
+
+/* 按策略映射 bytes 字节 (不初始化); 失败返回 -1 并打印原因 */
+static inline int numa_alloc(numa_region *r, size_t bytes, const numa_spec *spec)
+{
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    int mode = MPOL_DEFAULT;
+
+    r->spec = *spec;
+    r->base = MAP_FAILED;
+    if (spec->pages == NUMA_PAGES_HUGETLB_1G) {
+        r->bytes = (bytes + NUMA_GIGAPAGE_SIZE - 1) / NUMA_GIGAPAGE_SIZE * NUMA_GIGAPAGE_SIZE;
+        r->base = mmap(NULL, r->bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_1GB, -1, 0);
+        if (r->base == MAP_FAILED) {
+            printf("警告: 1GB 大页 MAP_HUGETLB 失败 (%s), 退回 2MB 大页\n", strerror(errno));
+            r->spec.pages = NUMA_PAGES_HUGETLB;
+        }
+    }
+    if (r->base == MAP_FAILED && r->spec.pages == NUMA_PAGES_HUGETLB) {
+        r->bytes = (bytes + NUMA_HUGEPAGE_SIZE - 1) / NUMA_HUGEPAGE_SIZE * NUMA_HUGEPAGE_SIZE;
+        r->base = mmap(NULL, r->bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (r->base == MAP_FAILED) {
+            printf("警告: MAP_HUGETLB 失败 (%s), 退回透明大页\n", strerror(errno));
+            r->spec.pages = NUMA_PAGES_THP;
+        }
+    }
+    if (r->base == MAP_FAILED) {
+        /* 透明大页按 2MB 对齐映射, 首尾才能整页使用大页 */
+        size_t align = r->spec.pages == NUMA_PAGES_THP ? NUMA_HUGEPAGE_SIZE : page;
+        size_t len = (bytes + page - 1) / page * page;
+        char *raw = (char *)mmap(NULL, len + align, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        uintptr_t start;
+
+        if (raw == (char *)MAP_FAILED) {
+            printf("错误: mmap %zu 字节失败: %s\n", len, strerror(errno));
+            return -1;
+        }
+        start = ((uintptr_t)raw + align - 1) / align * align;
+        if (start > (uintptr_t)raw)
+            munmap(raw, start - (uintptr_t)raw);
+        munmap((char *)start + len, (uintptr_t)raw + len + align - (start + len));
+        r->base = (void *)start;
+        r->bytes = len;
+        if (r->spec.pages == NUMA_PAGES_THP)
+            madvise(r->base, r->bytes, MADV_HUGEPAGE);
+        else if (r->spec.pages == NUMA_PAGES_NOTHP)
+            madvise(r->base, r->bytes, MADV_NOHUGEPAGE);
+    }
+
+    if (spec->place == NUMA_PLACE_INTERLEAVE)
+        mode = MPOL_INTERLEAVE;
+    else if (spec->place == NUMA_PLACE_BIND)
+        mode = MPOL_BIND;
+    else if (spec->place == NUMA_PLACE_PREFERRED)
+        mode = MPOL_PREFERRED;
+    if (mode != MPOL_DEFAULT) {
+        uint64_t nodes = spec->nodes ? spec->nodes : numa_memory_nodes();
+        unsigned long mask = (unsigned long)nodes;
+
+        if (mode == MPOL_PREFERRED)  /* 只取列表中的第一个节点 */
+            mask &= ~mask + 1;
+        r->spec.nodes = mask;
+        if (syscall(SYS_mbind, r->base, r->bytes, mode, &mask, (unsigned long)NUMA_MAX_NODES + 1,
+                    mode == MPOL_BIND ? MPOL_MF_STRICT : 0) != 0) {
+            printf("错误: mbind 失败: %s\n", strerror(errno));
+            munmap(r->base, r->bytes);
+            r->base = NULL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static inline void numa_free(numa_region *r)
+{
+    if (r->base)
+        munmap(r->base, r->bytes);
+    r->base = NULL;
+}
+
+/* 采样已触及的页, 统计各节点的页数; counts[NUMA_MAX_NODES], 返回采样页数 (未触及的页不计) */
+static inline int numa_page_nodes(const void *base, size_t bytes, int counts[NUMA_MAX_NODES])
+{
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t npages = (bytes + page - 1) / page;
+    size_t step = npages > NUMA_SAMPLE_PAGES ? npages / NUMA_SAMPLE_PAGES : 1;
+    void *pages[NUMA_SAMPLE_PAGES];
+    int status[NUMA_SAMPLE_PAGES];
+    int n = 0, sampled = 0;
+
+    memset(counts, 0, sizeof(int) * NUMA_MAX_NODES);
+    for (size_t p = 0; p < npages && n < NUMA_SAMPLE_PAGES; p += step)
+        pages[n++] = (char *)base + p * page;
+    if (syscall(SYS_move_pages, 0, (unsigned long)n, pages, NULL, status, 0) != 0)
+        return 0;
+    for (int i = 0; i < n; i++) {
+        if (status[i] >= 0 && status[i] < NUMA_MAX_NODES) {
+            counts[status[i]]++;
+            sampled++;
+        }
+    }
+    return sampled;
+}
+
+/* 从 /proc/self/smaps 读取包含 addr 的映射中透明大页的字节数, 读不到返回 0 */
+static inline size_t numa_thp_bytes(const void *addr)
+{
+    FILE *f = fopen("/proc/self/smaps", "r");
+    char line[512];
+    int inside = 0;
+    size_t kb = 0;
+
+    if (!f)
+        return 0;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long lo, hi;
+
+        if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2) {  /* 映射起始行, 字段行不会匹配 */
+            inside = (uintptr_t)addr >= lo && (uintptr_t)addr < hi;
+        } else if (inside && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return inside ? kb << 10 : 0;
+}
+
+/* 实际放置的文字描述: "node0 50.0%, node1 50.0%; THP 76.0 MiB" */
+static inline void numa_region_describe(const numa_region *r, char *buf, size_t len)
+{
+    int counts[NUMA_MAX_NODES];
+    int sampled = numa_page_nodes(r->base, r->bytes, counts);
+    size_t used = 0;
+
+    buf[0] = '\0';
+    if (sampled == 0)
+        used += (size_t)snprintf(buf, len, "节点未知");
+    for (int n = 0; n < NUMA_MAX_NODES && sampled > 0 && used < len; n++) {
+        if (counts[n])
+            used += (size_t)snprintf(buf + used, len - used, "%snode%d %.1f%%", used ? ", " : "", n,
+                                     100.0 * counts[n] / sampled);
+    }
+    if (used < len && r->spec.pages >= NUMA_PAGES_HUGETLB)
+        snprintf(buf + used, len - used, "; hugetlb %s %.1f MiB",
+                 r->spec.pages == NUMA_PAGES_HUGETLB_1G ? "1GB" : "2MB", r->bytes / 1048576.0);
+    else if (used < len)
+        snprintf(buf + used, len - used, "; THP %.1f MiB", numa_thp_bytes(r->base) / 1048576.0);
+}
+
+#endif /* NUMA_ALLOC_H */
@@ -0,0 +1,267 @@
+/******************************************************************************
+ * perf_counters.h
+ *
+ * 基于 perf_event_open 的硬件计数器 (C/C++ 通用, 仅 Linux):
+ *   周期、指令 (IPC)、L1D 读缺失、LLC 读缺失、dTLB 读缺失
+ *
+ * 每个事件单独打开 (不组成事件组), 某个事件不可用 (虚拟机无 PMU、
+ * perf_event_paranoid 限制、内核不支持) 时只缺失该列, 全部不可用时打印原因并跳过。
+ * 计数器以 inherit 方式作用于本进程及之后创建的线程, 因此必须在第一个
+ * OpenMP 并行区之前打开; 多路复用时按 time_enabled / time_running 换算。
+ *
+ * 区域计数取进入/离开时读数之差, 按运行次数平均后给出:
+ *   - FLOP/B (算法): 调用方给出的浮点运算数 / 必需访存字节数
+ *   - FLOP/B (LLC) : 浮点运算数 / (LLC 缺失 x 缓存行), 近似实际的内存流量
+ * 设置环境变量 ROOFLINE_PEAK_GFLOPS 与 ROOFLINE_PEAK_GBPS (如用 GEMM 与 STREAM
+ * Triad 实测) 后, 再按 roofline 模型判断每个区域是计算受限还是带宽受限。
+ ******************************************************************************/
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define PERF_CACHE_LINE 64
+
+enum {
+    PERF_EV_CYCLES,
+    PERF_EV_INSTRUCTIONS,
+    PERF_EV_L1D_MISS,
+    PERF_EV_LLC_MISS,
+    PERF_EV_DTLB_MISS,
+    PERF_EV_COUNT
+};
+
+typedef struct {
+    int fd[PERF_EV_COUNT];       /* -1 表示不可用 */
+    int navail;
+    double start[PERF_EV_COUNT];
+} perf_counters;
+
+/* 一个被测区域的累计值 */
+typedef struct {
+    const char *name;
+    int runs;
+    double count[PERF_EV_COUNT];
+    double seconds;
+    double flops;
+    double bytes;
+} perf_region;
+
+#if defined(__linux__)
+
+static inline int perf_open_event(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static inline uint64_t perf_cache_config(uint64_t cache)
+{
+    return cache | ((uint64_t)PERF_COUNT_HW_CACHE_OP_READ << 8) |
+           ((uint64_t)PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+/* 打开全部事件, 返回可用事件个数; 全部不可用时打印原因 */
+static inline int perf_counters_open(perf_counters *pc)
+{
+    int err = 0;
+
+    pc->fd[PERF_EV_CYCLES] = perf_open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    pc->fd[PERF_EV_INSTRUCTIONS] = perf_open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    pc->fd[PERF_EV_L1D_MISS] = perf_open_event(PERF_TYPE_HW_CACHE, perf_cache_config(PERF_COUNT_HW_CACHE_L1D));
+    pc->fd[PERF_EV_LLC_MISS] = perf_open_event(PERF_TYPE_HW_CACHE, perf_cache_config(PERF_COUNT_HW_CACHE_LL));
+    if (pc->fd[PERF_EV_LLC_MISS] < 0)  /* 部分 PMU 没有 LL 缓存事件, 退回通用的 cache-misses */
+        pc->fd[PERF_EV_LLC_MISS] = perf_open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    pc->fd[PERF_EV_DTLB_MISS] = perf_open_event(PERF_TYPE_HW_CACHE, perf_cache_config(PERF_COUNT_HW_CACHE_DTLB));
+
+    pc->navail = 0;
+    for (int i = 0; i < PERF_EV_COUNT; i++) {
+        if (pc->fd[i] >= 0)
+            pc->navail++;
+        else if (!err)
+            err = errno;
+    }
+    if (pc->navail == 0) {
+        FILE *f = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+        int paranoid = -9;
+
+        if (f) {
+            if (fscanf(f, "%d", &paranoid) != 1)
+                paranoid = -9;
+            fclose(f);
+        }
+        printf("硬件计数器不可用: %s (perf_event_paranoid = %d), 跳过计数\n", strerror(err), paranoid);
+    }
+    return pc->navail;
+}
+
+/* 读取按多路复用换算后的计数, 不可用的事件为 0 */
+static inline void perf_counters_read(const perf_counters *pc, double out[PERF_EV_COUNT])
+{
+    for (int i = 0; i < PERF_EV_COUNT; i++) {
+        uint64_t v[3] = {0, 0, 0};
+
+        out[i] = 0.0;
+        if (pc->fd[i] < 0 || read(pc->fd[i], v, sizeof(v)) != (ssize_t)sizeof(v))
+            continue;
+        out[i] = v[2] > 0 ? (double)v[0] * ((double)v[1] / (double)v[2]) : (double)v[0];
+    }
+}
+
+static inline void perf_counters_close(perf_counters *pc)
+{
+    for (int i = 0; i < PERF_EV_COUNT; i++) {
+        if (pc->fd[i] >= 0)
+            close(pc->fd[i]);
+        pc->fd[i] = -1;
+    }
+    pc->navail = 0;
+}
+
+#else /* !__linux__ */
+
+static inline int perf_counters_open(perf_counters *pc)
+{
+    for (int i = 0; i < PERF_EV_COUNT; i++)
+        pc->fd[i] = -1;
+    pc->navail = 0;
+    printf("硬件计数器不可用: 仅支持 Linux perf_event_open, 跳过计数\n");
+    return 0;
+}
+
+static inline void perf_counters_read(const perf_counters *pc, double out[PERF_EV_COUNT])
+{
+    (void)pc;
+    memset(out, 0, sizeof(double) * PERF_EV_COUNT);
+}
+
+static inline void perf_counters_close(perf_counters *pc)
+{
+    pc->navail = 0;
+}
+
+#endif
+
+/******************************************************************************
+ * 区域计数
+ ******************************************************************************/
+
+static inline void perf_region_begin(perf_counters *pc)
+{
+    if (pc && pc->navail > 0)
+        perf_counters_read(pc, pc->start);
+}
+
+/* 离开区域: 累加计数差值与本次运行的时间、浮点运算数、必需访存字节数 */
+static inline void perf_region_end(perf_counters *pc, perf_region *r, double seconds, double flops, double bytes)
+{
+    double now[PERF_EV_COUNT];
+
+    if (!pc || pc->navail == 0)
+        return;
+    perf_counters_read(pc, now);
+    for (int i = 0; i < PERF_EV_COUNT; i++)
+        r->count[i] += now[i] - pc->start[i];
+    r->runs++;
+    r->seconds += seconds;
+    r->flops += flops;
+    r->bytes += bytes;
+}
+
+/* 区域中事件 ev 每次运行的平均计数; 事件不可用或区域未运行时返回 -1 */
+static inline double perf_region_avg(const perf_counters *pc, const perf_region *r, int ev)
+{
+    if (!pc || pc->fd[ev] < 0 || r->runs == 0)
+        return -1.0;
+    return r->count[ev] / r->runs;
+}
+
+static inline double perf_env_double(const char *name)
+{
+    const char *s = getenv(name);
+    return s ? atof(s) : 0.0;
+}
+
+/* 打印各区域每次运行的平均计数与 roofline 位置 */
+static inline void perf_report(const perf_counters *pc, const perf_region *regions, int n)
+{
+    const double peak_gflops = perf_env_double("ROOFLINE_PEAK_GFLOPS");
+    const double peak_gbps = perf_env_double("ROOFLINE_PEAK_GBPS");
+
+    if (!pc || pc->navail == 0)
+        return;
+    printf("硬件计数器 (每次运行平均, 不可用的事件记为 -):\n");
+    printf("区域                 周期         指令    IPC     L1D缺失     LLC缺失    dTLB缺失   GFLOP/s    FLOP/B    FLOP/B\n");
+    printf("                                                                                             (算法)     (LLC)\n");
+    for (int i = 0; i < n; i++) {
+        const perf_region *r = &regions[i];
+        double avg[PERF_EV_COUNT], llc_bytes;
+        char cell[PERF_EV_COUNT][24];
+
+        if (r->runs == 0)
+            continue;
+        for (int e = 0; e < PERF_EV_COUNT; e++) {
+            avg[e] = r->count[e] / r->runs;
+            if (pc->fd[e] >= 0)
+                snprintf(cell[e], sizeof(cell[e]), "%.4g", avg[e]);
+            else
+                snprintf(cell[e], sizeof(cell[e]), "-");
+        }
+        llc_bytes = avg[PERF_EV_LLC_MISS] * PERF_CACHE_LINE;
+        printf("%-12s %12s %12s %6.2f %11s %11s %11s %9.2f %9.3f ", r->name,
+               cell[PERF_EV_CYCLES], cell[PERF_EV_INSTRUCTIONS],
+               avg[PERF_EV_CYCLES] > 0 ? avg[PERF_EV_INSTRUCTIONS] / avg[PERF_EV_CYCLES] : 0.0,
+               cell[PERF_EV_L1D_MISS], cell[PERF_EV_LLC_MISS], cell[PERF_EV_DTLB_MISS],
+               r->seconds > 0 ? r->flops / r->seconds * 1e-9 : 0.0,
+               r->bytes > 0 ? r->flops / r->bytes : 0.0);
+        if (pc->fd[PERF_EV_LLC_MISS] >= 0 && llc_bytes > 0)
+            printf("%9.3f\n", r->flops / r->runs / llc_bytes);
+        else
+            printf("%9s\n", "-");
+    }
+
+    if (peak_gflops <= 0.0 || peak_gbps <= 0.0) {
+        printf("未设置 ROOFLINE_PEAK_GFLOPS / ROOFLINE_PEAK_GBPS, 不做 roofline 判断\n");
+        return;
+    }
+    printf("Roofline: 峰值 %.1f GFLOP/s, 带宽 %.1f GB/s, 拐点 %.3f FLOP/B\n",
+           peak_gflops, peak_gbps, peak_gflops / peak_gbps);
+    for (int i = 0; i < n; i++) {
+        const perf_region *r = &regions[i];
+        double ai, roof, achieved;
+
+        if (r->runs == 0 || r->bytes <= 0.0 || r->seconds <= 0.0)
+            continue;
+        ai = r->flops / r->bytes;
+        roof = ai * peak_gbps < peak_gflops ? ai * peak_gbps : peak_gflops;
+        achieved = r->flops / r->seconds * 1e-9;
+        if (r->flops > 0.0)
+            printf("  %-12s %s, 可达 %.2f GFLOP/s, 实测 %.2f (%.0f%%)\n", r->name,
+                   ai < peak_gflops / peak_gbps ? "带宽受限" : "计算受限", roof, achieved,
+                   100.0 * achieved / roof);
+        else  /* 无浮点运算的区域 (如 STREAM Copy) 只比较带宽 */
+            printf("  %-12s 纯数据搬运, 带宽 %.2f GB/s (%.0f%%)\n", r->name,
+                   r->bytes / r->seconds * 1e-9, 100.0 * r->bytes / r->seconds * 1e-9 / peak_gbps);
+    }
+}
+
+#endif /* PERF_COUNTERS_H */
@@ -0,0 +1,522 @@
+/******************************************************************************
+ * hbm_profile.c
+ *
+ * Pass 插桩模式 (-passes=hbm-instrument) 的运行时。插桩后的程序把 malloc /
+ * free 改为 hbm_prof_malloc(size, site) / hbm_prof_free, site 是 Pass 为每个
+ * 调用点算出的稳定编号; calloc、realloc、operator new 等其余分配函数保持
+ * 原样, 前后插入 hbm_prof_track / hbm_prof_untrack。这里按编号统计:
+ *   - 分配次数、累计字节与单次最大字节
+ *   - 块的平均生命周期 (分配到释放; 退出时仍存活的块记到退出时刻)
+ *   - 采样到的访存次数: perf 的 mem-loads 事件 (Intel PEBS 负载延迟采样)
+ *     给出被访问的数据地址, 按地址归到当时存活的块
+ * 进程退出时写出剖析文件, 下一次编译时交给 Pass 的 -hbm-profile。
+ *
+ * 只有不小于 HBM_PROF_MIN_SIZE (默认 4K) 的块参与生命周期与访存统计: 放进
+ * HBM 的收益主要来自大块, 按起始地址排序的活块表也因此保持很小; 更小的块
+ * 只计次数与字节。没有 mem-loads 事件 (非 Intel、虚拟机) 或权限不足时打印
+ * 一次提示, 剖析文件中的采样数为 0, Pass 对这些调用点仍用静态估计。
+ *
+ * 环境变量:
+ *   HBM_PROFILE       剖析文件路径, 默认 hbm.prof; 其中的 %p 替换为进程号
+ *                     (MPI 程序每个进程各写一份, 编译时可一起读入)
+ *   HBM_PROF_PERIOD   每多少次负载采样一次, 默认 2000
+ *   HBM_PROF_MIN_SIZE 参与采样的最小块, 可带 K/M/G 后缀
+ *
+ * 剖析文件为文本, 以 # 开头的是注释:
+ *   # hbm profile v1
+ *   # period 2000 samples 81234 unattributed 512 lost 0 seconds 3.2
+ *   <site 十六进制> <分配次数> <累计字节> <最大字节> <平均生命周期秒> <采样数>
+ ******************************************************************************/
+#define _GNU_SOURCE
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hbm_runtime.h"
+
+#define HBM_PROF_MAX_SITES   4096          /* 超出的调用点合并到最后一项 */
+#define HBM_PROF_PERIOD      2000
+#define HBM_PROF_MIN_SIZE    4096
+#define HBM_PROF_RING_PAGES  64            /* 每个 CPU 的采样缓冲 (页, 2 的幂) */
+#define HBM_PROF_DRAIN_NS    10000000L     /* 后台线程取样本的间隔 */
+#define HBM_PROF_PMU         "/sys/bus/event_source/devices/cpu"
+
+/* 一个调用点的统计 */
+typedef struct {
+    uint64_t id;                 /* 0 表示空槽 */
+    unsigned long allocs;
+    unsigned long tracked;       /* 参与生命周期统计的块数 */
+    size_t total_bytes;
+    size_t max_bytes;
+    double lifetime;             /* 参与统计的块的生命周期之和 (秒) */
+    unsigned long samples;
+} hbm_prof_site;
+
+/* 一个参与采样的活块 */
+typedef struct {
+    uintptr_t start, end;
+    double born;
+    int site;
+} hbm_prof_block;
+
+/* 一个 CPU 上的采样缓冲 */
+typedef struct {
+    int fd;
+    struct perf_event_mmap_page *page;
+    char *data;
+    size_t size;
+} hbm_prof_ring;
+
+static struct {
+    pthread_once_t once;
+    pthread_mutex_t lock;
+    char path[256];
+    size_t min_size;
+    double start;
+    hbm_prof_site sites[HBM_PROF_MAX_SITES];
+    hbm_prof_block *blocks;      /* 按 start 升序 */
+    size_t nblocks, cap_blocks;
+    hbm_prof_ring *rings;
+    int nrings;
+    unsigned long period;
+    unsigned long samples, unattributed, lost;
+    pthread_t drainer;
+    int stop;
+} prof = {.once = PTHREAD_ONCE_INIT, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+static double hbm_prof_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/******************************************************************************
+ * 调用点与活块表 (调用方持有 prof.lock)
+ ******************************************************************************/
+
+static int hbm_prof_site_index(uint64_t id)
+{
+    size_t h = (size_t)(id % (HBM_PROF_MAX_SITES - 1));
+
+    for (size_t i = 0; i < HBM_PROF_MAX_SITES - 1; i++) {
+        hbm_prof_site *s = &prof.sites[(h + i) % (HBM_PROF_MAX_SITES - 1)];
+
+        if (s->id == id || s->id == 0) {
+            s->id = id;
+            return (int)((h + i) % (HBM_PROF_MAX_SITES - 1));
+        }
+    }
+    prof.sites[HBM_PROF_MAX_SITES - 1].id = UINT64_MAX;
+    return HBM_PROF_MAX_SITES - 1;
+}
+
+/* 第一个 start > addr 的块的下标 */
+static size_t hbm_prof_upper(uintptr_t addr)
+{
+    size_t lo = 0, hi = prof.nblocks;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+
+        if (prof.blocks[mid].start <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int hbm_prof_insert(const hbm_prof_block *b)
+{
+    size_t i;
+
+    if (prof.nblocks == prof.cap_blocks) {
+        size_t cap = prof.cap_blocks ? prof.cap_blocks * 2 : 256;
+        hbm_prof_block *blocks = (hbm_prof_block *)realloc(prof.blocks, cap * sizeof(*blocks));
+
+        if (!blocks)
+            return -1;
+        prof.blocks = blocks;
+        prof.cap_blocks = cap;
+    }
+    i = hbm_prof_upper(b->start);
+    memmove(prof.blocks + i + 1, prof.blocks + i, (prof.nblocks - i) * sizeof(*b));
+    prof.blocks[i] = *b;
+    prof.nblocks++;
+    return 0;
+}
+
+/* 取出并删除起始于 ptr 的块; 不在表中返回 -1 */
+static int hbm_prof_remove(uintptr_t ptr, hbm_prof_block *out)
+{
+    size_t i = hbm_prof_upper(ptr);
+
+    if (i == 0 || prof.blocks[i - 1].start != ptr)
+        return -1;
+    *out = prof.blocks[i - 1];
+    memmove(prof.blocks + i - 1, prof.blocks + i, (prof.nblocks - i) * sizeof(*out));
+    prof.nblocks--;
+    return 0;
+}
+
+static void hbm_prof_retire(const hbm_prof_block *b, double now)
+{
+    hbm_prof_site *s = &prof.sites[b->site];
+
+    s->tracked++;
+    s->lifetime += now - b->born;
+}
+
+/******************************************************************************
+ * perf 采样
+ ******************************************************************************/
+
+/* 读取 PMU 目录下文件的第一行 (去掉换行), 读不到返回 -1 */
+static int hbm_prof_pmu_file(const char *file, char *buf, size_t len)
+{
+    char path[256];
+    FILE *f;
+
+    snprintf(path, sizeof(path), HBM_PROF_PMU "/%s", file);
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+    if (!fgets(buf, (int)len, f))
+        buf[0] = '\0';
+    fclose(f);
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+/* 按 format/<name> (如 "config:0-7"、"config1:0-15") 把 value 放进 attr */
+static int hbm_prof_encode(struct perf_event_attr *attr, const char *name, uint64_t value)
+{
+    char file[128], fmt[64];
+    unsigned lo, hi;
+    __u64 *field;
+    int n;
+
+    snprintf(file, sizeof(file), "format/%s", name);
+    if (hbm_prof_pmu_file(file, fmt, sizeof(fmt)) != 0)
+        return -1;
+    if (strncmp(fmt, "config1:", 8) == 0)
+        field = &attr->config1;
+    else if (strncmp(fmt, "config2:", 8) == 0)
+        field = &attr->config2;
+    else if (strncmp(fmt, "config:", 7) == 0)
+        field = &attr->config;
+    else
+        return -1;
+    n = sscanf(strchr(fmt, ':') + 1, "%u-%u", &lo, &hi);
+    if (n < 1 || lo > 63)
+        return -1;
+    if (n == 1)
+        hi = lo;
+    if (hi > 63 || hi < lo)
+        return -1;
+    *field |= (value & (hi - lo == 63 ? ~0ULL : (1ULL << (hi - lo + 1)) - 1)) << lo;
+    return 0;
+}
+
+/* 由 sysfs 的 events/mem-loads (如 "event=0xcd,umask=0x1,ldlat=3") 构造事件 */
+static int hbm_prof_event(struct perf_event_attr *attr)
+{
+    char type[32], spec[256], *term, *save;
+
+    if (hbm_prof_pmu_file("type", type, sizeof(type)) != 0 ||
+        hbm_prof_pmu_file("events/mem-loads", spec, sizeof(spec)) != 0)
+        return -1;
+    memset(attr, 0, sizeof(*attr));
+    attr->size = sizeof(*attr);
+    attr->type = (uint32_t)strtoul(type, NULL, 10);
+    for (term = strtok_r(spec, ",", &save); term; term = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(term, '=');
+        uint64_t value = 1;
+
+        if (eq) {
+            *eq = '\0';
+            value = strtoull(eq + 1, NULL, 0);
+        }
+        if (hbm_prof_encode(attr, term, value) != 0)
+            return -1;
+    }
+    attr->sample_period = prof.period;
+    attr->sample_type = PERF_SAMPLE_ADDR;
+    attr->precise_ip = 2;
+    attr->inherit = 1;
+    attr->exclude_kernel = 1;
+    attr->exclude_hv = 1;
+    return 0;
+}
+
+/* 每个 CPU 打开一个作用于本进程 (含之后的线程) 的采样事件; 返回打开的个数 */
+static int hbm_prof_open(const char **why)
+{
+    const long page = sysconf(_SC_PAGESIZE);
+    const int ncpus = (int)sysconf(_SC_NPROCESSORS_CONF);
+    struct perf_event_attr attr;
+
+    if (hbm_prof_event(&attr) != 0) {
+        *why = "没有 mem-loads 事件";
+        return 0;
+    }
+    prof.rings = (hbm_prof_ring *)calloc((size_t)ncpus, sizeof(hbm_prof_ring));
+    if (!prof.rings) {
+        *why = "内存不足";
+        return 0;
+    }
+    *why = "perf_event_open 失败 (检查 perf_event_paranoid)";
+    for (int cpu = 0; cpu < ncpus; cpu++) {
+        hbm_prof_ring *r = &prof.rings[prof.nrings];
+        size_t len = (size_t)page * (HBM_PROF_RING_PAGES + 1);
+        void *p;
+
+        r->fd = (int)syscall(__NR_perf_event_open, &attr, 0, cpu, -1, 0);
+        if (r->fd < 0)
+            continue;
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+        if (p == MAP_FAILED) {
+            close(r->fd);
+            continue;
+        }
+        r->page = (struct perf_event_mmap_page *)p;
+        r->data = (char *)p + page;
+        r->size = (size_t)page * HBM_PROF_RING_PAGES;
+        prof.nrings++;
+    }
+    return prof.nrings;
+}
+
+static void hbm_prof_copy(const hbm_prof_ring *r, uint64_t off, void *dst, size_t len)
+{
+    size_t pos = (size_t)(off & (r->size - 1));
+    size_t first = len < r->size - pos ? len : r->size - pos;
+
+    memcpy(dst, r->data + pos, first);
+    memcpy((char *)dst + first, r->data, len - first);
+}
+
+/* 把一个缓冲中的样本归到活块上 (调用方持有 prof.lock) */
+static void hbm_prof_drain(hbm_prof_ring *r)
+{
+    uint64_t head = __atomic_load_n(&r->page->data_head, __ATOMIC_ACQUIRE);
+    uint64_t tail = r->page->data_tail;
+
+    while (tail < head) {
+        struct perf_event_header h;
+        uint64_t v[2];
+
+        hbm_prof_copy(r, tail, &h, sizeof(h));
+        if (h.size < sizeof(h))
+            break;
+        if (h.type == PERF_RECORD_SAMPLE && h.size >= sizeof(h) + sizeof(uint64_t)) {
+            size_t i;
+
+            hbm_prof_copy(r, tail + sizeof(h), v, sizeof(uint64_t));
+            i = hbm_prof_upper((uintptr_t)v[0]);
+            prof.samples++;
+            if (i > 0 && (uintptr_t)v[0] < prof.blocks[i - 1].end)
+                prof.sites[prof.blocks[i - 1].site].samples++;
+            else
+                prof.unattributed++;
+        } else if (h.type == PERF_RECORD_LOST && h.size >= sizeof(h) + sizeof(v)) {
+            hbm_prof_copy(r, tail + sizeof(h), v, sizeof(v));
+            prof.lost += (unsigned long)v[1];
+        }
+        tail += h.size;
+    }
+    __atomic_store_n(&r->page->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+static void hbm_prof_drain_all(void)
+{
+    for (int i = 0; i < prof.nrings; i++)
+        hbm_prof_drain(&prof.rings[i]);
+}
+
+/* 定期取走样本, 防止长时间没有分配/释放时缓冲溢出 */
+static void *hbm_prof_drainer(void *arg)
+{
+    const struct timespec ts = {0, HBM_PROF_DRAIN_NS};
+
+    (void)arg;
+    for (;;) {
+        nanosleep(&ts, NULL);
+        pthread_mutex_lock(&prof.lock);
+        if (prof.stop) {
+            pthread_mutex_unlock(&prof.lock);
+            return NULL;
+        }
+        hbm_prof_drain_all();
+        pthread_mutex_unlock(&prof.lock);
+    }
+}
+
+/******************************************************************************
+ * 初始化与剖析文件
+ ******************************************************************************/
+
+static size_t hbm_prof_parse_bytes(const char *s)
+{
+    char *end;
+    double v = strtod(s, &end);
+
+    if (end == s || v < 0)
+        return 0;
+    switch (*end) {
+    case 'k': case 'K': v *= 1024.0; end++; break;
+    case 'm': case 'M': v *= 1024.0 * 1024.0; end++; break;
+    case 'g': case 'G': v *= 1024.0 * 1024.0 * 1024.0; end++; break;
+    }
+    return *end == '\0' ? (size_t)v : 0;
+}
+
+static void hbm_prof_write(void)
+{
+    const double now = hbm_prof_now();
+    FILE *f;
+
+    pthread_mutex_lock(&prof.lock);
+    prof.stop = 1;
+    pthread_mutex_unlock(&prof.lock);
+    if (prof.nrings)
+        pthread_join(prof.drainer, NULL);
+
+    pthread_mutex_lock(&prof.lock);
+    hbm_prof_drain_all();
+    for (int i = 0; i < prof.nrings; i++)
+        ioctl(prof.rings[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+    for (size_t i = 0; i < prof.nblocks; i++)
+        hbm_prof_retire(&prof.blocks[i], now);
+    prof.nblocks = 0;
+
+    f = fopen(prof.path, "w");
+    if (!f) {
+        fprintf(stderr, "HBM 剖析: 无法写入 %s\n", prof.path);
+        pthread_mutex_unlock(&prof.lock);
+        return;
+    }
+    fprintf(f, "# hbm profile v1\n");
+    fprintf(f, "# period %lu samples %lu unattributed %lu lost %lu seconds %.3f\n",
+            prof.nrings ? prof.period : 0UL, prof.samples, prof.unattributed, prof.lost,
+            now - prof.start);
+    fprintf(f, "# site allocs total_bytes max_bytes lifetime_s samples\n");
+    /* 最后一项混合了多个调用点, 不写出 */
+    for (int i = 0; i < HBM_PROF_MAX_SITES - 1; i++) {
+        const hbm_prof_site *s = &prof.sites[i];
+
+        if (!s->id)
+            continue;
+        fprintf(f, "%016llx %lu %zu %zu %.6f %lu\n", (unsigned long long)s->id, s->allocs,
+                s->total_bytes, s->max_bytes, s->tracked ? s->lifetime / s->tracked : 0.0,
+                s->samples);
+    }
+    fclose(f);
+    pthread_mutex_unlock(&prof.lock);
+}
+
+static void hbm_prof_init(void)
+{
+    const char *path = getenv("HBM_PROFILE");
+    const char *period = getenv("HBM_PROF_PERIOD");
+    const char *min_size = getenv("HBM_PROF_MIN_SIZE");
+    const char *why, *pid;
+
+    if (!path || !*path)
+        path = "hbm.prof";
+    pid = strstr(path, "%p");
+    if (pid)
+        snprintf(prof.path, sizeof(prof.path), "%.*s%ld%s", (int)(pid - path), path,
+                 (long)getpid(), pid + 2);
+    else
+        snprintf(prof.path, sizeof(prof.path), "%s", path);
+
+    prof.period = period ? strtoul(period, NULL, 10) : 0;
+    if (prof.period == 0)
+        prof.period = HBM_PROF_PERIOD;
+    prof.min_size = HBM_PROF_MIN_SIZE;
+    if (min_size)
+        prof.min_size = hbm_prof_parse_bytes(min_size);
+    prof.start = hbm_prof_now();
+
+    if (hbm_prof_open(&why) == 0 ||
+        pthread_create(&prof.drainer, NULL, hbm_prof_drainer, NULL) != 0) {
+        if (prof.nrings)
+            why = "无法创建采样线程";
+        for (int i = 0; i < prof.nrings; i++)
+            close(prof.rings[i].fd);
+        prof.nrings = 0;
+        fprintf(stderr, "HBM 剖析: 访存采样不可用 (%s), 只记录大小与生命周期\n", why);
+    }
+    atexit(hbm_prof_write);
+}
+
+/******************************************************************************
+ * 接口
+ ******************************************************************************/
+
+void hbm_prof_track(void *ptr, size_t size, uint64_t site)
+{
+    hbm_prof_site *s;
+    int i;
+
+    if (!ptr)
+        return;
+    pthread_once(&prof.once, hbm_prof_init);
+    pthread_mutex_lock(&prof.lock);
+    i = hbm_prof_site_index(site);
+    s = &prof.sites[i];
+    s->allocs++;
+    s->total_bytes += size;
+    if (size > s->max_bytes)
+        s->max_bytes = size;
+    if (size >= prof.min_size && !prof.stop) {
+        hbm_prof_block b = {(uintptr_t)ptr, (uintptr_t)ptr + size, hbm_prof_now(), i};
+
+        /* 先取走旧样本: 地址可能刚被释放的块用过 */
+        hbm_prof_drain_all();
+        /* 表扩不动时只少这一块的生命周期与采样 */
+        hbm_prof_insert(&b);
+    }
+    pthread_mutex_unlock(&prof.lock);
+}
+
+void hbm_prof_untrack(void *ptr)
+{
+    hbm_prof_block b;
+
+    if (!ptr)
+        return;
+    pthread_mutex_lock(&prof.lock);
+    if (prof.nblocks) {
+        /* 样本须在块离开表之前归属 */
+        hbm_prof_drain_all();
+        if (hbm_prof_remove((uintptr_t)ptr, &b) == 0)
+            hbm_prof_retire(&b, hbm_prof_now());
+    }
+    pthread_mutex_unlock(&prof.lock);
+}
+
+void *hbm_prof_malloc(size_t size, uint64_t site)
+{
+    void *ptr = malloc(size);
+
+    hbm_prof_track(ptr, size, site);
+    return ptr;
+}
+
+void hbm_prof_free(void *ptr)
+{
+    hbm_prof_untrack(ptr);
+    free(ptr);
+}
@@ -0,0 +1,686 @@
+/******************************************************************************
+ * hbm_runtime.c
+ *
+ * hbm_malloc / hbm_free 及其余分配入口的实现, 配置与用法见 hbm_runtime.h。
+ *   - node 层每块单独 mmap 并 mbind 到目标节点 (common/numa_alloc.h), 按页
+ *     计入容量; sim 层用 posix_memalign, 按请求字节计入容量
+ *   - 快速层容量不足或映射失败时退回 DRAM (posix_memalign), 记为一次退回
+ *   - calloc / aligned_alloc / posix_memalign / operator new 与 hbm_malloc 共用
+ *     hbm_alloc; hbm_realloc 总是分配新块并复制, 块可以在两层之间迁移
+ *   - 所有由 hbm_malloc 返回的块登记在一张按地址散列的表中, hbm_free 据此
+ *     找到块的来源; 不在表中的指针按普通 malloc 的结果交给 free
+ *   - 另记录这些块覆盖的地址范围 [lo, hi): 范围之外的指针不必加锁查表,
+ *     直接交给 free, Pass 因而可以把无法证明来源的 free 都改为 hbm_free
+ *   - 统计与块表由一把互斥锁保护; mmap / munmap 在锁外进行
+ ******************************************************************************/
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hbm_runtime.h"
+#include "../common/numa_alloc.h"
+
+#define HBM_ALIGNMENT        64
+#define HBM_MAX_SITES        256           /* 超出的调用点合并到最后一项 */
+#define HBM_SIM_CAPACITY     (1ULL << 30)  /* 模拟层默认容量, 同 Pass 的默认值 */
+#define HBM_TABLE_MIN        1024
+
+/* 一个调用点的统计 */
+typedef struct {
+    void *addr;                  /* hbm_malloc 的返回地址, NULL 表示空槽 */
+    unsigned long calls;
+    unsigned long tier_allocs;   /* 落在快速层的次数 */
+    unsigned long fallbacks;     /* 快速层放不下退回 DRAM 的次数 */
+    unsigned long frees;
+    size_t tier_bytes;           /* 累计分配字节 */
+    size_t dram_bytes;
+    size_t live_tier;            /* 当前在快速层的字节 */
+    size_t peak_tier;
+} hbm_site;
+
+/* 一个已分配的块 */
+typedef struct {
+    void *ptr;                   /* NULL 表示空槽 */
+    size_t size;
+    size_t charged;              /* 计入快速层容量的字节, DRAM 块为 0 */
+    size_t mapped;               /* node 层的映射长度, 其余为 0 */
+    int site;
+} hbm_block;
+
+static struct {
+    pthread_once_t once;
+    pthread_mutex_t lock;
+    int kind;                    /* HBM_TIER_* */
+    int node;
+    const char *source;          /* 快速层的来源说明 */
+    size_t capacity;
+    size_t used;
+    size_t peak;
+    char stats_path[256];        /* 空串表示不输出统计 */
+    hbm_site sites[HBM_MAX_SITES];
+    hbm_block *blocks;           /* 开放寻址散列表, 线性探测 */
+    size_t nblocks, table_size;
+    uintptr_t lo, hi;            /* 块地址的范围, 只增不减; 锁外原子读取 */
+} hbm = {.once = PTHREAD_ONCE_INIT, .lock = PTHREAD_MUTEX_INITIALIZER, .lo = UINTPTR_MAX};
+
+/******************************************************************************
+ * 配置与快速层探测
+ ******************************************************************************/
+
+/* 字节数, 可带 K/M/G 后缀 (1024 的幂); 非法返回 0 */
+static size_t hbm_parse_bytes(const char *s)
+{
+    char *end;
+    double v = strtod(s, &end);
+
+    if (end == s || v <= 0)
+        return 0;
+    switch (*end) {
+    case 'k': case 'K': v *= 1024.0; end++; break;
+    case 'm': case 'M': v *= 1024.0 * 1024.0; end++; break;
+    case 'g': case 'G': v *= 1024.0 * 1024.0 * 1024.0; end++; break;
+    }
+    return *end == '\0' ? (size_t)v : 0;
+}
+
+/* 读取 /sys/devices/system/node/nodeN/ 下文件的第一行, 读不到返回 -1 */
+static int hbm_node_file(int node, const char *file, char *buf, size_t len)
+{
+    char path[160];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/%s", node, file);
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+    if (!fgets(buf, (int)len, f))
+        buf[0] = '\0';
+    fclose(f);
+    return 0;
+}
+
+/* 节点是否有 CPU */
+static int hbm_node_has_cpus(int node)
+{
+    char line[1024];
+
+    return hbm_node_file(node, "cpulist", line, sizeof(line)) == 0 && line[0] != '\n' && line[0] != '\0';
+}
+
+/* HMAT 报告的本地发起者读带宽 (MB/s), 没有 HMAT 时返回 0 */
+static long hbm_node_bandwidth(int node)
+{
+    char line[64];
+
+    if (hbm_node_file(node, "access0/initiators/read_bandwidth", line, sizeof(line)) != 0)
+        return 0;
+    return strtol(line, NULL, 10);
+}
+
+/* 节点的空闲内存 (字节), 读不到返回 0 */
+static size_t hbm_node_free(int node)
+{
+    char path[160], line[256];
+    size_t kb = 0;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/meminfo", node);
+    f = fopen(path, "r");
+    if (!f)
+        return 0;
+    while (fgets(line, sizeof(line), f)) {
+        const char *p = strstr(line, "MemFree:");
+        if (p && sscanf(p + 8, "%zu", &kb) == 1)
+            break;
+    }
+    fclose(f);
+    return kb << 10;
+}
+
+/* 高带宽节点: 有 HMAT 时取读带宽最高且高于所有带 CPU 节点的节点,
+ * 否则取第一个没有 CPU 的内存节点; 找不到返回 -1 */
+static int hbm_detect_node(const char **source)
+{
+    uint64_t nodes = numa_memory_nodes();
+    long best_bw = 0, dram_bw = 0;
+    int best = -1, cpuless = -1;
+
+    for (int n = 0; n < NUMA_MAX_NODES; n++) {
+        long bw;
+
+        if (!(nodes >> n & 1))
+            continue;
+        bw = hbm_node_bandwidth(n);
+        if (hbm_node_has_cpus(n)) {
+            if (bw > dram_bw)
+                dram_bw = bw;
+        } else if (cpuless < 0) {
+            cpuless = n;
+        }
+        if (bw > best_bw) {
+            best_bw = bw;
+            best = n;
+        }
+    }
+    if (best_bw > 0) {
+        *source = "HMAT 读带宽";
+        return best_bw > dram_bw ? best : -1;
+    }
+    *source = "无 CPU 的内存节点";
+    return cpuless;
+}
+
+static void hbm_stats_at_exit(void)
+{
+    FILE *f = stderr;
+
+    if (strcmp(hbm.stats_path, "1") != 0 && strcmp(hbm.stats_path, "stderr") != 0)
+        f = fopen(hbm.stats_path, "w");
+    if (!f) {
+        fprintf(stderr, "HBM 运行时: 无法写入统计文件 %s\n", hbm.stats_path);
+        return;
+    }
+    hbm_stats_print(f);
+    if (f != stderr)
+        fclose(f);
+}
+
+static void hbm_init(void)
+{
+    const char *tier = getenv("HBM_TIER");
+    const char *cap = getenv("HBM_CAPACITY");
+    const char *stats = getenv("HBM_STATS");
+
+    hbm.node = -1;
+    if (!tier || strcmp(tier, "auto") == 0) {
+        hbm.node = hbm_detect_node(&hbm.source);
+        hbm.kind = hbm.node >= 0 ? HBM_TIER_NODE : HBM_TIER_SIM;
+        if (hbm.node < 0)
+            hbm.source = "未探测到高带宽节点, 使用模拟层";
+    } else if (strncmp(tier, "node:", 5) == 0) {
+        char *end;
+        long n = strtol(tier + 5, &end, 10);
+
+        if (end == tier + 5 || *end != '\0' || n < 0 || n >= NUMA_MAX_NODES ||
+            !(numa_memory_nodes() >> n & 1)) {
+            fprintf(stderr, "HBM 运行时: 节点 %s 不存在或没有内存, 使用模拟层\n", tier + 5);
+            hbm.kind = HBM_TIER_SIM;
+            hbm.source = "HBM_TIER 指定的节点无效";
+        } else {
+            hbm.kind = HBM_TIER_NODE;
+            hbm.node = (int)n;
+            hbm.source = "HBM_TIER 指定";
+        }
+    } else if (strcmp(tier, "sim") == 0) {
+        hbm.kind = HBM_TIER_SIM;
+        hbm.source = "HBM_TIER 指定";
+    } else {
+        if (strcmp(tier, "off") != 0)
+            fprintf(stderr, "HBM 运行时: 未知的 HBM_TIER=%s, 全部分配在 DRAM\n", tier);
+        hbm.kind = HBM_TIER_OFF;
+        hbm.source = "全部分配在 DRAM";
+    }
+
+    if (cap && (hbm.capacity = hbm_parse_bytes(cap)) == 0)
+        fprintf(stderr, "HBM 运行时: 无法解析 HBM_CAPACITY=%s, 使用默认容量\n", cap);
+    if (hbm.capacity == 0)
+        hbm.capacity = hbm.kind == HBM_TIER_NODE ? hbm_node_free(hbm.node) : HBM_SIM_CAPACITY;
+    if (hbm.kind == HBM_TIER_OFF)
+        hbm.capacity = 0;
+
+    if (stats && *stats && strcmp(stats, "0") != 0) {
+        snprintf(hbm.stats_path, sizeof(hbm.stats_path), "%s", stats);
+        atexit(hbm_stats_at_exit);
+    }
+}
+
+/******************************************************************************
+ * 调用点与块表 (调用方持有 hbm.lock)
+ ******************************************************************************/
+
+static int hbm_site_index(void *addr)
+{
+    size_t h = ((uintptr_t)addr >> 2) % (HBM_MAX_SITES - 1);
+
+    for (size_t i = 0; i < HBM_MAX_SITES - 1; i++) {
+        hbm_site *s = &hbm.sites[(h + i) % (HBM_MAX_SITES - 1)];
+
+        if (s->addr == addr || s->addr == NULL) {
+            s->addr = addr;
+            return (int)((h + i) % (HBM_MAX_SITES - 1));
+        }
+    }
+    hbm.sites[HBM_MAX_SITES - 1].addr = (void *)-1;
+    return HBM_MAX_SITES - 1;
+}
+
+static size_t hbm_slot(const void *ptr, size_t table_size)
+{
+    return ((uintptr_t)ptr >> 6) * 0x9E3779B97F4A7C15ULL % table_size;
+}
+
+/* 表满一半时扩为两倍; 失败返回 -1 */
+static int hbm_table_reserve(void)
+{
+    hbm_block *old = hbm.blocks, *blocks;
+    size_t old_size = hbm.table_size, size;
+
+    if ((hbm.nblocks + 1) * 2 <= hbm.table_size)
+        return 0;
+    size = old_size ? old_size * 2 : HBM_TABLE_MIN;
+    blocks = (hbm_block *)calloc(size, sizeof(hbm_block));
+    if (!blocks)
+        return -1;
+    for (size_t i = 0; i < old_size; i++) {
+        size_t j;
+
+        if (!old[i].ptr)
+            continue;
+        for (j = hbm_slot(old[i].ptr, size); blocks[j].ptr; j = (j + 1) % size)
+            ;
+        blocks[j] = old[i];
+    }
+    hbm.blocks = blocks;
+    hbm.table_size = size;
+    free(old);
+    return 0;
+}
+
+static void hbm_table_insert(const hbm_block *b)
+{
+    size_t j;
+
+    for (j = hbm_slot(b->ptr, hbm.table_size); hbm.blocks[j].ptr; j = (j + 1) % hbm.table_size)
+        ;
+    hbm.blocks[j] = *b;
+    hbm.nblocks++;
+}
+
+/* ptr 的记录, 不在表中返回 NULL */
+static hbm_block *hbm_table_find(const void *ptr)
+{
+    size_t j;
+
+    if (hbm.table_size == 0)
+        return NULL;
+    for (j = hbm_slot(ptr, hbm.table_size); hbm.blocks[j].ptr != ptr; j = (j + 1) % hbm.table_size) {
+        if (!hbm.blocks[j].ptr)
+            return NULL;
+    }
+    return &hbm.blocks[j];
+}
+
+/* 取出并删除 ptr 的记录 (后移删除, 不留墓碑); 不在表中返回 -1 */
+static int hbm_table_remove(const void *ptr, hbm_block *out)
+{
+    hbm_block *e = hbm_table_find(ptr);
+    size_t j, k;
+
+    if (!e)
+        return -1;
+    j = (size_t)(e - hbm.blocks);
+    *out = *e;
+    hbm.blocks[j].ptr = NULL;
+    hbm.nblocks--;
+    for (k = (j + 1) % hbm.table_size; hbm.blocks[k].ptr; k = (k + 1) % hbm.table_size) {
+        size_t home = hbm_slot(hbm.blocks[k].ptr, hbm.table_size);
+
+        /* home 不在 (j, k] 内时, 这一项可以前移到空出的 j */
+        if ((j < k) ? (home <= j || home > k) : (home <= j && home > k)) {
+            hbm.blocks[j] = hbm.blocks[k];
+            hbm.blocks[k].ptr = NULL;
+            j = k;
+        }
+    }
+    return 0;
+}
+
+/******************************************************************************
+ * 分配与释放
+ ******************************************************************************/
+
+/* 在快速层分配 size 字节, 起始地址按 align (2 的幂, 至少 64) 对齐, 放不下时
+ * 退回 DRAM; zero 非 0 时清零 (新映射的页本来就是零)。site 为入口的返回地址。
+ * node 层的映射只保证页对齐, 要求更大对齐的块退回 DRAM */
+static void *hbm_alloc(size_t size, size_t align, int zero, void *site)
+{
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    hbm_block b = {NULL, size, 0, 0, 0};
+    numa_region r;
+    hbm_site *s;
+
+    pthread_once(&hbm.once, hbm_init);
+    if (align < HBM_ALIGNMENT)
+        align = HBM_ALIGNMENT;
+    if (hbm.kind == HBM_TIER_NODE)
+        b.charged = (size + page - 1) / page * page;
+    else if (hbm.kind == HBM_TIER_SIM)
+        b.charged = size;
+
+    /* 先在锁内占用容量, 映射失败再归还 */
+    pthread_mutex_lock(&hbm.lock);
+    if (hbm.kind == HBM_TIER_OFF || hbm.used + b.charged > hbm.capacity ||
+        (hbm.kind == HBM_TIER_NODE && align > page))
+        b.charged = 0;
+    hbm.used += b.charged;
+    pthread_mutex_unlock(&hbm.lock);
+
+    if (b.charged && hbm.kind == HBM_TIER_NODE) {
+        numa_spec spec = {NUMA_PLACE_BIND, 1ULL << hbm.node, NUMA_PAGES_DEFAULT};
+
+        if (numa_alloc(&r, size ? size : 1, &spec) == 0) {
+            b.ptr = r.base;
+            b.mapped = r.bytes;
+        }
+    } else if (b.charged && posix_memalign(&b.ptr, align, size ? size : 1) != 0) {
+        b.ptr = NULL;
+    }
+    if (!b.ptr && b.charged) {
+        pthread_mutex_lock(&hbm.lock);
+        hbm.used -= b.charged;
+        pthread_mutex_unlock(&hbm.lock);
+        b.charged = 0;
+    }
+    if (!b.ptr && posix_memalign(&b.ptr, align, size ? size : 1) != 0)
+        return NULL;
+
+    pthread_mutex_lock(&hbm.lock);
+    if (hbm_table_reserve() != 0) {
+        pthread_mutex_unlock(&hbm.lock);
+        if (b.mapped)
+            munmap(b.ptr, b.mapped);
+        else
+            free(b.ptr);
+        return NULL;
+    }
+    b.site = hbm_site_index(site);
+    hbm_table_insert(&b);
+    if ((uintptr_t)b.ptr < hbm.lo)
+        __atomic_store_n(&hbm.lo, (uintptr_t)b.ptr, __ATOMIC_RELAXED);
+    if ((uintptr_t)b.ptr + (size ? size : 1) > hbm.hi)
+        __atomic_store_n(&hbm.hi, (uintptr_t)b.ptr + (size ? size : 1), __ATOMIC_RELAXED);
+    s = &hbm.sites[b.site];
+    s->calls++;
+    if (b.charged) {
+        s->tier_allocs++;
+        s->tier_bytes += size;
+        s->live_tier += b.charged;
+        if (s->live_tier > s->peak_tier)
+            s->peak_tier = s->live_tier;
+        if (hbm.used > hbm.peak)
+            hbm.peak = hbm.used;
+    } else {
+        s->fallbacks += hbm.kind != HBM_TIER_OFF;
+        s->dram_bytes += size;
+    }
+    pthread_mutex_unlock(&hbm.lock);
+    if (zero && !b.mapped)
+        memset(b.ptr, 0, size);
+    return b.ptr;
+}
+
+/* ptr 在 hbm_alloc 分配过的地址范围内 (锁外判断)。
+ * 释放 ptr 的线程必定已看到分配它时对范围的更新 */
+static int hbm_in_range(const void *ptr)
+{
+    return (uintptr_t)ptr >= __atomic_load_n(&hbm.lo, __ATOMIC_RELAXED) &&
+           (uintptr_t)ptr < __atomic_load_n(&hbm.hi, __ATOMIC_RELAXED);
+}
+
+/* ptr 是 hbm_alloc 的块时给出其大小并返回 1, 否则返回 0 */
+static int hbm_owns(const void *ptr, size_t *size)
+{
+    hbm_block *e;
+
+    if (!hbm_in_range(ptr))
+        return 0;
+    pthread_mutex_lock(&hbm.lock);
+    e = hbm_table_find(ptr);
+    if (e)
+        *size = e->size;
+    pthread_mutex_unlock(&hbm.lock);
+    return e != NULL;
+}
+
+/* ptr 是 hbm_alloc 的块时释放并返回 1; 否则返回 0, 由调用方按其来源释放 */
+static int hbm_release(void *ptr)
+{
+    hbm_block b;
+    int found;
+
+    if (!ptr || !hbm_in_range(ptr))
+        return 0;
+    pthread_mutex_lock(&hbm.lock);
+    found = hbm_table_remove(ptr, &b) == 0;
+    if (found) {
+        hbm.sites[b.site].frees++;
+        hbm.sites[b.site].live_tier -= b.charged;
+        hbm.used -= b.charged;
+    }
+    pthread_mutex_unlock(&hbm.lock);
+
+    if (found && b.mapped)
+        munmap(b.ptr, b.mapped);
+    else if (found)
+        free(ptr);
+    return found;
+}
+
+/* realloc: 新块在快速层 (to_tier) 或 DRAM, 复制旧内容后释放旧块, ptr 可以
+ * 来自任一层; 因此同一个块可以在两层之间迁移 */
+static void *hbm_move(void *ptr, size_t size, int to_tier, void *site)
+{
+    size_t old;
+    void *p;
+
+    if (!ptr)
+        return to_tier ? hbm_alloc(size, HBM_ALIGNMENT, 0, site) : malloc(size);
+    if (!hbm_owns(ptr, &old)) {
+        if (!to_tier)
+            return realloc(ptr, size);
+        old = malloc_usable_size(ptr);
+    }
+    if (size == 0) {
+        if (!hbm_release(ptr))
+            free(ptr);
+        return NULL;
+    }
+    p = to_tier ? hbm_alloc(size, HBM_ALIGNMENT, 0, site) : malloc(size);
+    if (!p)
+        return NULL;
+    memcpy(p, ptr, old < size ? old : size);
+    if (!hbm_release(ptr))
+        free(ptr);
+    return p;
+}
+
+/******************************************************************************
+ * 接口
+ ******************************************************************************/
+
+void *hbm_malloc(size_t size)
+{
+    return hbm_alloc(size, HBM_ALIGNMENT, 0, __builtin_return_address(0));
+}
+
+void *hbm_calloc(size_t n, size_t size)
+{
+    if (size && n > SIZE_MAX / size)
+        return NULL;
+    return hbm_alloc(n * size, HBM_ALIGNMENT, 1, __builtin_return_address(0));
+}
+
+void *hbm_aligned_alloc(size_t align, size_t size)
+{
+    if (align == 0 || (align & (align - 1)))
+        return NULL;
+    return hbm_alloc(size, align, 0, __builtin_return_address(0));
+}
+
+int hbm_posix_memalign(void **out, size_t align, size_t size)
+{
+    void *p;
+
+    if (align < sizeof(void *) || (align & (align - 1)))
+        return EINVAL;
+    p = hbm_alloc(size, align, 0, __builtin_return_address(0));
+    if (!p)
+        return ENOMEM;
+    *out = p;
+    return 0;
+}
+
+void *hbm_realloc(void *ptr, size_t size)
+{
+    return hbm_move(ptr, size, 1, __builtin_return_address(0));
+}
+
+void *hbm_dram_realloc(void *ptr, size_t size)
+{
+    return hbm_move(ptr, size, 0, NULL);
+}
+
+void hbm_free(void *ptr)
+{
+    if (ptr && !hbm_release(ptr))
+        free(ptr);
+}
+
+/* C++ 的后备: libstdc++ 的 operator new / delete (LP64 下的修饰名)。弱引用,
+ * 纯 C 程序不必链接 libstdc++; 没有时按 malloc / free 处理 */
+extern void *_Znwm(size_t) __attribute__((weak));
+extern void *_Znam(size_t) __attribute__((weak));
+extern void _ZdlPv(void *) __attribute__((weak));
+extern void _ZdaPv(void *) __attribute__((weak));
+
+void *hbm_new(size_t size)
+{
+    void *p = hbm_alloc(size ? size : 1, HBM_ALIGNMENT, 0, __builtin_return_address(0));
+
+    /* 两层都分配不到时交给 operator new: 调用 new_handler 或抛出 bad_alloc */
+    if (p)
+        return p;
+    if (_Znwm)
+        return _Znwm(size);
+    abort();
+}
+
+void *hbm_new_array(size_t size)
+{
+    void *p = hbm_alloc(size ? size : 1, HBM_ALIGNMENT, 0, __builtin_return_address(0));
+
+    if (p)
+        return p;
+    if (_Znam)
+        return _Znam(size);
+    abort();
+}
+
+void *hbm_new_nothrow(size_t size, const void *tag)
+{
+    (void)tag;
+    return hbm_alloc(size ? size : 1, HBM_ALIGNMENT, 0, __builtin_return_address(0));
+}
+
+void hbm_delete(void *ptr)
+{
+    if (!ptr || hbm_release(ptr))
+        return;
+    if (_ZdlPv)
+        _ZdlPv(ptr);
+    else
+        free(ptr);
+}
+
+void hbm_delete_sized(void *ptr, size_t size)
+{
+    (void)size;
+    hbm_delete(ptr);
+}
+
+void hbm_delete_array(void *ptr)
+{
+    if (!ptr || hbm_release(ptr))
+        return;
+    if (_ZdaPv)
+        _ZdaPv(ptr);
+    else
+        free(ptr);
+}
+
+void hbm_delete_array_sized(void *ptr, size_t size)
+{
+    (void)size;
+    hbm_delete_array(ptr);
+}
+
+int hbm_tier_kind(void)
+{
+    pthread_once(&hbm.once, hbm_init);
+    return hbm.kind;
+}
+
+int hbm_tier_node(void)
+{
+    pthread_once(&hbm.once, hbm_init);
+    return hbm.node;
+}
+
+size_t hbm_tier_capacity(void)
+{
+    pthread_once(&hbm.once, hbm_init);
+    return hbm.capacity;
+}
+
+size_t hbm_tier_used(void)
+{
+    size_t used;
+
+    pthread_mutex_lock(&hbm.lock);
+    used = hbm.used;
+    pthread_mutex_unlock(&hbm.lock);
+    return used;
+}
+
+void hbm_stats_print(FILE *f)
+{
+    static const char *kinds[] = {"off", "node", "sim"};
+    char tier[32];
+
+    pthread_once(&hbm.once, hbm_init);
+    pthread_mutex_lock(&hbm.lock);
+    if (hbm.kind == HBM_TIER_NODE)
+        snprintf(tier, sizeof(tier), "node:%d", hbm.node);
+    else
+        snprintf(tier, sizeof(tier), "%s", kinds[hbm.kind]);
+    fprintf(f, "HBM 运行时: 快速层 %s (%s), 容量 %.1f MiB, 峰值占用 %.1f MiB, 当前 %.1f MiB\n",
+            tier, hbm.source, hbm.capacity / 1048576.0, hbm.peak / 1048576.0, hbm.used / 1048576.0);
+    fprintf(f, "调用点                                       调用   快速层     退回     释放    快速层MiB     DRAM MiB      峰值MiB\n");
+    for (int i = 0; i < HBM_MAX_SITES; i++) {
+        const hbm_site *s = &hbm.sites[i];
+        char name[64];
+        Dl_info info;
+
+        if (!s->addr)
+            continue;
+        if (i == HBM_MAX_SITES - 1 || !dladdr((char *)s->addr - 1, &info))
+            snprintf(name, sizeof(name), i == HBM_MAX_SITES - 1 ? "(其他调用点)" : "%p", s->addr);
+        else if (info.dli_sname)
+            snprintf(name, sizeof(name), "%s+0x%lx", info.dli_sname,
+                     (unsigned long)((char *)s->addr - (char *)info.dli_saddr));
+        else  /* 没有动态符号: 模块内偏移, 可交给 addr2line */
+            snprintf(name, sizeof(name), "%s+0x%lx",
+                     strrchr(info.dli_fname, '/') ? strrchr(info.dli_fname, '/') + 1 : info.dli_fname,
+                     (unsigned long)((char *)s->addr - (char *)info.dli_fbase));
+        fprintf(f, "%-40s %8lu %8lu %8lu %8lu %12.1f %12.1f %12.1f\n", name, s->calls, s->tier_allocs,
+                s->fallbacks, s->frees, s->tier_bytes / 1048576.0, s->dram_bytes / 1048576.0,
+                s->peak_tier / 1048576.0);
+    }
+    pthread_mutex_unlock(&hbm.lock);
+}
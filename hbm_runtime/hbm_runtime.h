@@ -0,0 +1,91 @@
+/******************************************************************************
+ * hbm_runtime.h
+ *
+ * tmp.cpp 中 HBM 放置 Pass 的运行时: Pass 把选中的 malloc / free 改写为
+ * hbm_malloc / hbm_free, 由本库在快速内存层上分配。快速内存层由环境变量
+ * HBM_TIER 选择:
+ *   auto       (默认) 按 sysfs 探测高带宽节点 (与 memkind 的做法类似: 优先用
+ *              HMAT 报告的读带宽, 否则取没有 CPU 的内存节点), 探测不到时用 sim
+ *   node:N     绑定 (mbind) 到 NUMA 节点 N
+ *   sim        模拟层: 普通 DRAM, 只按容量上限计账, 用于没有 HBM 的机器
+ *   off        全部分配在 DRAM, 只做统计, 作为对照
+ * 容量由 HBM_CAPACITY 指定 (可带 K/M/G 后缀), 默认取节点空闲内存, 模拟层默认
+ * 1G (与 Pass 的默认容量一致)。快速层放不下时退回 DRAM, 不报错。
+ *
+ * 每个调用点 (hbm_malloc 的返回地址) 统计分配次数、字节数、退回次数与峰值;
+ * 设置 HBM_STATS=1 (输出到 stderr) 或 HBM_STATS=文件路径 时在进程退出时打印。
+ *
+ * 剖析引导: 先用 -passes=hbm-instrument 编译, 插桩后的程序经 hbm_prof_malloc /
+ * hbm_prof_free 记录每个调用点的大小、生命周期与采样到的访存次数, 退出时写出
+ * 剖析文件 (见 hbm_profile.c); 再以 -hbm-profile=文件 重新编译, Pass 按实测的
+ * 访存密度为最热的调用点打分。
+ *
+ * 编译与链接 (仅 Linux):
+ *   gcc -O2 -fPIC -fexceptions -shared hbm_runtime/hbm_runtime.c hbm_runtime/hbm_profile.c \
+ *       -o libhbm_runtime.so -pthread
+ *   (-fexceptions 让 hbm_new 中 operator new 抛出的 bad_alloc 能穿过本库)
+ *   clang -O2 -fpass-plugin=./MyHBM.so app.c -L. -lhbm_runtime -ldl
+ ******************************************************************************/
+#ifndef HBM_RUNTIME_H
+#define HBM_RUNTIME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    HBM_TIER_OFF,
+    HBM_TIER_NODE,
+    HBM_TIER_SIM
+};
+
+/* Pass 插入的接口, 与 malloc / free 的语义相同; 返回的指针至少 64 字节对齐。
+ * hbm_free 也接受普通 malloc 返回的指针 (按地址范围判断后交给 free) */
+void *hbm_malloc(size_t size);
+void hbm_free(void *ptr);
+
+/* 其余 C 分配函数的对应入口。hbm_realloc 的结果在快速层 (放不下时在 DRAM),
+ * 旧块可以来自任一层; hbm_dram_realloc 的结果在 DRAM, 供没有放入 HBM、却
+ * 可能收到快速层块的 realloc 调用点使用 */
+void *hbm_calloc(size_t n, size_t size);
+void *hbm_realloc(void *ptr, size_t size);
+void *hbm_dram_realloc(void *ptr, size_t size);
+void *hbm_aligned_alloc(size_t align, size_t size);
+int hbm_posix_memalign(void **out, size_t align, size_t size);
+
+/* C++ operator new / new[] / nothrow new 与 delete / delete[] (含带大小的
+ * 版本) 的对应入口; 不是快速层的块交给 libstdc++ 的 operator delete。
+ * hbm_new 在两层都分配失败时调用 operator new, 以抛出 bad_alloc */
+void *hbm_new(size_t size);
+void *hbm_new_array(size_t size);
+void *hbm_new_nothrow(size_t size, const void *tag);
+void hbm_delete(void *ptr);
+void hbm_delete_sized(void *ptr, size_t size);
+void hbm_delete_array(void *ptr);
+void hbm_delete_array_sized(void *ptr, size_t size);
+
+/* hbm-instrument 插入的接口; site 为 Pass 给出的调用点编号。其余分配函数
+ * 的调用保持原样, 分配之后调用 hbm_prof_track, 释放之前调用 hbm_prof_untrack */
+void *hbm_prof_malloc(size_t size, uint64_t site);
+void hbm_prof_free(void *ptr);
+void hbm_prof_track(void *ptr, size_t size, uint64_t site);
+void hbm_prof_untrack(void *ptr);
+
+/* 快速层的类型 (HBM_TIER_*)、节点 (非 node 层为 -1)、容量与当前占用 (字节) */
+int hbm_tier_kind(void);
+int hbm_tier_node(void);
+size_t hbm_tier_capacity(void);
+size_t hbm_tier_used(void);
+
+/* 打印各调用点的统计 */
+void hbm_stats_print(FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HBM_RUNTIME_H */
@@ -1,81 +1,189 @@
 #include <iostream>
-#include <vector>
-#include <chrono>
-#include <arm_neon.h>  // ARM64 NEON 指令
+#include <algorithm>
+#include <cstring>
 #include <omp.h>      // OpenMP 并行化
 
+#include "common/bench_harness.h"
+#include "common/gemm_kernel.hpp"
+#include "common/gemm_options.h"
+#include "common/gemm_tune.hpp"
+#include "common/gemm_verify.h"
+#include "common/perf_counters.h"
+#include "common/matrix.hpp"
+
 using namespace std;
-using namespace std::chrono;
-
-// 矩阵大小和块大小
-const int N = 2048;
-const int BLOCK_SIZE = 64;
-
-// 初始化矩阵
-void initialize_matrices(vector<vector<float>> &A, vector<vector<float>> &B, vector<vector<float>> &C) {
-    #pragma omp parallel for
-    for (int i = 0; i < N; i++) {
-        for (int j = 0; j < N; j++) {
-            A[i][j] = static_cast<float>(rand()) / RAND_MAX;
-            B[i][j] = static_cast<float>(rand()) / RAND_MAX;
-            C[i][j] = 0.0f;
-        }
-    }
+
+// 初始化矩阵: A 为 M x K, B 为 K x N, 由各线程按行原地生成, 同一种子结果与线程数无关
+// C 在构造时已清零
+void initialize_matrices(Matrix<float> &A, Matrix<float> &B, int seed) {
+    matrix_rng_fill(A.data(), A.ld(), A.rows(), A.cols(), 0, 0, seed, MATRIX_RNG_A);
+    matrix_rng_fill(B.data(), B.ld(), B.rows(), B.cols(), 0, 0, seed, MATRIX_RNG_B);
 }
 
-// 使用 NEON 进行矩阵乘法 (C = A * B)
-void matrix_multiplication(const vector<vector<float>> &A, const vector<vector<float>> &B, vector<vector<float>> &C) {
-    #pragma omp parallel for collapse(2)
-    for (int i = 0; i < N; i += BLOCK_SIZE) {
-        for (int j = 0; j < N; j += BLOCK_SIZE) {
-            for (int k = 0; k < N; k += BLOCK_SIZE) {
-                for (int ii = i; ii < i + BLOCK_SIZE; ii++) {
-                    for (int jj = j; jj < j + BLOCK_SIZE; jj++) {
-                        float32x4_t c_vec = vld1q_f32(&C[ii][jj]);
-                        for (int kk = k; kk < k + BLOCK_SIZE; kk += 4) {
-                            float32x4_t a_vec = vld1q_f32(&A[ii][kk]);
-                            float32x4_t b_vec = vld1q_f32(&B[kk][jj]);
-                            c_vec = vmlaq_f32(c_vec, a_vec, b_vec);
-                        }
-                        vst1q_f32(&C[ii][jj], c_vec);
-                    }
-                }
-            }
+// 矩阵乘法 (C += A * B), 由选定的 SIMD 后端执行分块 GEMM
+void matrix_multiplication(const Matrix<float> &A, const Matrix<float> &B, Matrix<float> &C,
+                           const GemmBackend &backend, const GemmBlocking &blocking) {
+    gemm_blocked(backend, A.view(), B.view(), C.view(), blocking);
+}
+
+// 后端一致性检查: 在非方阵、非整块、瘦高/矮胖等形状上对比每个可用后端与双精度参考实现
+int check_backends() {
+    const int shapes[][3] = {{157, 301, 263}, {1, 1, 1}, {1000, 3, 7}, {5, 999, 2}, {64, 64, 1000}};
+    GemmBlocking small;
+    small.mc = 64;
+    small.kc = 100;
+    small.nc = 128;
+
+    int failures = 0;
+    for (const auto &shape : shapes) {
+        const int M = shape[0], Nc = shape[1], K = shape[2];
+        Matrix<float> A(M, K), B(K, Nc);
+        for (int i = 0; i < M; i++)
+            for (int k = 0; k < K; k++)
+                A(i, k) = static_cast<float>(rand()) / RAND_MAX - 0.5f;
+        for (int k = 0; k < K; k++)
+            for (int j = 0; j < Nc; j++)
+                B(k, j) = static_cast<float>(rand()) / RAND_MAX - 0.5f;
+
+        for (const GemmBackend &be : gemm_supported_backends()) {
+            Matrix<float> C(M, Nc);
+            gemm_blocked(be, A.view(), B.view(), C.view(), small);
+
+            gemm_verify_result r = gemm_verify_full(M, Nc, K, A.data(), A.ld(), B.data(), B.ld(), C.data(), C.ld());
+            cout << M << "x" << Nc << "x" << K << " 后端 " << be.name << " (" << be.mr << "x" << be.nr << "): ";
+            gemm_verify_print(&r);
+            failures += !r.passed;
         }
     }
+    return failures == 0 ? 0 : 1;
 }
 
 // 性能测试
-void performance_test() {
+// 返回 0 表示成功 (或未校验), 1 表示校验失败
+// pc 为 nullptr 时不做计数
+int performance_test(const gemm_options &opt, const GemmBackend &backend, const GemmBlocking &blocking,
+                     perf_counters *pc) {
+    const int M = opt.m, N = opt.n, K = opt.k;
+
     // 初始化矩阵
-    vector<vector<float>> A(N, vector<float>(N));
-    vector<vector<float>> B(N, vector<float>(N));
-    vector<vector<float>> C(N, vector<float>(N));
-    initialize_matrices(A, B, C);
-
-    // 开始计时
-    auto start = high_resolution_clock::now();
-    matrix_multiplication(A, B, C);
-    auto end = high_resolution_clock::now();
-
-    // 计算运行时间
-    double duration = duration_cast<duration<double>>(end - start).count();
-    cout << "矩阵乘法运行时间: " << duration << " 秒" << endl;
-
-    // 计算内存带宽
-    double memory_accessed = 3.0 * N * N * sizeof(float);  // A, B, C 矩阵
-    double memory_bandwidth = (memory_accessed / (1024.0 * 1024.0 * 1024.0)) / duration;
-    cout << "内存带宽: " << memory_bandwidth << " GB/s" << endl;
-
-    // 计算 FLOPS
-    double flops = 2.0 * N * N * N / duration;
-    double gflops = flops / (1024.0 * 1024.0 * 1024.0);
-    cout << "浮点运算性能: " << gflops << " GFLOPS" << endl;
-}
+    Matrix<float> A(M, K);
+    Matrix<float> B(K, N);
+    Matrix<float> C(M, N);
+    double t0 = bench_now();
+    initialize_matrices(A, B, opt.seed);
+    cout << "矩阵初始化时间: " << bench_now() - t0 << " 秒 (种子 " << opt.seed << ")" << endl;
+    matrix_pages_log("A", A.data(), A.size_bytes());
+    matrix_pages_log("B", B.data(), B.size_bytes());
+    matrix_pages_log("C", C.data(), C.size_bytes());
+
+    // 预热 + 重复计时; 每次计时前把 C 清零 (不计入时间), 使校验对应单次乘法
+    // 硬件计数只覆盖计时的运行, 不含预热
+    struct Run {
+        const Matrix<float> *A, *B;
+        Matrix<float> *C;
+        const GemmBackend *backend;
+        const GemmBlocking *blocking;
+        perf_counters *pc;
+        perf_region region;
+        int calls, warmup;
+        double flops, bytes;
+    } run = {&A, &B, &C, &backend, &blocking, pc, {"gemm", 0, {0}, 0.0, 0.0, 0.0}, 0, opt.bench.warmup, 0.0, 0.0};
+    bench_result result = {};
+    result.name = "matmul_arm64";
+    result.flops = run.flops = 2.0 * M * N * K;
+    run.bytes = (1.0 * M * K + 1.0 * K * N + 1.0 * M * N) * sizeof(float);  // A, B, C 矩阵
+    result.bytes = run.bytes;
+    bench_run(&opt.bench, nullptr,
+              [](void *ctx) {
+                  Run *r = static_cast<Run *>(ctx);
+                  std::memset(r->C->data(), 0, r->C->size_bytes());
+              },
+              [](void *ctx) {
+                  Run *r = static_cast<Run *>(ctx);
+                  perf_counters *pc = r->calls++ >= r->warmup ? r->pc : nullptr;
+                  perf_region_begin(pc);
+                  double t0 = bench_now();
+                  matrix_multiplication(*r->A, *r->B, *r->C, *r->backend, *r->blocking);
+                  perf_region_end(pc, &r->region, bench_now() - t0, r->flops, r->bytes);
+              },
+              &run, &result);
+
+    bench_param_str(&result, "backend", backend.name);
+    bench_param_int(&result, "m", M);
+    bench_param_int(&result, "n", N);
+    bench_param_int(&result, "k", K);
+    bench_param_int(&result, "mc", blocking.mc);
+    bench_param_int(&result, "kc", blocking.kc);
+    bench_param_int(&result, "nc", blocking.nc);
+    bench_param_int(&result, "threads", omp_get_max_threads());
+    bench_param_str(&result, "pages", matrix_pages_name(opt.pages));
+    bench_param_int(&result, "seed", opt.seed);
+    // dTLB 读缺失随计时一并输出, 用于比较不同页面类型
+    double dtlb = perf_region_avg(pc, &run.region, PERF_EV_DTLB_MISS);
+    if (dtlb >= 0.0) {
+        bench_param_int(&result, "dtlb_misses", static_cast<long>(dtlb));
+    }
+    bench_report(&opt.bench, &result);
+    if (dtlb >= 0.0) {
+        cout << "dTLB 读缺失: " << dtlb << " 次/运行, " << dtlb / (2.0 * M * N * K) * 1e6
+             << " 次/百万 FLOP (页面: " << matrix_pages_name(opt.pages) << ")" << endl;
+    }
+    perf_report(pc, &run.region, 1);
 
-int main() {
-    cout << "矩阵大小: " << N << " x " << N << endl;
-    cout << "块大小: " << BLOCK_SIZE << endl;
-    performance_test();
+    // 校验结果
+    if (opt.verify_mode != GEMM_VERIFY_OFF) {
+        gemm_verify_result r = gemm_verify(opt.verify_mode, M, N, K, A.data(), A.ld(), B.data(), B.ld(), C.data(), C.ld());
+        gemm_verify_print(&r);
+        return r.passed ? 0 : 1;
+    }
     return 0;
 }
+
+int main(int argc, char *argv[]) {
+    gemm_options opt;
+    gemm_options_init(&opt);
+    if (gemm_options_parse(&opt, argc, argv) != 0) {
+        gemm_options_usage(argv[0], opt.modes);
+        return 1;
+    }
+    matrix_set_pages(opt.pages);
+    if (opt.check_backends) {
+        return check_backends();
+    }
+
+    // 计数器需在第一个 OpenMP 并行区之前打开, 之后创建的线程才会被计入
+    perf_counters counters;
+    perf_counters *pc = nullptr;
+    if (opt.perf && perf_counters_open(&counters) > 0) {
+        pc = &counters;
+    }
+
+    const GemmBackend *backend = opt.backend ? gemm_find_backend(opt.backend) : &gemm_detect_backend();
+    if (!backend) {
+        cout << "错误: 后端 " << opt.backend << " 未编译或当前 CPU 不支持" << endl;
+        return 1;
+    }
+
+    // 自动调优: 扫描分块参数, 写入调优文件后继续用最优参数测试
+    if (opt.autotune) {
+        double gflops = 0.0;
+        GemmBlocking best = gemm_autotune(*backend, opt.m, opt.n, opt.k, &gflops);
+        cout << "最优分块 MC/KC/NC: " << best.mc << "/" << best.kc << "/" << best.nc
+             << " (" << gflops << " GFLOPS)" << endl;
+        if (!gemm_tune_save(opt.tune_file, *backend, best, gflops)) {
+            cout << "警告: 无法写入调优文件 " << opt.tune_file << endl;
+        }
+    }
+
+    const char *source = nullptr;
+    GemmBlocking blocking = gemm_resolve_blocking(*backend, opt, &source);
+    cout << "矩阵大小: M=" << opt.m << ", N=" << opt.n << ", K=" << opt.k << endl;
+    cout << "后端: " << backend->name << ", 微内核: " << backend->mr << " x " << backend->nr
+         << ", 分块 MC/KC/NC: " << blocking.mc << "/" << blocking.kc << "/" << blocking.nc
+         << " (来源: " << source << ")" << endl;
+    int ret = performance_test(opt, *backend, blocking, pc);
+    if (pc) {
+        perf_counters_close(pc);
+    }
+    return ret;
+}
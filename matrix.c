@@ -3,111 +3,652 @@
 #include <mpi.h>
 #include <time.h>
 
-#define N 2048  // 矩阵大小 N x N
+#include "common/bench_harness.h"
+#include "common/gemm_mpi.h"
+#include "common/gemm_options.h"
+#include "common/gemm_verify.h"
+#include "common/matrix_layout.h"
 
-// 初始化矩阵
-void initialize_matrix(float *matrix) {
-    for (int i = 0; i < N; i++) {
-        for (int j = 0; j < N; j++) {
-            matrix[i * N + j] = (float)(rand()) / RAND_MAX;
-        }
-    }
+// 原地生成矩阵 id 中从全局第 row0 行开始的行块 (matrix_rng.h), 结果与进程数无关
+void initialize_matrix(const gemm_options *opt, matrix_f32 *matrix, int row0, int id) {
+    matrix_rng_fill(matrix->data, matrix->ld, matrix->rows, matrix->cols, row0, 0, opt->seed, id);
+}
+
+// 各进程原地生成本地数据的时间, 返回所有进程中的最大值 (仅进程 0 上有效)
+double max_init_time(double seconds) {
+    double worst = 0.0;
+    MPI_Reduce(&seconds, &worst, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    return worst;
 }
 
 // 矩阵乘法 C = A * B
-void matrix_multiplication(float *A, float *B, float *C, int start_row, int end_row) {
+void matrix_multiplication(const matrix_f32 *A, const matrix_f32 *B, matrix_f32 *C, int start_row, int end_row) {
     for (int i = start_row; i < end_row; i++) {
-        for (int j = 0; j < N; j++) {
+        for (int j = 0; j < B->cols; j++) {
             float sum = 0.0f;
-            for (int k = 0; k < N; k++) {
-                sum += A[i * N + k] * B[k * N + j];
+            for (int k = 0; k < A->cols; k++) {
+                sum += MAT_AT(*A, i, k) * MAT_AT(*B, k, j);
+            }
+            MAT_AT(*C, i - start_row, j) = sum;
+        }
+    }
+}
+
+// 在进程 0 上校验完整结果, 并把结果广播给所有进程作为退出码
+int verify_on_root(const gemm_options *opt, int rank, matrix_f32 *A, matrix_f32 *B, matrix_f32 *C) {
+    int failed = 0;
+    if (opt->verify_mode != GEMM_VERIFY_OFF) {
+        if (rank == 0) {
+            gemm_verify_result r = gemm_verify(opt->verify_mode, opt->m, opt->n, opt->k,
+                                               A->data, A->ld, B->data, B->ld, C->data, C->ld);
+            gemm_verify_print(&r);
+            failed = !r.passed;
+        }
+        MPI_Bcast(&failed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    }
+    return failed;
+}
+
+// 进程 0 打印并写出计时结果; dtlb 为 gemm_mpi_dtlb 的汇总 (未计数时为 -1)
+void report_result(const gemm_options *opt, int size, bench_result *result, const char *name,
+                   double dtlb, double dtlb_worst) {
+    result->name = name;
+    result->flops = 2.0 * opt->m * opt->n * opt->k;
+    result->bytes = (1.0 * opt->m * opt->k + 1.0 * opt->k * opt->n + 1.0 * opt->m * opt->n) * sizeof(float);
+    bench_param_int(result, "m", opt->m);
+    bench_param_int(result, "n", opt->n);
+    bench_param_int(result, "k", opt->k);
+    bench_param_int(result, "procs", size);
+    if (opt->mode != GEMM_MODE_1D) {
+        bench_param_int(result, "nb", opt->nb);
+    }
+    bench_param_str(result, "pages", matrix_pages_name(opt->pages));
+    bench_param_int(result, "seed", opt->seed);
+    // dTLB 读缺失随计时一并输出, 用于比较不同页面类型
+    if (dtlb >= 0.0) {
+        bench_param_int(result, "dtlb_misses", (long)dtlb);
+    }
+    bench_report(&opt->bench, result);
+    gemm_mpi_dtlb_print(dtlb, dtlb_worst, result->flops, opt->pages);
+}
+
+// --perf 时汇总各进程的 dTLB 读缺失, 所有进程都须调用
+double reduce_dtlb(const gemm_options *opt, const gemm_mpi_probe *probe, double *worst) {
+    *worst = 0.0;
+    return opt->perf ? gemm_mpi_dtlb(probe, worst, MPI_COMM_WORLD) : -1.0;
+}
+
+// 进程 0 打印本地三个矩阵实际得到的页面 (指定 --pages 时)
+void report_pages(const matrix_f32 *A, const matrix_f32 *B, const matrix_f32 *C) {
+    matrix_pages_log("A", A->data, matrix_f32_elems(A) * sizeof(float));
+    matrix_pages_log("B", B->data, matrix_f32_elems(B) * sizeof(float));
+    matrix_pages_log("C", C->data, matrix_f32_elems(C) * sizeof(float));
+}
+
+// 1D 模式的本地乘法
+typedef struct {
+    matrix_f32 *A_part, *B, *C_part;
+    int local_rows;
+    gemm_mpi_probe probe;
+} local_ctx;
+
+void local_iteration(void *arg) {
+    local_ctx *c = (local_ctx *)arg;
+    perf_counters *pc = gemm_mpi_probe_begin(&c->probe);
+    matrix_multiplication(c->A_part, c->B, c->C_part, 0, c->local_rows);
+    gemm_mpi_probe_end(&c->probe, pc);
+}
+
+// SUMMA 主循环, 面板的内存与通信量只在第一次运行时统计
+typedef struct {
+    summa_grid *grid;
+    int K;
+    matrix_f32 *A_loc, *B_loc, *C_loc;
+    gemm_mpi_stats *stats;
+    gemm_mpi_probe probe;
+} summa_ctx;
+
+void summa_reset(void *arg) {
+    summa_ctx *c = (summa_ctx *)arg;
+    memset(c->C_loc->data, 0, matrix_f32_elems(c->C_loc) * sizeof(float));
+}
+
+void summa_iteration(void *arg) {
+    summa_ctx *c = (summa_ctx *)arg;
+    perf_counters *pc = gemm_mpi_probe_begin(&c->probe);
+    summa_multiply(c->grid, c->K, c->A_loc, c->B_loc, c->C_loc, gemm_local_naive, c->stats);
+    gemm_mpi_probe_end(&c->probe, pc);
+    c->stats = NULL;
+}
+
+// 2D SUMMA 模式: A、B、C 在二维进程网格上块循环分布
+int run_summa(const gemm_options *opt, int rank, perf_counters *pc) {
+    const int M = opt->m, N = opt->n, K = opt->k;
+    double start_time, init_time, gather_time;
+    summa_grid grid;
+    matrix_f32 A = {0}, B = {0}, C_final = {0}, A_loc = {0}, B_loc = {0}, C_loc = {0};
+    gemm_mpi_stats stats = {0.0, 0.0, 0.0};
+
+    summa_grid_create(&grid, MPI_COMM_WORLD, opt->nb);
+
+    // 进程 0 持有完整的 C 用于收集; 校验时用同一种子重新生成完整的 A 和 B
+    if (rank == 0) {
+        if (matrix_f32_alloc(&C_final, M, N, MATRIX_PAD_AUTO) != 0 ||
+            (opt->verify_mode != GEMM_VERIFY_OFF &&
+             (matrix_f32_alloc(&A, M, K, MATRIX_PAD_AUTO) != 0 ||
+              matrix_f32_alloc(&B, K, N, MATRIX_PAD_AUTO) != 0))) {
+            printf("错误: 进程 0 内存分配失败\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        if (opt->verify_mode != GEMM_VERIFY_OFF) {
+            initialize_matrix(opt, &A, 0, MATRIX_RNG_A);
+            initialize_matrix(opt, &B, 0, MATRIX_RNG_B);
+        }
+        printf("SUMMA 进程网格: %d x %d, 块大小: %d\n", grid.nprow, grid.npcol, grid.nb);
+    }
+
+    if (summa_local_alloc(&grid, &A_loc, M, K, grid.myrow, grid.mycol) != 0 ||
+        summa_local_alloc(&grid, &B_loc, K, N, grid.myrow, grid.mycol) != 0 ||
+        summa_local_alloc(&grid, &C_loc, M, N, grid.myrow, grid.mycol) != 0) {
+        printf("错误: 进程 %d 内存分配失败\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    stats.mem_bytes = (double)(matrix_f32_elems(&A_loc) + matrix_f32_elems(&B_loc) +
+                               matrix_f32_elems(&C_loc)) * sizeof(float);
+
+    // 各进程按块循环分布原地生成本地块, 不需要从进程 0 分发
+    start_time = MPI_Wtime();
+    summa_rng_fill(&grid, &A_loc, opt->seed, MATRIX_RNG_A);
+    summa_rng_fill(&grid, &B_loc, opt->seed, MATRIX_RNG_B);
+    init_time = max_init_time(MPI_Wtime() - start_time);
+
+    // 计算时间包含面板广播, 取所有进程中的最大值
+    MPI_Comm comm = MPI_COMM_WORLD;
+    bench_sync sync = bench_mpi_sync(&comm);
+    summa_ctx ctx = {&grid, K, &A_loc, &B_loc, &C_loc, &stats,
+                     gemm_mpi_probe_init(pc, "summa", opt->bench.warmup)};
+    bench_result result = {0};
+    bench_run(&opt->bench, &sync, summa_reset, summa_iteration, &ctx, &result);
+    double dtlb_worst, dtlb = reduce_dtlb(opt, &ctx.probe, &dtlb_worst);
+
+    start_time = MPI_Wtime();
+    summa_gather(&grid, &C_final, &C_loc, M, N, &stats);
+    gather_time = MPI_Wtime() - start_time;
+
+    if (rank == 0) {
+        printf("矩阵初始化时间: %.3f 秒 (各进程原地生成)\n", init_time);
+        printf("结果收集时间: %.3f 秒\n", gather_time);
+        report_result(opt, grid.nprow * grid.npcol, &result, "matrix_summa", dtlb, dtlb_worst);
+        report_pages(&A_loc, &B_loc, &C_loc);
+    }
+    gemm_mpi_report(&stats, MPI_COMM_WORLD);
+
+    int failed = verify_on_root(opt, rank, &A, &B, &C_final);
+
+    matrix_f32_free(&A_loc);
+    matrix_f32_free(&B_loc);
+    matrix_f32_free(&C_loc);
+    if (rank == 0) {
+        matrix_f32_free(&A);
+        matrix_f32_free(&B);
+        matrix_f32_free(&C_final);
+    }
+    summa_grid_free(&grid);
+    return failed;
+}
+
+// 计算 C 的行 [row0, row1)、列 [col0, col1), A 与 C 的行号一致
+void matrix_multiplication_panel(const matrix_f32 *A, const matrix_f32 *B, matrix_f32 *C,
+                                 int row0, int row1, int col0, int col1) {
+    for (int i = row0; i < row1; i++) {
+        for (int j = col0; j < col1; j++) {
+            float sum = 0.0f;
+            for (int k = 0; k < A->cols; k++) {
+                sum += MAT_AT(*A, i, k) * MAT_AT(*B, k, j);
+            }
+            MAT_AT(*C, i, j) = sum;
+        }
+    }
+}
+
+/******************************************************************************
+ * 流水线模式: 计算与通信重叠
+ *
+ * B 按列切成宽度为 nb 的面板, 计算面板 p 时面板 p+1 的 MPI_Ibcast 已在传输;
+ * A 的行块用 MPI_Iscatterv 与第一个面板同时发出; 每算完一个面板就用 MPI_Isend
+ * 把本地 C 的对应列送回进程 0 (进程 0 预先为所有面板投递 MPI_Irecv)。
+ * 计算按行分段, 段间 MPI_Test 推动未完成的请求, 否则多数 MPI 实现只在 Wait 时才推进传输。
+ *
+ * 每个请求记录投递和完成时刻, 通信活跃时间取这些区间的并集:
+ *   暴露通信 = 阻塞在 MPI_Wait 中的时间
+ *   隐藏通信 = 通信活跃时间 - 暴露通信, 即被计算掩盖的部分
+ ******************************************************************************/
+
+#define PIPE_POLL_ROWS 8   // 每计算多少行检查一次通信进度
+
+typedef struct {
+    MPI_Request req;
+    double t_post;   // < 0 表示未使用
+    double t_done;
+} pipe_req;
+
+void pipe_posted(pipe_req *r) {
+    r->t_post = MPI_Wtime();
+    r->t_done = r->t_post;
+}
+
+// 非阻塞地检查所有未完成的请求, 顺带推动 MPI 进度
+void pipe_poll(pipe_req *reqs, int n) {
+    for (int i = 0; i < n; i++) {
+        if (reqs[i].req != MPI_REQUEST_NULL) {
+            int flag;
+            MPI_Test(&reqs[i].req, &flag, MPI_STATUS_IGNORE);
+            if (flag) {
+                reqs[i].t_done = MPI_Wtime();
+            }
+        }
+    }
+}
+
+// 等待请求完成, 返回阻塞时间 (暴露的通信时间)
+double pipe_wait(pipe_req *reqs, int n) {
+    double t0 = MPI_Wtime();
+    for (int i = 0; i < n; i++) {
+        if (reqs[i].req != MPI_REQUEST_NULL) {
+            MPI_Wait(&reqs[i].req, MPI_STATUS_IGNORE);
+            reqs[i].t_done = MPI_Wtime();
+        }
+    }
+    return MPI_Wtime() - t0;
+}
+
+int pipe_cmp_post(const void *a, const void *b) {
+    double x = ((const pipe_req *)a)->t_post, y = ((const pipe_req *)b)->t_post;
+    return (x > y) - (x < y);
+}
+
+// 所有已使用请求的 [投递, 完成] 区间的并集长度 (会对数组排序)
+double pipe_active_time(pipe_req *reqs, int n) {
+    double total = 0.0, lo = 0.0, hi = 0.0;
+    int open = 0;
+    qsort(reqs, n, sizeof(pipe_req), pipe_cmp_post);
+    for (int i = 0; i < n; i++) {
+        if (reqs[i].t_post < 0.0) {
+            continue;
+        }
+        if (!open || reqs[i].t_post > hi) {
+            total += hi - lo;
+            lo = reqs[i].t_post;
+            hi = reqs[i].t_done;
+            open = 1;
+        } else if (reqs[i].t_done > hi) {
+            hi = reqs[i].t_done;
+        }
+    }
+    return total + hi - lo;
+}
+
+// 行跨度为 ld 的一整行 (含填充); 按行计数与偏移, N 很大时元素个数也不会超出 int
+MPI_Datatype matrix_row_type(size_t ld) {
+    MPI_Datatype t;
+    MPI_Type_contiguous((int)ld, MPI_FLOAT, &t);
+    MPI_Type_commit(&t);
+    return t;
+}
+
+// 行跨度为 ld 的 rows x cols 子矩阵对应的派生数据类型
+MPI_Datatype pipe_block_type(int rows, int cols, size_t ld) {
+    MPI_Datatype t;
+    MPI_Type_vector(rows, cols, (int)ld, MPI_FLOAT, &t);
+    MPI_Type_commit(&t);
+    return t;
+}
+
+// 一次流水线运行所需的全部状态, 供 bench_run 重复调用
+typedef struct {
+    int M, N, K, rank, size, width, npanels, local_rows;
+    matrix_f32 *A, *B, *C_final, *A_part, *C_part;
+    int *a_counts, *a_displs;                         // 单位: 行 (a_row)
+    MPI_Datatype a_row;
+    pipe_req *reqs;
+    int n_send, n_reqs;
+    int calls, warmup;                                // 预热的运行不计入下面的分解
+    double compute_time, exposed_time, hidden_time;   // 计时运行的累计值
+    gemm_mpi_probe probe;                             // 计数整个流水线 (含通信)
+} pipe_ctx;
+
+void pipe_reset(void *arg) {
+    pipe_ctx *c = (pipe_ctx *)arg;
+    for (int i = 0; i < c->n_reqs; i++) {
+        c->reqs[i].req = MPI_REQUEST_NULL;
+        c->reqs[i].t_post = -1.0;
+        c->reqs[i].t_done = -1.0;
+    }
+}
+
+// 分发 A、流水线广播 B 面板、计算并回传 C 面板
+void pipe_iteration(void *arg) {
+    pipe_ctx *c = (pipe_ctx *)arg;
+    const int M = c->M, N = c->N, K = c->K, size = c->size, width = c->width, npanels = c->npanels;
+    const int local_rows = c->local_rows;
+    pipe_req *reqs = c->reqs;
+    pipe_req *a_req = reqs, *b_req = reqs + 1, *c_send = reqs + 1 + npanels, *c_recv = reqs + c->n_send;
+    double compute_time = 0.0, exposed_time = 0.0;
+    perf_counters *pc = gemm_mpi_probe_begin(&c->probe);
+
+    // 进程 0 先为所有面板投递接收, C 面板到达时直接写入 C_final
+    if (c->rank == 0) {
+        for (int p = 0; p < npanels; p++) {
+            int col0 = p * width, cols = N - col0 < width ? N - col0 : width;
+            for (int r = 0; r < size; r++) {
+                int rows = gemm_rows_of(M, size, r);
+                if (rows == 0) {
+                    continue;
+                }
+                MPI_Datatype t = pipe_block_type(rows, cols, c->C_final->ld);
+                MPI_Irecv(&MAT_AT(*c->C_final, gemm_row_start(M, size, r), col0), 1, t, r, p,
+                          MPI_COMM_WORLD, &c_recv[p * size + r].req);
+                pipe_posted(&c_recv[p * size + r]);
+                MPI_Type_free(&t);  // 类型在挂起的操作完成后才真正释放
             }
-            C[(i - start_row) * N + j] = sum;
         }
     }
+
+    MPI_Iscatterv(c->A->data, c->a_counts, c->a_displs, c->a_row,
+                  c->A_part->data, c->a_counts[c->rank], c->a_row, 0, MPI_COMM_WORLD, &a_req->req);
+    pipe_posted(a_req);
+
+    for (int p = 0; p <= npanels; p++) {
+        // 投递面板 p 的广播 (前一轮计算期间已投递的面板 p 在这里等待)
+        if (p < npanels) {
+            int col0 = p * width, cols = N - col0 < width ? N - col0 : width;
+            MPI_Datatype t = pipe_block_type(K, cols, c->B->ld);
+            MPI_Ibcast(&MAT_AT(*c->B, 0, col0), 1, t, 0, MPI_COMM_WORLD, &b_req[p].req);
+            pipe_posted(&b_req[p]);
+            MPI_Type_free(&t);
+        }
+        if (p == 0) {
+            continue;
+        }
+
+        // 计算面板 q = p - 1, 此时面板 p 的广播在后台传输
+        int q = p - 1;
+        int col0 = q * width, cols = N - col0 < width ? N - col0 : width;
+        exposed_time += pipe_wait(a_req, 1);
+        exposed_time += pipe_wait(&b_req[q], 1);
+
+        double t0 = MPI_Wtime();
+        for (int i = 0; i < local_rows; i += PIPE_POLL_ROWS) {
+            int i1 = i + PIPE_POLL_ROWS < local_rows ? i + PIPE_POLL_ROWS : local_rows;
+            matrix_multiplication_panel(c->A_part, c->B, c->C_part, i, i1, col0, col0 + cols);
+            pipe_poll(reqs, c->n_reqs);
+        }
+        compute_time += MPI_Wtime() - t0;
+
+        if (local_rows > 0) {
+            MPI_Datatype t = pipe_block_type(local_rows, cols, c->C_part->ld);
+            MPI_Isend(&MAT_AT(*c->C_part, 0, col0), 1, t, 0, q, MPI_COMM_WORLD, &c_send[q].req);
+            pipe_posted(&c_send[q]);
+            MPI_Type_free(&t);
+        }
+    }
+
+    // 收尾: 剩余的 C 面板发送与接收
+    exposed_time += pipe_wait(reqs, c->n_reqs);
+    gemm_mpi_probe_end(&c->probe, pc);
+
+    // 进程 0 预先投递的接收在整个计算期间挂起, 不代表数据在传输, 不计入活跃时间
+    double comm_time = pipe_active_time(reqs, c->n_send);
+    if (c->calls++ >= c->warmup) {
+        c->compute_time += compute_time;
+        c->exposed_time += exposed_time;
+        c->hidden_time += comm_time > exposed_time ? comm_time - exposed_time : 0.0;
+    }
+}
+
+int run_pipeline(const gemm_options *opt, int rank, int size, perf_counters *pc) {
+    const int M = opt->m, N = opt->n, K = opt->k;
+    const int width = opt->nb < N ? opt->nb : N;
+    const int npanels = (N + width - 1) / width;
+    const int local_rows = gemm_rows_of(M, size, rank);
+    double start_time, init_time = 0.0;
+    matrix_f32 A = {0}, B = {0}, C_final = {0}, A_part = {0}, C_part = {0};
+
+    if (matrix_f32_alloc(&B, K, N, MATRIX_PAD_AUTO) != 0 ||
+        matrix_f32_alloc(&A_part, local_rows, K, MATRIX_PAD_AUTO) != 0 ||
+        matrix_f32_alloc(&C_part, local_rows, N, MATRIX_PAD_AUTO) != 0) {
+        printf("错误: 进程 %d 内存分配失败\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    int *a_counts = (int *)malloc(size * sizeof(int));
+    int *a_displs = (int *)malloc(size * sizeof(int));
+    for (int r = 0; r < size; r++) {
+        a_counts[r] = gemm_rows_of(M, size, r);
+        a_displs[r] = gemm_row_start(M, size, r);
+    }
+
+    if (rank == 0) {
+        if (matrix_f32_alloc(&A, M, K, MATRIX_PAD_AUTO) != 0 ||
+            matrix_f32_alloc(&C_final, M, N, MATRIX_PAD_AUTO) != 0) {
+            printf("错误: 进程 0 内存分配失败\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        start_time = MPI_Wtime();
+        initialize_matrix(opt, &A, 0, MATRIX_RNG_A);
+        initialize_matrix(opt, &B, 0, MATRIX_RNG_B);
+        init_time = MPI_Wtime() - start_time;
+        printf("流水线模式: B 列面板 %d 个, 面板宽度 %d\n", npanels, width);
+        printf("矩阵初始化时间: %.3f 秒\n", init_time);
+    }
+
+    // 请求表: [0] A 的分发, [1, npanels] B 面板广播, 其后是 C 面板的发送, 进程 0 还有接收
+    pipe_ctx ctx = {0};
+    ctx.M = M;
+    ctx.N = N;
+    ctx.K = K;
+    ctx.rank = rank;
+    ctx.size = size;
+    ctx.width = width;
+    ctx.npanels = npanels;
+    ctx.local_rows = local_rows;
+    ctx.A = &A;
+    ctx.B = &B;
+    ctx.C_final = &C_final;
+    ctx.A_part = &A_part;
+    ctx.C_part = &C_part;
+    ctx.a_counts = a_counts;
+    ctx.a_displs = a_displs;
+    ctx.a_row = matrix_row_type(A_part.ld);
+    ctx.n_send = 1 + 2 * npanels;
+    ctx.n_reqs = ctx.n_send + (rank == 0 ? npanels * size : 0);
+    ctx.reqs = (pipe_req *)malloc(ctx.n_reqs * sizeof(pipe_req));
+    ctx.warmup = opt->bench.warmup;
+    ctx.probe = gemm_mpi_probe_init(pc, "pipeline", opt->bench.warmup);
+
+    // 计时覆盖分发、计算与收集的整个流水线
+    MPI_Comm comm = MPI_COMM_WORLD;
+    bench_sync sync = bench_mpi_sync(&comm);
+    bench_result result = {0};
+    bench_run(&opt->bench, &sync, pipe_reset, pipe_iteration, &ctx, &result);
+
+    // 分解项取每次运行的平均值, 再取所有进程中的最大值
+    double mine[3] = {ctx.compute_time / result.reps, ctx.exposed_time / result.reps,
+                      ctx.hidden_time / result.reps}, worst[3];
+    MPI_Reduce(mine, worst, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    double dtlb_worst, dtlb = reduce_dtlb(opt, &ctx.probe, &dtlb_worst);
+    if (rank == 0) {
+        report_result(opt, size, &result, "matrix_pipeline", dtlb, dtlb_worst);
+        report_pages(&A_part, &B, &C_part);
+        printf("矩阵乘法计算时间: %.3f 秒\n", worst[0]);
+        printf("暴露通信时间: %.3f 秒\n", worst[1]);
+        printf("隐藏通信时间: %.3f 秒\n", worst[2]);
+        if (worst[1] + worst[2] > 0.0) {
+            printf("通信隐藏比例: %.1f%%\n", 100.0 * worst[2] / (worst[1] + worst[2]));
+        }
+    }
+
+    // A 的行块在计算前分发, B 面板和 C 面板都在计算期间传输
+    gemm_mpi_stats stats = {0.0, 0.0, 0.0};
+    stats.mem_bytes = (double)(matrix_f32_elems(&B) + matrix_f32_elems(&A_part) +
+                               matrix_f32_elems(&C_part)) * sizeof(float);
+    stats.dist_bytes = (double)matrix_f32_elems(&A_part) * sizeof(float);
+    stats.compute_bytes = (double)(matrix_f32_elems(&B) + matrix_f32_elems(&C_part)) * sizeof(float);
+    gemm_mpi_report(&stats, MPI_COMM_WORLD);
+
+    int failed = verify_on_root(opt, rank, &A, &B, &C_final);
+
+    free(ctx.reqs);
+    MPI_Type_free(&ctx.a_row);
+    free(a_counts);
+    free(a_displs);
+    matrix_f32_free(&B);
+    matrix_f32_free(&A_part);
+    matrix_f32_free(&C_part);
+    if (rank == 0) {
+        matrix_f32_free(&A);
+        matrix_f32_free(&C_final);
+    }
+    return failed;
 }
 
 int main(int argc, char *argv[]) {
     int rank, size;
     double start_time, end_time;
-    double init_time, compute_time, gather_time;
+    double init_time, gather_time;
 
     // 初始化 MPI 环境
     MPI_Init(&argc, &argv);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-    // 检查矩阵行数是否能被进程数整除
-    if (N % size != 0) {
+    // 解析参数: 问题规模 --m/--n/--k/--size, --verify[=full|freivalds] 在进程 0 上校验结果
+    gemm_options opt;
+    gemm_options_init(&opt);
+    opt.modes = "1d|summa|pipeline";
+    if (gemm_options_parse(&opt, argc, argv) != 0) {
         if (rank == 0) {
-            printf("错误: 矩阵行数 %d 无法被进程数 %d 整除\n", N, size);
+            gemm_options_usage(argv[0], opt.modes);
         }
         MPI_Finalize();
         return -1;
     }
+    const int M = opt.m, N = opt.n, K = opt.k;
+    matrix_set_pages(opt.pages);
 
-    int rows_per_process = N / size;
+    // --perf: 计数器须在第一个 OpenMP 并行区 (矩阵生成) 之前打开
+    perf_counters counters;
+    perf_counters *pc = NULL;
+    if (opt.perf && perf_counters_open(&counters) > 0) {
+        pc = &counters;
+    }
 
-    // 分配内存
-    float *A = NULL;
-    float *B = (float *)malloc(N * N * sizeof(float));
-    float *C = NULL;
-    float *C_final = NULL;
-    float *A_part = (float *)malloc(rows_per_process * N * sizeof(float));
-    float *C_part = (float *)malloc(rows_per_process * N * sizeof(float));
+    if (opt.mode == GEMM_MODE_SUMMA) {
+        int failed = run_summa(&opt, rank, pc);
+        if (pc) {
+            perf_counters_close(pc);
+        }
+        MPI_Finalize();
+        return failed;
+    }
+    if (opt.mode == GEMM_MODE_PIPELINE) {
+        int failed = run_pipeline(&opt, rank, size, pc);
+        if (pc) {
+            perf_counters_close(pc);
+        }
+        MPI_Finalize();
+        return failed;
+    }
 
-    // 进程 0 初始化矩阵 A 和 B
-    if (rank == 0) {
-        A = (float *)malloc(N * N * sizeof(float));
-        C_final = (float *)malloc(N * N * sizeof(float));
-        
-        start_time = MPI_Wtime();
-        initialize_matrix(A);
-        initialize_matrix(B);
-        end_time = MPI_Wtime();
-        init_time = end_time - start_time;
+    // 1D 行划分: 行数不能被进程数整除时前 M % size 个进程多分一行
+    int local_rows = gemm_rows_of(M, size, rank);
+
+    // 分配内存: 每个矩阵一次对齐分配, 行跨度按 matrix_layout.h 的规则填充
+    matrix_f32 A = {0}, B, C_final = {0}, A_part, C_part;
+    if (matrix_f32_alloc(&B, K, N, MATRIX_PAD_AUTO) != 0 ||
+        matrix_f32_alloc(&A_part, local_rows, K, MATRIX_PAD_AUTO) != 0 ||
+        matrix_f32_alloc(&C_part, local_rows, N, MATRIX_PAD_AUTO) != 0) {
+        printf("错误: 进程 %d 内存分配失败\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
 
-    // 广播 B 给所有进程
-    MPI_Bcast(B, N * N, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    // 各进程的 C 行块在完整矩阵中的行数与起始行, 供 Gatherv 按整行 (含填充) 收集
+    int *c_counts = (int *)malloc(size * sizeof(int));
+    int *c_displs = (int *)malloc(size * sizeof(int));
+    MPI_Datatype c_row = matrix_row_type(C_part.ld);
+    for (int r = 0; r < size; r++) {
+        c_counts[r] = gemm_rows_of(M, size, r);
+        c_displs[r] = gemm_row_start(M, size, r);
+    }
 
-    // 进程 0 分发 A 的部分数据
-    MPI_Scatter(A, rows_per_process * N, MPI_FLOAT,
-                A_part, rows_per_process * N, MPI_FLOAT,
-                0, MPI_COMM_WORLD);
+    // 每个进程原地生成完整的 B 和自己的 A 行块, 不再广播 B、分发 A
+    start_time = MPI_Wtime();
+    initialize_matrix(&opt, &B, 0, MATRIX_RNG_B);
+    initialize_matrix(&opt, &A_part, gemm_row_start(M, size, rank), MATRIX_RNG_A);
+    init_time = max_init_time(MPI_Wtime() - start_time);
+
+    // 进程 0 持有完整的 C 用于收集; 校验时用同一种子重新生成完整的 A
+    if (rank == 0) {
+        if (matrix_f32_alloc(&C_final, M, N, MATRIX_PAD_AUTO) != 0 ||
+            (opt.verify_mode != GEMM_VERIFY_OFF && matrix_f32_alloc(&A, M, K, MATRIX_PAD_AUTO) != 0)) {
+            printf("错误: 进程 0 内存分配失败\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        if (opt.verify_mode != GEMM_VERIFY_OFF) {
+            initialize_matrix(&opt, &A, 0, MATRIX_RNG_A);
+        }
+    }
+
+    // 矩阵乘法计算: 栅栏同步后重复计时, 取所有进程中的最大值
+    MPI_Comm comm = MPI_COMM_WORLD;
+    bench_sync sync = bench_mpi_sync(&comm);
+    local_ctx ctx = {&A_part, &B, &C_part, local_rows, gemm_mpi_probe_init(pc, "1d", opt.bench.warmup)};
+    bench_result result = {0};
+    bench_run(&opt.bench, &sync, NULL, local_iteration, &ctx, &result);
+    double dtlb_worst, dtlb = reduce_dtlb(&opt, &ctx.probe, &dtlb_worst);
 
-    // 开始矩阵乘法计算
+    // 收集 C 的部分结果到 C_final, 单独计时
     start_time = MPI_Wtime();
-    matrix_multiplication(A_part, B, C_part, 0, rows_per_process);
+    MPI_Gatherv(C_part.data, c_counts[rank], c_row,
+                C_final.data, c_counts, c_displs, c_row,
+                0, MPI_COMM_WORLD);
     end_time = MPI_Wtime();
-    compute_time = end_time - start_time;
-
-    // 收集 C 的部分结果到 C_final
-    MPI_Gather(C_part, rows_per_process * N, MPI_FLOAT,
-               C_final, rows_per_process * N, MPI_FLOAT,
-               0, MPI_COMM_WORLD);
+    gather_time = end_time - start_time;
 
     // 进程 0 输出运行时间
     if (rank == 0) {
-        end_time = MPI_Wtime();
-        gather_time = end_time - start_time;
-        double total_time = init_time + compute_time + gather_time;
-        printf("矩阵初始化时间: %.3f 秒\n", init_time);
-        printf("矩阵乘法计算时间: %.3f 秒\n", compute_time);
+        printf("矩阵初始化时间: %.3f 秒 (各进程原地生成)\n", init_time);
         printf("结果收集时间: %.3f 秒\n", gather_time);
-        printf("总运行时间: %.3f 秒\n", total_time);
+        report_result(&opt, size, &result, "matrix_1d", dtlb, dtlb_worst);
+        report_pages(&A_part, &B, &C_part);
     }
 
+    // 每个进程都持有完整的 B, 内存与进程数无关; A、B 原地生成, 只需收集 C
+    gemm_mpi_stats stats = {0.0, 0.0, 0.0};
+    stats.mem_bytes = (double)(matrix_f32_elems(&B) + matrix_f32_elems(&A_part) +
+                               matrix_f32_elems(&C_part)) * sizeof(float);
+    stats.dist_bytes = (double)matrix_f32_elems(&C_part) * sizeof(float);
+    gemm_mpi_report(&stats, MPI_COMM_WORLD);
+
+    // 进程 0 校验结果, 并把结果广播给所有进程作为退出码
+    int failed = verify_on_root(&opt, rank, &A, &B, &C_final);
+
     // 释放内存
-    free(B);
-    free(A_part);
-    free(C_part);
+    if (pc) {
+        perf_counters_close(pc);
+    }
+    MPI_Type_free(&c_row);
+    free(c_counts);
+    free(c_displs);
+    matrix_f32_free(&B);
+    matrix_f32_free(&A_part);
+    matrix_f32_free(&C_part);
     if (rank == 0) {
-        free(A);
-        free(C_final);
+        matrix_f32_free(&A);
+        matrix_f32_free(&C_final);
     }
 
     // 结束 MPI 环境
     MPI_Finalize();
-    return 0;
+    return failed;
 }
@@ -1,135 +1,397 @@
 #include <iostream>
-#include <vector>
-#include <chrono>
+#include <cstring>
+#include <unistd.h>
 #include <mpi.h>   // MPI 库
+#include <omp.h>   // OpenMP 并行化
+
+#include "common/bench_harness.h"
+#include "common/cpu_affinity.h"
+#include "common/gemm_kernel.hpp"
+#include "common/gemm_mpi.h"
+#include "common/gemm_options.h"
+#include "common/gemm_tune.hpp"
+#include "common/gemm_verify.h"
+#include "common/matrix.hpp"
 
 using namespace std;
-using namespace std::chrono;
-
-// 矩阵大小
-const int N = 2048;
-
-// 初始化矩阵
-void initialize_matrices(vector<vector<float>> &A, vector<vector<float>> &B, vector<vector<float>> &C) {
-    for (int i = 0; i < N; i++) {
-        for (int j = 0; j < N; j++) {
-            A[i][j] = static_cast<float>(rand()) / RAND_MAX;
-            B[i][j] = static_cast<float>(rand()) / RAND_MAX;
-            C[i][j] = 0.0f;
+
+// 本进程的绑核方案
+struct RankPlacement {
+    cpu_set_t cpus;
+    int numa_node = 0;
+    int threads = 1;
+};
+
+// 进程到 NUMA 节点、线程到核的绑定:
+//   启动器已经限定了进程的 CPU 掩码 (mpirun --bind-to/--map-by) 时沿用该掩码;
+//   否则把同一主机上的进程按块均匀分到各 NUMA 节点, 节点内再平分该节点的 CPU。
+// 线程数取 OMP_NUM_THREADS, 未设置时等于分到的 CPU 数; 每个 OpenMP 线程绑定一个 CPU。
+// 矩阵在绑定之后分配, 由各 OpenMP 线程按行清零并原地生成, 首次访问即落在本进程所在的 NUMA 节点上。
+RankPlacement place_rank(MPI_Comm node_comm) {
+    RankPlacement pl;
+    int local_rank, local_size;
+    MPI_Comm_rank(node_comm, &local_rank);
+    MPI_Comm_size(node_comm, &local_size);
+
+    sched_getaffinity(0, sizeof(cpu_set_t), &pl.cpus);
+    if (CPU_COUNT(&pl.cpus) >= sysconf(_SC_NPROCESSORS_ONLN)) {
+        // 只在有 CPU 的节点之间分配, 节点编号可能不连续
+        int node_ids[AFFINITY_MAX_NODES];
+        const int nnodes = affinity_cpu_node_ids(node_ids, AFFINITY_MAX_NODES);
+        const int slot = local_rank * nnodes / local_size;
+        pl.numa_node = node_ids[slot];
+
+        // 同一节点上的进程是 local_rank 连续的一段
+        int first = -1, count = 0;
+        for (int r = 0; r < local_size; r++) {
+            if (r * nnodes / local_size == slot) {
+                if (first < 0) first = r;
+                count++;
+            }
         }
-    }
-}
 
-// 矩阵乘法 (C = A * B)
-void matrix_multiplication(const vector<vector<float>> &A, const vector<vector<float>> &B, vector<vector<float>> &C, int start_row, int end_row) {
-    for (int i = start_row; i < end_row; i++) {
-        for (int j = 0; j < N; j++) {
-            float sum = 0.0f;
-            for (int k = 0; k < N; k++) {
-                sum += A[i][k] * B[k][j];
+        cpu_set_t node_cpus;
+        if (affinity_node_cpus(pl.numa_node, &node_cpus) != 0) {
+            node_cpus = pl.cpus;
+        }
+        CPU_AND(&node_cpus, &node_cpus, &pl.cpus);
+        const int ncpus = CPU_COUNT(&node_cpus), j = local_rank - first;
+        if (ncpus > 0) {
+            // 进程多于 CPU 时退化为每进程一个 CPU (轮流共享)
+            int lo = j * ncpus / count, hi = (j + 1) * ncpus / count;
+            if (hi <= lo) {
+                lo = j % ncpus;
+                hi = lo + 1;
+            }
+            CPU_ZERO(&pl.cpus);
+            for (int i = lo; i < hi; i++) {
+                CPU_SET(affinity_nth_cpu(&node_cpus, i), &pl.cpus);
             }
-            C[i][j] = sum;
+            affinity_bind_set(&pl.cpus);
         }
+    } else {
+        pl.numa_node = affinity_cpu_node(affinity_nth_cpu(&pl.cpus, 0));
+    }
+
+    const int ncpus = CPU_COUNT(&pl.cpus);
+    pl.threads = getenv("OMP_NUM_THREADS") ? omp_get_max_threads() : ncpus;
+    omp_set_num_threads(pl.threads);
+    #pragma omp parallel
+    {
+        affinity_bind_cpu(affinity_nth_cpu(&pl.cpus, omp_get_thread_num() % ncpus));
     }
+    return pl;
 }
 
-// 性能测试
-void performance_test(int rank, int size) {
-    // 矩阵初始化
-    vector<vector<float>> A(N, vector<float>(N));
-    vector<vector<float>> B(N, vector<float>(N));
-    vector<vector<float>> C(N, vector<float>(N));
+// 每个进程上的本地乘法使用的后端与分块参数
+static const GemmBackend *local_backend = nullptr;
+static GemmBlocking local_blocking;
+
+// 本地乘法 (C += A * B): 分块、多线程、SIMD 的 gemm_blocked, 同时作为 SUMMA 的本地回调
+void local_gemm(int m, int n, int k, const float *A, size_t lda, const float *B, size_t ldb, float *C, size_t ldc) {
+    gemm_blocked(*local_backend, MatrixView<const float>(A, m, k, lda), MatrixView<const float>(B, k, n, ldb),
+                 MatrixView<float>(C, m, n, ldc), local_blocking);
+}
+
+// 汇总每个进程的计算性能
+void report_rank_performance(const RankPlacement &pl, double flops, double seconds) {
+    gemm_mpi_perf perf = {};
+    gethostname(perf.host, sizeof(perf.host) - 1);
+    affinity_format_cpulist(&pl.cpus, perf.cpus, sizeof(perf.cpus));
+    perf.numa_node = pl.numa_node;
+    perf.threads = pl.threads;
+    perf.flops = flops;
+    perf.seconds = seconds;
+    gemm_mpi_perf_report(&perf, MPI_COMM_WORLD);
+}
+
+// 原地生成矩阵 id 中从全局第 row0 行开始的行块, 各线程生成自己的行
+void fill_rows(Matrix<float> &X, int row0, const gemm_options &opt, int id) {
+    matrix_rng_fill(X.data(), X.ld(), X.rows(), X.cols(), row0, 0, opt.seed, id);
+}
 
-    // 进程 0 初始化矩阵并广播 B
+// 各进程生成本地数据的时间, 进程 0 打印最大值
+void report_init_time(int rank, const gemm_options &opt, double seconds) {
+    double worst = 0.0;
+    MPI_Reduce(&seconds, &worst, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
     if (rank == 0) {
-        initialize_matrices(A, B, C);
+        cout << "矩阵初始化时间: " << worst << " 秒 (各进程原地生成, 种子 " << opt.seed << ")" << endl;
     }
+}
 
-    // 广播矩阵 B 给所有进程
-    for (int i = 0; i < N; i++) {
-        MPI_Bcast(&B[i][0], N, MPI_FLOAT, 0, MPI_COMM_WORLD);
+// 在进程 0 上校验完整结果并广播; 返回值在所有进程上一致
+int verify_on_root(int rank, const gemm_options &opt, const Matrix<float> &A, const Matrix<float> &B, const Matrix<float> &C) {
+    int failed = 0;
+    if (opt.verify_mode != GEMM_VERIFY_OFF) {
+        if (rank == 0) {
+            gemm_verify_result r = gemm_verify(opt.verify_mode, opt.m, opt.n, opt.k,
+                                               A.data(), A.ld(), B.data(), B.ld(), C.data(), C.ld());
+            gemm_verify_print(&r);
+            failed = !r.passed;
+        }
+        MPI_Bcast(&failed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    }
+    return failed;
+}
+
+// 栅栏同步的重复计时: 每次计时前调用 reset (不计时), 耗时取所有进程中的最大值
+template <class Reset, class Body>
+bench_result time_phase(const gemm_options &opt, Reset reset, Body body) {
+    struct Ctx {
+        Reset *reset;
+        Body *body;
+    } ctx = {&reset, &body};
+    MPI_Comm comm = MPI_COMM_WORLD;
+    bench_sync sync = bench_mpi_sync(&comm);
+    bench_result result = {};
+    bench_run(&opt.bench, &sync,
+              [](void *p) { (*static_cast<Ctx *>(p)->reset)(); },
+              [](void *p) { (*static_cast<Ctx *>(p)->body)(); },
+              &ctx, &result);
+    return result;
+}
+
+// 进程 0 打印并写出整体计时结果 (--perf 时附上所有进程的 dTLB 读缺失),
+// 随后汇总每个进程的 GFLOPS (按各自耗时的中位数)
+void report_performance(int rank, int size, const gemm_options &opt, const RankPlacement &pl,
+                        bench_result &result, const char *name, double local_flops,
+                        const gemm_mpi_probe &probe) {
+    const int M = opt.m, N = opt.n, K = opt.k;
+    result.name = name;
+    result.flops = 2.0 * M * N * K;
+    result.bytes = (1.0 * M * K + 1.0 * K * N + 1.0 * M * N) * sizeof(float);  // A, B, C 矩阵
+    bench_param_str(&result, "backend", local_backend->name);
+    bench_param_int(&result, "m", M);
+    bench_param_int(&result, "n", N);
+    bench_param_int(&result, "k", K);
+    bench_param_int(&result, "procs", size);
+    bench_param_int(&result, "threads", pl.threads);
+    if (opt.mode == GEMM_MODE_SUMMA) {
+        bench_param_int(&result, "nb", opt.nb);
+    }
+    bench_param_str(&result, "pages", matrix_pages_name(opt.pages));
+    bench_param_int(&result, "seed", opt.seed);
+    // dTLB 读缺失随计时一并输出, 用于比较不同页面类型
+    double dtlb_worst = 0.0, dtlb = opt.perf ? gemm_mpi_dtlb(&probe, &dtlb_worst, MPI_COMM_WORLD) : -1.0;
+    if (dtlb >= 0.0) {
+        bench_param_int(&result, "dtlb_misses", static_cast<long>(dtlb));
     }
+    if (rank == 0) {
+        bench_report(&opt.bench, &result);
+        gemm_mpi_dtlb_print(dtlb, dtlb_worst, result.flops, opt.pages);
+    }
+    report_rank_performance(pl, local_flops, result.local.median);
+}
 
-    // 计算每个进程负责的行数
-    int rows_per_process = N / size;
-    int start_row = rank * rows_per_process;
-    int end_row = (rank + 1) * rows_per_process;
+// 1D 行划分性能测试; 返回 0 表示成功 (或未校验), 1 表示校验失败 (所有进程返回值一致)
+int performance_test(int rank, int size, const gemm_options &opt, const RankPlacement &pl,
+                     perf_counters *pc) {
+    const int M = opt.m, N = opt.n, K = opt.k;
 
-    // 每个进程分配部分 A 和 C
-    vector<vector<float>> A_part(rows_per_process, vector<float>(N));
-    vector<vector<float>> C_part(rows_per_process, vector<float>(N, 0.0f));
+    // 计算每个进程负责的行数: 不能整除时前 M % size 个进程多分一行
+    int local_rows = gemm_rows_of(M, size, rank);
 
-    // 进程 0 分发 A 的部分数据
+    // 每个进程原地生成完整的 B 和自己的 A 行块, 不再广播 B、分发 A;
+    // 行跨度与完整矩阵一致, C 的行块可整体收发
+    Matrix<float> B(K, N);
+    Matrix<float> A_part(local_rows, K);
+    Matrix<float> C_part(local_rows, N);
+    double t0 = MPI_Wtime();
+    fill_rows(B, 0, opt, MATRIX_RNG_B);
+    fill_rows(A_part, gemm_row_start(M, size, rank), opt, MATRIX_RNG_A);
+    report_init_time(rank, opt, MPI_Wtime() - t0);
+
+    // 只有进程 0 需要完整的 C, 校验时还需要完整的 A (用同一种子重新生成)
+    Matrix<float> A, C;
     if (rank == 0) {
-        for (int i = 1; i < size; i++) {
-            int start = i * rows_per_process;
-            MPI_Send(&A[start][0], rows_per_process * N, MPI_FLOAT, i, 0, MPI_COMM_WORLD);
+        C = Matrix<float>(M, N);
+        if (opt.verify_mode != GEMM_VERIFY_OFF) {
+            A = Matrix<float>(M, K);
+            fill_rows(A, 0, opt, MATRIX_RNG_A);
         }
-        // 进程 0 自己的部分
-        for (int i = 0; i < rows_per_process; i++) {
-            for (int j = 0; j < N; j++) {
-                A_part[i][j] = A[i][j];
-            }
-        }
-    } else {
-        // 接收 A 的部分数据
-        MPI_Recv(&A_part[0][0], rows_per_process * N, MPI_FLOAT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
     }
 
-    // 开始计时
-    auto start = high_resolution_clock::now();
-    matrix_multiplication(A_part, B, C_part, 0, rows_per_process);
-    auto end = high_resolution_clock::now();
+    // 只计时本地乘法, 每次计时前把 C_part 清零
+    gemm_mpi_probe probe = gemm_mpi_probe_init(pc, "1d", opt.bench.warmup);
+    bench_result result = time_phase(opt,
+        [&] { std::memset(C_part.data(), 0, C_part.size_bytes()); },
+        [&] {
+            perf_counters *run_pc = gemm_mpi_probe_begin(&probe);
+            local_gemm(local_rows, N, K, A_part.data(), A_part.ld(), B.data(), B.ld(), C_part.data(), C_part.ld());
+            gemm_mpi_probe_end(&probe, run_pc);
+        });
 
     // 收集 C 的部分结果
     if (rank == 0) {
-        for (int i = 0; i < rows_per_process; i++) {
-            for (int j = 0; j < N; j++) {
-                C[i][j] = C_part[i][j];
-            }
-        }
+        std::memcpy(C.data(), C_part.data(), C_part.size_bytes());
         for (int i = 1; i < size; i++) {
-            int start = i * rows_per_process;
-            MPI_Recv(&C[start][0], rows_per_process * N, MPI_FLOAT, i, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            int start = gemm_row_start(M, size, i);
+            int rows = gemm_rows_of(M, size, i);
+            MPI_Recv(C.row(start), static_cast<int>(rows * C.ld()), MPI_FLOAT, i, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
         }
     } else {
-        MPI_Send(&C_part[0][0], rows_per_process * N, MPI_FLOAT, 0, 1, MPI_COMM_WORLD);
+        MPI_Send(C_part.data(), static_cast<int>(C_part.elems()), MPI_FLOAT, 0, 1, MPI_COMM_WORLD);
     }
 
-    // 计算运行时间
-    double duration = duration_cast<duration<double>>(end - start).count();
+    report_performance(rank, size, opt, pl, result, "mpi_matmul_1d", 2.0 * local_rows * N * K, probe);
     if (rank == 0) {
-        cout << "矩阵乘法运行时间: " << duration << " 秒" << endl;
+        matrix_pages_log("A", A_part.data(), A_part.size_bytes());
+        matrix_pages_log("B", B.data(), B.size_bytes());
+        matrix_pages_log("C", C_part.data(), C_part.size_bytes());
+    }
+
+    // 每个进程都持有完整的 B, 内存与进程数无关; A、B 原地生成, 只需收集 C
+    gemm_mpi_stats stats = {0.0, 0.0, 0.0};
+    stats.mem_bytes = static_cast<double>(B.size_bytes() + A_part.size_bytes() + C_part.size_bytes());
+    stats.dist_bytes = static_cast<double>(C_part.size_bytes());
+    gemm_mpi_report(&stats, MPI_COMM_WORLD);
+
+    // 进程 0 持有完整的 A、B、C, 在其上校验并把结果广播给所有进程
+    return verify_on_root(rank, opt, A, B, C);
+}
 
-        // 计算内存带宽
-        double memory_accessed = 3.0 * N * N * sizeof(float);  // A, B, C 矩阵
-        double memory_bandwidth = (memory_accessed / (1024.0 * 1024.0 * 1024.0)) / duration;
-        cout << "内存带宽: " << memory_bandwidth << " GB/s" << endl;
+// 2D SUMMA 性能测试: A、B、C 在二维进程网格上块循环分布, 每个进程只持有约 1/P 的数据
+int performance_test_summa(int rank, const gemm_options &opt, const RankPlacement &pl,
+                           perf_counters *pc) {
+    const int M = opt.m, N = opt.n, K = opt.k;
+    summa_grid grid;
+    summa_grid_create(&grid, MPI_COMM_WORLD, opt.nb);
+    if (rank == 0) {
+        cout << "SUMMA 进程网格: " << grid.nprow << " x " << grid.npcol << ", 块大小: " << grid.nb << endl;
+    }
 
-        // 计算 FLOPS
-        double flops = 2.0 * N * N * N / duration;
-        double gflops = flops / (1024.0 * 1024.0 * 1024.0);
-        cout << "浮点运算性能: " << gflops << " GFLOPS" << endl;
+    // 进程 0 持有完整的 C 用于收集; 校验时用同一种子重新生成完整的 A、B
+    Matrix<float> A, B, C;
+    if (rank == 0) {
+        C = Matrix<float>(M, N);
+        if (opt.verify_mode != GEMM_VERIFY_OFF) {
+            A = Matrix<float>(M, K);
+            B = Matrix<float>(K, N);
+            fill_rows(A, 0, opt, MATRIX_RNG_A);
+            fill_rows(B, 0, opt, MATRIX_RNG_B);
+        }
     }
+    matrix_f32 C_g = {C.data(), M, N, C.ld()};
+
+    // 本地块
+    matrix_f32 A_loc = {}, B_loc = {}, C_loc = {};
+    if (summa_local_alloc(&grid, &A_loc, M, K, grid.myrow, grid.mycol) != 0 ||
+        summa_local_alloc(&grid, &B_loc, K, N, grid.myrow, grid.mycol) != 0 ||
+        summa_local_alloc(&grid, &C_loc, M, N, grid.myrow, grid.mycol) != 0) {
+        cout << "错误: 进程 " << rank << " 内存分配失败" << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    gemm_mpi_stats stats = {0.0, 0.0, 0.0};
+    stats.mem_bytes = static_cast<double>(matrix_f32_elems(&A_loc) + matrix_f32_elems(&B_loc) +
+                                          matrix_f32_elems(&C_loc)) * sizeof(float);
+    // 各进程按块循环分布原地生成本地块, 不需要从进程 0 分发
+    double t0 = MPI_Wtime();
+    summa_rng_fill(&grid, &A_loc, opt.seed, MATRIX_RNG_A);
+    summa_rng_fill(&grid, &B_loc, opt.seed, MATRIX_RNG_B);
+    report_init_time(rank, opt, MPI_Wtime() - t0);
+
+    // 计时包含面板广播; 面板的内存与通信量只在第一次运行时统计
+    gemm_mpi_stats *run_stats = &stats;
+    gemm_mpi_probe probe = gemm_mpi_probe_init(pc, "summa", opt.bench.warmup);
+    bench_result result = time_phase(opt,
+        [&] { std::memset(C_loc.data, 0, matrix_f32_elems(&C_loc) * sizeof(float)); },
+        [&] {
+            perf_counters *run_pc = gemm_mpi_probe_begin(&probe);
+            summa_multiply(&grid, K, &A_loc, &B_loc, &C_loc, local_gemm, run_stats);
+            gemm_mpi_probe_end(&probe, run_pc);
+            run_stats = nullptr;
+        });
+
+    summa_gather(&grid, &C_g, &C_loc, M, N, &stats);
+    report_performance(rank, grid.nprow * grid.npcol, opt, pl, result, "mpi_matmul_summa",
+                       2.0 * C_loc.rows * C_loc.cols * K, probe);
+    if (rank == 0) {
+        matrix_pages_log("A", A_loc.data, matrix_f32_elems(&A_loc) * sizeof(float));
+        matrix_pages_log("B", B_loc.data, matrix_f32_elems(&B_loc) * sizeof(float));
+        matrix_pages_log("C", C_loc.data, matrix_f32_elems(&C_loc) * sizeof(float));
+    }
+    gemm_mpi_report(&stats, MPI_COMM_WORLD);
+
+    matrix_f32_free(&A_loc);
+    matrix_f32_free(&B_loc);
+    matrix_f32_free(&C_loc);
+    summa_grid_free(&grid);
+
+    return verify_on_root(rank, opt, A, B, C);
 }
 
 int main(int argc, char* argv[]) {
-    MPI_Init(&argc, &argv);
-    
+    // 只有主线程调用 MPI, OpenMP 并行区内不通信
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
     int rank, size;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
+    if (provided < MPI_THREAD_FUNNELED) {
+        if (rank == 0) {
+            cout << "错误: MPI 库不支持 MPI_THREAD_FUNNELED" << endl;
+        }
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
 
-    if (N % size != 0) {
+    gemm_options opt;
+    gemm_options_init(&opt);
+    opt.modes = "1d|summa|pipeline";  // pipeline 按 1d 运行, 见下
+    if (gemm_options_parse(&opt, argc, argv) != 0) {
         if (rank == 0) {
-            cout << "错误: 矩阵行数无法被进程数整除！" << endl;
+            gemm_options_usage(argv[0], opt.modes);
         }
         MPI_Finalize();
         return -1;
     }
 
-    performance_test(rank, size);
+    matrix_set_pages(opt.pages);
+
+    // --perf: 计数器以 inherit 方式作用于之后创建的线程, 须在绑核和第一个
+    // OpenMP 并行区之前打开
+    perf_counters counters;
+    perf_counters *pc = nullptr;
+    if (opt.perf && perf_counters_open(&counters) > 0) {
+        pc = &counters;
+    }
+
+    local_backend = opt.backend ? gemm_find_backend(opt.backend) : &gemm_detect_backend();
+    if (!local_backend) {
+        if (rank == 0) {
+            cout << "错误: 后端 " << opt.backend << " 未编译或当前 CPU 不支持" << endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    const char *source = nullptr;
+    local_blocking = gemm_resolve_blocking(*local_backend, opt, &source);
+
+    // 同一主机上的进程组成 node_comm, 用于分配 NUMA 节点和 CPU
+    MPI_Comm node_comm;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm);
+    RankPlacement pl = place_rank(node_comm);
+    MPI_Comm_free(&node_comm);
+
+    if (rank == 0) {
+        cout << "矩阵大小: M=" << opt.m << ", N=" << opt.n << ", K=" << opt.k << ", 进程数: " << size << endl;
+        cout << "后端: " << local_backend->name << ", 微内核: " << local_backend->mr << " x " << local_backend->nr
+             << ", 分块 MC/KC/NC: " << local_blocking.mc << "/" << local_blocking.kc << "/" << local_blocking.nc
+             << " (来源: " << source << ")" << endl;
+    }
+
+    // 流水线模式只在 matrix.c 中实现, 这里按 1D 行划分运行
+    if (opt.mode == GEMM_MODE_PIPELINE && rank == 0) {
+        cout << "提示: pipeline 模式由 matrix.c 提供, 本程序按 1d 模式运行" << endl;
+    }
+
+    int ret = opt.mode == GEMM_MODE_SUMMA ? performance_test_summa(rank, opt, pl, pc)
+                                          : performance_test(rank, size, opt, pl, pc);
+    if (pc) {
+        perf_counters_close(pc);
+    }
 
     MPI_Finalize();
-    return 0;
+    return ret;
 }
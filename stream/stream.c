@@ -40,13 +40,22 @@
 /*     program constitutes acceptance of these licensing restrictions.   */
 /*  5. Absolutely no warranty is expressed or implied.                   */
 /*-----------------------------------------------------------------------*/
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
 # include <stdio.h>
 #include <stdlib.h>
+# include <string.h>
 # include <unistd.h>
 # include <math.h>
 # include <float.h>
 # include <limits.h>
 # include <sys/time.h>
+#ifdef STREAM_MPI
+# include <mpi.h>
+#endif
+# include "../common/numa_alloc.h"
+# include "../common/cpu_affinity.h"
 
 /*-----------------------------------------------------------------------
  * INSTRUCTIONS:
@@ -90,6 +99,10 @@
  *                gcc -O -DSTREAM_ARRAY_SIZE=100000000 stream.c -o stream.100M
  *          will override the default size of 10M with a new size of 100M elements
  *          per array.
+ *      The compile-time value is only the default: the arrays are allocated
+ *          at run time, and "--size=N" (suffixes K, M, G = 10^3, 10^6, 10^9)
+ *          selects another size without recompiling, e.g.
+ *                ./stream --size=100M
  */
 #ifndef STREAM_ARRAY_SIZE
 #   define STREAM_ARRAY_SIZE	10000000
@@ -102,7 +115,7 @@
  *         values larger than the default are unlikely to noticeably
  *         increase the reported performance.
  *      NTIMES can also be set on the compile line without changing the source
- *         code using, for example, "-DNTIMES=7".
+ *         code using, for example, "-DNTIMES=7", or at run time with "--ntimes=7".
  */
 #ifdef NTIMES
 #if NTIMES<=1
@@ -119,7 +132,9 @@
  *      Use of non-zero values for OFFSET can be especially helpful if the
  *         STREAM_ARRAY_SIZE is set to a value close to a large power of 2.
  *      OFFSET can also be set on the compile line without changing the source
- *         code using, for example, "-DOFFSET=56".
+ *         code using, for example, "-DOFFSET=56", or at run time with "--offset=56".
+ *      Each array is a separate page-aligned mapping, so OFFSET is the number
+ *         of elements by which each array starts past its page boundary.
  */
 #ifndef OFFSET
 #   define OFFSET	0
@@ -144,14 +159,132 @@
  *
  *     To run with single-precision variables and arithmetic, simply add
  *         -DSTREAM_TYPE=float
- *     to the compile line.
+ *     to the compile line, or select it at run time with "--type=float".
  *     Note that this changes the minimum array sizes required --- see (1) above.
  *
- *     The preprocessor directive "TUNED" does not do much -- it simply causes the 
- *       code to call separate functions to execute each kernel.  Trivial versions
- *       of these functions are provided, but they are *not* tuned -- they just 
- *       provide predefined interfaces to be replaced with tuned code.
+ *     The preprocessor directive "TUNED" causes the code to call separate
+ *       functions to execute each kernel.  In this version they are
+ *       hand-vectorized (AVX2, AVX-512, NEON, SVE, see stream_tuned.h), split
+ *       the arrays into static per-thread chunks aligned to cache lines, and
+ *       take three run-time options:
+ *            --isa=avx512|avx2|sve|neon|scalar   default: best on this CPU
+ *            --store=regular|nt|zva              default: nt where available
+ *            --prefetch=BYTES                    software prefetch distance,
+ *                                                default 0 (off)
+ *       "nt" uses non-temporal (streaming) stores, "zva" (aarch64) zeroes
+ *       each destination line with DC ZVA before writing it; both avoid
+ *       the write-allocate read of the destination.  After validation,
+ *       every kernel is re-run with each available store mode and the best
+ *       rates are printed side by side, to show the write-allocate overhead.
+ *            gcc -O -fopenmp -DTUNED stream.c -o stream_tuned
+ *
+ *
+ *     The preprocessor directive "PERF_COUNTERS" wraps each kernel with
+ *       perf_event_open hardware counters (cycles, instructions, L1D/LLC/dTLB
+ *       misses, see ../common/perf_counters.h) and prints per-kernel averages
+ *       over the timed iterations, plus a roofline placement when
+ *       ROOFLINE_PEAK_GFLOPS and ROOFLINE_PEAK_GBPS are set. If the counters
+ *       cannot be opened (no PMU, perf_event_paranoid) STREAM runs unchanged.
+ *            gcc -O -fopenmp -DPERF_COUNTERS stream.c -o stream_perf
+ *
+ *     NUMA placement is selected per array at run time (Linux only, see
+ *       ../common/numa_alloc.h).  "--alloc=SPEC" applies to all three arrays,
+ *       "--alloc-a=SPEC", "--alloc-b=SPEC" and "--alloc-c=SPEC" override one
+ *       array.  SPEC is a comma separated list of one placement
+ *            firsttouch        parallel initialization decides (default)
+ *            serial            initialized by the master thread only
+ *            interleave[:L]    pages interleaved over node list L
+ *                              (default: all nodes with memory)
+ *            bind:L            pages restricted to node list L
+ *            preferred:N       node N first, others when it is full
+ *       and optionally one page size
+ *            thp / nothp       transparent huge pages on / off (madvise)
+ *            hugetlb           explicit huge pages (MAP_HUGETLB), falls
+ *                              back to thp if none are reserved
+ *            hugetlb1g         explicit 1 GB pages, falls back to hugetlb
+ *       Node lists use '-' for ranges and '+' between ranges, e.g. "0-1+4".
+ *       The effective placement (sampled with move_pages) and the amount of
+ *       huge pages are printed for each array before the kernels run, e.g.
+ *            ./stream --alloc=bind:1 --alloc-c=interleave,thp
+ *
+ *     "--extended" adds six kernels after the classic four, for access
+ *       patterns the four do not cover:
+ *            Read:      sum of a[]                      1 word  per element
+ *            Write:     fill d[] with a constant        1 word
+ *            Strided:   d[j] = a[j] for every S-th j    2 words per copied element
+ *            Gather:    d[j] = src[idx[j]]              2 words + 1 index
+ *            Scatter:   d[idx[j]] = src[j]              2 words + 1 index
+ *            TriadN:    d = x0 + scalar*(x1+...+x(N-1)) N+1 words
+ *       idx is a random permutation of [0, STREAM_ARRAY_SIZE).  "--stride=S"
+ *       (default 8) and "--streams=N" (2..8, default 5) set the parameters;
+ *       the rates count only the words listed above, so the strided rate
+ *       drops once S words span more than a cache line.  The extra arrays
+ *       (d, src, idx and x0..x(N-1)) use the --alloc policy, and every
+ *       extended kernel is validated after its last iteration.
+ *
+ *     Sweep mode (OpenMP builds) re-runs the four kernels inside one process
+ *       for a range of thread counts and thread placements, pinning every
+ *       thread with sched_setaffinity, and prints the best rate of each
+ *       configuration plus the thread count at which Triad saturates:
+ *            --sweep=LIST          thread counts, e.g. "1-16", "1,2,4,8" or "all"
+ *            --placement=LIST      any of compact, scatter, l3, numa (default all)
+ *            --sweep-csv=FILE      also append one CSV line per configuration
+ *       compact fills the physical cores of one NUMA node (L3 domain by L3
+ *       domain) before their SMT siblings and before the next node; scatter
+ *       deals threads round-robin over nodes, then over the L3 domains of a
+ *       node, then over cores; l3 and numa place at most one thread per L3
+ *       domain or per NUMA node.  Only CPUs in the initial affinity mask are
+ *       used.  The arrays are re-allocated (with the --alloc policies) and
+ *       re-initialized by the pinned threads for every configuration, so
+ *       first-touch placement follows the threads.  Leave OMP_PROC_BIND
+ *       and OMP_PLACES unset.
+ *            ./stream_omp --sweep=all --placement=compact,scatter --sweep-csv=bw.csv
+ *
+ *     Matrix mode (OpenMP builds) measures every CPU node x memory node
+ *       pair, e.g. sockets against DRAM, HBM or CXL memory-only nodes:
+ *            --matrix              threads on the CPUs of NUMA node i (rows),
+ *                                  arrays bound to memory node j (columns)
+ *            --matrix-threads=N    at most N threads per CPU node (default:
+ *                                  every CPU of the node, cores before SMT
+ *                                  siblings)
+ *       Nodes are read from /sys/devices/system/node: the rows are the
+ *       nodes with CPUs in the initial affinity mask, the columns the nodes
+ *       with memory, including CPU-less ones.  The page size option of
+ *       --alloc (thp, nothp, hugetlb, hugetlb1g) is kept, the placement
+ *       is replaced by bind:j.  A one-node machine gives a 1x1 matrix;
+ *       booting with numa=fake=N splits memory into N nodes for testing.
+ *
+ *     Latency mode measures load-to-use latency with a random pointer chase
+ *       instead of bandwidth (see stream_latency.h):
+ *            --latency[=MIN-MAX]   working sets, default 4K-1G (K/M/G are
+ *                                  powers of 1024), two points per octave
+ *            --latency-loaders=N   N more threads run Triad meanwhile
+ *       Each size is annotated with the cache level it fits in or with the
+ *       NUMA node(s) holding its pages; the chain uses the policy of array
+ *       a, e.g. "--latency --alloc=bind:1,thp" for remote memory without
+ *       TLB misses.
  *
+ *     MPI (see stream_mpi.h): compile with an MPI wrapper and -DSTREAM_MPI,
+ *       e.g. "mpicc -O2 -fopenmp -DSTREAM_MPI stream.c -o stream_mpi", and
+ *       start one rank per socket or NUMA node:
+ *            mpirun -np 2 --map-by socket --bind-to socket ./stream_mpi
+ *       Every rank runs the kernels on its own arrays of STREAM_ARRAY_SIZE
+ *       elements with OMP_NUM_THREADS threads; each kernel starts after a
+ *       barrier, and the summary is the aggregate bandwidth of all ranks,
+ *       followed by the best rate of every rank and of every host.  The
+ *       sweep, matrix and latency modes run independently on each rank.
+ *
+ *     Telemetry mode times every thread of every iteration instead of
+ *       only the team (see stream_telemetry.h):
+ *            --telemetry           per-thread report: fastest and slowest
+ *                                  thread, imbalance, straggler CPU/node,
+ *                                  per-node thread bandwidth, drift
+ *            --json=FILE           also write all samples as JSON (implies
+ *                                  --telemetry)
+ *       Each kernel then runs in one parallel region in which every thread
+ *       calls the kernel on its own static share, so the rates can differ
+ *       slightly from a normal run.  Use a large --ntimes to watch for
+ *       thermal throttling or frequency drift over a long run.
  *
  *	4) Optional: Mail the results to mccalpin@cs.virginia.edu
  *	   Be sure to include info that will help me understand:
@@ -176,56 +309,194 @@
 #ifndef STREAM_TYPE
 #define STREAM_TYPE double
 #endif
-/*
-static STREAM_TYPE	a[STREAM_ARRAY_SIZE+OFFSET],
-			b[STREAM_ARRAY_SIZE+OFFSET],
-			c[STREAM_ARRAY_SIZE+OFFSET];
-*/
-static double	avgtime[4] = {0}, maxtime[4] = {0},
-		mintime[4] = {FLT_MAX,FLT_MAX,FLT_MAX,FLT_MAX};
-
-static char	*label[4] = {"Copy:      ", "Scale:     ",
-    "Add:       ", "Triad:     "};
-
-static double	bytes[4] = {
-    2 * sizeof(STREAM_TYPE) * STREAM_ARRAY_SIZE,
-    2 * sizeof(STREAM_TYPE) * STREAM_ARRAY_SIZE,
-    3 * sizeof(STREAM_TYPE) * STREAM_ARRAY_SIZE,
-    3 * sizeof(STREAM_TYPE) * STREAM_ARRAY_SIZE
-    };
+
+/* reference kernels, one set per element type selectable with --type */
+#define STREAM_KTYPE	double
+#define STREAM_KNAME(x)	x##_double
+#include "stream_kernels.h"
+#undef STREAM_KTYPE
+#undef STREAM_KNAME
+#define STREAM_KTYPE	float
+#define STREAM_KNAME(x)	x##_float
+#include "stream_kernels.h"
+#undef STREAM_KTYPE
+#undef STREAM_KNAME
+
+typedef void (*stream_kernel_t)(void *a, void *b, void *c, ssize_t n, double scalar);
+
+typedef struct {
+    const char		*name;
+    int			size;
+    double		epsilon;
+    void		(*fill)(void *x, ssize_t n, double v, int parallel);
+    stream_kernel_t	copy, scale, add, triad;
+    void		(*expected)(int ntimes, double *a, double *b, double *c);
+    double		(*error)(const void *x, ssize_t n, double expected,
+				 double epsilon, ssize_t *nbad);
+    double		(*get)(const void *x, ssize_t j);
+    /* --extended */
+    double		(*sum)(const void *x, ssize_t n);
+    void		(*iota)(void *x, ssize_t n);
+    void		(*strided)(void *dst, const void *src, ssize_t n, ssize_t stride);
+    void		(*gather)(void *dst, const void *src, const ssize_t *idx, ssize_t n);
+    void		(*scatter)(void *dst, const void *src, const ssize_t *idx, ssize_t n);
+    void		(*triadn)(void *dst, void *const *x, int nx, ssize_t n, double scalar);
+} stream_type_t;
+
+#define STREAM_TYPE_ENTRY(t, eps) { #t, sizeof(t), eps, fill_##t, \
+	copy_##t, scale_##t, add_##t, triad_##t, expected_##t, error_##t, get_##t, \
+	sum_##t, iota_##t, strided_##t, gather_##t, scatter_##t, triadn_##t }
+static const stream_type_t stream_types[] = {
+    STREAM_TYPE_ENTRY(double, 1.e-13),
+    STREAM_TYPE_ENTRY(float, 1.e-6)
+};
+
+#ifdef TUNED
+# include "stream_tuned.h"
+static stream_isa_t	tuned_isas[STREAM_MAX_ISAS];
+static const stream_isa_t *tuned_isa;
+static const char	*tuned_isa_name = NULL;		/* NULL = best available */
+static int		tuned_store = -1;		/* -1 = nt where available */
+static ssize_t		tuned_prefetch = 0;
+#endif
+
+/* run-time configuration, defaults from the compile-time macros */
+static ssize_t	array_size = STREAM_ARRAY_SIZE;
+static int	array_offset = OFFSET;
+static int	ntimes = NTIMES;
+static const stream_type_t *stream_type =
+    &stream_types[sizeof(STREAM_TYPE) == sizeof(float) ? 1 : 0];
+static const char *alloc_default = "firsttouch";
+static const char *alloc_spec[3];	/* per-array overrides, NULL = alloc_default */
+static numa_region	region[3];
+static const char	*sweep_threads = NULL;		/* --sweep, NULL = single run */
+static const char	*sweep_csv = NULL;
+static unsigned		sweep_placements = ~0u;
+static int		matrix = 0;			/* --matrix */
+static int		matrix_threads = 0;		/* 0 = all CPUs of a node */
+static const char	*latency_range = NULL;		/* --latency, NULL = off */
+static int		latency_loaders = 0;
+static int		mpi_rank = 0, mpi_size = 1;	/* 0 and 1 without STREAM_MPI */
+static int		telemetry = 0;			/* --telemetry */
+static const char	*telemetry_json = NULL;
+
+/* the classic four kernels, then the --extended set */
+#define NKERNELS	10
+static int	nkernels = 4;
+static ssize_t	ext_stride = 8;
+static int	ext_streams = 5;
+static char	ext_triadn_label[16] = "TriadN:    ";
+
+static double	avgtime[NKERNELS] = {0}, maxtime[NKERNELS] = {0},
+		mintime[NKERNELS] = {FLT_MAX,FLT_MAX,FLT_MAX,FLT_MAX,FLT_MAX,
+				     FLT_MAX,FLT_MAX,FLT_MAX,FLT_MAX,FLT_MAX};
+
+static char	*label[NKERNELS] = {"Copy:      ", "Scale:     ",
+    "Add:       ", "Triad:     ", "Read:      ", "Write:     ",
+    "Strided:   ", "Gather:    ", "Scatter:   ", ext_triadn_label};
+
+static double	bytes[NKERNELS];
+
+#ifdef PERF_COUNTERS
+# include "../common/perf_counters.h"
+static double	flops[NKERNELS];
+static perf_counters	perf;
+static perf_region	perf_kernels[NKERNELS] = {{"Copy"}, {"Scale"}, {"Add"}, {"Triad"},
+    {"Read"}, {"Write"}, {"Strided"}, {"Gather"}, {"Scatter"}, {"TriadN"}};
+/* the first iteration is skipped, as for the reported times */
+# define PERF_BEGIN(k)	if ((k) > 0) perf_region_begin(&perf)
+# define PERF_END(j,k)	if ((k) > 0) perf_region_end(&perf, &perf_kernels[j], \
+				times[j][k], flops[j], bytes[j])
+#else
+# define PERF_BEGIN(k)
+# define PERF_END(j,k)
+#endif
+
+/* all ranks enter every kernel together */
+#ifdef STREAM_MPI
+# define STREAM_SYNC()	MPI_Barrier(MPI_COMM_WORLD)
+#else
+# define STREAM_SYNC()
+#endif
 
 extern double mysecond();
-extern void checkSTREAMresults(double* a,double* b,double *c);
+extern void checkSTREAMresults(void *a, void *b, void *c);
+extern int parse_args(int argc, char **argv);
+extern int run_sweep(numa_spec *spec);
+extern int run_matrix(numa_spec *spec);
+extern int run_latency(numa_spec *spec);
+extern int ext_setup(void);
+extern void ext_kernel(int j, void *a);
+extern void ext_check(int j, void *a);
+extern void ext_free(void);
+extern void checkExtendedResults(void);
+extern int telemetry_setup(void);
+extern double telemetry_run(int j, int k, void *a, void *b, void *c, double scalar);
+extern void telemetry_report(double **times);
+extern int telemetry_write_json(const char *path, double **times);
+extern void telemetry_free(void);
+#ifdef STREAM_MPI
+extern void mpi_collect(double **times, void *a, void *b, void *c);
+extern void mpi_report(void);
+#endif
+extern void *alloc_array(int i, numa_spec *spec);
 #ifdef TUNED
-extern void tuned_STREAM_Copy();
-extern void tuned_STREAM_Scale(STREAM_TYPE scalar);
-extern void tuned_STREAM_Add();
-extern void tuned_STREAM_Triad(STREAM_TYPE scalar);
+extern void tuned_STREAM_Copy(void *a, void *b, void *c);
+extern void tuned_STREAM_Scale(void *a, void *b, void *c, double scalar);
+extern void tuned_STREAM_Add(void *a, void *b, void *c);
+extern void tuned_STREAM_Triad(void *a, void *b, void *c, double scalar);
+extern int tuned_select(void);
+extern void tuned_store_report(void *a, void *b, void *c);
 #endif
 #ifdef _OPENMP
 extern int omp_get_num_threads();
 #endif
+#ifdef STREAM_MPI
+# define STREAM_MAIN	stream_main
+#else
+# define STREAM_MAIN	main
+#endif
 int
-main()
+STREAM_MAIN(int argc, char **argv)
     {
-    double *a = (double *)malloc(STREAM_ARRAY_SIZE * sizeof(double));
-    double *b = (double *)malloc(STREAM_ARRAY_SIZE * sizeof(double));   
-    double *c = (double *)malloc(STREAM_ARRAY_SIZE * sizeof(double));
+    void		*a, *b, *c;
+    numa_spec		spec[3];
     int			quantum, checktick();
     int			BytesPerWord;
-    int			k;
+    int			i, k;
     ssize_t		j;
-    STREAM_TYPE		scalar;
-    double		t, times[4][NTIMES];
+    double		scalar;
+    double		t, *times[NKERNELS];
+    char		desc[256];
+
+    if (parse_args(argc, argv) != 0)
+	return 1;
+    for (i=0; i<3; i++) {
+	if (alloc_spec[i] == NULL)
+	    alloc_spec[i] = alloc_default;
+	if (numa_parse_spec(alloc_spec[i], &spec[i]) != 0) {
+	    printf("Invalid allocation policy for array %c: %s\n", 'a' + i, alloc_spec[i]);
+	    return 1;
+	}
+    }
+#ifdef TUNED
+    if (tuned_select() != 0)
+	return 1;
+#endif
 
     /* --- SETUP --- determine precision and check timing --- */
 
     printf(HLINE);
     printf("STREAM version $Revision: 5.10 $\n");
     printf(HLINE);
-    BytesPerWord = sizeof(STREAM_TYPE);
-    printf("This system uses %d bytes per array element.\n",
-	BytesPerWord);
+#ifdef PERF_COUNTERS
+    /* must precede the first parallel region so that worker threads inherit the counters */
+    perf_counters_open(&perf);
+    printf(HLINE);
+#endif
+    BytesPerWord = stream_type->size;
+    printf("This system uses %d bytes per array element (%s).\n",
+	BytesPerWord, stream_type->name);
 
     printf(HLINE);
 #ifdef N
@@ -236,16 +507,41 @@ main()
     printf("*****  WARNING: ******\n");
 #endif
 
-    printf("Array size = %llu (elements), Offset = %d (elements)\n" , (unsigned long long) STREAM_ARRAY_SIZE, OFFSET);
+    printf("Array size = %llu (elements), Offset = %d (elements)\n" , (unsigned long long) array_size, array_offset);
     printf("Memory per array = %.1f MiB (= %.1f GiB).\n", 
-	BytesPerWord * ( (double) STREAM_ARRAY_SIZE / 1024.0/1024.0),
-	BytesPerWord * ( (double) STREAM_ARRAY_SIZE / 1024.0/1024.0/1024.0));
+	BytesPerWord * ( (double) array_size / 1024.0/1024.0),
+	BytesPerWord * ( (double) array_size / 1024.0/1024.0/1024.0));
     printf("Total memory required = %.1f MiB (= %.1f GiB).\n",
-	(3.0 * BytesPerWord) * ( (double) STREAM_ARRAY_SIZE / 1024.0/1024.),
-	(3.0 * BytesPerWord) * ( (double) STREAM_ARRAY_SIZE / 1024.0/1024./1024.));
-    printf("Each kernel will be executed %d times.\n", NTIMES);
+	(3.0 * BytesPerWord) * ( (double) array_size / 1024.0/1024.),
+	(3.0 * BytesPerWord) * ( (double) array_size / 1024.0/1024./1024.));
+    printf("Each kernel will be executed %d times.\n", ntimes);
     printf(" The *best* time for each kernel (excluding the first iteration)\n"); 
     printf(" will be used to compute the reported bandwidth.\n");
+#ifdef TUNED
+    printf("Tuned kernels: %s, %s stores, software prefetch %ld bytes.\n",
+	tuned_isa->name, stream_store_names[tuned_store], (long) tuned_prefetch);
+#endif
+
+    bytes[0] = bytes[1] = 2.0 * BytesPerWord * (double) array_size;
+    bytes[2] = bytes[3] = 3.0 * BytesPerWord * (double) array_size;
+    bytes[4] = bytes[5] = 1.0 * BytesPerWord * (double) array_size;
+    bytes[6] = 2.0 * BytesPerWord * (double) ((array_size + ext_stride - 1) / ext_stride);
+    bytes[7] = bytes[8] = (2.0 * BytesPerWord + sizeof(ssize_t)) * (double) array_size;
+    bytes[9] = (ext_streams + 1.0) * BytesPerWord * (double) array_size;
+#ifdef PERF_COUNTERS
+    flops[0] = 0;
+    flops[1] = flops[2] = (double) array_size;
+    flops[3] = 2.0 * (double) array_size;
+    flops[4] = (double) array_size;
+    flops[9] = (double) ext_streams * (double) array_size;
+#endif
+    if (nkernels > 4) {
+	printf("Extended kernels: stride %ld, %d-stream triad, %.1f MiB more memory.\n",
+	    (long) ext_stride, ext_streams,
+	    ((2.0 + ext_streams) * BytesPerWord + sizeof(ssize_t)) * (double) array_size / 1024.0/1024.0);
+    }
+    for (j=0; j<nkernels; j++)
+	times[j] = (double *) malloc(sizeof(double) * ntimes);
 
 #ifdef _OPENMP
     printf(HLINE);
@@ -266,14 +562,37 @@ main()
 		k++;
     printf ("Number of Threads counted = %i\n",k);
 #endif
+#ifdef STREAM_MPI
+    printf("Number of MPI ranks = %d, %.1f MiB of arrays per rank.\n", mpi_size,
+	(3.0 * BytesPerWord) * ( (double) array_size / 1024.0/1024.));
+#endif
+    if (sweep_threads)
+	return run_sweep(spec);
+    if (matrix)
+	return run_matrix(spec);
+    if (latency_range)
+	return run_latency(spec);
 
     /* Get initial value for system clock. */
-#pragma omp parallel for
-    for (j=0; j<STREAM_ARRAY_SIZE; j++) {
-	    a[j] = 1.0;
-	    b[j] = 2.0;
-	    c[j] = 0.0;
-	}
+    if ((a = alloc_array(0, &spec[0])) == NULL ||
+	(b = alloc_array(1, &spec[1])) == NULL ||
+	(c = alloc_array(2, &spec[2])) == NULL)
+	return 1;
+    if (nkernels > 4 && ext_setup() != 0)
+	return 1;
+    if (telemetry && telemetry_setup() != 0)
+	return 1;
+    stream_type->fill(a, array_size, 1.0, spec[0].place != NUMA_PLACE_SERIAL);
+    stream_type->fill(b, array_size, 2.0, spec[1].place != NUMA_PLACE_SERIAL);
+    stream_type->fill(c, array_size, 0.0, spec[2].place != NUMA_PLACE_SERIAL);
+
+    printf(HLINE);
+    for (i=0; i<3; i++) {
+	numa_format_spec(&region[i].spec, desc, sizeof(desc));
+	printf("Array %c: policy %s\n", 'a' + i, desc);
+	numa_region_describe(&region[i], desc, sizeof(desc));
+	printf("         placement %s\n", desc);
+    }
 
     printf(HLINE);
 
@@ -287,9 +606,7 @@ main()
     }
 
     t = mysecond();
-#pragma omp parallel for
-    for (j = 0; j < STREAM_ARRAY_SIZE; j++)
-		a[j] = 2.0E0 * a[j];
+    stream_type->scale(a, a, a, array_size, 2.0E0);
     t = 1.0E6 * (mysecond() - t);
 
     printf("Each test below will take on the order"
@@ -308,54 +625,87 @@ main()
     /*	--- MAIN LOOP --- repeat test cases NTIMES times --- */
 
     scalar = 3.0;
-    for (k=0; k<NTIMES; k++)
+    for (k=0; k<ntimes; k++)
 	{
+	if (telemetry) {
+	    for (j=0; j<nkernels; j++) {
+		STREAM_SYNC();
+		PERF_BEGIN(k);
+		times[j][k] = telemetry_run(j, k, a, b, c, scalar);
+		PERF_END(j,k);
+		if (j >= 4 && k == ntimes-1)
+		    ext_check(j, a);
+		}
+	    continue;
+	    }
+
+	STREAM_SYNC();
+	PERF_BEGIN(k);
 	times[0][k] = mysecond();
 #ifdef TUNED
-        tuned_STREAM_Copy();
+        tuned_STREAM_Copy(a, b, c);
 #else
-#pragma omp parallel for
-	for (j=0; j<STREAM_ARRAY_SIZE; j++)
-	    c[j] = a[j];
+	stream_type->copy(a, b, c, array_size, scalar);
 #endif
 	times[0][k] = mysecond() - times[0][k];
+	PERF_END(0,k);
 	
+	STREAM_SYNC();
+	PERF_BEGIN(k);
 	times[1][k] = mysecond();
 #ifdef TUNED
-        tuned_STREAM_Scale(scalar);
+        tuned_STREAM_Scale(a, b, c, scalar);
 #else
-#pragma omp parallel for
-	for (j=0; j<STREAM_ARRAY_SIZE; j++)
-	    b[j] = scalar*c[j];
+	stream_type->scale(a, b, c, array_size, scalar);
 #endif
 	times[1][k] = mysecond() - times[1][k];
+	PERF_END(1,k);
 	
+	STREAM_SYNC();
+	PERF_BEGIN(k);
 	times[2][k] = mysecond();
 #ifdef TUNED
-        tuned_STREAM_Add();
+        tuned_STREAM_Add(a, b, c);
 #else
-#pragma omp parallel for
-	for (j=0; j<STREAM_ARRAY_SIZE; j++)
-	    c[j] = a[j]+b[j];
+	stream_type->add(a, b, c, array_size, scalar);
 #endif
 	times[2][k] = mysecond() - times[2][k];
+	PERF_END(2,k);
 	
+	STREAM_SYNC();
+	PERF_BEGIN(k);
 	times[3][k] = mysecond();
 #ifdef TUNED
-        tuned_STREAM_Triad(scalar);
+        tuned_STREAM_Triad(a, b, c, scalar);
 #else
-#pragma omp parallel for
-	for (j=0; j<STREAM_ARRAY_SIZE; j++)
-	    a[j] = b[j]+scalar*c[j];
+	stream_type->triad(a, b, c, array_size, scalar);
 #endif
 	times[3][k] = mysecond() - times[3][k];
+	PERF_END(3,k);
+
+	for (j=4; j<nkernels; j++) {
+	    STREAM_SYNC();
+	    PERF_BEGIN(k);
+	    times[j][k] = mysecond();
+	    ext_kernel(j, a);
+	    times[j][k] = mysecond() - times[j][k];
+	    PERF_END(j,k);
+	    if (k == ntimes-1)
+		ext_check(j, a);
+	    }
 	}
 
     /*	--- SUMMARY --- */
 
-    for (k=1; k<NTIMES; k++) /* note -- skip first iteration */
+#ifdef STREAM_MPI
+    /* from here on times[][] hold the slowest rank of every iteration */
+    mpi_collect(times, a, b, c);
+    printf("Aggregate of %d ranks:\n", mpi_size);
+#endif
+
+    for (k=1; k<ntimes; k++) /* note -- skip first iteration */
 	{
-	for (j=0; j<4; j++)
+	for (j=0; j<nkernels; j++)
 	    {
 	    avgtime[j] = avgtime[j] + times[j][k];
 	    mintime[j] = MIN(mintime[j], times[j][k]);
@@ -364,24 +714,754 @@ main()
 	}
     
     printf("Function    Best Rate MB/s  Avg time     Min time     Max time\n");
-    for (j=0; j<4; j++) {
-		avgtime[j] = avgtime[j]/(double)(NTIMES-1);
+    for (j=0; j<nkernels; j++) {
+		avgtime[j] = avgtime[j]/(double)(ntimes-1);
 
 		printf("%s%12.1f  %11.6f  %11.6f  %11.6f\n", label[j],
-	       1.0E-06 * bytes[j]/mintime[j],
+	       1.0E-06 * bytes[j] * mpi_size/mintime[j],
 	       avgtime[j],
 	       mintime[j],
 	       maxtime[j]);
     }
     printf(HLINE);
+#ifdef STREAM_MPI
+    mpi_report();
+#endif
+    if (telemetry) {
+	telemetry_report(times);
+	if (telemetry_json && mpi_rank == 0)
+	    telemetry_write_json(telemetry_json, times);
+    }
+#ifdef PERF_COUNTERS
+    if (perf.navail > 0) {
+	perf_report(&perf, perf_kernels, nkernels);
+	printf(HLINE);
+    }
+    perf_counters_close(&perf);
+#endif
 
     /* --- Check Results --- */
     checkSTREAMresults(a,b,c);
+    if (nkernels > 4)
+	checkExtendedResults();
     printf(HLINE);
+#ifdef TUNED
+    tuned_store_report(a,b,c);
+#endif
 
+    for (i=0; i<3; i++)
+	numa_free(&region[i]);
+    if (nkernels > 4)
+	ext_free();
+    if (telemetry)
+	telemetry_free();
+    for (j=0; j<nkernels; j++)
+	free(times[j]);
     return 0;
 }
 
+/* element count with an optional K/M/G (10^3/10^6/10^9) suffix; -1 if malformed */
+static ssize_t parse_count(const char *s)
+{
+	char *end;
+	double v = strtod(s, &end);
+
+	if (end == s || v < 0)
+	    return -1;
+	switch (*end) {
+	case 'k': case 'K': v *= 1e3; end++; break;
+	case 'm': case 'M': v *= 1e6; end++; break;
+	case 'g': case 'G': v *= 1e9; end++; break;
+	}
+	return *end == '\0' ? (ssize_t) v : -1;
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [--size=N] [--type=double|float] [--offset=N] [--ntimes=N]\n"
+	       "          [--alloc=SPEC] [--alloc-a=SPEC] [--alloc-b=SPEC] [--alloc-c=SPEC]\n"
+	       "          [--extended] [--stride=S] [--streams=2..8]\n"
+	       "          [--sweep=THREADS] [--placement=compact,scatter,l3,numa] [--sweep-csv=FILE]\n"
+	       "          [--matrix] [--matrix-threads=N]\n"
+	       "          [--latency[=4K-1G]] [--latency-loaders=N]\n"
+	       "          [--telemetry] [--json=FILE]\n"
+#ifdef TUNED
+	       "          [--isa=NAME] [--store=regular|nt|zva] [--prefetch=BYTES]\n"
+#endif
+	       "  N accepts the suffixes K, M, G (10^3, 10^6, 10^9)\n"
+	       "  SPEC: firsttouch | serial | interleave[:nodes] | bind:nodes | preferred:node\n"
+	       "        optionally followed by ,thp | ,nothp | ,hugetlb | ,hugetlb1g (see INSTRUCTIONS in stream.c)\n",
+	       prog);
+}
+
+static const char *placement_names[4] = {"compact", "scatter", "l3", "numa"};
+
+/* comma separated placement names to a bit mask; 0 if malformed */
+static unsigned parse_placements(const char *s)
+{
+	unsigned mask = 0;
+	int p;
+
+	while (*s) {
+	    size_t len = strcspn(s, ",");
+
+	    for (p=0; p<4; p++)
+		if (strlen(placement_names[p]) == len && strncmp(s, placement_names[p], len) == 0)
+		    break;
+	    if (p == 4)
+		return 0;
+	    mask |= 1u << p;
+	    s += len + (s[len] == ',');
+	}
+	return mask;
+}
+
+/* run-time options; returns 0 to run, nonzero to exit */
+int parse_args(int argc, char **argv)
+{
+	int i, t;
+	ssize_t v;
+
+	for (i=1; i<argc; i++) {
+	    const char *arg = argv[i];
+
+	    if (strncmp(arg, "--size=", 7) == 0 && (v = parse_count(arg + 7)) > 0) {
+		array_size = v;
+	    } else if (strncmp(arg, "--offset=", 9) == 0 && (v = parse_count(arg + 9)) >= 0
+		       && v <= INT_MAX) {
+		array_offset = (int) v;
+	    } else if (strncmp(arg, "--ntimes=", 9) == 0 && (v = parse_count(arg + 9)) > 1
+		       && v <= INT_MAX) {
+		ntimes = (int) v;
+	    } else if (strncmp(arg, "--type=", 7) == 0) {
+		for (t=0; t<2 && strcmp(arg + 7, stream_types[t].name) != 0; t++)
+		    ;
+		if (t == 2) {
+		    printf("Unknown element type: %s\n", arg + 7);
+		    return 1;
+		}
+		stream_type = &stream_types[t];
+	    } else if (strncmp(arg, "--alloc=", 8) == 0) {
+		alloc_default = arg + 8;
+	    } else if (strncmp(arg, "--alloc-", 8) == 0 && arg[8] >= 'a' && arg[8] <= 'c'
+		       && arg[9] == '=') {
+		alloc_spec[arg[8] - 'a'] = arg + 10;
+	    } else if (strncmp(arg, "--sweep=", 8) == 0) {
+		sweep_threads = arg + 8;
+	    } else if (strcmp(arg, "--matrix") == 0) {
+		matrix = 1;
+	    } else if (strncmp(arg, "--matrix-threads=", 17) == 0 && (v = parse_count(arg + 17)) >= 0
+		       && v < CPU_SETSIZE) {
+		matrix_threads = (int) v;
+	    } else if (strcmp(arg, "--extended") == 0) {
+		nkernels = NKERNELS;
+	    } else if (strncmp(arg, "--stride=", 9) == 0 && (v = parse_count(arg + 9)) > 0) {
+		ext_stride = v;
+	    } else if (strncmp(arg, "--streams=", 10) == 0 && (v = parse_count(arg + 10)) >= 2
+		       && v <= 8) {
+		ext_streams = (int) v;
+		snprintf(ext_triadn_label, sizeof(ext_triadn_label), "Triad%d:    ", ext_streams);
+	    } else if (strcmp(arg, "--latency") == 0) {
+		latency_range = "4K-1G";
+	    } else if (strncmp(arg, "--latency=", 10) == 0) {
+		latency_range = arg + 10;
+	    } else if (strncmp(arg, "--latency-loaders=", 18) == 0 && (v = parse_count(arg + 18)) >= 0
+		       && v < CPU_SETSIZE) {
+		latency_loaders = (int) v;
+	    } else if (strcmp(arg, "--telemetry") == 0) {
+		telemetry = 1;
+	    } else if (strncmp(arg, "--json=", 7) == 0) {
+		telemetry = 1;
+		telemetry_json = arg + 7;
+	    } else if (strncmp(arg, "--sweep-csv=", 12) == 0) {
+		sweep_csv = arg + 12;
+	    } else if (strncmp(arg, "--placement=", 12) == 0) {
+		if ((sweep_placements = parse_placements(arg + 12)) == 0) {
+		    printf("Invalid placement list: %s\n", arg + 12);
+		    return 1;
+		}
+#ifdef TUNED
+	    } else if (strncmp(arg, "--isa=", 6) == 0) {
+		tuned_isa_name = arg + 6;
+	    } else if (strncmp(arg, "--store=", 8) == 0) {
+		for (t=0; t<STREAM_STORE_MODES && strcmp(arg + 8, stream_store_names[t]) != 0; t++)
+		    ;
+		if (t == STREAM_STORE_MODES) {
+		    printf("Unknown store mode: %s\n", arg + 8);
+		    return 1;
+		}
+		tuned_store = t;
+	    } else if (strncmp(arg, "--prefetch=", 11) == 0 && (v = parse_count(arg + 11)) >= 0) {
+		tuned_prefetch = v;
+#endif
+	    } else {
+		if (strcmp(arg, "--help") != 0 && strcmp(arg, "-h") != 0)
+		    printf("Invalid argument: %s\n", arg);
+		usage(argv[0]);
+		return 1;
+	    }
+	}
+	return 0;
+}
+
+/* map array i (a, b, c) with array_offset elements of padding in front of it */
+void *alloc_array(int i, numa_spec *spec)
+{
+	size_t len = (size_t) (array_size + array_offset) * stream_type->size;
+
+	if (numa_alloc(&region[i], len, spec) != 0) {
+	    printf("Failed to allocate array %c (%zu bytes)\n", 'a' + i, len);
+	    return NULL;
+	}
+	return (char *) region[i].base + (size_t) array_offset * stream_type->size;
+}
+
+/*------------------------- extended kernel set -------------------------*/
+
+/* d, src, idx and the TriadN inputs x0..x7 */
+static numa_region	ext_region[3 + 8];
+static void		*ext_d, *ext_src, *ext_x[8];
+static ssize_t		*ext_idx;
+static volatile double	ext_sum;
+static ssize_t		ext_errors[NKERNELS];
+
+static void *ext_alloc(int r, size_t bytes, const numa_spec *spec)
+{
+	if (numa_alloc(&ext_region[r], bytes, spec) != 0) {
+	    printf("Failed to allocate %zu bytes for the extended kernels\n", bytes);
+	    return NULL;
+	}
+	return ext_region[r].base;
+}
+
+/* allocate and initialize the arrays of the extended kernels */
+int ext_setup(void)
+{
+	const size_t words = (size_t) array_size * stream_type->size;
+	numa_spec spec;
+	uint64_t x = 0x9E3779B97F4A7C15ULL;
+	ssize_t j;
+	int i;
+
+	if (numa_parse_spec(alloc_default, &spec) != 0)
+	    return 1;
+	if ((ext_d = ext_alloc(0, words, &spec)) == NULL ||
+	    (ext_src = ext_alloc(1, words, &spec)) == NULL ||
+	    (ext_idx = (ssize_t *) ext_alloc(2, sizeof(ssize_t) * array_size, &spec)) == NULL)
+	    return 1;
+	for (i=0; i<ext_streams; i++)
+	    if ((ext_x[i] = ext_alloc(3 + i, words, &spec)) == NULL)
+		return 1;
+
+	stream_type->fill(ext_d, array_size, 0.0, 1);
+	stream_type->iota(ext_src, array_size);
+	for (i=0; i<ext_streams; i++)
+	    stream_type->fill(ext_x[i], array_size, i + 1.0, 1);
+#pragma omp parallel for
+	for (j=0; j<array_size; j++)
+	    ext_idx[j] = j;
+	/* random permutation (Fisher-Yates, xorshift with a fixed seed) */
+	for (j=array_size-1; j>0; j--) {
+	    ssize_t r, t;
+	    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+	    r = (ssize_t) (x % (uint64_t) (j + 1));
+	    t = ext_idx[j]; ext_idx[j] = ext_idx[r]; ext_idx[r] = t;
+	}
+	return 0;
+}
+
+void ext_free(void)
+{
+	int r;
+
+	for (r=0; r<3 + 8; r++)
+	    numa_free(&ext_region[r]);
+}
+
+/* extended kernel j (4 = Read ... 9 = TriadN) */
+void ext_kernel(int j, void *a)
+{
+	switch (j) {
+	case 4: ext_sum = stream_type->sum(a, array_size); break;
+	case 5: stream_type->fill(ext_d, array_size, 3.0, 1); break;
+	case 6: stream_type->strided(ext_d, a, array_size, ext_stride); break;
+	case 7: stream_type->gather(ext_d, ext_src, ext_idx, array_size); break;
+	case 8: stream_type->scatter(ext_d, ext_src, ext_idx, array_size); break;
+	case 9: stream_type->triadn(ext_d, ext_x, ext_streams, array_size, 3.0); break;
+	}
+}
+
+/* count wrong elements right after the last iteration of kernel j, while
+   d still holds its result */
+void ext_check(int j, void *a)
+{
+	const double eps = stream_type->epsilon;
+	double aj, bj, cj, expect, tol;
+	double one[8], out;
+	void *tiny[8];
+	ssize_t i, err = 0;
+	int q;
+
+	switch (j) {
+	case 4:
+	    /* the reduction order differs from a serial sum, so allow n ulps */
+	    stream_type->expected(ntimes, &aj, &bj, &cj);
+	    expect = aj * (double) array_size;
+	    tol = MAX(eps, DBL_EPSILON * (double) array_size);
+	    err = fabs(ext_sum - expect) > tol * fabs(expect);
+	    break;
+	case 5:
+	    for (i=0; i<array_size; i++)
+		err += stream_type->get(ext_d, i) != 3.0;
+	    break;
+	case 6:
+	    for (i=0; i<array_size; i+=ext_stride)
+		err += stream_type->get(ext_d, i) != stream_type->get(a, i);
+	    break;
+	case 7:
+	    for (i=0; i<array_size; i++)
+		err += stream_type->get(ext_d, i) != (double) (ext_idx[i] & 0xffffff);
+	    break;
+	case 8:
+	    for (i=0; i<array_size; i++)
+		err += stream_type->get(ext_d, ext_idx[i]) != (double) (i & 0xffffff);
+	    break;
+	case 9:
+	    /* the same kernel on one element gives the expected value */
+	    for (q=0; q<ext_streams; q++) {
+		tiny[q] = &one[q];
+		stream_type->fill(tiny[q], 1, q + 1.0, 0);
+	    }
+	    stream_type->triadn(&out, tiny, ext_streams, 1, 3.0);
+	    expect = stream_type->get(&out, 0);
+	    for (i=0; i<array_size; i++)
+		err += fabs(stream_type->get(ext_d, i) - expect) > eps * fabs(expect);
+	    break;
+	}
+	ext_errors[j] = err;
+}
+
+void checkExtendedResults(void)
+{
+	int j, failed = 0;
+
+	for (j=4; j<nkernels; j++) {
+	    if (ext_errors[j] == 0)
+		continue;
+	    failed++;
+	    if (j == 4)
+		printf("Failed Validation on Read: sum differs from %llu * a[]\n",
+		    (unsigned long long) array_size);
+	    else
+		printf("Failed Validation on %.*s: %ld errors were found.\n",
+		    (int) strcspn(label[j], ":"), label[j], (long) ext_errors[j]);
+	}
+	if (failed == 0)
+	    printf("Extended kernels validate: Read, Write, Strided, Gather, Scatter, %.*s\n",
+		(int) strcspn(ext_triadn_label, ":"), ext_triadn_label);
+}
+
+/* kernel j (Copy, Scale, Add, Triad) on the run-time arrays */
+static void run_kernel(int j, void *a, void *b, void *c, double scalar)
+{
+#ifdef TUNED
+	switch (j) {
+	case 0: tuned_STREAM_Copy(a, b, c); break;
+	case 1: tuned_STREAM_Scale(a, b, c, scalar); break;
+	case 2: tuned_STREAM_Add(a, b, c); break;
+	default: tuned_STREAM_Triad(a, b, c, scalar); break;
+	}
+#else
+	const stream_kernel_t kernel[4] = {stream_type->copy, stream_type->scale,
+					   stream_type->add, stream_type->triad};
+	kernel[j](a, b, c, array_size, scalar);
+#endif
+}
+
+#ifdef _OPENMP
+extern int omp_get_thread_num();
+extern void omp_set_num_threads(int);
+
+typedef struct {
+    int		cpu, node, l3, core;
+    int		smt;	/* rank among the SMT siblings of its core */
+    int		cidx;	/* rank of its core within the L3 domain */
+    int		didx;	/* rank of its L3 domain within the node */
+    long long	key;
+} sweep_cpu_t;
+
+static int cmp_topology(const void *x, const void *y)
+{
+	const sweep_cpu_t *p = (const sweep_cpu_t *) x, *q = (const sweep_cpu_t *) y;
+	if (p->node != q->node) return p->node - q->node;
+	if (p->l3 != q->l3) return p->l3 - q->l3;
+	if (p->core != q->core) return p->core - q->core;
+	return p->cpu - q->cpu;
+}
+
+static int cmp_key(const void *x, const void *y)
+{
+	const sweep_cpu_t *p = (const sweep_cpu_t *) x, *q = (const sweep_cpu_t *) y;
+	if (p->key != q->key) return p->key < q->key ? -1 : 1;
+	return p->cpu - q->cpu;
+}
+
+/* CPUs of the initial affinity mask with their topology ranks */
+static int sweep_topology(sweep_cpu_t *cpus)
+{
+	cpu_set_t mask;
+	int i, n = 0;
+
+	if (sched_getaffinity(0, sizeof(mask), &mask) != 0)
+	    return 0;
+	for (i=0; i<CPU_SETSIZE; i++) {
+	    if (!CPU_ISSET(i, &mask))
+		continue;
+	    cpus[n].cpu = i;
+	    cpus[n].node = affinity_cpu_node(i);
+	    cpus[n].l3 = affinity_cpu_l3(i);
+	    cpus[n].core = affinity_cpu_core(i);
+	    n++;
+	}
+	qsort(cpus, n, sizeof(sweep_cpu_t), cmp_topology);
+	for (i=0; i<n; i++) {
+	    const sweep_cpu_t *prev = i > 0 ? &cpus[i-1] : NULL;
+	    int same_node = prev && prev->node == cpus[i].node;
+	    int same_l3 = same_node && prev->l3 == cpus[i].l3;
+	    int same_core = same_l3 && prev->core == cpus[i].core;
+
+	    cpus[i].smt = same_core ? prev->smt + 1 : 0;
+	    cpus[i].cidx = same_core ? prev->cidx : same_l3 ? prev->cidx + 1 : 0;
+	    cpus[i].didx = same_l3 ? prev->didx : same_node ? prev->didx + 1 : 0;
+	}
+	return n;
+}
+
+/* order[] = CPUs for placement p, in the order threads are put on them */
+static int sweep_order(int p, sweep_cpu_t *cpus, int n, int *order)
+{
+	int i, m = 0;
+
+	for (i=0; i<n; i++) {
+	    sweep_cpu_t *c = &cpus[i];
+	    if (p == 0)
+		c->key = (long long) c->node << 48 | (long long) c->smt << 32 | c->didx << 16 | c->cidx;
+	    else if (p == 1)
+		c->key = (long long) c->smt << 48 | (long long) c->cidx << 32 | c->didx << 16 | c->node;
+	    else if (p == 2)
+		c->key = c->smt || c->cidx ? -1 : (long long) c->didx << 16 | c->node;
+	    else
+		c->key = c->smt || c->cidx || c->didx ? -1 : c->node;
+	}
+	qsort(cpus, n, sizeof(sweep_cpu_t), cmp_key);
+	for (i=0; i<n; i++)
+	    if (cpus[i].key >= 0)
+		order[m++] = cpus[i].cpu;
+	return m;
+}
+
+/* the --sweep mode: best rate of every kernel for each placement and
+   thread count, one fresh set of arrays per configuration */
+int run_sweep(numa_spec *spec)
+{
+	static sweep_cpu_t cpus[CPU_SETSIZE];
+	static int order[CPU_SETSIZE];
+	cpu_set_t counts, set;
+	int ncpus = sweep_topology(cpus);
+	int p, t, i, k, j, ncount, failed = 0;
+	void *a, *b, *c;
+	double rate[4], best_triad[CPU_SETSIZE], t0, tk[4], aj, bj, cj, err;
+	ssize_t nbad;
+	char cpulist[256], nodelist[96];
+	FILE *csv = NULL;
+
+	if (strcmp(sweep_threads, "all") == 0) {
+	    CPU_ZERO(&counts);
+	    for (t=1; t<=ncpus; t++)
+		CPU_SET(t, &counts);
+	} else if (affinity_parse_cpulist(sweep_threads, &counts) != 0 || CPU_COUNT(&counts) == 0) {
+	    printf("Invalid thread count list: %s\n", sweep_threads);
+	    return 1;
+	}
+	if (sweep_csv) {
+	    if ((csv = fopen(sweep_csv, "a")) == NULL) {
+		printf("Cannot open %s\n", sweep_csv);
+		return 1;
+	    }
+	    if (ftell(csv) == 0)
+		fprintf(csv, "placement,threads,cpus,nodes,type,array_size,"
+			     "copy_mbs,scale_mbs,add_mbs,triad_mbs\n");
+	}
+	stream_type->expected(ntimes, &aj, &bj, &cj);
+
+	printf(HLINE);
+	printf("Sweep over %d CPUs, best of %d iterations per kernel (MB/s)\n", ncpus, ntimes - 1);
+	for (p=0; p<4; p++) {
+	    if (!(sweep_placements & (1u << p)))
+		continue;
+	    ncount = sweep_order(p, cpus, ncpus, order);
+	    printf(HLINE);
+	    printf("Placement %-8s Threads  Copy         Scale        Add          Triad        CPUs\n",
+		placement_names[p]);
+	    memset(best_triad, 0, sizeof(best_triad));
+	    for (t=1; t<=ncount; t++) {
+		if (!CPU_ISSET(t, &counts))
+		    continue;
+		CPU_ZERO(&set);
+		for (i=0; i<t; i++)
+		    CPU_SET(order[i], &set);
+		affinity_format_cpulist(&set, cpulist, sizeof(cpulist));
+		CPU_ZERO(&set);
+		for (i=0; i<t; i++)
+		    CPU_SET(affinity_cpu_node(order[i]), &set);
+		affinity_format_cpulist(&set, nodelist, sizeof(nodelist));
+
+		omp_set_num_threads(t);
+#pragma omp parallel
+		affinity_bind_cpu(order[omp_get_thread_num()]);
+
+		if ((a = alloc_array(0, &spec[0])) == NULL ||
+		    (b = alloc_array(1, &spec[1])) == NULL ||
+		    (c = alloc_array(2, &spec[2])) == NULL)
+		    return 1;
+		stream_type->fill(a, array_size, 1.0, spec[0].place != NUMA_PLACE_SERIAL);
+		stream_type->fill(b, array_size, 2.0, spec[1].place != NUMA_PLACE_SERIAL);
+		stream_type->fill(c, array_size, 0.0, spec[2].place != NUMA_PLACE_SERIAL);
+		stream_type->scale(a, a, a, array_size, 2.0E0);
+
+		for (j=0; j<4; j++)
+		    rate[j] = 0.0;
+		for (k=0; k<ntimes; k++) {
+		    for (j=0; j<4; j++) {
+			t0 = mysecond();
+			run_kernel(j, a, b, c, 3.0);
+			tk[j] = mysecond() - t0;
+			if (k > 0)
+			    rate[j] = MAX(rate[j], 1.0E-06 * bytes[j]/tk[j]);
+		    }
+		}
+
+		/* same check as checkSTREAMresults, reported per configuration */
+		err = stream_type->error(a, array_size, aj, stream_type->epsilon, &nbad) / fabs(aj);
+		err = MAX(err, stream_type->error(b, array_size, bj, stream_type->epsilon, &nbad) / fabs(bj));
+		err = MAX(err, stream_type->error(c, array_size, cj, stream_type->epsilon, &nbad) / fabs(cj));
+		for (i=0; i<3; i++)
+		    numa_free(&region[i]);
+
+		best_triad[t] = rate[3];
+		printf("%-18s %7d %12.1f %12.1f %12.1f %12.1f  %s%s\n", "", t,
+		    rate[0], rate[1], rate[2], rate[3], cpulist,
+		    err > stream_type->epsilon ? "  FAILED VALIDATION" : "");
+		if (err > stream_type->epsilon)
+		    failed++;
+		if (csv)
+		    fprintf(csv, "%s,%d,\"%s\",\"%s\",%s,%ld,%.1f,%.1f,%.1f,%.1f\n",
+			placement_names[p], t, cpulist, nodelist, stream_type->name,
+			(long) array_size, rate[0], rate[1], rate[2], rate[3]);
+	    }
+
+	    /* saturation: fewest threads reaching 95% of the best Triad rate */
+	    for (t=1, rate[3]=0.0, k=0; t<=ncount; t++)
+		if (best_triad[t] > rate[3]) {
+		    rate[3] = best_triad[t];
+		    k = t;
+		}
+	    for (t=1; t<=ncount && best_triad[t] < 0.95 * rate[3]; t++)
+		;
+	    if (k > 0)
+		printf("%s: Triad peak %.1f MB/s at %d threads, 95%% of it from %d threads\n",
+		    placement_names[p], rate[3], k, t);
+	}
+	printf(HLINE);
+	if (csv)
+	    fclose(csv);
+	if (failed)
+	    printf("%d configurations failed validation\n", failed);
+	else
+	    printf("Solution Validates in all configurations: avg error less than %e\n",
+		stream_type->epsilon);
+	printf(HLINE);
+	return failed ? 1 : 0;
+}
+
+/* the --matrix mode: best rate of every kernel with the threads on the
+   CPUs of one NUMA node and the arrays bound to another, for all pairs */
+int run_matrix(numa_spec *spec)
+{
+	static sweep_cpu_t cpus[CPU_SETSIZE];
+	static int order[CPU_SETSIZE], cpu[CPU_SETSIZE];
+	static double rate[NUMA_MAX_NODES][NUMA_MAX_NODES][4];
+	int ncpus = sweep_topology(cpus), ncount = sweep_order(0, cpus, ncpus, order);
+	int rows[NUMA_MAX_NODES], cols[NUMA_MAX_NODES], nrows = 0, ncols = 0;
+	int r, m, t, i, j, k, failed = 0;
+	uint64_t mem = numa_memory_nodes();
+	numa_spec bind[3];
+	void *a, *b, *c;
+	double t0, best, aj, bj, cj, err;
+	ssize_t nbad;
+	cpu_set_t set;
+	char cpulist[256];
+
+	/* rows: nodes with CPUs we may use; columns: nodes with memory */
+	for (i=0; i<ncount; i++) {
+	    int node = affinity_cpu_node(order[i]);
+	    for (r=0; r<nrows && rows[r] != node; r++)
+		;
+	    if (r == nrows && nrows < NUMA_MAX_NODES)
+		rows[nrows++] = node;
+	}
+	for (m=0; m<NUMA_MAX_NODES; m++)
+	    if (mem & (1ULL << m))
+		cols[ncols++] = m;
+	stream_type->expected(ntimes, &aj, &bj, &cj);
+
+	printf(HLINE);
+	printf("Matrix: threads on CPU node (rows) x arrays on memory node (columns),\n"
+	       "best of %d iterations per kernel\n", ntimes - 1);
+	for (r=0; r<nrows; r++) {
+	    /* order[] is compact: cores of a node before their SMT siblings */
+	    CPU_ZERO(&set);
+	    for (i=0, t=0; i<ncount; i++)
+		if (affinity_cpu_node(order[i]) == rows[r] && (matrix_threads == 0 || t < matrix_threads)) {
+		    cpu[t++] = order[i];
+		    CPU_SET(order[i], &set);
+		}
+	    affinity_format_cpulist(&set, cpulist, sizeof(cpulist));
+	    printf("CPU node %d: %d threads on CPUs %s\n", rows[r], t, cpulist);
+
+	    omp_set_num_threads(t);
+#pragma omp parallel
+	    affinity_bind_cpu(cpu[omp_get_thread_num()]);
+
+	    for (m=0; m<ncols; m++) {
+		for (i=0; i<3; i++) {
+		    bind[i] = spec[i];
+		    bind[i].place = NUMA_PLACE_BIND;
+		    bind[i].nodes = 1ULL << cols[m];
+		}
+		for (j=0; j<4; j++)
+		    rate[r][m][j] = -1.0;
+		if ((a = alloc_array(0, &bind[0])) == NULL ||
+		    (b = alloc_array(1, &bind[1])) == NULL ||
+		    (c = alloc_array(2, &bind[2])) == NULL) {
+		    for (i=0; i<3; i++)
+			numa_free(&region[i]);
+		    continue;
+		}
+		stream_type->fill(a, array_size, 1.0, 1);
+		stream_type->fill(b, array_size, 2.0, 1);
+		stream_type->fill(c, array_size, 0.0, 1);
+		stream_type->scale(a, a, a, array_size, 2.0E0);
+
+		for (k=0; k<ntimes; k++)
+		    for (j=0; j<4; j++) {
+			t0 = mysecond();
+			run_kernel(j, a, b, c, 3.0);
+			t0 = mysecond() - t0;
+			if (k > 0)
+			    rate[r][m][j] = MAX(rate[r][m][j], 1.0E-06 * bytes[j]/t0);
+		    }
+
+		err = stream_type->error(a, array_size, aj, stream_type->epsilon, &nbad) / fabs(aj);
+		err = MAX(err, stream_type->error(b, array_size, bj, stream_type->epsilon, &nbad) / fabs(bj));
+		err = MAX(err, stream_type->error(c, array_size, cj, stream_type->epsilon, &nbad) / fabs(cj));
+		if (err > stream_type->epsilon) {
+		    printf("CPU node %d, memory node %d: FAILED VALIDATION\n", rows[r], cols[m]);
+		    failed++;
+		}
+		for (i=0; i<3; i++)
+		    numa_free(&region[i]);
+	    }
+	}
+
+	for (j=0; j<4; j++) {
+	    printf(HLINE);
+	    snprintf(cpulist, sizeof(cpulist), "%.*s MB/s", (int) strcspn(label[j], ":"), label[j]);
+	    printf("%-11s", cpulist);
+	    for (m=0; m<ncols; m++) {
+		snprintf(cpulist, sizeof(cpulist), "mem%d", cols[m]);
+		printf("%11s", cpulist);
+	    }
+	    printf("\n");
+	    for (r=0; r<nrows; r++) {
+		printf("cpu%-8d", rows[r]);
+		for (m=0; m<ncols; m++)
+		    if (rate[r][m][j] < 0)
+			printf("%11s", "-");
+		    else
+			printf("%11.1f", rate[r][m][j]);
+		printf("\n");
+	    }
+	}
+
+	/* Triad relative to the best memory node of each CPU node */
+	if (ncols > 1) {
+	    printf(HLINE);
+	    printf("Triad relative to the fastest memory node of each CPU node\n");
+	    for (r=0; r<nrows; r++) {
+		for (m=0, best=0.0; m<ncols; m++)
+		    best = MAX(best, rate[r][m][3]);
+		printf("cpu%-8d", rows[r]);
+		for (m=0; m<ncols; m++)
+		    if (rate[r][m][3] < 0 || best <= 0)
+			printf("%11s", "-");
+		    else
+			printf("%11.2f", rate[r][m][3] / best);
+		printf("\n");
+	    }
+	}
+	printf(HLINE);
+	if (failed)
+	    printf("%d node pairs failed validation\n", failed);
+	else
+	    printf("Solution Validates for all node pairs: avg error less than %e\n",
+		stream_type->epsilon);
+	printf(HLINE);
+	return failed ? 1 : 0;
+}
+#else
+int run_sweep(numa_spec *spec)
+{
+	(void) spec;
+	printf("Sweep mode needs an OpenMP build (e.g. gcc -fopenmp)\n");
+	return 1;
+}
+
+int run_matrix(numa_spec *spec)
+{
+	(void) spec;
+	printf("Matrix mode needs an OpenMP build (e.g. gcc -fopenmp)\n");
+	return 1;
+}
+#endif
+
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+# include "stream_latency.h"
+# include "stream_telemetry.h"
+#ifdef STREAM_MPI
+# include "stream_mpi.h"
+
+/* only rank 0 prints; a rank that fails takes the others down with it */
+int main(int argc, char **argv)
+{
+	int provided, rc;
+
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+	MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &mpi_size);
+	if (mpi_rank != 0 && freopen("/dev/null", "w", stdout) == NULL)
+	    MPI_Abort(MPI_COMM_WORLD, 1);
+	rc = stream_main(argc, argv);
+	fflush(stdout);
+	if (rc != 0)
+	    MPI_Abort(MPI_COMM_WORLD, rc);
+	MPI_Finalize();
+	return 0;
+}
+#endif
+
 # define	M	20
 
 int
@@ -431,115 +1511,42 @@ double mysecond()
         return ( (double) tp.tv_sec + (double) tp.tv_usec * 1.e-6 );
 }
 
-#ifndef abs
-#define abs(a) ((a) >= 0 ? (a) : -(a))
-#endif
-void checkSTREAMresults (double *a, double *b, double *c)
+void checkSTREAMresults (void *a, void *b, void *c)
 {
-	STREAM_TYPE aj,bj,cj,scalar;
-	STREAM_TYPE aSumErr,bSumErr,cSumErr;
-	STREAM_TYPE aAvgErr,bAvgErr,cAvgErr;
+	double aj,bj,cj;
+	double aAvgErr,bAvgErr,cAvgErr;
 	double epsilon;
-	ssize_t	j;
-	int	k,ierr,err;
-
-    /* reproduce initialization */
-	aj = 1.0;
-	bj = 2.0;
-	cj = 0.0;
-    /* a[] is modified during timing check */
-	aj = 2.0E0 * aj;
-    /* now execute timing loop */
-	scalar = 3.0;
-	for (k=0; k<NTIMES; k++)
-        {
-            cj = aj;
-            bj = scalar*cj;
-            cj = aj+bj;
-            aj = bj+scalar*cj;
-        }
+	ssize_t	ierr;
+	int	err;
 
-    /* accumulate deltas between observed and expected results */
-	aSumErr = 0.0;
-	bSumErr = 0.0;
-	cSumErr = 0.0;
-	for (j=0; j<STREAM_ARRAY_SIZE; j++) {
-		aSumErr += abs(a[j] - aj);
-		bSumErr += abs(b[j] - bj);
-		cSumErr += abs(c[j] - cj);
-		// if (j == 417) printf("Index 417: c[j]: %f, cj: %f\n",c[j],cj);	// MCCALPIN
-	}
-	aAvgErr = aSumErr / (STREAM_TYPE) STREAM_ARRAY_SIZE;
-	bAvgErr = bSumErr / (STREAM_TYPE) STREAM_ARRAY_SIZE;
-	cAvgErr = cSumErr / (STREAM_TYPE) STREAM_ARRAY_SIZE;
-
-	if (sizeof(STREAM_TYPE) == 4) {
-		epsilon = 1.e-6;
-	}
-	else if (sizeof(STREAM_TYPE) == 8) {
-		epsilon = 1.e-13;
-	}
-	else {
-		printf("WEIRD: sizeof(STREAM_TYPE) = %lu\n",sizeof(STREAM_TYPE));
-		epsilon = 1.e-6;
-	}
+    /* reproduce initialization, timing check and timing loop */
+	stream_type->expected(ntimes, &aj, &bj, &cj);
+	epsilon = stream_type->epsilon;
 
+    /* accumulate deltas between observed and expected results */
 	err = 0;
-	if (abs(aAvgErr/aj) > epsilon) {
+	aAvgErr = stream_type->error(a, array_size, aj, epsilon, &ierr);
+	if (fabs(aAvgErr/aj) > epsilon) {
 		err++;
 		printf ("Failed Validation on array a[], AvgRelAbsErr > epsilon (%e)\n",epsilon);
-		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",aj,aAvgErr,abs(aAvgErr)/aj);
-		ierr = 0;
-		for (j=0; j<STREAM_ARRAY_SIZE; j++) {
-			if (abs(a[j]/aj-1.0) > epsilon) {
-				ierr++;
-#ifdef VERBOSE
-				if (ierr < 10) {
-					printf("         array a: index: %ld, expected: %e, observed: %e, relative error: %e\n",
-						j,aj,a[j],abs((aj-a[j])/aAvgErr));
-				}
-#endif
-			}
-		}
-		printf("     For array a[], %d errors were found.\n",ierr);
+		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",aj,aAvgErr,fabs(aAvgErr)/aj);
+		printf("     For array a[], %ld errors were found.\n",(long) ierr);
 	}
-	if (abs(bAvgErr/bj) > epsilon) {
+	bAvgErr = stream_type->error(b, array_size, bj, epsilon, &ierr);
+	if (fabs(bAvgErr/bj) > epsilon) {
 		err++;
 		printf ("Failed Validation on array b[], AvgRelAbsErr > epsilon (%e)\n",epsilon);
-		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",bj,bAvgErr,abs(bAvgErr)/bj);
+		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",bj,bAvgErr,fabs(bAvgErr)/bj);
 		printf ("     AvgRelAbsErr > Epsilon (%e)\n",epsilon);
-		ierr = 0;
-		for (j=0; j<STREAM_ARRAY_SIZE; j++) {
-			if (abs(b[j]/bj-1.0) > epsilon) {
-				ierr++;
-#ifdef VERBOSE
-				if (ierr < 10) {
-					printf("         array b: index: %ld, expected: %e, observed: %e, relative error: %e\n",
-						j,bj,b[j],abs((bj-b[j])/bAvgErr));
-				}
-#endif
-			}
-		}
-		printf("     For array b[], %d errors were found.\n",ierr);
+		printf("     For array b[], %ld errors were found.\n",(long) ierr);
 	}
-	if (abs(cAvgErr/cj) > epsilon) {
+	cAvgErr = stream_type->error(c, array_size, cj, epsilon, &ierr);
+	if (fabs(cAvgErr/cj) > epsilon) {
 		err++;
 		printf ("Failed Validation on array c[], AvgRelAbsErr > epsilon (%e)\n",epsilon);
-		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",cj,cAvgErr,abs(cAvgErr)/cj);
+		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",cj,cAvgErr,fabs(cAvgErr)/cj);
 		printf ("     AvgRelAbsErr > Epsilon (%e)\n",epsilon);
-		ierr = 0;
-		for (j=0; j<STREAM_ARRAY_SIZE; j++) {
-			if (abs(c[j]/cj-1.0) > epsilon) {
-				ierr++;
-#ifdef VERBOSE
-				if (ierr < 10) {
-					printf("         array c: index: %ld, expected: %e, observed: %e, relative error: %e\n",
-						j,cj,c[j],abs((cj-c[j])/cAvgErr));
-				}
-#endif
-			}
-		}
-		printf("     For array c[], %d errors were found.\n",ierr);
+		printf("     For array c[], %ld errors were found.\n",(long) ierr);
 	}
 	if (err == 0) {
 		printf ("Solution Validates: avg error less than %e on all three arrays\n",epsilon);
@@ -547,43 +1554,111 @@ void checkSTREAMresults (double *a, double *b, double *c)
 #ifdef VERBOSE
 	printf ("Results Validation Verbose Results: \n");
 	printf ("    Expected a(1), b(1), c(1): %f %f %f \n",aj,bj,cj);
-	printf ("    Observed a(1), b(1), c(1): %f %f %f \n",a[1],b[1],c[1]);
-	printf ("    Rel Errors on a, b, c:     %e %e %e \n",abs(aAvgErr/aj),abs(bAvgErr/bj),abs(cAvgErr/cj));
+	printf ("    Observed a(1), b(1), c(1): %f %f %f \n",
+		stream_type->get(a,1),stream_type->get(b,1),stream_type->get(c,1));
+	printf ("    Rel Errors on a, b, c:     %e %e %e \n",fabs(aAvgErr/aj),fabs(bAvgErr/bj),fabs(cAvgErr/cj));
 #endif
 }
 
 #ifdef TUNED
-/* stubs for "tuned" versions of the kernels */
-void tuned_STREAM_Copy()
+/* pick the instruction set and store mode from the command line */
+int tuned_select(void)
 {
-	ssize_t j;
-#pragma omp parallel for
-        for (j=0; j<STREAM_ARRAY_SIZE; j++)
-            c[j] = a[j];
+	int i, n = stream_isa_list(tuned_isas);
+
+	tuned_isa = &tuned_isas[0];
+	if (tuned_isa_name) {
+	    for (i=0; i<n && strcmp(tuned_isas[i].name, tuned_isa_name) != 0; i++)
+		;
+	    if (i == n) {
+		printf("Instruction set %s is not available; choose from:", tuned_isa_name);
+		for (i=0; i<n; i++)
+		    printf(" %s", tuned_isas[i].name);
+		printf("\n");
+		return 1;
+	    }
+	    tuned_isa = &tuned_isas[i];
+	}
+	if (tuned_store < 0)
+	    tuned_store = tuned_isa->stores & (1u << STREAM_STORE_NT)
+		? STREAM_STORE_NT : STREAM_STORE_REGULAR;
+	if (!(tuned_isa->stores & (1u << tuned_store))) {
+	    printf("Store mode %s is not available with %s\n",
+		stream_store_names[tuned_store], tuned_isa->name);
+	    return 1;
+	}
+	return 0;
 }
 
-void tuned_STREAM_Scale(STREAM_TYPE scalar)
+void tuned_STREAM_Copy(void *a, void *b, void *c)
 {
-	ssize_t j;
-#pragma omp parallel for
-	for (j=0; j<STREAM_ARRAY_SIZE; j++)
-	    b[j] = scalar*c[j];
+	tuned_isa->kernel[stream_type - stream_types][0](a, b, c, array_size, 0.0,
+							 tuned_store, tuned_prefetch);
 }
 
-void tuned_STREAM_Add()
+void tuned_STREAM_Scale(void *a, void *b, void *c, double scalar)
 {
-	ssize_t j;
-#pragma omp parallel for
-	for (j=0; j<STREAM_ARRAY_SIZE; j++)
-	    c[j] = a[j]+b[j];
+	tuned_isa->kernel[stream_type - stream_types][1](a, b, c, array_size, scalar,
+							 tuned_store, tuned_prefetch);
 }
 
-void tuned_STREAM_Triad(STREAM_TYPE scalar)
+void tuned_STREAM_Add(void *a, void *b, void *c)
 {
-	ssize_t j;
-#pragma omp parallel for
-	for (j=0; j<STREAM_ARRAY_SIZE; j++)
-	    a[j] = b[j]+scalar*c[j];
+	tuned_isa->kernel[stream_type - stream_types][2](a, b, c, array_size, 0.0,
+							 tuned_store, tuned_prefetch);
+}
+
+void tuned_STREAM_Triad(void *a, void *b, void *c, double scalar)
+{
+	tuned_isa->kernel[stream_type - stream_types][3](a, b, c, array_size, scalar,
+							 tuned_store, tuned_prefetch);
+}
+
+/* Re-run every kernel ntimes with each store mode of the selected
+   instruction set and print the best rates side by side.  The rates use
+   the STREAM byte counts, so the regular-store column is low by the
+   write-allocate traffic that the other modes avoid.  The arrays are
+   overwritten, so this runs after the validation. */
+void tuned_store_report(void *a, void *b, void *c)
+{
+	double best[STREAM_STORE_MODES][4], t;
+	int m, j, k;
+
+	printf("Store mode comparison (%s, best of %d, prefetch %ld bytes):\n",
+	    tuned_isa->name, ntimes - 1, (long) tuned_prefetch);
+	printf("Function   ");
+	for (m=0; m<STREAM_STORE_MODES; m++)
+	    if (tuned_isa->stores & (1u << m))
+		printf(" %7s MB/s", stream_store_names[m]);
+	if (tuned_isa->stores & (1u << STREAM_STORE_NT))
+	    printf("  nt/regular");
+	printf("\n");
+
+	for (m=0; m<STREAM_STORE_MODES; m++) {
+	    if (!(tuned_isa->stores & (1u << m)))
+		continue;
+	    for (j=0; j<4; j++)
+		best[m][j] = FLT_MAX;
+	    for (k=0; k<ntimes; k++) {
+		for (j=0; j<4; j++) {
+		    t = mysecond();
+		    tuned_isa->kernel[stream_type - stream_types][j](a, b, c, array_size, 3.0,
+								     m, tuned_prefetch);
+		    t = mysecond() - t;
+		    if (k > 0)
+			best[m][j] = MIN(best[m][j], t);
+		}
+	    }
+	}
+	for (j=0; j<4; j++) {
+	    printf("%s", label[j]);
+	    for (m=0; m<STREAM_STORE_MODES; m++)
+		if (tuned_isa->stores & (1u << m))
+		    printf(" %12.1f", 1.0E-06 * bytes[j]/best[m][j]);
+	    if (tuned_isa->stores & (1u << STREAM_STORE_NT))
+		printf("  %10.2f", best[STREAM_STORE_REGULAR][j]/best[STREAM_STORE_NT][j]);
+	    printf("\n");
+	}
+	printf(HLINE);
 }
-/* end of stubs for the "tuned" versions of the kernels */
-#endif
\ No newline at end of file
+#endif
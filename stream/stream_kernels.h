@@ -0,0 +1,216 @@
+/*-----------------------------------------------------------------------*/
+/* stream_kernels.h                                                      */
+/*                                                                       */
+/* Reference STREAM kernels for one element type.  stream.c includes     */
+/* this file once per type supported at run time, after defining         */
+/*     STREAM_KTYPE      the element type (double, float)                */
+/*     STREAM_KNAME(x)   the name of kernel x for this type              */
+/* All kernels share one signature so that they can be put in a table;  */
+/* the arrays are passed as void * and "scalar" is ignored by Copy/Add.  */
+/*     Copy:  c = a          Scale: b = scalar*c                         */
+/*     Add:   c = a+b        Triad: a = b+scalar*c                       */
+/* The extended kernels (--extended) have their own signatures:          */
+/*     Read: sum(a)          Write: fill(d)      Strided: d = a, stride s */
+/*     Gather: d = src[idx]  Scatter: d[idx] = src                        */
+/*     TriadN: d = x0 + scalar*(x1 + ... + x(N-1))                        */
+/*-----------------------------------------------------------------------*/
+
+#if !defined(STREAM_KTYPE) || !defined(STREAM_KNAME)
+# error "define STREAM_KTYPE and STREAM_KNAME before including stream_kernels.h"
+#endif
+
+/* fill x[0..n) with v; "parallel" = 0 initializes from the master thread only */
+static void STREAM_KNAME(fill)(void *x, ssize_t n, double v, int parallel)
+{
+	STREAM_KTYPE *restrict xx = (STREAM_KTYPE *) x;
+	ssize_t j;
+#pragma omp parallel for if(parallel)
+	for (j=0; j<n; j++)
+	    xx[j] = (STREAM_KTYPE) v;
+}
+
+static void STREAM_KNAME(copy)(void *a, void *b, void *c, ssize_t n, double scalar)
+{
+	const STREAM_KTYPE *restrict aa = (const STREAM_KTYPE *) a;
+	STREAM_KTYPE *restrict cc = (STREAM_KTYPE *) c;
+	ssize_t j;
+	(void) b; (void) scalar;
+#pragma omp parallel for
+	for (j=0; j<n; j++)
+	    cc[j] = aa[j];
+}
+
+/* b and c may alias (the timing check calls it with b == c == a) */
+static void STREAM_KNAME(scale)(void *a, void *b, void *c, ssize_t n, double scalar)
+{
+	STREAM_KTYPE *bb = (STREAM_KTYPE *) b;
+	const STREAM_KTYPE *cc = (const STREAM_KTYPE *) c;
+	const STREAM_KTYPE s = (STREAM_KTYPE) scalar;
+	ssize_t j;
+	(void) a;
+#pragma omp parallel for
+	for (j=0; j<n; j++)
+	    bb[j] = s*cc[j];
+}
+
+static void STREAM_KNAME(add)(void *a, void *b, void *c, ssize_t n, double scalar)
+{
+	const STREAM_KTYPE *restrict aa = (const STREAM_KTYPE *) a;
+	const STREAM_KTYPE *restrict bb = (const STREAM_KTYPE *) b;
+	STREAM_KTYPE *restrict cc = (STREAM_KTYPE *) c;
+	ssize_t j;
+	(void) scalar;
+#pragma omp parallel for
+	for (j=0; j<n; j++)
+	    cc[j] = aa[j]+bb[j];
+}
+
+static void STREAM_KNAME(triad)(void *a, void *b, void *c, ssize_t n, double scalar)
+{
+	STREAM_KTYPE *restrict aa = (STREAM_KTYPE *) a;
+	const STREAM_KTYPE *restrict bb = (const STREAM_KTYPE *) b;
+	const STREAM_KTYPE *restrict cc = (const STREAM_KTYPE *) c;
+	const STREAM_KTYPE s = (STREAM_KTYPE) scalar;
+	ssize_t j;
+#pragma omp parallel for
+	for (j=0; j<n; j++)
+	    aa[j] = bb[j]+s*cc[j];
+}
+
+/* reproduce initialization, timing check and ntimes iterations in this
+   precision to get the values every element of a, b and c should hold */
+static void STREAM_KNAME(expected)(int ntimes, double *a, double *b, double *c)
+{
+	STREAM_KTYPE aj = 1.0, bj = 2.0, cj = 0.0, scalar = 3.0;
+	int k;
+
+	aj = 2.0E0 * aj;
+	for (k=0; k<ntimes; k++) {
+	    cj = aj;
+	    bj = scalar*cj;
+	    cj = aj+bj;
+	    aj = bj+scalar*cj;
+	}
+	*a = aj;
+	*b = bj;
+	*c = cj;
+}
+
+/* average absolute error of x[] against the expected value, and the
+   number of elements whose relative error exceeds epsilon */
+static double STREAM_KNAME(error)(const void *x, ssize_t n, double expected,
+				  double epsilon, ssize_t *nbad)
+{
+	const STREAM_KTYPE *xx = (const STREAM_KTYPE *) x;
+	const STREAM_KTYPE e = (STREAM_KTYPE) expected;
+	double sum = 0.0;
+	ssize_t j, bad = 0;
+#pragma omp parallel for reduction(+:sum,bad)
+	for (j=0; j<n; j++) {
+	    STREAM_KTYPE d = xx[j] - e;
+	    sum += d >= 0 ? d : -d;
+	    if (fabs((double) xx[j]/e - 1.0) > epsilon)
+		bad++;
+	}
+	*nbad = bad;
+	return sum / (double) n;
+}
+
+/* value of x[j] as double, for the verbose validation output */
+static double STREAM_KNAME(get)(const void *x, ssize_t j)
+{
+	return (double) ((const STREAM_KTYPE *) x)[j];
+}
+
+/*------------------------- extended kernel set -------------------------*/
+
+/* Read: sum of x[], accumulated in double */
+static double STREAM_KNAME(sum)(const void *x, ssize_t n)
+{
+	const STREAM_KTYPE *xx = (const STREAM_KTYPE *) x;
+	double sum = 0.0;
+	ssize_t j;
+#pragma omp parallel for reduction(+:sum)
+	for (j=0; j<n; j++)
+	    sum += xx[j];
+	return sum;
+}
+
+/* x[j] = j modulo 2^24, exact in float; the source of Gather and Scatter */
+static void STREAM_KNAME(iota)(void *x, ssize_t n)
+{
+	STREAM_KTYPE *xx = (STREAM_KTYPE *) x;
+	ssize_t j;
+#pragma omp parallel for
+	for (j=0; j<n; j++)
+	    xx[j] = (STREAM_KTYPE) (j & 0xffffff);
+}
+
+/* Strided copy: dst[j] = src[j] for every stride-th j */
+static void STREAM_KNAME(strided)(void *dst, const void *src, ssize_t n, ssize_t stride)
+{
+	STREAM_KTYPE *restrict d = (STREAM_KTYPE *) dst;
+	const STREAM_KTYPE *restrict s = (const STREAM_KTYPE *) src;
+	ssize_t j;
+#pragma omp parallel for
+	for (j=0; j<n; j+=stride)
+	    d[j] = s[j];
+}
+
+/* Gather: dst[j] = src[idx[j]] */
+static void STREAM_KNAME(gather)(void *dst, const void *src, const ssize_t *idx, ssize_t n)
+{
+	STREAM_KTYPE *restrict d = (STREAM_KTYPE *) dst;
+	const STREAM_KTYPE *restrict s = (const STREAM_KTYPE *) src;
+	ssize_t j;
+#pragma omp parallel for
+	for (j=0; j<n; j++)
+	    d[j] = s[idx[j]];
+}
+
+/* Scatter: dst[idx[j]] = src[j]; idx is a permutation, so no two threads
+   write the same element */
+static void STREAM_KNAME(scatter)(void *dst, const void *src, const ssize_t *idx, ssize_t n)
+{
+	STREAM_KTYPE *restrict d = (STREAM_KTYPE *) dst;
+	const STREAM_KTYPE *restrict s = (const STREAM_KTYPE *) src;
+	ssize_t j;
+#pragma omp parallel for
+	for (j=0; j<n; j++)
+	    d[idx[j]] = s[j];
+}
+
+/* N-stream triad: dst = x[0] + scalar*(x[1] + ... + x[nx-1]); the number
+   of streams is a constant in each instance so the inner sum unrolls */
+#define STREAM_TRIADN(NX) \
+	case NX: { \
+	    _Pragma("omp parallel for") \
+	    for (j=0; j<n; j++) { \
+		STREAM_KTYPE t = xx[1][j]; \
+		int q; \
+		for (q=2; q<NX; q++) \
+		    t += xx[q][j]; \
+		d[j] = xx[0][j] + s*t; \
+	    } \
+	    break; }
+static void STREAM_KNAME(triadn)(void *dst, void *const *x, int nx, ssize_t n, double scalar)
+{
+	STREAM_KTYPE *d = (STREAM_KTYPE *) dst;
+	const STREAM_KTYPE *xx[8];
+	const STREAM_KTYPE s = (STREAM_KTYPE) scalar;
+	ssize_t j;
+	int i;
+
+	for (i=0; i<nx && i<8; i++)
+	    xx[i] = (const STREAM_KTYPE *) x[i];
+	switch (nx) {
+	STREAM_TRIADN(2)
+	STREAM_TRIADN(3)
+	STREAM_TRIADN(4)
+	STREAM_TRIADN(5)
+	STREAM_TRIADN(6)
+	STREAM_TRIADN(7)
+	STREAM_TRIADN(8)
+	}
+}
+#undef STREAM_TRIADN
@@ -0,0 +1,275 @@
+/*-----------------------------------------------------------------------*/
+/* stream_latency.h                                                      */
+/*                                                                       */
+/* Latency mode of stream.c (--latency): a pointer chase through a       */
+/* randomly ordered cycle of cache lines, for working sets from a few KB */
+/* to several GB.  Every load depends on the previous one, so the time   */
+/* per load is the load-to-use latency of whatever level of the memory   */
+/* hierarchy holds the working set; the random order defeats the         */
+/* hardware prefetchers.  Each row is annotated with the cache level the */
+/* working set fits in (sizes from sysfs) or with the NUMA node(s) its   */
+/* pages are on, so the L1/L2/L3/DRAM/remote plateaus can be read off.   */
+/*                                                                       */
+/* The chain is allocated with the policy of array a (--alloc/--alloc-a),*/
+/* e.g. bind:1 to measure a remote node or thp/hugetlb to take the TLB   */
+/* out of the measurement.  --latency-loaders=N runs Triad on N other    */
+/* threads during the chase (loaded latency) and reports the bandwidth   */
+/* they achieve.                                                         */
+/*                                                                       */
+/* This file is part of stream.c and uses its globals.                   */
+/*-----------------------------------------------------------------------*/
+
+#define LATENCY_LINE		64
+#define LATENCY_REPS		3
+#define LATENCY_MIN_LOADS	(1L << 23)
+
+typedef struct {
+    int		level;
+    size_t	bytes;
+} latency_cache_t;
+
+/* data and unified caches of cpu0, smallest first; returns the count */
+static int latency_caches(latency_cache_t *caches, int max)
+{
+	char path[128], type[32], size[32];
+	int idx, n = 0;
+
+	for (idx=0; idx<8 && n<max; idx++) {
+	    FILE *f;
+	    long kb;
+
+	    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", idx);
+	    if ((f = fopen(path, "r")) == NULL)
+		break;
+	    if (fscanf(f, "%31s", type) != 1)
+		type[0] = '\0';
+	    fclose(f);
+	    if (strcmp(type, "Instruction") == 0)
+		continue;
+	    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", idx);
+	    if ((f = fopen(path, "r")) == NULL)
+		continue;
+	    if (fscanf(f, "%31s", size) != 1)
+		size[0] = '\0';
+	    fclose(f);
+	    kb = strtol(size, NULL, 10);
+	    if (strchr(size, 'M'))
+		kb *= 1024;
+	    snprintf(path, sizeof(path), "cache/index%d/level", idx);
+	    caches[n].level = affinity_cpu_sysfs_int(0, path, 0);
+	    caches[n].bytes = (size_t) kb << 10;
+	    if (caches[n].bytes > 0)
+		n++;
+	}
+	return n;
+}
+
+/* bytes with an optional K/M/G suffix (powers of 1024); 0 if malformed */
+static size_t parse_bytes(const char *s, char **end)
+{
+	double v = strtod(s, end);
+
+	if (*end == s || v <= 0)
+	    return 0;
+	switch (**end) {
+	case 'k': case 'K': v *= 1024.0; (*end)++; break;
+	case 'm': case 'M': v *= 1024.0*1024.0; (*end)++; break;
+	case 'g': case 'G': v *= 1024.0*1024.0*1024.0; (*end)++; break;
+	}
+	return (size_t) v;
+}
+
+static void format_bytes(size_t n, char *buf, size_t len)
+{
+	if (n >= (1UL << 30) && n % (1UL << 30) == 0)
+	    snprintf(buf, len, "%zu GiB", n >> 30);
+	else if (n >= (1UL << 20))
+	    snprintf(buf, len, "%.4g MiB", n / 1048576.0);
+	else
+	    snprintf(buf, len, "%.4g KiB", n / 1024.0);
+}
+
+/* link the lines of buf into one cycle in random order (Fisher-Yates on
+   the visiting order, xorshift generator with a fixed seed); returns the
+   first line */
+static void **latency_chain(char *buf, size_t lines)
+{
+	size_t *order = (size_t *) malloc(sizeof(size_t) * lines);
+	uint64_t x = 0x9E3779B97F4A7C15ULL;
+	size_t i;
+	void **first;
+
+	if (order == NULL)
+	    return NULL;
+	for (i=0; i<lines; i++)
+	    order[i] = i;
+	for (i=lines-1; i>0; i--) {
+	    size_t j, t;
+	    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+	    j = (size_t) (x % (i + 1));
+	    t = order[i]; order[i] = order[j]; order[j] = t;
+	}
+	for (i=0; i<lines; i++)
+	    *(void **) (buf + order[i] * LATENCY_LINE) =
+		buf + order[(i + 1) % lines] * LATENCY_LINE;
+	first = (void **) (buf + order[0] * LATENCY_LINE);
+	free(order);
+	return first;
+}
+
+/* follow the chain for "loads" loads (a multiple of 16), returning the
+   end point so that the compiler cannot drop the loop */
+static void **latency_chase(void **p, long loads)
+{
+	long i;
+
+	for (i=0; i<loads; i+=16) {
+#define LATENCY_HOP	p = (void **) *p;
+	    LATENCY_HOP LATENCY_HOP LATENCY_HOP LATENCY_HOP
+	    LATENCY_HOP LATENCY_HOP LATENCY_HOP LATENCY_HOP
+	    LATENCY_HOP LATENCY_HOP LATENCY_HOP LATENCY_HOP
+	    LATENCY_HOP LATENCY_HOP LATENCY_HOP LATENCY_HOP
+#undef LATENCY_HOP
+	}
+	return p;
+}
+
+/* best of LATENCY_REPS timed chases over the chain, in ns per load */
+static double latency_measure(void **first, size_t lines, void *volatile *sink)
+{
+	long loads = (long) lines > LATENCY_MIN_LOADS ? (long) lines : LATENCY_MIN_LOADS;
+	double best = FLT_MAX, t;
+	void **p;
+	int r;
+
+	loads = (loads + 15) / 16 * 16;
+	p = latency_chase(first, ((long) lines + 15) / 16 * 16);	/* warm up */
+	for (r=0; r<LATENCY_REPS; r++) {
+	    t = mysecond();
+	    p = latency_chase(p, loads);
+	    t = mysecond() - t;
+	    best = MIN(best, t);
+	}
+	*sink = p;
+	return 1.0E9 * best / (double) loads;
+}
+
+/* the --latency mode */
+int run_latency(numa_spec *spec)
+{
+	latency_cache_t caches[8];
+	int ncaches = latency_caches(caches, 8), i, loaders = latency_loaders;
+	size_t lo, hi, ws;
+	char *end, label_ws[32], pages[224], where[256];
+	void *a = NULL, *b = NULL, *c = NULL;
+	void *volatile sink;
+	numa_region chain;
+
+	if ((lo = parse_bytes(latency_range, &end)) == 0 || *end != '-'
+	    || (hi = parse_bytes(end + 1, &end)) == 0 || *end != '\0' || hi < lo) {
+	    printf("Invalid latency range: %s (e.g. 4K-1G)\n", latency_range);
+	    return 1;
+	}
+	lo = MAX(lo, 16 * LATENCY_LINE);
+#ifndef _OPENMP
+	if (loaders > 0) {
+	    printf("Loaded latency needs an OpenMP build, running without loaders\n");
+	    loaders = 0;
+	}
+#endif
+	if (loaders > 0) {
+	    if ((a = alloc_array(0, &spec[0])) == NULL ||
+		(b = alloc_array(1, &spec[1])) == NULL ||
+		(c = alloc_array(2, &spec[2])) == NULL)
+		return 1;
+	    stream_type->fill(a, array_size, 1.0, 1);
+	    stream_type->fill(b, array_size, 2.0, 1);
+	    stream_type->fill(c, array_size, 0.0, 1);
+	}
+
+	printf(HLINE);
+	printf("Latency: random pointer chase over %d-byte lines, best of %d\n",
+	    LATENCY_LINE, LATENCY_REPS);
+	for (i=0; i<ncaches; i++) {
+	    format_bytes(caches[i].bytes, label_ws, sizeof(label_ws));
+	    printf("%sL%d %s", i ? ", " : "Caches (cpu0): ", caches[i].level, label_ws);
+	}
+	if (ncaches > 0)
+	    printf("\n");
+	if (loaders > 0)
+	    printf("Loaded: %d threads run Triad on %llu-element arrays during the chase\n",
+		loaders, (unsigned long long) array_size);
+	printf(HLINE);
+	printf("Working set      ns/load%s  Level\n", loaders > 0 ? "   Triad MB/s" : "");
+
+	for (ws = lo; ws <= hi; ws = ws % 3 == 0 ? ws / 3 * 4 : ws + ws / 2) {
+	    size_t lines = ws / LATENCY_LINE;
+	    double ns = 0.0, mbs = 0.0;
+	    void **first;
+
+	    if (numa_alloc(&chain, lines * LATENCY_LINE, &spec[0]) != 0)
+		return 1;
+	    if ((first = latency_chain((char *) chain.base, lines)) == NULL) {
+		printf("Out of memory for %zu lines\n", lines);
+		return 1;
+	    }
+
+	    if (loaders == 0) {
+		ns = latency_measure(first, lines, &sink);
+	    }
+#ifdef _OPENMP
+	    else {
+		volatile int stop = 0;
+#pragma omp parallel num_threads(loaders + 1) reduction(+:mbs)
+		{
+		    int tid = omp_get_thread_num();
+#pragma omp barrier
+		    if (tid == 0) {
+			ns = latency_measure(first, lines, &sink);
+			stop = 1;
+		    } else {
+			/* Triad on this loader's share; the nested parallel
+			   region of the kernel runs on this thread alone */
+			ssize_t n0 = array_size * (tid-1) / loaders;
+			ssize_t n1 = array_size * tid / loaders;
+			size_t off = (size_t) n0 * stream_type->size;
+			double t0 = mysecond(), t1 = t0;
+			long iters = 0;
+
+			while (!stop) {
+			    stream_type->triad((char *) a + off, (char *) b + off,
+					       (char *) c + off, n1 - n0, 3.0);
+			    iters++;
+			    t1 = mysecond();
+			}
+			if (t1 > t0)
+			    mbs += 1.0E-06 * 3.0 * stream_type->size * (double) (n1 - n0)
+				   * iters / (t1 - t0);
+		    }
+		}
+	    }
+#endif
+
+	    /* the level the working set fits in, or where its pages are */
+	    for (i=0; i<ncaches && ws > caches[i].bytes; i++)
+		;
+	    if (i < ncaches) {
+		snprintf(where, sizeof(where), "L%d", caches[i].level);
+	    } else {
+		numa_region_describe(&chain, pages, sizeof(pages));
+		snprintf(where, sizeof(where), "memory %s", pages);
+	    }
+	    numa_free(&chain);
+
+	    format_bytes(ws, label_ws, sizeof(label_ws));
+	    if (loaders > 0)
+		printf("%-12s %10.2f %12.1f  %s\n", label_ws, ns, mbs, where);
+	    else
+		printf("%-12s %10.2f  %s\n", label_ws, ns, where);
+	}
+	printf(HLINE);
+	if (loaders > 0)
+	    for (i=0; i<3; i++)
+		numa_free(&region[i]);
+	return 0;
+}
@@ -0,0 +1,149 @@
+/*-----------------------------------------------------------------------*/
+/* stream_mpi.h                                                          */
+/*                                                                       */
+/* MPI build of stream.c (mpicc -DSTREAM_MPI).  Every rank allocates its */
+/* own three arrays of STREAM_ARRAY_SIZE (--size) elements and runs the  */
+/* kernels with its own OpenMP threads; all ranks enter each kernel      */
+/* together after an MPI_Barrier.  Afterwards                            */
+/*   - every iteration of every kernel is timed by its slowest rank, and */
+/*     the usual summary table reports the aggregate bandwidth of all    */
+/*     ranks from these times,                                           */
+/*   - rank 0 prints the best rate of each rank (with its host, NUMA     */
+/*     node, threads and CPUs) and of each host, the latter from the     */
+/*     slowest rank of that host in each iteration,                      */
+/*   - each rank validates its own arrays; failures are listed by rank.  */
+/* Only rank 0 writes to stdout.                                         */
+/*                                                                       */
+/* This file is part of stream.c and uses its globals.                   */
+/*-----------------------------------------------------------------------*/
+
+typedef struct {
+    char	host[64];
+    char	cpus[64];	/* affinity mask of the rank */
+    int		node;		/* NUMA node of its first CPU */
+    int		threads;
+    int		valid;
+} mpi_rank_info_t;
+
+static mpi_rank_info_t	*mpi_info;	/* [rank], rank 0 only */
+static double		*mpi_times;	/* [(rank*NKERNELS+j)*ntimes+k], rank 0 only */
+
+/* gather the times and rank descriptions to rank 0, then replace times[][]
+   by the time of the slowest rank in every iteration */
+void mpi_collect(double **times, void *a, void *b, void *c)
+{
+	mpi_rank_info_t mine;
+	double aj, bj, cj, err, *local;
+	ssize_t nbad;
+	cpu_set_t set;
+	int j, len;
+
+	memset(&mine, 0, sizeof(mine));
+	MPI_Get_processor_name(mine.host, &len);
+	mine.host[sizeof(mine.host) - 1] = '\0';
+	sched_getaffinity(0, sizeof(set), &set);
+	affinity_format_cpulist(&set, mine.cpus, sizeof(mine.cpus));
+	mine.node = affinity_cpu_node(affinity_nth_cpu(&set, 0));
+#ifdef _OPENMP
+	mine.threads = omp_get_max_threads();
+#else
+	mine.threads = 1;
+#endif
+	stream_type->expected(ntimes, &aj, &bj, &cj);
+	err = stream_type->error(a, array_size, aj, stream_type->epsilon, &nbad) / fabs(aj);
+	err = MAX(err, stream_type->error(b, array_size, bj, stream_type->epsilon, &nbad) / fabs(bj));
+	err = MAX(err, stream_type->error(c, array_size, cj, stream_type->epsilon, &nbad) / fabs(cj));
+	mine.valid = err <= stream_type->epsilon;
+
+	local = (double *) malloc(sizeof(double) * NKERNELS * ntimes);
+	for (j=0; j<NKERNELS; j++)
+	    if (j < nkernels)
+		memcpy(local + j * ntimes, times[j], sizeof(double) * ntimes);
+	    else
+		memset(local + j * ntimes, 0, sizeof(double) * ntimes);
+	if (mpi_rank == 0) {
+	    mpi_info = (mpi_rank_info_t *) malloc(sizeof(mpi_rank_info_t) * mpi_size);
+	    mpi_times = (double *) malloc(sizeof(double) * NKERNELS * ntimes * mpi_size);
+	}
+	MPI_Gather(&mine, (int) sizeof(mine), MPI_BYTE,
+		   mpi_info, (int) sizeof(mine), MPI_BYTE, 0, MPI_COMM_WORLD);
+	MPI_Gather(local, NKERNELS * ntimes, MPI_DOUBLE,
+		   mpi_times, NKERNELS * ntimes, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+	free(local);
+
+	for (j=0; j<nkernels; j++)
+	    MPI_Allreduce(MPI_IN_PLACE, times[j], ntimes, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+}
+
+/* best rate of kernel j for the ranks with member[r] set: in each
+   iteration their bytes over the time of the slowest of them */
+static double mpi_best_rate(int j, const int *member)
+{
+	double best = 0.0, t;
+	int k, r, n;
+
+	for (k=1; k<ntimes; k++) {
+	    for (r=0, n=0, t=0.0; r<mpi_size; r++)
+		if (member[r]) {
+		    t = MAX(t, mpi_times[((size_t) r * NKERNELS + j) * ntimes + k]);
+		    n++;
+		}
+	    if (t > 0)
+		best = MAX(best, 1.0E-06 * bytes[j] * n / t);
+	}
+	return best;
+}
+
+/* per-rank and per-host tables, on rank 0 */
+void mpi_report(void)
+{
+	int *member, *done, r, q, j, ranks, threads, failed = 0;
+
+	if (mpi_rank != 0)
+	    return;
+	member = (int *) calloc(mpi_size, sizeof(int));
+	done = (int *) calloc(mpi_size, sizeof(int));
+
+	printf("Best rate per rank (MB/s):\n");
+	printf("%4s  %-16s %4s %8s  %-12s %10s %10s %10s %10s\n",
+	    "Rank", "Host", "Node", "Threads", "CPUs", "Copy", "Scale", "Add", "Triad");
+	for (r=0; r<mpi_size; r++) {
+	    const mpi_rank_info_t *p = &mpi_info[r];
+
+	    memset(member, 0, sizeof(int) * mpi_size);
+	    member[r] = 1;
+	    printf("%4d  %-16s %4d %8d  %-12s", r, p->host, p->node, p->threads, p->cpus);
+	    for (j=0; j<4; j++)
+		printf(" %10.1f", mpi_best_rate(j, member));
+	    printf("%s\n", p->valid ? "" : "  FAILED VALIDATION");
+	    failed += !p->valid;
+	}
+
+	printf("Best rate per host (MB/s):\n");
+	printf("%-16s %6s %8s %10s %10s %10s %10s\n",
+	    "Host", "Ranks", "Threads", "Copy", "Scale", "Add", "Triad");
+	for (r=0; r<mpi_size; r++) {
+	    if (done[r])
+		continue;
+	    ranks = threads = 0;
+	    for (q=0; q<mpi_size; q++) {
+		member[q] = !done[q] && strcmp(mpi_info[q].host, mpi_info[r].host) == 0;
+		if (member[q]) {
+		    done[q] = 1;
+		    ranks++;
+		    threads += mpi_info[q].threads;
+		}
+	    }
+	    printf("%-16s %6d %8d", mpi_info[r].host, ranks, threads);
+	    for (j=0; j<4; j++)
+		printf(" %10.1f", mpi_best_rate(j, member));
+	    printf("\n");
+	}
+	if (failed)
+	    printf("%d of %d ranks failed validation\n", failed, mpi_size);
+	printf(HLINE);
+	free(member);
+	free(done);
+	free(mpi_info);
+	free(mpi_times);
+}
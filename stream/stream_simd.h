@@ -0,0 +1,133 @@
+/*-----------------------------------------------------------------------*/
+/* stream_simd.h                                                         */
+/*                                                                       */
+/* Tuned STREAM kernels for one instruction set and element type.        */
+/* stream_tuned.h includes this file once per (ISA, type) pair after     */
+/* defining                                                              */
+/*     SIMD_NAME(x)           name of function x for this pair           */
+/*     SIMD_ATTR              function attributes (e.g. target("avx2"))  */
+/*     SIMD_T, SIMD_V         element type, vector type                  */
+/*     SIMD_W                 elements per vector (may be a run-time     */
+/*                            value, e.g. svcntd())                      */
+/*     SIMD_LOAD(p)           unaligned load                             */
+/*     SIMD_STORE(p,v)        regular store, p is vector aligned         */
+/*     SIMD_STREAM2(p,v0,v1)  non-temporal store of two consecutive      */
+/*                            vectors, p is vector aligned               */
+/*     SIMD_FENCE()           orders the non-temporal stores             */
+/*     SIMD_ZVA(p)            zero the cache line at p without reading   */
+/*                            it (aarch64 DC ZVA, empty elsewhere)       */
+/*     SIMD_SET1(s), SIMD_MUL(x,y), SIMD_ADD(x,y)                         */
+/*     SIMD_FMA(x,y,z)        x + y*z                                    */
+/*                                                                       */
+/* Each thread works on one static, cache-line aligned chunk of the      */
+/* destination (stream_chunk).  Inside a chunk the main loop handles one */
+/* cache line (at least two vectors) per iteration, so that prefetches,  */
+/* DC ZVA and the paired non-temporal stores all work on whole lines.    */
+/*-----------------------------------------------------------------------*/
+
+/* dst[j] = op(x[j], y[j]) for j in [lo, hi); op and store are constants
+   after inlining, which gives one specialized loop per combination */
+static inline SIMD_ATTR __attribute__((always_inline))
+void SIMD_NAME(range)(const int op, const int store, SIMD_T *restrict d,
+		      const SIMD_T *restrict x, const SIMD_T *restrict y,
+		      SIMD_T s, ssize_t lo, ssize_t hi, ssize_t pf)
+{
+	const ssize_t w = SIMD_W;
+	const ssize_t line = STREAM_LINE / (ssize_t) sizeof(SIMD_T);
+	const ssize_t step = 2*w > line ? 2*w : line;
+	const SIMD_V vs = SIMD_SET1(s);
+	ssize_t j = lo, v;
+
+#define SIMD_SCALAR_OP(i) (op == 0 ? x[i] : op == 1 ? s*x[i] : \
+			   op == 2 ? x[i]+y[i] : x[i]+s*y[i])
+#define SIMD_VECTOR_OP(i) (op == 0 ? SIMD_LOAD(x+(i)) : \
+			   op == 1 ? SIMD_MUL(vs, SIMD_LOAD(x+(i))) : \
+			   op == 2 ? SIMD_ADD(SIMD_LOAD(x+(i)), SIMD_LOAD(y+(i))) : \
+			   SIMD_FMA(SIMD_LOAD(x+(i)), vs, SIMD_LOAD(y+(i))))
+
+	/* head: up to the first cache line boundary of the destination */
+	for (; j < hi && ((uintptr_t) (d+j) & (STREAM_LINE-1)) != 0; j++)
+	    d[j] = SIMD_SCALAR_OP(j);
+
+	for (; j + step <= hi; j += step) {
+	    if (pf > 0)		/* one prefetch per line of the step */
+		for (v = 0; v < step; v += line) {
+		    __builtin_prefetch(x+j+pf+v, 0, 0);
+		    if (op >= 2)
+			__builtin_prefetch(y+j+pf+v, 0, 0);
+		}
+	    if (store == STREAM_STORE_ZVA)
+		for (v = 0; v < step; v += line)
+		    SIMD_ZVA(d+j+v);
+	    for (v = 0; v < step; v += 2*w) {
+		SIMD_V r0 = SIMD_VECTOR_OP(j+v);
+		SIMD_V r1 = SIMD_VECTOR_OP(j+v+w);
+		if (store == STREAM_STORE_NT) {
+		    SIMD_STREAM2(d+j+v, r0, r1);
+		} else {
+		    SIMD_STORE(d+j+v, r0);
+		    SIMD_STORE(d+j+v+w, r1);
+		}
+	    }
+	}
+
+	/* tail */
+	for (; j < hi; j++)
+	    d[j] = SIMD_SCALAR_OP(j);
+	if (store == STREAM_STORE_NT)
+	    SIMD_FENCE();
+#undef SIMD_SCALAR_OP
+#undef SIMD_VECTOR_OP
+}
+
+/* one parallel region per kernel call; every thread takes its own chunk */
+static SIMD_ATTR void SIMD_NAME(run)(const int op, int store, SIMD_T *d,
+				     const SIMD_T *x, const SIMD_T *y,
+				     double scalar, ssize_t n, ssize_t pf_bytes)
+{
+	const ssize_t pf = pf_bytes / (ssize_t) sizeof(SIMD_T);
+	const SIMD_T s = (SIMD_T) scalar;
+#pragma omp parallel
+	{
+	    ssize_t lo, hi;
+
+	    stream_chunk(d, n, sizeof(SIMD_T), &lo, &hi);
+	    if (store == STREAM_STORE_NT)
+		SIMD_NAME(range)(op, STREAM_STORE_NT, d, x, y, s, lo, hi, pf);
+	    else if (store == STREAM_STORE_ZVA)
+		SIMD_NAME(range)(op, STREAM_STORE_ZVA, d, x, y, s, lo, hi, pf);
+	    else
+		SIMD_NAME(range)(op, STREAM_STORE_REGULAR, d, x, y, s, lo, hi, pf);
+	}
+}
+
+/* the four STREAM kernels in the stream_tuned_kernel_t form */
+static void SIMD_NAME(copy)(void *a, void *b, void *c, ssize_t n, double scalar,
+			    int store, ssize_t pf)
+{
+	(void) b;
+	SIMD_NAME(run)(0, store, (SIMD_T *) c, (const SIMD_T *) a, (const SIMD_T *) a,
+		       scalar, n, pf);
+}
+
+static void SIMD_NAME(scale)(void *a, void *b, void *c, ssize_t n, double scalar,
+			     int store, ssize_t pf)
+{
+	(void) a;
+	SIMD_NAME(run)(1, store, (SIMD_T *) b, (const SIMD_T *) c, (const SIMD_T *) c,
+		       scalar, n, pf);
+}
+
+static void SIMD_NAME(add)(void *a, void *b, void *c, ssize_t n, double scalar,
+			   int store, ssize_t pf)
+{
+	SIMD_NAME(run)(2, store, (SIMD_T *) c, (const SIMD_T *) a, (const SIMD_T *) b,
+		       scalar, n, pf);
+}
+
+static void SIMD_NAME(triad)(void *a, void *b, void *c, ssize_t n, double scalar,
+			     int store, ssize_t pf)
+{
+	SIMD_NAME(run)(3, store, (SIMD_T *) a, (const SIMD_T *) b, (const SIMD_T *) c,
+		       scalar, n, pf);
+}
@@ -0,0 +1,299 @@
+/*-----------------------------------------------------------------------*/
+/* stream_telemetry.h                                                    */
+/*                                                                       */
+/* Telemetry mode of stream.c (--telemetry, --json=FILE).  The usual     */
+/* times[][] only say when the last thread finished a kernel; here every */
+/* kernel runs in an explicit parallel region in which each thread times */
+/* its own static share (the same split as "omp parallel for"), so that  */
+/* the report can show                                                   */
+/*   - the fastest and slowest thread of every kernel and how long the   */
+/*     others waited for the slowest one (imbalance),                    */
+/*   - which thread (CPU, NUMA node) was the straggler, and the mean     */
+/*     thread bandwidth per node, so that one slow socket stands out,    */
+/*   - the drift between the first and the last quarter of the           */
+/*     iterations, for long runs that throttle or change frequency.      */
+/* --json=FILE writes the configuration, the summary and every sample   */
+/* (start and end of each thread in each iteration) for offline plots.   */
+/*                                                                       */
+/* This file is part of stream.c and uses its globals.                   */
+/*-----------------------------------------------------------------------*/
+
+typedef struct {
+    double	start, end;	/* seconds since the start of the iteration */
+    int		cpu;
+} telemetry_sample_t;
+
+static int			tel_threads = 1;
+static double			tel_origin;	/* mysecond() at the first iteration */
+static double			*tel_begin;	/* [j*ntimes+k], since tel_origin */
+static telemetry_sample_t	*tel_samples;	/* [(j*ntimes+k)*tel_threads+tid] */
+static int			tel_node[CPU_SETSIZE];
+
+#define TEL_SAMPLE(j,k)	(&tel_samples[((size_t) (j) * ntimes + (k)) * tel_threads])
+
+int telemetry_setup(void)
+{
+	int i;
+
+#ifdef _OPENMP
+	tel_threads = omp_get_max_threads();
+	/* the kernels called on one thread's share must not fork again */
+	omp_set_max_active_levels(1);
+#endif
+	tel_begin = (double *) malloc(sizeof(double) * NKERNELS * ntimes);
+	tel_samples = (telemetry_sample_t *) calloc((size_t) NKERNELS * ntimes * tel_threads,
+						    sizeof(telemetry_sample_t));
+	if (tel_begin == NULL || tel_samples == NULL) {
+	    printf("Out of memory for %d threads of telemetry\n", tel_threads);
+	    return 1;
+	}
+	for (i=0; i<CPU_SETSIZE; i++)
+	    tel_node[i] = -1;
+	printf("Telemetry: per-thread timing of every iteration on %d threads%s%s\n",
+	    tel_threads, telemetry_json ? ", JSON to " : "", telemetry_json ? telemetry_json : "");
+	return 0;
+}
+
+static int telemetry_node(int cpu)
+{
+	if (cpu < 0 || cpu >= CPU_SETSIZE)
+	    return 0;
+	if (tel_node[cpu] < 0)
+	    tel_node[cpu] = affinity_cpu_node(cpu);
+	return tel_node[cpu];
+}
+
+/* kernel j on the elements [lo, hi) only, on the calling thread */
+static void telemetry_range(int j, void *a, void *b, void *c, double scalar,
+			    ssize_t lo, ssize_t hi, double *sum)
+{
+	const size_t off = (size_t) lo * stream_type->size;
+	char *aa = (char *) a + off, *bb = (char *) b + off, *cc = (char *) c + off;
+	const ssize_t n = hi - lo;
+	void *x[8];
+	ssize_t s;
+	int q;
+
+	switch (j) {
+	case 0: case 1: case 2: case 3: {
+#ifdef TUNED
+	    tuned_isa->kernel[stream_type - stream_types][j](aa, bb, cc, n, scalar,
+							     tuned_store, tuned_prefetch);
+#else
+	    const stream_kernel_t kernel[4] = {stream_type->copy, stream_type->scale,
+					       stream_type->add, stream_type->triad};
+	    kernel[j](aa, bb, cc, n, scalar);
+#endif
+	    break; }
+	case 4: *sum = stream_type->sum(aa, n); break;
+	case 5: stream_type->fill((char *) ext_d + off, n, 3.0, 0); break;
+	case 6:
+	    /* the first multiple of the stride in this share */
+	    s = (lo + ext_stride - 1) / ext_stride * ext_stride;
+	    if (s < hi)
+		stream_type->strided((char *) ext_d + (size_t) s * stream_type->size,
+				     (char *) a + (size_t) s * stream_type->size,
+				     hi - s, ext_stride);
+	    break;
+	case 7: stream_type->gather((char *) ext_d + off, ext_src, ext_idx + lo, n); break;
+	case 8: stream_type->scatter(ext_d, (char *) ext_src + off, ext_idx + lo, n); break;
+	case 9:
+	    for (q=0; q<ext_streams; q++)
+		x[q] = (char *) ext_x[q] + off;
+	    stream_type->triadn((char *) ext_d + off, x, ext_streams, n, scalar);
+	    break;
+	}
+}
+
+/* iteration k of kernel j with per-thread timing; returns the wall time */
+double telemetry_run(int j, int k, void *a, void *b, void *c, double scalar)
+{
+	telemetry_sample_t *sample = TEL_SAMPLE(j, k);
+	double t0, sum = 0.0;
+
+	if (j == 0 && k == 0)
+	    tel_origin = mysecond();
+	t0 = mysecond();
+#pragma omp parallel num_threads(tel_threads) reduction(+:sum)
+	{
+#ifdef _OPENMP
+	    int tid = omp_get_thread_num(), nt = omp_get_num_threads();
+#else
+	    int tid = 0, nt = 1;
+#endif
+	    ssize_t lo = array_size * tid / nt, hi = array_size * (tid + 1) / nt;
+	    double t1 = mysecond();
+
+	    telemetry_range(j, a, b, c, scalar, lo, hi, &sum);
+	    sample[tid].end = mysecond() - t0;
+	    sample[tid].start = t1 - t0;
+	    sample[tid].cpu = sched_getcpu();
+	}
+	tel_begin[j * ntimes + k] = t0 - tel_origin;
+	if (j == 4)
+	    ext_sum = sum;
+	return mysecond() - t0;
+}
+
+/* bandwidth of thread tid in one sample, counting its share of bytes[j] */
+static double telemetry_rate(int j, const telemetry_sample_t *s, int tid)
+{
+	ssize_t lo = array_size * tid / tel_threads, hi = array_size * (tid + 1) / tel_threads;
+	double t = s[tid].end - s[tid].start;
+
+	return t > 0 ? 1.0E-06 * bytes[j] * (double) (hi - lo) / (double) array_size / t : 0.0;
+}
+
+/* relative change of the mean rate from the first to the last quarter of
+   the iterations (the first one excluded); 0 for short runs */
+static double telemetry_drift(int j, double **times)
+{
+	int q = (ntimes - 1) / 4, k;
+	double first = 0.0, last = 0.0;
+
+	if (q < 2)
+	    return 0.0;
+	for (k=0; k<q; k++) {
+	    first += bytes[j] / times[j][1 + k];
+	    last += bytes[j] / times[j][ntimes - q + k];
+	}
+	return last / first - 1.0;
+}
+
+void telemetry_report(double **times)
+{
+	int j, k, t, n, nodes = 0, *slowest;
+	double fast, slow, imbalance;
+
+	if ((slowest = (int *) calloc(tel_threads, sizeof(int))) == NULL)
+	    return;
+	for (t=0; t<tel_threads; t++)
+	    nodes = MAX(nodes, telemetry_node(TEL_SAMPLE(0, ntimes-1)[t].cpu) + 1);
+
+	printf("Per-thread telemetry (%d threads, mean over iterations 2-%d):\n",
+	    tel_threads, ntimes);
+	printf("Function   Fastest MB/s  Slowest MB/s  Imbalance  Usual straggler\n");
+	for (j=0; j<nkernels; j++) {
+	    int worst = 0;
+
+	    fast = slow = imbalance = 0.0;
+	    memset(slowest, 0, sizeof(int) * tel_threads);
+	    for (k=1; k<ntimes; k++) {
+		const telemetry_sample_t *s = TEL_SAMPLE(j, k);
+		double rmin = FLT_MAX, rmax = 0.0, emin = FLT_MAX, emax = 0.0;
+		int last = 0;
+
+		for (t=0; t<tel_threads; t++) {
+		    double r = telemetry_rate(j, s, t);
+		    rmin = MIN(rmin, r);
+		    rmax = MAX(rmax, r);
+		    emin = MIN(emin, s[t].end);
+		    if (s[t].end > emax) {
+			emax = s[t].end;
+			last = t;
+		    }
+		}
+		fast += rmax;
+		slow += rmin;
+		/* the share of the iteration the first thread to finish sat idle */
+		imbalance += emax > 0 ? (emax - emin) / emax : 0.0;
+		slowest[last]++;
+	    }
+	    for (t=1; t<tel_threads; t++)
+		if (slowest[t] > slowest[worst])
+		    worst = t;
+	    t = TEL_SAMPLE(j, ntimes-1)[worst].cpu;
+	    printf("%s%12.1f  %12.1f  %8.1f%%  thread %d (cpu %d, node %d) in %d/%d\n",
+		label[j], fast / (ntimes-1), slow / (ntimes-1),
+		100.0 * imbalance / (ntimes-1), worst, t, telemetry_node(t),
+		slowest[worst], ntimes-1);
+	}
+
+	if (nodes > 1) {
+	    printf("Mean thread bandwidth per NUMA node (MB/s):\nFunction  ");
+	    for (n=0; n<nodes; n++)
+		printf("   node%-5d", n);
+	    printf("\n");
+	    for (j=0; j<nkernels; j++) {
+		printf("%s", label[j]);
+		for (n=0; n<nodes; n++) {
+		    double sum = 0.0;
+		    int count = 0;
+
+		    for (k=1; k<ntimes; k++)
+			for (t=0; t<tel_threads; t++)
+			    if (telemetry_node(TEL_SAMPLE(j, k)[t].cpu) == n) {
+				sum += telemetry_rate(j, TEL_SAMPLE(j, k), t);
+				count++;
+			    }
+		    if (count > 0)
+			printf("%12.1f", sum / count);
+		    else
+			printf("%12s", "-");
+		}
+		printf("\n");
+	    }
+	}
+
+	if ((ntimes - 1) / 4 >= 2) {
+	    printf("Drift, last vs first quarter of the iterations:");
+	    for (j=0; j<nkernels; j++)
+		printf("%s %.*s %+.1f%%", j ? "," : "", (int) strcspn(label[j], ":"),
+		    label[j], 100.0 * telemetry_drift(j, times));
+	    printf("\n");
+	}
+	printf(HLINE);
+	free(slowest);
+}
+
+/* --json: configuration, summary and every per-thread sample */
+int telemetry_write_json(const char *path, double **times)
+{
+	FILE *f = fopen(path, "w");
+	int j, k, t;
+
+	if (f == NULL) {
+	    printf("Cannot write %s\n", path);
+	    return 1;
+	}
+	fprintf(f, "{\n  \"stream\": {\"version\": \"5.10\", \"type\": \"%s\", \"array_size\": %llu,"
+		" \"offset\": %d, \"ntimes\": %d, \"threads\": %d",
+		stream_type->name, (unsigned long long) array_size, array_offset, ntimes, tel_threads);
+#ifdef TUNED
+	fprintf(f, ", \"isa\": \"%s\", \"store\": \"%s\", \"prefetch\": %ld",
+		tuned_isa->name, stream_store_names[tuned_store], (long) tuned_prefetch);
+#endif
+	fprintf(f, "},\n  \"summary\": [\n");
+	for (j=0; j<nkernels; j++)
+	    fprintf(f, "    {\"kernel\": \"%.*s\", \"bytes\": %.0f, \"best_mbs\": %.1f,"
+		    " \"avg_time\": %.6e, \"min_time\": %.6e, \"max_time\": %.6e,"
+		    " \"drift\": %.4f}%s\n",
+		    (int) strcspn(label[j], ":"), label[j], bytes[j],
+		    1.0E-06 * bytes[j] / mintime[j], avgtime[j], mintime[j], maxtime[j],
+		    telemetry_drift(j, times), j < nkernels-1 ? "," : "");
+	fprintf(f, "  ],\n  \"iterations\": [\n");
+	for (k=0; k<ntimes; k++)
+	    for (j=0; j<nkernels; j++) {
+		const telemetry_sample_t *s = TEL_SAMPLE(j, k);
+
+		fprintf(f, "    {\"kernel\": \"%.*s\", \"iteration\": %d, \"begin\": %.6f,"
+			" \"time\": %.6e, \"mbs\": %.1f, \"threads\": [",
+			(int) strcspn(label[j], ":"), label[j], k, tel_begin[j * ntimes + k],
+			times[j][k], 1.0E-06 * bytes[j] / times[j][k]);
+		for (t=0; t<tel_threads; t++)
+		    fprintf(f, "%s{\"cpu\": %d, \"node\": %d, \"start\": %.6e, \"end\": %.6e,"
+			    " \"mbs\": %.1f}", t ? ", " : "", s[t].cpu, telemetry_node(s[t].cpu),
+			    s[t].start, s[t].end, telemetry_rate(j, s, t));
+		fprintf(f, "]}%s\n", k == ntimes-1 && j == nkernels-1 ? "" : ",");
+	    }
+	fprintf(f, "  ]\n}\n");
+	fclose(f);
+	printf("Telemetry written to %s\n", path);
+	return 0;
+}
+
+void telemetry_free(void)
+{
+	free(tel_begin);
+	free(tel_samples);
+}
@@ -0,0 +1,402 @@
+/*-----------------------------------------------------------------------*/
+/* stream_tuned.h                                                        */
+/*                                                                       */
+/* Hand-vectorized STREAM kernels for the TUNED build of stream.c.       */
+/* Instruction sets, chosen at run time from CPUID / HWCAP:              */
+/*     avx512   x86-64 AVX-512F      (function-level target attribute)   */
+/*     avx2     x86-64 AVX2 + FMA    (function-level target attribute)   */
+/*     sve      aarch64 SVE, vector length agnostic (needs +sve)         */
+/*     neon     aarch64 Advanced SIMD                                    */
+/*     scalar   portable C, always available                             */
+/* and store modes                                                       */
+/*     regular  ordinary stores; the destination lines are read first    */
+/*              (write allocate), so the real traffic of Copy/Scale is   */
+/*              3 words per element instead of the 2 STREAM counts       */
+/*     nt       non-temporal stores (MOVNTPD, STNP, STNT1) that bypass   */
+/*              the caches and skip the read                             */
+/*     zva      aarch64 only: DC ZVA zeroes each destination line in the */
+/*              cache before the regular stores, which also skips the    */
+/*              read (used only when the ZVA block is one cache line)    */
+/* Software prefetch of the source arrays is issued a fixed distance (in */
+/* bytes) ahead; 0 disables it and leaves the hardware prefetchers.      */
+/*-----------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <string.h>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+#if defined(__x86_64__)
+# include <immintrin.h>
+#endif
+#if defined(__aarch64__)
+# include <arm_neon.h>
+# include <sys/auxv.h>
+# if defined(__ARM_FEATURE_SVE)
+#  include <arm_sve.h>
+# endif
+# ifndef HWCAP_ASIMD
+#  define HWCAP_ASIMD	(1 << 1)
+# endif
+# ifndef HWCAP_SVE
+#  define HWCAP_SVE	(1 << 22)
+# endif
+#endif
+
+#define STREAM_LINE		64
+
+#define STREAM_STORE_REGULAR	0
+#define STREAM_STORE_NT		1
+#define STREAM_STORE_ZVA	2
+#define STREAM_STORE_MODES	3
+
+static const char *stream_store_names[STREAM_STORE_MODES] = {"regular", "nt", "zva"};
+
+typedef void (*stream_tuned_kernel_t)(void *a, void *b, void *c, ssize_t n, double scalar,
+				      int store, ssize_t prefetch_bytes);
+
+typedef struct {
+    const char		*name;
+    unsigned		stores;		/* bit (1 << STREAM_STORE_x) per supported mode */
+    /* [element type, in stream_types order][Copy, Scale, Add, Triad] */
+    stream_tuned_kernel_t kernel[2][4];
+} stream_isa_t;
+
+#define STREAM_MAX_ISAS	4
+
+/* Static chunk of [0, n) for the calling thread.  The chunk boundaries
+   fall on cache line boundaries of dst, so no two threads write the same
+   line; the part before the first boundary goes to thread 0. */
+static void stream_chunk(const void *dst, ssize_t n, size_t size, ssize_t *lo, ssize_t *hi)
+{
+	const ssize_t line = STREAM_LINE / (ssize_t) size;
+	ssize_t head = (ssize_t) ((STREAM_LINE - ((uintptr_t) dst & (STREAM_LINE-1)))
+				  & (STREAM_LINE-1)) / (ssize_t) size;
+	ssize_t lines;
+	int tid = 0, nth = 1;
+
+#ifdef _OPENMP
+	tid = omp_get_thread_num();
+	nth = omp_get_num_threads();
+#endif
+	if (head > n)
+	    head = n;
+	lines = (n - head) / line;
+	*lo = tid == 0 ? 0 : head + lines * tid / nth * line;
+	*hi = tid == nth-1 ? n : head + lines * (tid+1) / nth * line;
+}
+
+/*--------------------------------- scalar -------------------------------*/
+
+#define SIMD_ATTR
+#define SIMD_W			1
+#define SIMD_LOAD(p)		(*(p))
+#define SIMD_STORE(p,v)		(*(p) = (v))
+#define SIMD_STREAM2(p,v0,v1)	((p)[0] = (v0), (p)[1] = (v1))
+#define SIMD_FENCE()		do { } while (0)
+#define SIMD_ZVA(p)
+#define SIMD_SET1(s)		(s)
+#define SIMD_MUL(x,y)		((x)*(y))
+#define SIMD_ADD(x,y)		((x)+(y))
+#define SIMD_FMA(x,y,z)		((x)+(y)*(z))
+
+#define SIMD_NAME(x)		x##_scalar_double
+#define SIMD_T			double
+#define SIMD_V			double
+#include "stream_simd.h"
+#undef SIMD_NAME
+#undef SIMD_T
+#undef SIMD_V
+#define SIMD_NAME(x)		x##_scalar_float
+#define SIMD_T			float
+#define SIMD_V			float
+#include "stream_simd.h"
+#undef SIMD_NAME
+#undef SIMD_T
+#undef SIMD_V
+
+#undef SIMD_ATTR
+#undef SIMD_W
+#undef SIMD_LOAD
+#undef SIMD_STORE
+#undef SIMD_STREAM2
+#undef SIMD_FENCE
+#undef SIMD_ZVA
+#undef SIMD_SET1
+#undef SIMD_MUL
+#undef SIMD_ADD
+#undef SIMD_FMA
+
+/*----------------------------- AVX2 / AVX-512 ----------------------------*/
+
+#if defined(__x86_64__)
+#define SIMD_FENCE()		_mm_sfence()
+#define SIMD_ZVA(p)
+
+#define SIMD_ATTR		__attribute__((target("avx2,fma")))
+#define SIMD_NAME(x)		x##_avx2_double
+#define SIMD_T			double
+#define SIMD_V			__m256d
+#define SIMD_W			4
+#define SIMD_LOAD(p)		_mm256_loadu_pd(p)
+#define SIMD_STORE(p,v)		_mm256_store_pd(p, v)
+#define SIMD_STREAM2(p,v0,v1)	(_mm256_stream_pd(p, v0), _mm256_stream_pd((p)+4, v1))
+#define SIMD_SET1(s)		_mm256_set1_pd(s)
+#define SIMD_MUL(x,y)		_mm256_mul_pd(x, y)
+#define SIMD_ADD(x,y)		_mm256_add_pd(x, y)
+#define SIMD_FMA(x,y,z)		_mm256_fmadd_pd(y, z, x)
+#include "stream_simd.h"
+#undef SIMD_NAME
+#undef SIMD_T
+#undef SIMD_V
+#undef SIMD_W
+#undef SIMD_LOAD
+#undef SIMD_STORE
+#undef SIMD_STREAM2
+#undef SIMD_SET1
+#undef SIMD_MUL
+#undef SIMD_ADD
+#undef SIMD_FMA
+
+#define SIMD_NAME(x)		x##_avx2_float
+#define SIMD_T			float
+#define SIMD_V			__m256
+#define SIMD_W			8
+#define SIMD_LOAD(p)		_mm256_loadu_ps(p)
+#define SIMD_STORE(p,v)		_mm256_store_ps(p, v)
+#define SIMD_STREAM2(p,v0,v1)	(_mm256_stream_ps(p, v0), _mm256_stream_ps((p)+8, v1))
+#define SIMD_SET1(s)		_mm256_set1_ps(s)
+#define SIMD_MUL(x,y)		_mm256_mul_ps(x, y)
+#define SIMD_ADD(x,y)		_mm256_add_ps(x, y)
+#define SIMD_FMA(x,y,z)		_mm256_fmadd_ps(y, z, x)
+#include "stream_simd.h"
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#undef SIMD_T
+#undef SIMD_V
+#undef SIMD_W
+#undef SIMD_LOAD
+#undef SIMD_STORE
+#undef SIMD_STREAM2
+#undef SIMD_SET1
+#undef SIMD_MUL
+#undef SIMD_ADD
+#undef SIMD_FMA
+
+#define SIMD_ATTR		__attribute__((target("avx512f")))
+#define SIMD_NAME(x)		x##_avx512_double
+#define SIMD_T			double
+#define SIMD_V			__m512d
+#define SIMD_W			8
+#define SIMD_LOAD(p)		_mm512_loadu_pd(p)
+#define SIMD_STORE(p,v)		_mm512_store_pd(p, v)
+#define SIMD_STREAM2(p,v0,v1)	(_mm512_stream_pd(p, v0), _mm512_stream_pd((p)+8, v1))
+#define SIMD_SET1(s)		_mm512_set1_pd(s)
+#define SIMD_MUL(x,y)		_mm512_mul_pd(x, y)
+#define SIMD_ADD(x,y)		_mm512_add_pd(x, y)
+#define SIMD_FMA(x,y,z)		_mm512_fmadd_pd(y, z, x)
+#include "stream_simd.h"
+#undef SIMD_NAME
+#undef SIMD_T
+#undef SIMD_V
+#undef SIMD_W
+#undef SIMD_LOAD
+#undef SIMD_STORE
+#undef SIMD_STREAM2
+#undef SIMD_SET1
+#undef SIMD_MUL
+#undef SIMD_ADD
+#undef SIMD_FMA
+
+#define SIMD_NAME(x)		x##_avx512_float
+#define SIMD_T			float
+#define SIMD_V			__m512
+#define SIMD_W			16
+#define SIMD_LOAD(p)		_mm512_loadu_ps(p)
+#define SIMD_STORE(p,v)		_mm512_store_ps(p, v)
+#define SIMD_STREAM2(p,v0,v1)	(_mm512_stream_ps(p, v0), _mm512_stream_ps((p)+16, v1))
+#define SIMD_SET1(s)		_mm512_set1_ps(s)
+#define SIMD_MUL(x,y)		_mm512_mul_ps(x, y)
+#define SIMD_ADD(x,y)		_mm512_add_ps(x, y)
+#define SIMD_FMA(x,y,z)		_mm512_fmadd_ps(y, z, x)
+#include "stream_simd.h"
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#undef SIMD_T
+#undef SIMD_V
+#undef SIMD_W
+#undef SIMD_LOAD
+#undef SIMD_STORE
+#undef SIMD_STREAM2
+#undef SIMD_SET1
+#undef SIMD_MUL
+#undef SIMD_ADD
+#undef SIMD_FMA
+#undef SIMD_FENCE
+#undef SIMD_ZVA
+#endif /* __x86_64__ */
+
+/*------------------------------ NEON / SVE ------------------------------*/
+
+#if defined(__aarch64__)
+/* STNP of two q registers: a 32-byte non-temporal pair store */
+#define STREAM_STNP(p,v0,v1) \
+	__asm__ volatile("stnp %q1, %q2, [%0]" :: "r"(p), "w"(v0), "w"(v1) : "memory")
+#define SIMD_FENCE()		__asm__ volatile("dmb ishst" ::: "memory")
+#define SIMD_ZVA(p)		__asm__ volatile("dc zva, %0" :: "r"(p) : "memory")
+#define SIMD_ATTR
+
+#define SIMD_NAME(x)		x##_neon_double
+#define SIMD_T			double
+#define SIMD_V			float64x2_t
+#define SIMD_W			2
+#define SIMD_LOAD(p)		vld1q_f64(p)
+#define SIMD_STORE(p,v)		vst1q_f64(p, v)
+#define SIMD_STREAM2(p,v0,v1)	STREAM_STNP(p, v0, v1)
+#define SIMD_SET1(s)		vdupq_n_f64(s)
+#define SIMD_MUL(x,y)		vmulq_f64(x, y)
+#define SIMD_ADD(x,y)		vaddq_f64(x, y)
+#define SIMD_FMA(x,y,z)		vfmaq_f64(x, y, z)
+#include "stream_simd.h"
+#undef SIMD_NAME
+#undef SIMD_T
+#undef SIMD_V
+#undef SIMD_W
+#undef SIMD_LOAD
+#undef SIMD_STORE
+#undef SIMD_SET1
+#undef SIMD_MUL
+#undef SIMD_ADD
+#undef SIMD_FMA
+
+#define SIMD_NAME(x)		x##_neon_float
+#define SIMD_T			float
+#define SIMD_V			float32x4_t
+#define SIMD_W			4
+#define SIMD_LOAD(p)		vld1q_f32(p)
+#define SIMD_STORE(p,v)		vst1q_f32(p, v)
+#define SIMD_SET1(s)		vdupq_n_f32(s)
+#define SIMD_MUL(x,y)		vmulq_f32(x, y)
+#define SIMD_ADD(x,y)		vaddq_f32(x, y)
+#define SIMD_FMA(x,y,z)		vfmaq_f32(x, y, z)
+#include "stream_simd.h"
+#undef SIMD_NAME
+#undef SIMD_T
+#undef SIMD_V
+#undef SIMD_W
+#undef SIMD_LOAD
+#undef SIMD_STORE
+#undef SIMD_STREAM2
+#undef SIMD_SET1
+#undef SIMD_MUL
+#undef SIMD_ADD
+#undef SIMD_FMA
+
+#if defined(__ARM_FEATURE_SVE)
+#define SIMD_NAME(x)		x##_sve_double
+#define SIMD_T			double
+#define SIMD_V			svfloat64_t
+#define SIMD_W			((ssize_t) svcntd())
+#define SIMD_LOAD(p)		svld1_f64(svptrue_b64(), p)
+#define SIMD_STORE(p,v)		svst1_f64(svptrue_b64(), p, v)
+#define SIMD_STREAM2(p,v0,v1)	(svstnt1_f64(svptrue_b64(), p, v0), \
+				 svstnt1_f64(svptrue_b64(), (p)+svcntd(), v1))
+#define SIMD_SET1(s)		svdup_n_f64(s)
+#define SIMD_MUL(x,y)		svmul_f64_x(svptrue_b64(), x, y)
+#define SIMD_ADD(x,y)		svadd_f64_x(svptrue_b64(), x, y)
+#define SIMD_FMA(x,y,z)		svmla_f64_x(svptrue_b64(), x, y, z)
+#include "stream_simd.h"
+#undef SIMD_NAME
+#undef SIMD_T
+#undef SIMD_V
+#undef SIMD_W
+#undef SIMD_LOAD
+#undef SIMD_STORE
+#undef SIMD_STREAM2
+#undef SIMD_SET1
+#undef SIMD_MUL
+#undef SIMD_ADD
+#undef SIMD_FMA
+
+#define SIMD_NAME(x)		x##_sve_float
+#define SIMD_T			float
+#define SIMD_V			svfloat32_t
+#define SIMD_W			((ssize_t) svcntw())
+#define SIMD_LOAD(p)		svld1_f32(svptrue_b32(), p)
+#define SIMD_STORE(p,v)		svst1_f32(svptrue_b32(), p, v)
+#define SIMD_STREAM2(p,v0,v1)	(svstnt1_f32(svptrue_b32(), p, v0), \
+				 svstnt1_f32(svptrue_b32(), (p)+svcntw(), v1))
+#define SIMD_SET1(s)		svdup_n_f32(s)
+#define SIMD_MUL(x,y)		svmul_f32_x(svptrue_b32(), x, y)
+#define SIMD_ADD(x,y)		svadd_f32_x(svptrue_b32(), x, y)
+#define SIMD_FMA(x,y,z)		svmla_f32_x(svptrue_b32(), x, y, z)
+#include "stream_simd.h"
+#undef SIMD_NAME
+#undef SIMD_T
+#undef SIMD_V
+#undef SIMD_W
+#undef SIMD_LOAD
+#undef SIMD_STORE
+#undef SIMD_STREAM2
+#undef SIMD_SET1
+#undef SIMD_MUL
+#undef SIMD_ADD
+#undef SIMD_FMA
+#endif /* __ARM_FEATURE_SVE */
+
+#undef SIMD_ATTR
+#undef SIMD_FENCE
+#undef SIMD_ZVA
+
+/* DC ZVA is usable when allowed (DZP clear) and the block is one cache line */
+static int stream_zva_usable(void)
+{
+	uint64_t dczid;
+
+	__asm__ volatile("mrs %0, dczid_el0" : "=r"(dczid));
+	return !(dczid & 0x10) && (4u << (dczid & 0xf)) == STREAM_LINE;
+}
+#endif /* __aarch64__ */
+
+/*-------------------------- run-time selection --------------------------*/
+
+#define STREAM_ISA_ENTRY(isa, stores) { #isa, stores, \
+	{ { copy_##isa##_double, scale_##isa##_double, add_##isa##_double, triad_##isa##_double }, \
+	  { copy_##isa##_float, scale_##isa##_float, add_##isa##_float, triad_##isa##_float } } }
+
+/* instruction sets usable on this CPU, best first (scalar is always last) */
+static int stream_isa_list(stream_isa_t *list)
+{
+	int n = 0;
+	const unsigned nt = (1u << STREAM_STORE_REGULAR) | (1u << STREAM_STORE_NT);
+
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+	    stream_isa_t e = STREAM_ISA_ENTRY(avx512, nt);
+	    list[n++] = e;
+	}
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+	    stream_isa_t e = STREAM_ISA_ENTRY(avx2, nt);
+	    list[n++] = e;
+	}
+#elif defined(__aarch64__)
+	unsigned long hwcap = getauxval(AT_HWCAP);
+	const unsigned zva = stream_zva_usable() ? 1u << STREAM_STORE_ZVA : 0;
+# if defined(__ARM_FEATURE_SVE)
+	if (hwcap & HWCAP_SVE) {
+	    stream_isa_t e = STREAM_ISA_ENTRY(sve, nt | zva);
+	    list[n++] = e;
+	}
+# endif
+	if (hwcap & HWCAP_ASIMD) {
+	    stream_isa_t e = STREAM_ISA_ENTRY(neon, nt | zva);
+	    list[n++] = e;
+	}
+#endif
+	{
+	    stream_isa_t e = STREAM_ISA_ENTRY(scalar, 1u << STREAM_STORE_REGULAR);
+	    list[n++] = e;
+	}
+	return n;
+}
@@ -6,7 +6,30 @@
  *   - OpenMP 并行加分
  *   - AliasAnalysis 去重
  *   - Metadata 注解, Profile Gating
- *   - 最终替换 malloc->hbm_malloc, free->hbm_free
+ *   - 模块级跟踪 (HBMSiteTrackingAnalysis): 指针经调用、返回、全局变量与结构体
+ *     字段流动, 分配/释放包装函数 (自动识别或 -hbm-alloc-wrappers /
+ *     -hbm-free-wrappers 指定) 的每个调用点各算一个分配点, free 跨函数匹配;
+ *     流向无法证明的分配点放入后把所有 free 改为 hbm_free (运行时按地址分派)
+ *   - HBM 容量 (-hbm-capacity) 内按 0/1 背包选择调用点: 价值为分数, 重量为
+ *     估计的字节数 (常量 / 剖析实测 / SCEV 上界 / -hbm-dynamic-size 的最坏值);
+ *     -hbm-report 输出每个调用点的大小、分数与决定, 也可用
+ *     -pass-remarks(-missed)=hbm-placement 查看
+ *   - 分配函数由 TargetLibraryInfo 识别: malloc, calloc, realloc, aligned_alloc,
+ *     posix_memalign 与 C++ operator new / new[] (含 nothrow), 释放为 free、
+ *     operator delete / delete[] (含带大小的版本) 与 realloc 的旧指针
+ *   - 最终替换为运行时的对应入口: malloc->hbm_malloc, calloc->hbm_calloc,
+ *     _Znwm->hbm_new, free->hbm_free, _ZdlPv->hbm_delete 等; 对齐要求原样传递,
+ *     收到快速层块却没有放入的 realloc 改为 hbm_dram_realloc (迁回 DRAM)
+ *     (运行时实现见 hbm_runtime/, 改写后的程序需链接 libhbm_runtime)
+ *   - 剖析引导: -passes=hbm-instrument 把 malloc/free 改为带调用点编号的
+ *     hbm_prof_malloc/hbm_prof_free (其余分配函数前后插入 hbm_prof_track /
+ *     hbm_prof_untrack; 分配包装的每个调用点各有编号), 运行后得到剖析文件;
+ *     下一次编译加
+ *     -hbm-profile=文件, 最热调用点的分数改由实测访存密度给出
+ *     (插件的命令行选项要在解析命令行前注册, opt 需同时给出 -load 与
+ *      -load-pass-plugin, 例如
+ *      opt -load ./MyHBM.so -load-pass-plugin ./MyHBM.so \
+ *          -passes=my-module-transform -hbm-profile=hbm.prof in.ll -o out.bc)
  *
  * 需要根据你的实际情况在 CMake/Build 上配置搜索 LLVM 路径，并编译成 .so 插件。
  ******************************************************************************/
@@ -22,21 +45,30 @@
  #include "llvm/IR/DerivedTypes.h"
  #include "llvm/IR/IRBuilder.h"
  #include "llvm/IR/DebugInfoMetadata.h"
+ #include "llvm/IR/InstIterator.h"
  
- #include "llvm/Analysis/LoopAnalysis.h"
+ #include "llvm/Analysis/LoopInfo.h"
  #include "llvm/Analysis/ScalarEvolution.h"
+ #include "llvm/Analysis/ScalarEvolutionExpressions.h"
  #include "llvm/Analysis/AliasAnalysis.h"
  #include "llvm/Analysis/TargetLibraryInfo.h"
+ #include "llvm/Analysis/ValueTracking.h"
  #include "llvm/Analysis/OptimizationRemarkEmitter.h"
  
+ #include "llvm/ADT/StringSet.h"
  #include "llvm/Support/CommandLine.h"
+ #include "llvm/Support/Format.h"
+ #include "llvm/Support/LineIterator.h"
+ #include "llvm/Support/MemoryBuffer.h"
  #include "llvm/Support/raw_ostream.h"
+ #include "llvm/Transforms/Utils/Cloning.h"
  
  #include <vector>
  #include <string>
  #include <algorithm>
  #include <unordered_set>
  #include <unordered_map>
+ #include <map>
  #include <memory>
  #include <cmath>
  
@@ -46,16 +78,51 @@
   * 0. 数据结构
   ******************************************************************************/
  
+ /// 分配大小的来源, 依可信程度排列
+ enum class SizeSource {
+   Constant,    // 常量实参
+   Profile,     // 剖析中观测到的最大值
+   SCEVBound,   // ScalarEvolution 给出的无符号值域上界
+   WorstCase    // 无法界定, 取 -hbm-dynamic-size
+ };
+ 
+ /// TargetLibraryInfo 识别出的分配与释放函数 (operator new/delete 只认 LP64 的修饰名)
+ enum class HBMAllocKind {
+   None,
+   Malloc,          // malloc(size)
+   Calloc,          // calloc(n, size)
+   Realloc,         // realloc(ptr, size): 分配新块, 同时释放 ptr
+   AlignedAlloc,    // aligned_alloc(align, size)
+   PosixMemalign,   // posix_memalign(&ptr, align, size): 指针经内存返回
+   New,             // operator new(size)
+   NewArray,        // operator new[](size)
+   NewNothrow,      // operator new(size, nothrow) 与 new[](size, nothrow)
+   Free,            // free(ptr)
+   Delete,          // operator delete(ptr[, size])
+   DeleteArray      // operator delete[](ptr[, size])
+ };
+ 
  /// 记录单个 malloc 调用点的分析结果
  struct MallocRecord {
-   CallInst *MallocCall = nullptr;          // malloc指令
+   CallBase *MallocCall = nullptr;          // 分配指令 (operator new 可以是 invoke)
+   HBMAllocKind Kind = HBMAllocKind::Malloc;// 分配函数; 包装调用点为包装内部的分配函数
    double Score = 0.0;                      // 静态分析评分
    uint64_t AllocSize = 0;                  // 分配大小(若能解析)
    bool UserForcedHot = false;              // 是否用户/metadata强制hot
    bool UnmatchedFree = false;              // 若无法找到对应的free
    std::vector<CallInst*> FreeCalls;        // 匹配到的 free 指令
- 
-   // 也可在这里添加“Escaped”字段，用于跨函数或多次传递的场景
+   uint64_t SiteID = 0;                     // 调用点编号, 与剖析文件对应
+   unsigned Ordinal = 0;                    // 函数内第几个 malloc (或包装调用)
+   Function *Wrapper = nullptr;             // 经分配包装分配时为包装函数
+   CallInst *WrappedAlloc = nullptr;        // 自动识别的包装中被返回的分配调用
+   unsigned SizeArg = 0;                    // 大小所在的实参, ~0u 表示不在实参中
+   unsigned CountArg = ~0u;                 // calloc 的元素个数所在的实参
+   bool Escaped = false;                    // 指针流入外部代码, 可能在那里释放
+   bool FreeUnproven = false;               // 指针存入无法跟踪的内存, free 找不全
+   bool ProfileHot = false;                 // 分数来自实测访存密度
+   uint64_t SizeEstimate = 0;               // 背包中的重量 (字节)
+   SizeSource SizeFrom = SizeSource::WorstCase;
+   std::string SizeExpr;                    // 非常量大小的 SCEV 表达式
  };
  
  /// 函数级的分析结果
@@ -63,11 +130,354 @@
    std::vector<MallocRecord> MallocRecords;
  };
  
+ /// 分数达到此值的调用点才放入 HBM (强制 hot 的除外)
+ static constexpr double HBMScoreThreshold = 80.0;
+ 
+ static cl::list<std::string> HBMProfileFiles(
+     "hbm-profile", cl::CommaSeparated, cl::value_desc("文件"),
+     cl::desc("hbm-instrument 插桩程序写出的剖析文件, 可用逗号分隔多个 (计数相加)"));
+ 
+ static cl::opt<std::string> HBMCapacity(
+     "hbm-capacity", cl::init("1G"), cl::value_desc("字节"),
+     cl::desc("HBM 容量, 可带 K/M/G 后缀 (默认 1G, 与运行时模拟层一致)"));
+ 
+ static cl::opt<std::string> HBMDynamicSize(
+     "hbm-dynamic-size", cl::init("256M"), cl::value_desc("字节"),
+     cl::desc("无法由常量、剖析或 SCEV 界定大小的分配按此最坏值计入容量"));
+ 
+ static cl::opt<std::string> HBMReport(
+     "hbm-report", cl::value_desc("文件"),
+     cl::desc("输出放置报告 (调用点、大小、分数、决定), - 表示 stderr"));
+ 
+ static cl::list<std::string> HBMAllocWrappers(
+     "hbm-alloc-wrappers", cl::CommaSeparated, cl::value_desc("名字[:大小实参]"),
+     cl::desc("视同 malloc 的分配包装函数 (大小实参默认为第 0 个); "
+              "返回 malloc 结果的函数会自动识别"));
+ 
+ static cl::list<std::string> HBMFreeWrappers(
+     "hbm-free-wrappers", cl::CommaSeparated, cl::value_desc("名字[:指针实参]"),
+     cl::desc("视同 free 的释放包装函数 (指针实参默认为第 0 个); "
+              "直接 free 自己实参的函数会自动识别"));
+ 
+ static cl::opt<double> HBMProfileHotShare(
+     "hbm-profile-hot-share", cl::init(0.01),
+     cl::desc("访存采样份额不低于此值的调用点按实测访存密度打分, 其余仍用静态估计"));
+ 
+ /******************************************************************************
+  * 0.5 调用点编号与剖析文件
+  *
+  *   - 编号由函数名和该函数内第几个分配调用 (各种分配函数合在一起按指令
+  *     顺序计数) 决定, 插桩编译与带剖析的编译只要在流水线的同一位置运行
+  *     本插件 (例如都在 -O2 之前) 就能对上
+  *   - 分配包装的调用点另按该函数内第几个包装调用编号 (最高位置 1), 插桩
+  *     时把编号传给包装的克隆, 每个调用点各有自己的剖析记录
+  *   - 剖析文件的格式见 hbm_runtime/hbm_profile.c
+  ******************************************************************************/
+ 
+ /// 函数名与序号的 FNV-1a 散列, 0 留给运行时表示空槽
+ static uint64_t hbmSiteID(const Function &F, unsigned Ordinal) {
+   uint64_t H = 0xcbf29ce484222325ULL;
+   auto Mix = [&H](unsigned char C) { H = (H ^ C) * 0x100000001b3ULL; };
+   for (char C : F.getName())
+     Mix((unsigned char)C);
+   Mix('#');
+   for (unsigned i = 0; i < 4; ++i)
+     Mix((unsigned char)(Ordinal >> (8 * i)));
+   return H ? H : 1;
+ }
+ 
+ /// 分配包装调用点的编号, 与直接分配调用的编号区分开
+ static uint64_t wrapperSiteID(const Function &F, unsigned Ordinal) {
+   return hbmSiteID(F, Ordinal | 0x80000000u);
+ }
+ 
+ /// F 中对分配包装的直接调用 (不含递归调用自己), 按指令顺序
+ static SmallVector<CallInst*, 4> wrapperCalls(Function &F,
+                                               const StringMap<unsigned> &AllocWrappers) {
+   SmallVector<CallInst*, 4> Calls;
+   for (auto &I : instructions(F)) {
+     auto *CI = dyn_cast<CallInst>(&I);
+     Function *Callee = CI ? CI->getCalledFunction() : nullptr;
+     if (Callee && Callee != &F && AllocWrappers.count(Callee->getName()))
+       Calls.push_back(CI);
+   }
+   return Calls;
+ }
+ 
+ /// 字节数, 可带 K/M/G 后缀 (1024 的幂), 与 HBM_CAPACITY 的写法相同
+ static bool parseBytes(StringRef S, uint64_t &Bytes) {
+   uint64_t Mul = 1;
+   if (!S.empty()) {
+     switch (S.back()) {
+     case 'k': case 'K': Mul = 1ULL << 10; break;
+     case 'm': case 'M': Mul = 1ULL << 20; break;
+     case 'g': case 'G': Mul = 1ULL << 30; break;
+     }
+     if (Mul != 1)
+       S = S.drop_back();
+   }
+   if (S.getAsInteger(10, Bytes) || Bytes > UINT64_MAX / Mul)
+     return false;
+   Bytes *= Mul;
+   return true;
+ }
+ 
+ /// 选项中的字节数, 非法时打印提示并用默认值
+ static uint64_t bytesOption(const cl::opt<std::string> &Opt, uint64_t Default) {
+   uint64_t Bytes;
+   if (parseBytes(Opt, Bytes))
+     return Bytes;
+   errs() << "hbm: 无法解析 -" << Opt.ArgStr << "=" << Opt << ", 使用 " << Default << " 字节\n";
+   return Default;
+ }
+ 
+ /// CB 调用的分配/释放函数
+ static HBMAllocKind allocKind(const CallBase *CB, const TargetLibraryInfo &TLI) {
+   LibFunc LF;
+   if (!TLI.getLibFunc(*CB, LF))
+     return HBMAllocKind::None;
+   switch (LF) {
+   case LibFunc_malloc:             return HBMAllocKind::Malloc;
+   case LibFunc_calloc:             return HBMAllocKind::Calloc;
+   case LibFunc_realloc:            return HBMAllocKind::Realloc;
+   case LibFunc_aligned_alloc:      return HBMAllocKind::AlignedAlloc;
+   case LibFunc_posix_memalign:     return HBMAllocKind::PosixMemalign;
+   case LibFunc_Znwm:               return HBMAllocKind::New;
+   case LibFunc_Znam:               return HBMAllocKind::NewArray;
+   case LibFunc_ZnwmRKSt9nothrow_t:
+   case LibFunc_ZnamRKSt9nothrow_t: return HBMAllocKind::NewNothrow;
+   case LibFunc_free:               return HBMAllocKind::Free;
+   case LibFunc_ZdlPv:
+   case LibFunc_ZdlPvm:             return HBMAllocKind::Delete;
+   case LibFunc_ZdaPv:
+   case LibFunc_ZdaPvm:             return HBMAllocKind::DeleteArray;
+   default:                         return HBMAllocKind::None;
+   }
+ }
+ 
+ /// 分配点 (realloc 既是分配点也是其旧指针的释放)
+ static bool isAllocation(HBMAllocKind K) {
+   return K != HBMAllocKind::None && K != HBMAllocKind::Free &&
+          K != HBMAllocKind::Delete && K != HBMAllocKind::DeleteArray;
+ }
+ 
+ /// 释放其第 0 个实参
+ static bool isRelease(HBMAllocKind K) {
+   return K == HBMAllocKind::Free || K == HBMAllocKind::Delete ||
+          K == HBMAllocKind::DeleteArray || K == HBMAllocKind::Realloc;
+ }
+ 
+ /// 大小所在的实参 (calloc 为元素大小), ~0u 表示没有
+ static unsigned allocSizeArg(HBMAllocKind K) {
+   switch (K) {
+   case HBMAllocKind::Malloc:
+   case HBMAllocKind::New:
+   case HBMAllocKind::NewArray:
+   case HBMAllocKind::NewNothrow:    return 0;
+   case HBMAllocKind::Calloc:
+   case HBMAllocKind::Realloc:
+   case HBMAllocKind::AlignedAlloc:  return 1;
+   case HBMAllocKind::PosixMemalign: return 2;
+   default:                          return ~0u;
+   }
+ }
+ 
+ /// calloc 的元素个数所在的实参, 其他分配函数为 ~0u
+ static unsigned allocCountArg(HBMAllocKind K) {
+   return K == HBMAllocKind::Calloc ? 0 : ~0u;
+ }
+ 
+ /// 运行时中的对应入口, 原型与被替换的函数相同 (见 hbm_runtime.h)
+ static const char *hbmEntryName(const CallBase *CB, HBMAllocKind K) {
+   switch (K) {
+   case HBMAllocKind::Malloc:        return "hbm_malloc";
+   case HBMAllocKind::Calloc:        return "hbm_calloc";
+   case HBMAllocKind::Realloc:       return "hbm_realloc";
+   case HBMAllocKind::AlignedAlloc:  return "hbm_aligned_alloc";
+   case HBMAllocKind::PosixMemalign: return "hbm_posix_memalign";
+   case HBMAllocKind::New:           return "hbm_new";
+   case HBMAllocKind::NewArray:      return "hbm_new_array";
+   case HBMAllocKind::NewNothrow:    return "hbm_new_nothrow";
+   case HBMAllocKind::Free:          return "hbm_free";
+   case HBMAllocKind::Delete:
+     return CB->arg_size() == 2 ? "hbm_delete_sized" : "hbm_delete";
+   case HBMAllocKind::DeleteArray:
+     return CB->arg_size() == 2 ? "hbm_delete_array_sized" : "hbm_delete_array";
+   case HBMAllocKind::None:          break;
+   }
+   return nullptr;
+ }
+ 
+ static FunctionCallee hbmEntry(Module &M, const CallBase *CB, HBMAllocKind K) {
+   return M.getOrInsertFunction(hbmEntryName(CB, K), CB->getFunctionType());
+ }
+ 
+ static const char *allocKindName(HBMAllocKind K) {
+   switch (K) {
+   case HBMAllocKind::Malloc:        return "malloc";
+   case HBMAllocKind::Calloc:        return "calloc";
+   case HBMAllocKind::Realloc:       return "realloc";
+   case HBMAllocKind::AlignedAlloc:  return "aligned_alloc";
+   case HBMAllocKind::PosixMemalign: return "posix_memalign";
+   case HBMAllocKind::New:           return "new";
+   case HBMAllocKind::NewArray:      return "new[]";
+   case HBMAllocKind::NewNothrow:    return "new(nothrow)";
+   default:                          return "?";
+   }
+ }
+ 
+ /// 分配调用的常量字节数 (calloc 为两个实参之积), 不是常量时为 0
+ static uint64_t constantAllocSize(const CallBase *CB, unsigned SizeArg, unsigned CountArg) {
+   if (SizeArg >= CB->arg_size())
+     return 0;
+   auto *Size = dyn_cast<ConstantInt>(CB->getArgOperand(SizeArg));
+   if (!Size || Size->getValue().getActiveBits() > 64)
+     return 0;
+   if (CountArg == ~0u)
+     return Size->getZExtValue();
+   auto *Count = CountArg < CB->arg_size() ? dyn_cast<ConstantInt>(CB->getArgOperand(CountArg)) : nullptr;
+   if (!Count || Count->getValue().getActiveBits() > 64)
+     return 0;
+   bool Overflow;
+   APInt Bytes = Size->getValue().zext(128).umul_ov(Count->getValue().zext(128), Overflow);
+   return Bytes.getActiveBits() <= 64 ? Bytes.getZExtValue() : 0;
+ }
+ 
+ /// 分配点得到的指针: 返回值; posix_memalign 为函数内从其 memptr (局部变量)
+ /// 取出的 load。memptr 不是局部变量时返回 false, 指针的去向无法跟踪
+ static bool allocRoots(CallBase *CB, HBMAllocKind K, SmallVectorImpl<Value*> &Roots) {
+   if (K != HBMAllocKind::PosixMemalign) {
+     Roots.push_back(CB);
+     return true;
+   }
+   auto *Slot = dyn_cast<AllocaInst>(CB->getArgOperand(0)->stripPointerCasts());
+   if (!Slot)
+     return false;
+   SmallVector<Value*, 4> Work{Slot};
+   while (!Work.empty()) {
+     Value *V = Work.pop_back_val();
+     for (User *U : V->users()) {
+       if (isa<BitCastInst>(U))
+         Work.push_back(U);
+       else if (auto *LI = dyn_cast<LoadInst>(U))
+         Roots.push_back(LI);
+     }
+   }
+   return true;
+ }
+ 
+ /// 一个调用点在剖析文件中的记录
+ struct HBMProfileSite {
+   uint64_t Allocs = 0;
+   uint64_t TotalBytes = 0;
+   uint64_t MaxBytes = 0;
+   double Lifetime = 0.0;     // 平均生命周期 (秒)
+   uint64_t Samples = 0;
+ };
+ 
+ struct HBMProfile {
+   std::unordered_map<uint64_t, HBMProfileSite> Sites;
+   uint64_t TotalSamples = 0;
+   uint64_t SampledBytes = 0; // 有采样的调用点的最大字节之和
+ };
+ 
+ /// 读入剖析文件, 同一调用点在多个文件中的计数相加; 出错时打印原因并返回 false
+ static bool loadHBMProfile(ArrayRef<std::string> Files, HBMProfile &P) {
+   for (const std::string &File : Files) {
+     auto Buf = MemoryBuffer::getFile(File);
+     if (!Buf) {
+       errs() << "hbm-profile: 无法读取 " << File << ": "
+              << Buf.getError().message() << "\n";
+       return false;
+     }
+     for (line_iterator It(**Buf, /*SkipBlanks=*/true, '#'); !It.is_at_end(); ++It) {
+       SmallVector<StringRef, 6> F;
+       HBMProfileSite S;
+       uint64_t ID;
+       It->split(F, ' ', -1, /*KeepEmpty=*/false);
+       if (F.size() != 6 || F[0].getAsInteger(16, ID) || F[1].getAsInteger(10, S.Allocs) ||
+           F[2].getAsInteger(10, S.TotalBytes) || F[3].getAsInteger(10, S.MaxBytes) ||
+           F[4].getAsDouble(S.Lifetime) || F[5].getAsInteger(10, S.Samples)) {
+         errs() << "hbm-profile: " << File << ":" << It.line_number()
+                << ": 无法解析 \"" << *It << "\"\n";
+         return false;
+       }
+       HBMProfileSite &Dst = P.Sites[ID];
+       // 生命周期按分配次数加权平均
+       if (Dst.Allocs + S.Allocs)
+         Dst.Lifetime = (Dst.Lifetime * Dst.Allocs + S.Lifetime * S.Allocs) /
+                        (double)(Dst.Allocs + S.Allocs);
+       Dst.Allocs += S.Allocs;
+       Dst.TotalBytes += S.TotalBytes;
+       Dst.MaxBytes = std::max(Dst.MaxBytes, S.MaxBytes);
+       Dst.Samples += S.Samples;
+     }
+   }
+   for (auto &KV : P.Sites) {
+     P.TotalSamples += KV.second.Samples;
+     if (KV.second.Samples)
+       P.SampledBytes += KV.second.MaxBytes;
+   }
+   return true;
+ }
+ 
+ /// 给有剖析记录的分配调用与分配包装调用加上
+ ///   !prof.memusage !{i64 采样数}
+ ///   !hbm.profile   !{i64 采样数, i64 最大字节, i64 平均生命周期(us),
+ ///                    i64 总采样数, i64 有采样调用点的总字节}
+ /// 返回标注的调用点个数
+ static unsigned annotateWithProfile(Module &M, const HBMProfile &P,
+                                     const StringMap<unsigned> &AllocWrappers,
+                                     FunctionAnalysisManager &FAM) {
+   LLVMContext &Ctx = M.getContext();
+   auto *Int64Ty = Type::getInt64Ty(Ctx);
+   auto MD = [&](uint64_t V) { return ConstantAsMetadata::get(ConstantInt::get(Int64Ty, V)); };
+   unsigned Annotated = 0;
+   auto Annotate = [&](CallBase *CI, uint64_t ID) {
+     auto It = P.Sites.find(ID);
+     if (It == P.Sites.end())
+       return;
+     const HBMProfileSite &S = It->second;
+     CI->setMetadata("prof.memusage", MDNode::get(Ctx, {MD(S.Samples)}));
+     CI->setMetadata("hbm.profile",
+                     MDNode::get(Ctx, {MD(S.Samples), MD(S.MaxBytes),
+                                       MD((uint64_t)(S.Lifetime * 1e6)),
+                                       MD(P.TotalSamples), MD(P.SampledBytes)}));
+     ++Annotated;
+   };
+ 
+   for (Function &F : M) {
+     if (F.isDeclaration())
+       continue;
+     auto &TLI = FAM.getResult<TargetLibraryAnalysis>(F);
+     unsigned Ordinal = 0;
+     for (auto &I : instructions(F)) {
+       auto *CI = dyn_cast<CallBase>(&I);
+       if (CI && isAllocation(allocKind(CI, TLI)))
+         Annotate(CI, hbmSiteID(F, Ordinal++));
+     }
+     Ordinal = 0;
+     for (CallInst *CI : wrapperCalls(F, AllocWrappers))
+       Annotate(CI, wrapperSiteID(F, Ordinal++));
+   }
+   return Annotated;
+ }
+ 
+ /// 元数据 MD 的第 i 个 i64 操作数, 不存在时为 0
+ static uint64_t mdInt(const MDNode *MD, unsigned i) {
+   if (i >= MD->getNumOperands())
+     return 0;
+   if (auto *Op = dyn_cast<ConstantAsMetadata>(MD->getOperand(i)))
+     if (auto *CInt = dyn_cast<ConstantInt>(Op->getValue()))
+       return CInt->getZExtValue();
+   return 0;
+ }
+ 
  /******************************************************************************
   * 1. 函数级分析Pass (新PM) - MyFunctionAnalysisPass
   *
-  *   - 扫描 malloc, free
-  *   - 对 malloc 进行静态打分：循环深度、写/读次数、OpenMP 并行、profile gating、metadata等
+  *   - 扫描分配函数 (malloc, calloc, operator new 等) 与释放函数
+  *   - 对分配点进行静态打分：循环深度、写/读次数、OpenMP 并行、profile gating、metadata等
   *   - 若 free 未匹配到 => 标记 unmatched => 可在此处扣分(示例)
   *   - 结合 AliasAnalysis，避免多个别名指针的重复计分
   ******************************************************************************/
@@ -78,19 +488,14 @@
  
    Result run(Function &F, FunctionAnalysisManager &FAM);
  
- private:
-   friend AnalysisInfoMixin<MyFunctionAnalysisPass>;
-   static AnalysisKey Key;
- 
-   // 辅助函数
-   double analyzeMalloc(CallInst *CI, Function &F,
+   // 以下也供模块级跟踪为包装调用点和其他函数中的访问打分;
+   // 大小由模块级跟踪统一估计 (WorstCase 每个模块只解析一次)
+   void estimateSize(MallocRecord &MR, ScalarEvolution &SE, uint64_t WorstCase);
+   double analyzeMalloc(const MallocRecord &MR, Function &F,
                         LoopAnalysis::Result &LA,
                         ScalarEvolution &SE,
                         AAResults &AA);
  
-   void matchFreeCalls(FunctionMallocInfo &FMI,
-                       std::vector<CallInst*> &freeCalls);
- 
    // Access/loop/alias
    void explorePointerUsers(Value *RootPtr, Value *V,
                             LoopAnalysis::Result &LA,
@@ -106,9 +511,19 @@
                              bool isWrite);
  
    uint64_t getLoopTripCount(Loop *L, ScalarEvolution &SE);
+   bool isProfileHot(CallBase *CI);
+ 
+ private:
+   friend AnalysisInfoMixin<MyFunctionAnalysisPass>;
+   static AnalysisKey Key;
+ 
+   // 辅助函数
+   void matchFreeCalls(FunctionMallocInfo &FMI,
+                       std::vector<CallInst*> &freeCalls);
  };
  
  AnalysisKey MyFunctionAnalysisPass::Key;
+ } // end anonymous namespace
  
  /******************************************************************************
   * run()：分析一个函数
@@ -121,28 +536,31 @@
    auto &LA = FAM.getResult<LoopAnalysis>(F);
    auto &SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
    auto &AA = FAM.getResult<AAManager>(F);
+   auto &TLI = FAM.getResult<TargetLibraryAnalysis>(F);
    // auto &ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(F); //可选
  
-   // 收集本函数中的 free
+   // 收集本函数中的释放
    std::vector<CallInst*> freeCalls;
+   unsigned mallocOrdinal = 0;
  
-   // 遍历指令, 识别 malloc/free
+   // 遍历指令, 识别分配/释放
    for (auto &BB : F) {
      for (auto &I : BB) {
-       if (auto *CI = dyn_cast<CallInst>(&I)) {
-         if (Function *Callee = CI->getCalledFunction()) {
-           auto Name = Callee->getName();
-           if (Name == "malloc") {
+       if (auto *CI = dyn_cast<CallBase>(&I)) {
+         HBMAllocKind Kind = allocKind(CI, TLI);
+         if (Kind != HBMAllocKind::None) {
+           if (isAllocation(Kind)) {
              // 记录
              MallocRecord MR;
              MR.MallocCall = CI;
+             MR.Kind = Kind;
+             MR.SizeArg = allocSizeArg(Kind);
+             MR.CountArg = allocCountArg(Kind);
+             MR.Ordinal = mallocOrdinal++;
+             MR.SiteID = hbmSiteID(F, MR.Ordinal);
  
              // 分配大小
-             if (CI->arg_size() >= 1) {
-               if (auto *Cst = dyn_cast<ConstantInt>(CI->getArgOperand(0))) {
-                 MR.AllocSize = Cst->getZExtValue();
-               }
-             }
+             MR.AllocSize = constantAllocSize(CI, MR.SizeArg, MR.CountArg);
              // 检查metadata -> "hot_mem"
              if (CI->hasMetadata("hot_mem")) {
                MR.UserForcedHot = true;
@@ -152,12 +570,13 @@
                MR.UserForcedHot = true;
              }
              // 计算打分
-             MR.Score = analyzeMalloc(CI, F, LA, SE, AA);
+             MR.Score = analyzeMalloc(MR, F, LA, SE, AA);
+             MR.ProfileHot = isProfileHot(CI);
  
              FMI.MallocRecords.push_back(MR);
- 
-           } else if (Name == "free") {
-             freeCalls.push_back(CI);
+           }
+           if (isRelease(Kind) && isa<CallInst>(CI)) {
+             freeCalls.push_back(cast<CallInst>(CI));
            }
          }
        }
@@ -171,20 +590,81 @@
  }
  
  /******************************************************************************
-  * 分析单个 malloc 调用点: 处理Profile Gating、OpenMP等
+  * 剖析中采样份额不低于 -hbm-profile-hot-share 的调用点: 采样足够多, 实测值可信
+  ******************************************************************************/
+ bool MyFunctionAnalysisPass::isProfileHot(CallBase *CI) {
+   MDNode *PM = CI->getMetadata("hbm.profile");
+   if (!PM)
+     return false;
+   uint64_t Samples = mdInt(PM, 0), Total = mdInt(PM, 3);
+   return Total && Samples && (double)Samples / Total >= HBMProfileHotShare;
+ }
+ 
+ /******************************************************************************
+  * 估计分配大小 (背包中的重量): 常量 > 剖析观测的最大值 > SCEV 值域上界
+  * (小于最坏值时) > WorstCase (-hbm-dynamic-size)。估计不必是安全上界:
+  * 运行时在快速层放不下时会退回 DRAM
+  ******************************************************************************/
+ void MyFunctionAnalysisPass::estimateSize(MallocRecord &MR, ScalarEvolution &SE,
+                                           uint64_t WorstCase) {
+   CallBase *CB = MR.MallocCall;
+   Value *Arg = CB->arg_size() > MR.SizeArg ? CB->getArgOperand(MR.SizeArg) : nullptr;
+   Value *Count = CB->arg_size() > MR.CountArg ? CB->getArgOperand(MR.CountArg) : nullptr;
+ 
+   MR.SizeFrom = SizeSource::WorstCase;
+   MR.SizeEstimate = WorstCase;
+   if (Arg && isa<ConstantInt>(Arg) && (!Count || isa<ConstantInt>(Count))) {
+     MR.SizeFrom = SizeSource::Constant;
+     MR.SizeEstimate = MR.AllocSize;
+     return;
+   }
+   if (MDNode *PM = MR.MallocCall->getMetadata("hbm.profile")) {
+     if (uint64_t Observed = mdInt(PM, 1)) {
+       MR.SizeFrom = SizeSource::Profile;
+       MR.SizeEstimate = Observed;
+     }
+   }
+   if (!Arg || !SE.isSCEVable(Arg->getType()) ||
+       (Count && Count->getType() != Arg->getType()))
+     return;
+   const SCEV *S = SE.getSCEV(Arg);
+   if (Count)
+     S = SE.getMulExpr(SE.getSCEV(Count), S);
+   raw_string_ostream OS(MR.SizeExpr);
+   OS << *S;
+   OS.flush();
+   if (MR.SizeFrom == SizeSource::Profile)
+     return;
+   APInt Max = SE.getUnsignedRangeMax(S);
+   if (Max.getActiveBits() <= 64 && Max.getZExtValue() < WorstCase) {
+     MR.SizeFrom = SizeSource::SCEVBound;
+     MR.SizeEstimate = Max.getZExtValue();
+   }
+ }
+ 
+ /******************************************************************************
+  * 分析单个分配点: 处理Profile Gating、OpenMP等
   ******************************************************************************/
- double MyFunctionAnalysisPass::analyzeMalloc(CallInst *CI, Function &F,
+ double MyFunctionAnalysisPass::analyzeMalloc(const MallocRecord &MR, Function &F,
                                               LoopAnalysis::Result &LA,
                                               ScalarEvolution &SE,
                                               AAResults &AA) {
+   CallBase *CI = MR.MallocCall;
    double Score = 0.0;
  
+   // (0) 实测访存密度: 最热的调用点直接用 (采样数/字节) 与全体平均密度之比打分,
+   //     平均密度恰好得到放置阈值; 不再用下面按 sqrt(tripCount) 的静态估计
+   if (isProfileHot(CI)) {
+     MDNode *PM = CI->getMetadata("hbm.profile");
+     double Bytes = (double)std::max<uint64_t>(mdInt(PM, 1), 1);
+     double AvgDensity = (double)mdInt(PM, 3) / (double)std::max<uint64_t>(mdInt(PM, 4), 1);
+     return HBMScoreThreshold * ((double)mdInt(PM, 0) / Bytes) / AvgDensity;
+   }
+ 
    // (1) 基础：分配大小
-   if (CI->arg_size() >= 1) {
-     if (auto *Cst = dyn_cast<ConstantInt>(CI->getArgOperand(0))) {
-       double kb = (double)Cst->getZExtValue() / 1024.0;
-       Score += kb * 0.1; // 每KB加0.1分
-     }
+   if (MR.AllocSize) {
+     double kb = (double)MR.AllocSize / 1024.0;
+     Score += kb * 0.1; // 每KB加0.1分
    }
  
    // (2) Metadata: Profile Gating
@@ -211,13 +691,17 @@
  
    // (4) 遍历指针use，统计Load/Store, 并用AliasAnalysis避免重复计分
    std::unordered_set<Value*> visited;
-   explorePointerUsers(CI, CI, LA, SE, AA, Score, visited);
+   SmallVector<Value*, 4> Roots;
+   allocRoots(CI, MR.Kind, Roots);
+   for (Value *Root : Roots)
+     explorePointerUsers(Root, Root, LA, SE, AA, Score, visited);
  
    return Score;
  }
  
  /******************************************************************************
-  * 为本函数找到对应的 free；若没找到 => unmatched => 可能扣分
+  * 为本函数找到对应的 free；若没找到 => unmatched
+  *   (扣分移到模块级跟踪: 只有跨函数也证明不了的分配点才扣分)
   ******************************************************************************/
  void MyFunctionAnalysisPass::matchFreeCalls(FunctionMallocInfo &FMI,
                                              std::vector<CallInst*> &freeCalls) {
@@ -226,7 +710,7 @@
      Value *mallocPtr = MR.MallocCall;
      bool matched = false;
      for (auto *fc : freeCalls) {
-       if (fc->arg_size() == 1) {
+       if (fc->arg_size() >= 1) {
          Value *freeArg = fc->getArgOperand(0);
          if (freeArg == mallocPtr) {
            MR.FreeCalls.push_back(fc);
@@ -237,13 +721,6 @@
      // 若依然没匹配到 => unmatched
      if (!matched) {
        MR.UnmatchedFree = true;
-       // 视为逃逸 => 这里做一个小扣分(示例：-10 分)
-       // 亦可在后面再处理
-       for (auto &m : FMI.MallocRecords) {
-         if (m.MallocCall == MR.MallocCall) {
-           m.Score -= 10.0;
-         }
-       }
      }
    }
  }
@@ -291,7 +768,7 @@
        }
      }
      // 如果是其他 call => 可能逃逸, 这里加分/扣分看需求
-     else if (auto *CallI = dyn_cast<CallInst>(I)) {
+     else if (isa<CallInst>(I)) {
        Score += 5.0; // 简单加5分
      }
      // GEP, BitCast, PHI => 继续递归
@@ -365,73 +842,679 @@
    return 1;
  }
  
+ /******************************************************************************
+  * 1.5 模块级分析 - HBMSiteTrackingAnalysis
+  *
+  *   - 分配点: 函数级分析找到的分配调用, 加上每一个分配包装函数的调用;
+  *     自动识别的包装 (返回自己分配的结果) 内部的分配调用不再单独算
+  *   - 从分配点出发跟踪指针: 经转换/GEP/PHI/select, 作为实参进入被调函数,
+  *     经 return 回到所有调用者, 存入全局变量或结构体字段后从同一位置
+  *     (全局变量, 或 结构体类型+字段号) 的 load 取出; 其他函数中的访问也计分
+  *   - 沿途遇到的释放 (free, operator delete, realloc 的旧指针) 与释放包装
+  *     调用都记入 FreeCalls, 不限于同一函数
+  *   - 流入外部声明 (不带 nofree) 或间接调用 => Escaped, 可能在看不到的
+  *     代码里释放, 不放入; 存入的结构体/全局变量本身能到达外部代码, 或经
+  *     对外可见函数的 return 传出, 同样算 Escaped (LTO 阶段 internalize
+  *     之后才能跟得住); 存入无法跟踪的内存 => FreeUnproven, 放入时把
+  *     所有 free 改为 hbm_free, 由运行时按地址判断块是否来自快速层
+  *   - 假定模块里有全部 free (多文件程序请在 LTO 阶段运行)
+  ******************************************************************************/
+ 
+ /// 名字[:实参位置] 的列表
+ static StringMap<unsigned> parseWrapperList(const cl::list<std::string> &List) {
+   StringMap<unsigned> Map;
+   for (StringRef Item : List) {
+     StringRef Name, Pos;
+     std::tie(Name, Pos) = Item.split(':');
+     unsigned ArgNo = 0;
+     if (!Pos.empty() && Pos.getAsInteger(10, ArgNo)) {
+       errs() << "hbm: 无法解析包装函数 " << Item << ", 忽略\n";
+       continue;
+     }
+     Map[Name] = ArgNo;
+   }
+   return Map;
+ }
+ 
+ /// 去掉实参位置超出模块中同名函数形参个数的项 (可变实参部分也不支持),
+ /// 提示与解析失败相同, 每项只提示一次
+ static void dropBadWrapperArgs(Module &M, StringMap<unsigned> &Map) {
+   static StringSet<> Reported;
+   for (auto It = Map.begin(); It != Map.end();) {
+     auto Cur = It++;
+     Function *F = M.getFunction(Cur->getKey());
+     if (!F || Cur->getValue() < F->arg_size())
+       continue;
+     std::string Item = (Cur->getKey() + ":" + Twine(Cur->getValue())).str();
+     if (Reported.insert(Item).second)
+       errs() << "hbm: 无法解析包装函数 " << Item << ", 忽略\n";
+     Map.erase(Cur);
+   }
+ }
+ 
+ /// 自动识别的分配包装: 所有 return 返回同一个分配调用 (返回指针的分配函数)
+ /// 的结果, 该结果此外只用于比较 (判空) 与内建函数 (memset 等)。返回这个调用
+ static CallInst *wrappedAllocation(Function &F, const TargetLibraryInfo &TLI) {
+   if (F.isDeclaration() || !F.getReturnType()->isPointerTy())
+     return nullptr;
+   CallInst *Inner = nullptr;
+   for (auto &I : instructions(F)) {
+     auto *RI = dyn_cast<ReturnInst>(&I);
+     if (!RI)
+       continue;
+     auto *CI = dyn_cast<CallInst>(RI->getReturnValue()->stripPointerCasts());
+     if (!CI || (Inner && Inner != CI))
+       return nullptr;
+     HBMAllocKind K = allocKind(CI, TLI);
+     if (!isAllocation(K) || K == HBMAllocKind::PosixMemalign)
+       return nullptr;
+     Inner = CI;
+   }
+   if (!Inner)
+     return nullptr;
+   SmallVector<Value*, 4> Work{Inner};
+   while (!Work.empty()) {
+     Value *V = Work.pop_back_val();
+     for (User *U : V->users()) {
+       if (isa<BitCastInst>(U))
+         Work.push_back(U);
+       else if (auto *CB = dyn_cast<CallBase>(U)) {
+         if (!CB->getCalledFunction() || !CB->getCalledFunction()->isIntrinsic())
+           return nullptr;
+       } else if (!isa<ReturnInst>(U) && !isa<ICmpInst>(U))
+         return nullptr;
+     }
+   }
+   return Inner;
+ }
+ 
+ /// 自动识别的释放包装: 直接释放 (free, operator delete) 自己的某个实参,
+ /// 返回该实参的位置
+ static Optional<unsigned> freedArgument(Function &F, const TargetLibraryInfo &TLI) {
+   for (auto &I : instructions(F)) {
+     auto *CI = dyn_cast<CallInst>(&I);
+     HBMAllocKind K = CI ? allocKind(CI, TLI) : HBMAllocKind::None;
+     if (isRelease(K) && K != HBMAllocKind::Realloc)
+       if (auto *A = dyn_cast<Argument>(CI->getArgOperand(0)->stripPointerCasts()))
+         return A->getArgNo();
+   }
+   return None;
+ }
+ 
+ /// 模块中的分配/释放包装: 选项给出的加上自动识别的
+ struct HBMWrappers {
+   StringMap<unsigned> Alloc;                // 名字 -> 大小实参
+   StringMap<unsigned> Free;                 // 名字 -> 指针实参
+   DenseMap<Function*, CallInst*> Inner;     // 自动识别的包装 -> 内部分配调用
+   DenseMap<Function*, unsigned> CountArg;   // 自动识别的包装 -> 数量实参
+ };
+ 
+ /// 自动识别包装函数; 包装的大小实参为内部分配调用的大小实参
+ /// (calloc 的两个实参都须来自包装的实参, 否则按不在实参中处理)
+ static HBMWrappers findWrappers(Module &M, FunctionAnalysisManager &FAM) {
+   // 选项只解析一次, 出错提示不随每次调用重复
+   static const StringMap<unsigned> OptAlloc = parseWrapperList(HBMAllocWrappers);
+   static const StringMap<unsigned> OptFree = parseWrapperList(HBMFreeWrappers);
+   HBMWrappers W;
+   W.Alloc = OptAlloc;
+   W.Free = OptFree;
+   dropBadWrapperArgs(M, W.Alloc);
+   dropBadWrapperArgs(M, W.Free);
+   for (Function &F : M) {
+     if (F.isDeclaration()) continue;
+     auto &TLI = FAM.getResult<TargetLibraryAnalysis>(F);
+     if (CallInst *CI = wrappedAllocation(F, TLI)) {
+       HBMAllocKind K = allocKind(CI, TLI);
+       auto ArgNo = [&](unsigned i) {
+         auto *A = i < CI->arg_size() ? dyn_cast<Argument>(CI->getArgOperand(i)) : nullptr;
+         return A ? A->getArgNo() : ~0u;
+       };
+       unsigned SizeArg = ArgNo(allocSizeArg(K));
+       unsigned CountArg = ArgNo(allocCountArg(K));
+       if (K == HBMAllocKind::Calloc && CountArg == ~0u)
+         SizeArg = ~0u;
+       W.Inner[&F] = CI;
+       W.Alloc.try_emplace(F.getName(), SizeArg);
+       W.CountArg[&F] = CountArg;
+     } else if (!W.Free.count(F.getName())) {
+       if (Optional<unsigned> ArgNo = freedArgument(F, TLI))
+         W.Free[F.getName()] = *ArgNo;
+     }
+   }
+   return W;
+ }
+ 
+ /// 存放指针的内存位置: (全局变量, ~0u) 或 (结构体类型, 字段号)
+ using HBMSlot = std::pair<const void*, unsigned>;
+ 
+ static Optional<HBMSlot> slotOf(Value *Ptr) {
+   Ptr = Ptr->stripPointerCasts();
+   if (auto *GV = dyn_cast<GlobalVariable>(Ptr))
+     return HBMSlot(GV, ~0u);
+   if (auto *GEP = dyn_cast<GEPOperator>(Ptr)) {
+     if (GEP->getNumIndices() >= 2) {
+       SmallVector<Value*, 4> Idx(GEP->idx_begin(), GEP->idx_end() - 1);
+       Type *T = GetElementPtrInst::getIndexedType(GEP->getSourceElementType(), Idx);
+       auto *Field = dyn_cast<ConstantInt>(*(GEP->idx_end() - 1));
+       if (T && T->isStructTy() && Field)
+         return HBMSlot(T, (unsigned)Field->getZExtValue());
+     }
+     // 全局数组的元素: 整个全局变量算一个位置
+     if (auto *GV = dyn_cast<GlobalVariable>(GEP->getPointerOperand()->stripPointerCasts()))
+       return HBMSlot(GV, ~0u);
+   }
+   return None;
+ }
+ 
+ /// 存放指针的容器 (slotOf 的基址: 局部变量、实参、全局变量等) 能否到达外部
+ /// 代码。向上追溯容器的来源 (实参追到各调用点, 从内存取出的追到取出的位置,
+ /// 调用结果追到被调函数的返回值), 向下跟踪容器地址的用户; 流入外部声明
+ /// 或间接调用、地址本身被存入内存、经对外可见函数的实参或返回值往来都算
+ static bool containerEscapes(Value *Obj, FunctionAnalysisManager &FAM) {
+   // (值, 是否追溯来源)
+   SmallVector<std::pair<Value*, bool>, 16> Work{{Obj, true}};
+   SmallPtrSet<Value*, 32> SeenUp, SeenDown;
+   auto callersOf = [&](Function *F, SmallVectorImpl<CallBase*> &Calls) {
+     if (!F->hasLocalLinkage())
+       return false;
+     for (User *U : F->users()) {
+       auto *CB = dyn_cast<CallBase>(U);
+       if (!CB || CB->getCalledOperand() != F)
+         return false;  // 地址被取走, 找不全调用者
+       Calls.push_back(CB);
+     }
+     return true;
+   };
+ 
+   while (!Work.empty()) {
+     Value *V;
+     bool Up;
+     std::tie(V, Up) = Work.pop_back_val();
+     if (Up) {
+       if (!SeenUp.insert(V).second)
+         continue;
+       Work.push_back({V, false});
+       if (auto *A = dyn_cast<Argument>(V)) {
+         SmallVector<CallBase*, 8> Calls;
+         if (!callersOf(A->getParent(), Calls))
+           return true;
+         for (CallBase *CB : Calls)
+           if (A->getArgNo() < CB->arg_size())
+             Work.push_back({getUnderlyingObject(CB->getArgOperand(A->getArgNo())), true});
+       } else if (auto *LI = dyn_cast<LoadInst>(V)) {
+         Work.push_back({getUnderlyingObject(LI->getPointerOperand()), true});
+       } else if (auto *PN = dyn_cast<PHINode>(V)) {
+         for (Value *In : PN->incoming_values())
+           Work.push_back({getUnderlyingObject(In), true});
+       } else if (auto *Sel = dyn_cast<SelectInst>(V)) {
+         Work.push_back({getUnderlyingObject(Sel->getTrueValue()), true});
+         Work.push_back({getUnderlyingObject(Sel->getFalseValue()), true});
+       } else if (auto *CB = dyn_cast<CallBase>(V)) {
+         auto &TLI = FAM.getResult<TargetLibraryAnalysis>(*CB->getFunction());
+         Function *Callee = CB->getCalledFunction();
+         if (isAllocation(allocKind(CB, TLI)))
+           continue;  // 新分配的容器
+         if (!Callee || Callee->isDeclaration())
+           return true;
+         for (auto &I : instructions(*Callee))
+           if (auto *RI = dyn_cast<ReturnInst>(&I))
+             if (Value *RV = RI->getReturnValue())
+               Work.push_back({getUnderlyingObject(RV), true});
+       } else if (!isa<AllocaInst>(V) && !isa<GlobalVariable>(V)) {
+         return true;
+       }
+       continue;
+     }
+ 
+     if (!SeenDown.insert(V).second)
+       continue;
+     for (Use &U : V->uses()) {
+       User *Usr = U.getUser();
+       if (isa<ConstantExpr>(Usr)) {
+         Work.push_back({Usr, false});  // 全局变量的常量 GEP/bitcast
+         continue;
+       }
+       auto *I = dyn_cast<Instruction>(Usr);
+       if (!I)
+         return true;
+       if (isa<BitCastInst>(I) || isa<GetElementPtrInst>(I) || isa<PHINode>(I) ||
+           isa<SelectInst>(I) || isa<AddrSpaceCastInst>(I)) {
+         Work.push_back({I, false});
+       } else if (isa<LoadInst>(I) || isa<ICmpInst>(I) || isa<PtrToIntInst>(I)) {
+         // 读容器内容、判空、取地址值
+       } else if (isa<StoreInst>(I)) {
+         if (U.getOperandNo() == 0)
+           return true;  // 容器地址本身被存走
+       } else if (auto *RI = dyn_cast<ReturnInst>(I)) {
+         SmallVector<CallBase*, 8> Calls;
+         if (!callersOf(RI->getFunction(), Calls))
+           return true;
+         for (CallBase *CB : Calls)
+           Work.push_back({CB, false});
+       } else if (auto *CB = dyn_cast<CallBase>(I)) {
+         Function *Callee = CB->getCalledFunction();
+         if (!Callee || !CB->isArgOperand(&U))
+           return true;
+         unsigned ArgNo = CB->getArgOperandNo(&U);
+         HBMAllocKind K = allocKind(CB, FAM.getResult<TargetLibraryAnalysis>(*CB->getFunction()));
+         if (isRelease(K) || Callee->isIntrinsic() || Callee->hasFnAttribute(Attribute::NoFree))
+           continue;  // 释放容器本身不会释放其中的指针
+         if (Callee->isDeclaration() || ArgNo >= Callee->arg_size())
+           return true;
+         Work.push_back({Callee->getArg(ArgNo), false});
+       } else {
+         return true;
+       }
+     }
+   }
+   return false;
+ }
+ 
+ namespace {
+ class HBMSiteTrackingAnalysis : public AnalysisInfoMixin<HBMSiteTrackingAnalysis> {
+ public:
+   struct Result {
+     std::vector<MallocRecord> Sites;
+   };
+ 
+   Result run(Module &M, ModuleAnalysisManager &MAM);
+ 
+ private:
+   friend AnalysisInfoMixin<HBMSiteTrackingAnalysis>;
+   static AnalysisKey Key;
+ 
+   void trackSite(MallocRecord &MR, FunctionAnalysisManager &FAM,
+                  const StringMap<unsigned> &FreeWrappers,
+                  const std::map<HBMSlot, SmallVector<LoadInst*, 4>> &Slots);
+ 
+   MyFunctionAnalysisPass Scorer;
+ };
+ 
+ AnalysisKey HBMSiteTrackingAnalysis::Key;
+ } // end anonymous namespace
+ 
+ HBMSiteTrackingAnalysis::Result
+ HBMSiteTrackingAnalysis::run(Module &M, ModuleAnalysisManager &MAM) {
+   auto &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+   Result R;
+ 
+   // (1) 分配/释放包装
+   HBMWrappers W = findWrappers(M, FAM);
+   const StringMap<unsigned> &FreeWrappers = W.Free;
+ 
+   // (2) 可能存放指针的内存位置 -> 从中取指针的 load
+   std::map<HBMSlot, SmallVector<LoadInst*, 4>> Slots;
+   for (Function &F : M)
+     for (auto &I : instructions(F))
+       if (auto *LI = dyn_cast<LoadInst>(&I))
+         if (LI->getType()->isPointerTy())
+           if (Optional<HBMSlot> S = slotOf(LI->getPointerOperand()))
+             Slots[*S].push_back(LI);
+ 
+   // (3) 分配点: 直接的 malloc 与分配包装的调用, 各自估计大小
+   const uint64_t WorstCase = bytesOption(HBMDynamicSize, 256ULL << 20);
+   for (Function &F : M) {
+     if (F.isDeclaration()) continue;
+     auto &FMI = FAM.getResult<MyFunctionAnalysisPass>(F);
+     for (const MallocRecord &MR : FMI.MallocRecords) {
+       if (W.Inner.lookup(&F) == MR.MallocCall)
+         continue;
+       R.Sites.push_back(MR);
+       Scorer.estimateSize(R.Sites.back(), FAM.getResult<ScalarEvolutionAnalysis>(F), WorstCase);
+     }
+ 
+     unsigned Ordinal = 0;
+     for (CallInst *CI : wrapperCalls(F, W.Alloc)) {
+       Function *Callee = CI->getCalledFunction();
+       auto &LA = FAM.getResult<LoopAnalysis>(F);
+       auto &SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
+       auto &AA = FAM.getResult<AAManager>(F);
+       MallocRecord MR;
+       MR.MallocCall = CI;
+       MR.Wrapper = Callee;
+       MR.WrappedAlloc = W.Inner.lookup(Callee);
+       if (MR.WrappedAlloc)
+         MR.Kind = allocKind(MR.WrappedAlloc, FAM.getResult<TargetLibraryAnalysis>(*Callee));
+       MR.SizeArg = W.Alloc.lookup(Callee->getName());
+       auto WC = W.CountArg.find(Callee);
+       MR.CountArg = WC != W.CountArg.end() ? WC->second : ~0u;
+       MR.Ordinal = Ordinal++;
+       MR.SiteID = wrapperSiteID(F, MR.Ordinal);
+       MR.UserForcedHot = CI->hasMetadata("hot_mem") || F.hasFnAttribute("hot_mem");
+       MR.AllocSize = constantAllocSize(CI, MR.SizeArg, MR.CountArg);
+       MR.Score = Scorer.analyzeMalloc(MR, F, LA, SE, AA);
+       MR.ProfileHot = Scorer.isProfileHot(CI);
+       Scorer.estimateSize(MR, SE, WorstCase);
+       // 大小不来自实参时用包装内部分配调用的常量
+       if (MR.SizeArg == ~0u && MR.WrappedAlloc) {
+         if (uint64_t Bytes = constantAllocSize(MR.WrappedAlloc, allocSizeArg(MR.Kind),
+                                                allocCountArg(MR.Kind))) {
+           MR.AllocSize = MR.SizeEstimate = Bytes;
+           MR.SizeFrom = SizeSource::Constant;
+         }
+       }
+       R.Sites.push_back(MR);
+     }
+   }
+ 
+   // (4) 跟踪每个分配点
+   for (MallocRecord &MR : R.Sites) {
+     trackSite(MR, FAM, FreeWrappers, Slots);
+     MR.UnmatchedFree = MR.FreeCalls.empty();
+     if (MR.Escaped)
+       MR.Score -= 10.0;  // 逃逸扣分
+   }
+   return R;
+ }
+ 
+ void HBMSiteTrackingAnalysis::trackSite(MallocRecord &MR, FunctionAnalysisManager &FAM,
+                                         const StringMap<unsigned> &FreeWrappers,
+                                         const std::map<HBMSlot, SmallVector<LoadInst*, 4>> &Slots) {
+   // (值, 是否需要计分): 分配点本身已由 analyzeMalloc 计分, 派生的指针
+   // 由 explorePointerUsers 在同一次计分中覆盖
+   SmallVector<std::pair<Value*, bool>, 16> Work;
+   SmallVector<Value*, 4> Roots;
+   SmallPtrSet<Value*, 32> Seen;
+ 
+   if (!allocRoots(MR.MallocCall, MR.Kind, Roots))
+     MR.FreeUnproven = true;  // posix_memalign 的结果存入了无法跟踪的内存
+   for (Value *Root : Roots)
+     Work.push_back({Root, false});
+   MR.FreeCalls.clear();
+   while (!Work.empty()) {
+     Value *V;
+     bool NeedScore;
+     std::tie(V, NeedScore) = Work.pop_back_val();
+     if (!Seen.insert(V).second)
+       continue;
+     if (NeedScore) {
+       Function &G = isa<Argument>(V) ? *cast<Argument>(V)->getParent()
+                                      : *cast<Instruction>(V)->getFunction();
+       std::unordered_set<Value*> Visited;
+       double S = 0.0;
+       Scorer.explorePointerUsers(V, V, FAM.getResult<LoopAnalysis>(G),
+                                  FAM.getResult<ScalarEvolutionAnalysis>(G),
+                                  FAM.getResult<AAManager>(G), S, Visited);
+       MR.Score += S;
+     }
+ 
+     for (Use &U : V->uses()) {
+       auto *I = dyn_cast<Instruction>(U.getUser());
+       if (!I) {
+         MR.FreeUnproven = true;
+       } else if (isa<BitCastInst>(I) || isa<GetElementPtrInst>(I) || isa<PHINode>(I) ||
+                  isa<SelectInst>(I) || isa<AddrSpaceCastInst>(I)) {
+         Work.push_back({I, false});
+       } else if (isa<LoadInst>(I) || isa<ICmpInst>(I) || isa<PtrToIntInst>(I)) {
+         // 通过指针访问、判空、取地址值 (按不会再转回指针处理)
+       } else if (auto *SI = dyn_cast<StoreInst>(I)) {
+         if (U.getOperandNo() != 0)
+           continue;  // 存入的是别的值
+         Optional<HBMSlot> S = slotOf(SI->getPointerOperand());
+         if (!S) {
+           MR.FreeUnproven = true;
+           continue;
+         }
+         if (containerEscapes(getUnderlyingObject(SI->getPointerOperand()), FAM))
+           MR.Escaped = true;  // 外部代码能从容器中取走指针
+         auto It = Slots.find(*S);
+         if (It != Slots.end())
+           for (LoadInst *LI : It->second)
+             Work.push_back({LI, true});
+       } else if (auto *RI = dyn_cast<ReturnInst>(I)) {
+         if (!RI->getFunction()->hasLocalLinkage())
+           MR.Escaped = true;  // 对外可见, 模块外也可能有调用者
+         for (User *CU : RI->getFunction()->users()) {
+           auto *CB = dyn_cast<CallBase>(CU);
+           if (CB && CB->getCalledOperand() == RI->getFunction())
+             Work.push_back({CB, true});
+           else
+             MR.Escaped = true;  // 地址被取走, 找不全调用者
+         }
+       } else if (auto *CB = dyn_cast<CallBase>(I)) {
+         Function *Callee = CB->getCalledFunction();
+         if (!Callee || !CB->isArgOperand(&U)) {
+           MR.Escaped = true;
+           continue;
+         }
+         unsigned ArgNo = CB->getArgOperandNo(&U);
+         auto FW = FreeWrappers.find(Callee->getName());
+         HBMAllocKind K = allocKind(CB, FAM.getResult<TargetLibraryAnalysis>(*CB->getFunction()));
+         if ((isRelease(K) && ArgNo == 0) ||
+             (FW != FreeWrappers.end() && FW->second == ArgNo)) {
+           if (auto *FC = dyn_cast<CallInst>(CB))
+             MR.FreeCalls.push_back(FC);
+           else
+             MR.Escaped = true;
+         } else if (Callee->isIntrinsic() || Callee->hasFnAttribute(Attribute::NoFree)) {
+           // 不会释放
+         } else if (Callee->isDeclaration() || ArgNo >= Callee->arg_size()) {
+           MR.Escaped = true;
+         } else {
+           Work.push_back({Callee->getArg(ArgNo), true});
+         }
+       } else {
+         MR.FreeUnproven = true;
+       }
+     }
+   }
+ }
+ 
  /******************************************************************************
   * 2. 模块级Pass - MyModuleTransformPass
   *
-  *   - 汇总所有函数的 analysis 结果
-  *   - 统一排序(用户强制Hot优先, Score降序)
+  *   - 汇总模块级跟踪 (HBMSiteTrackingAnalysis) 的分配点
+  *   - 强制 hot 优先 (指针逃逸的除外), 其余按 分数/字节 做背包选择
   *   - 考虑HBM容量
-  *   - 替换 malloc -> hbm_malloc, free -> hbm_free
+  *   - 替换分配/释放函数为运行时的对应入口 (malloc -> hbm_malloc, ...)
   ******************************************************************************/
  namespace {
+ /// -passes=hbm-profile-load: 只按 -hbm-profile 标注元数据 (便于查看);
+ /// my-module-transform 在给出 -hbm-profile 时会自己先做这一步
+ class HBMProfileLoaderPass : public PassInfoMixin<HBMProfileLoaderPass> {
+ public:
+   PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+ };
+ 
+ /// -passes=hbm-instrument: malloc(n) -> hbm_prof_malloc(n, 调用点编号),
+ /// free -> hbm_prof_free; 其余分配函数之后插入 hbm_prof_track, 释放之前
+ /// 插入 hbm_prof_untrack, 供运行时记录剖析; 分配包装的调用改调带编号实参
+ /// 的克隆
+ class HBMInstrumentPass : public PassInfoMixin<HBMInstrumentPass> {
+ public:
+   PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+ };
+ 
  class MyModuleTransformPass : public PassInfoMixin<MyModuleTransformPass> {
  public:
    PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
  
  private:
-   static constexpr uint64_t DefaultHBMCapacity = 1ULL << 30; // 1GB
- 
    void processMallocRecords(Module &M,
-                             SmallVectorImpl<MallocRecord> &AllMallocs);
+                             SmallVectorImpl<MallocRecord> &AllMallocs,
+                             FunctionAnalysisManager &FAM);
+   void redirectWrapperCall(Module &M, MallocRecord &MR, FunctionCallee HBMAlloc);
+   void rewriteFree(Module &M, CallInst *FC, FunctionCallee HBMFree,
+                    const StringMap<unsigned> &FreeWrappers,
+                    FunctionAnalysisManager &FAM);
  };
  } // end anonymous namespace
  
  PreservedAnalyses
  MyModuleTransformPass::run(Module &M, ModuleAnalysisManager &MAM) {
-   // 1) 汇总所有函数的 FunctionMallocInfo
-   SmallVector<MallocRecord, 16> AllMallocs;
- 
-   for (Function &F : M) {
-     if (F.isDeclaration()) continue;
- 
-     // 从 MAM 获取“函数级分析”结果
-     auto &FMI = MAM.getResult<MyFunctionAnalysisPass>(F);
-     for (auto &MR : FMI.MallocRecords) {
-       AllMallocs.push_back(MR);
-     }
+   auto &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+ 
+   // 0) 读入剖析并标注; 已缓存的分析结果随之作废
+   if (!HBMProfileFiles.empty()) {
+     HBMProfile P;
+     if (loadHBMProfile(HBMProfileFiles, P) &&
+         annotateWithProfile(M, P, findWrappers(M, FAM).Alloc, FAM))
+       MAM.invalidate(M, PreservedAnalyses::none());
    }
  
+   // 1) 模块级跟踪汇总了所有函数的 FunctionMallocInfo 与包装调用点
+   auto &Tracking = MAM.getResult<HBMSiteTrackingAnalysis>(M);
+   SmallVector<MallocRecord, 16> AllMallocs(Tracking.Sites.begin(), Tracking.Sites.end());
+ 
    // 2) 全局处理
-   processMallocRecords(M, AllMallocs);
+   processMallocRecords(M, AllMallocs, FAM);
  
    // 假设做了修改
    return PreservedAnalyses::none();
  }
  
  /******************************************************************************
-  * 对AllMallocs做排序、容量限制、替换
+  * 0/1 背包: 在 Capacity 字节内选出分数之和最大的一组调用点
+  *
+  *   - 重量按 Capacity / HBMKnapsackBuckets 为单位向上取整, 动态规划的规模
+  *     为 调用点数 x 桶数; 取整只会高估, 选出的组合一定放得下
+  *   - 规模超过 HBMKnapsackMaxCells 时退化为按 分数/字节 降序的贪心
+  *   - 最后再按 分数/字节 降序用真实字节补进剩余容量, 弥补取整的损失
+  * 返回所用方法的说明
   ******************************************************************************/
- void MyModuleTransformPass::processMallocRecords(Module &M,
-        SmallVectorImpl<MallocRecord> &AllMallocs) {
-   // (A) 排序: 先看UserForcedHot，再看Score
-   std::sort(AllMallocs.begin(), AllMallocs.end(),
-     [](const MallocRecord &A, const MallocRecord &B) {
-       if (A.UserForcedHot != B.UserForcedHot)
-         return A.UserForcedHot > B.UserForcedHot;
-       return A.Score > B.Score;
+ static constexpr uint64_t HBMKnapsackBuckets = 8192;
+ static constexpr uint64_t HBMKnapsackMaxCells = 64ULL << 20;
+ 
+ static const char *knapsackSelect(ArrayRef<uint64_t> Weights, ArrayRef<double> Values,
+                                   uint64_t Capacity, SmallVectorImpl<bool> &Take) {
+   const size_t N = Weights.size();
+   const char *Method = "背包";
+   Take.assign(N, false);
+ 
+   std::vector<size_t> ByDensity(N);
+   for (size_t i = 0; i < N; ++i)
+     ByDensity[i] = i;
+   std::stable_sort(ByDensity.begin(), ByDensity.end(), [&](size_t A, size_t B) {
+     return Values[A] * (double)std::max<uint64_t>(Weights[B], 1) >
+            Values[B] * (double)std::max<uint64_t>(Weights[A], 1);
+   });
+ 
+   const uint64_t Unit = std::max<uint64_t>(1, (Capacity + HBMKnapsackBuckets - 1) / HBMKnapsackBuckets);
+   const uint64_t B = Capacity / Unit;
+   if (N && (uint64_t)N * (B + 1) <= HBMKnapsackMaxCells) {
+     std::vector<double> Best(B + 1, 0.0);
+     std::vector<std::vector<bool>> Keep(N, std::vector<bool>(B + 1, false));
+     for (size_t i = 0; i < N; ++i) {
+       uint64_t W = (Weights[i] + Unit - 1) / Unit;
+       if (W > B)
+         continue;
+       for (uint64_t c = B + 1; c-- > W;) {
+         if (Best[c - W] + Values[i] > Best[c]) {
+           Best[c] = Best[c - W] + Values[i];
+           Keep[i][c] = true;
+         }
+       }
+     }
+     for (size_t i = N, c = B; i-- > 0;) {
+       if (Keep[i][c]) {
+         Take[i] = true;
+         c -= (Weights[i] + Unit - 1) / Unit;
+       }
+     }
+   } else if (N) {
+     Method = "贪心 (调用点过多)";
+   }
+ 
+   uint64_t Used = 0;
+   for (size_t i = 0; i < N; ++i)
+     if (Take[i])
+       Used += Weights[i];
+   for (size_t i : ByDensity) {
+     if (!Take[i] && Used + Weights[i] <= Capacity) {
+       Take[i] = true;
+       Used += Weights[i];
      }
-   );
+   }
+   return Method;
+ }
+ 
+ static const char *sizeSourceName(SizeSource S) {
+   switch (S) {
+   case SizeSource::Constant:  return "const";
+   case SizeSource::Profile:   return "profile";
+   case SizeSource::SCEVBound: return "scev";
+   case SizeSource::WorstCase: return "worst";
+   }
+   return "?";
+ }
  
-   // (B) HBM容量
+ /// 调用点的可读名字: 函数#序号 (包装调用为 函数@包装#序号), 有调试信息时附上源码位置
+ static std::string siteName(const MallocRecord &MR) {
+   std::string Name;
+   raw_string_ostream OS(Name);
+   OS << MR.MallocCall->getFunction()->getName();
+   if (MR.Wrapper)
+     OS << "@" << MR.Wrapper->getName();
+   OS << "#" << MR.Ordinal;
+   if (const DebugLoc &DL = MR.MallocCall->getDebugLoc())
+     OS << " (" << DL->getFilename() << ":" << DL.getLine() << ")";
+   return OS.str();
+ }
+ 
+ /******************************************************************************
+  * 对AllMallocs做容量限制、替换
+  *   - 强制 hot 的调用点总是放入, 先占用容量
+  *   - 分数达到阈值的调用点参与背包, 价值为分数, 重量为 SizeEstimate;
+  *     背包按 分数/字节 权衡, 小而热的缓冲不会被一个大缓冲挤掉
+  ******************************************************************************/
+ void MyModuleTransformPass::processMallocRecords(Module &M,
+        SmallVectorImpl<MallocRecord> &AllMallocs,
+        FunctionAnalysisManager &FAM) {
+   // (A) HBM容量
+   const uint64_t capacity = bytesOption(HBMCapacity, 1ULL << 30);
    uint64_t used = 0ULL;
-   uint64_t capacity = DefaultHBMCapacity;
+   SmallVector<const char*, 16> Decision(AllMallocs.size(), nullptr);
+   SmallVector<size_t, 16> Candidates;
+ 
+   for (size_t i = 0; i < AllMallocs.size(); ++i) {
+     MallocRecord &MR = AllMallocs[i];
+     if (!MR.MallocCall) continue; // 防御
+     if (MR.Escaped) {
+       // 外部代码可能用 free 释放, 强制 hot 也不能放
+       if (MR.UserForcedHot) {
+         errs() << "hbm: " << MR.MallocCall->getFunction()->getName()
+                << " 中强制 hot 的分配指针流入外部代码, 不放入\n";
+         Decision[i] = "不放: 指针流入外部代码 (忽略强制 hot)";
+       } else {
+         Decision[i] = "不放: 指针流入外部代码";
+       }
+     } else if (MR.UserForcedHot) {
+       Decision[i] = "放入 (强制 hot)";
+       used += MR.SizeEstimate;
+     } else if (MR.Score < HBMScoreThreshold) {
+       Decision[i] = "不放: 分数低于阈值";
+     } else {
+       Candidates.push_back(i);
+     }
+   }
+ 
+   // (B) 背包
+   SmallVector<uint64_t, 16> Weights;
+   SmallVector<double, 16> Values;
+   SmallVector<bool, 16> Take;
+   for (size_t i : Candidates) {
+     Weights.push_back(AllMallocs[i].SizeEstimate);
+     Values.push_back(AllMallocs[i].Score);
+   }
+   const uint64_t room = used < capacity ? capacity - used : 0;
+   const char *Method = knapsackSelect(Weights, Values, room, Take);
+   for (size_t k = 0; k < Candidates.size(); ++k) {
+     size_t i = Candidates[k];
+     if (Take[k]) {
+       Decision[i] = "放入";
+       used += Weights[k];
+     } else {
+       Decision[i] = Weights[k] > room ? "不放: 大于剩余容量" : "不放: 背包未选中";
+     }
+   }
  
    LLVMContext &Ctx = M.getContext();
    auto *Int64Ty   = Type::getInt64Ty(Ctx);
    auto *Int8PtrTy = Type::getInt8PtrTy(Ctx);
    auto *VoidTy    = Type::getVoidTy(Ctx);
  
-   // 声明/获取 hbm_malloc, hbm_free
+   // 声明/获取 hbm_malloc, hbm_free (外部包装改写时使用; 其余入口按被替换
+   // 函数的原型在替换时声明)
    FunctionCallee HBMAlloc =
        M.getOrInsertFunction("hbm_malloc",
          FunctionType::get(Int8PtrTy, {Int64Ty}, false));
@@ -440,31 +1523,342 @@
        M.getOrInsertFunction("hbm_free",
          FunctionType::get(VoidTy, {Int8PtrTy}, false));
  
-   // (C) 逐个替换
-   for (auto &MR : AllMallocs) {
-     if (!MR.MallocCall) continue; // 防御
+   // (C) 报告与替换
+   SmallSetVector<CallInst*, 16> FreesToRewrite;
+   bool RewriteAllFrees = false;
+   std::unique_ptr<raw_fd_ostream> File;
+   raw_ostream *Report = nullptr;
+   if (HBMReport == "-") {
+     Report = &errs();
+   } else if (!HBMReport.empty()) {
+     std::error_code EC;
+     File = std::make_unique<raw_fd_ostream>(HBMReport, EC);
+     if (EC)
+       errs() << "hbm: 无法写入报告 " << HBMReport << ": " << EC.message() << "\n";
+     else
+       Report = File.get();
+   }
+   if (Report) {
+     *Report << format("HBM 放置 (%s): 容量 %.1f MiB, 计划占用 %.1f MiB, 阈值 %.0f\n",
+                       Method, capacity / 1048576.0, used / 1048576.0, HBMScoreThreshold);
+     *Report << "site                             id                      MiB size          score  score/MiB  decision\n";
+   }
  
-     // 如果 score 太低，且又不是强制hot，就跳过
-     if (!MR.UserForcedHot && MR.Score < 80.0) {
-       continue;
+   for (size_t i = 0; i < AllMallocs.size(); ++i) {
+     MallocRecord &MR = AllMallocs[i];
+     if (!MR.MallocCall) continue;
+     const bool Placed = StringRef(Decision[i]).startswith("放入");
+     const double MiB = MR.SizeEstimate / 1048576.0;
+ 
+     if (Report) {
+       *Report << format("%-32s %016llx %10.3f %-8s %10.1f %10.1f  %s",
+                         siteName(MR).c_str(), (unsigned long long)MR.SiteID, MiB,
+                         sizeSourceName(MR.SizeFrom), MR.Score,
+                         MR.Score / std::max(MiB, 1.0 / 1048576.0), Decision[i]);
+       if (MR.ProfileHot)
+         *Report << " [剖析]";
+       if (MR.Wrapper)
+         *Report << " [经 " << MR.Wrapper->getName() << "]";
+       if (MR.Kind != HBMAllocKind::Malloc)
+         *Report << " [" << allocKindName(MR.Kind) << "]";
+       if (MR.FreeUnproven)
+         *Report << " [free 未能全部找到]";
+       if (!MR.SizeExpr.empty() && MR.SizeFrom != SizeSource::Constant)
+         *Report << " size=" << MR.SizeExpr;
+       *Report << "\n";
      }
-     // 看 HBM 容量(非强制hot)
-     if (!MR.UserForcedHot && (used + MR.AllocSize > capacity)) {
+ 
+     auto &ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(*MR.MallocCall->getFunction());
+     if (Placed)
+       ORE.emit([&] {
+         return OptimizationRemark("hbm-placement", "Placed", MR.MallocCall)
+                << "放入 HBM: 分数 " << ore::NV("Score", (int)MR.Score) << ", 估计 "
+                << ore::NV("Bytes", MR.SizeEstimate) << " 字节";
+       });
+     else
+       ORE.emit([&] {
+         return OptimizationRemarkMissed("hbm-placement", "NotPlaced", MR.MallocCall)
+                << Decision[i] << ": 分数 " << ore::NV("Score", (int)MR.Score) << ", 估计 "
+                << ore::NV("Bytes", MR.SizeEstimate) << " 字节";
+       });
+     if (!Placed)
        continue;
+ 
+     // 替换: 原型不变, 对齐等实参原样传给运行时
+     if (!MR.Wrapper)
+       MR.MallocCall->setCalledFunction(hbmEntry(M, MR.MallocCall, MR.Kind));
+     else
+       redirectWrapperCall(M, MR, HBMAlloc);
+ 
+     // free -> hbm_free 等; 找不全时改写模块中所有的释放
+     FreesToRewrite.insert(MR.FreeCalls.begin(), MR.FreeCalls.end());
+     RewriteAllFrees |= MR.FreeUnproven;
+   }
+ 
+   // (D) 统一改写释放 (同一个 free 可能属于多个分配点)。hbm_free 等接受
+   //     任何 malloc / operator new 返回的指针, 多改写的释放只是多一次地址
+   //     范围判断。放入 HBM 的 realloc 此时已是 hbm_realloc, 不再改写
+   StringMap<unsigned> FreeWrappers = parseWrapperList(HBMFreeWrappers);
+   dropBadWrapperArgs(M, FreeWrappers);
+   if (RewriteAllFrees) {
+     for (Function &F : M) {
+       if (F.isDeclaration()) continue;
+       auto &TLI = FAM.getResult<TargetLibraryAnalysis>(F);
+       for (auto &I : instructions(F))
+         if (auto *CI = dyn_cast<CallInst>(&I))
+           if (isRelease(allocKind(CI, TLI)) ||
+               (CI->getCalledFunction() && FreeWrappers.count(CI->getCalledFunction()->getName())))
+             FreesToRewrite.insert(CI);
      }
+   }
+   for (CallInst *FC : FreesToRewrite)
+     rewriteFree(M, FC, HBMFree, FreeWrappers, FAM);
+ }
+ 
+ /// 放入 HBM 的包装调用: 自动识别的包装改调一个内部分配调用换成运行时入口
+ /// 的副本 (<包装>.hbm, 各调用点共用); 选项给出的外部包装直接换成 hbm_malloc
+ void MyModuleTransformPass::redirectWrapperCall(Module &M, MallocRecord &MR,
+                                                 FunctionCallee HBMAlloc) {
+   Function *W = MR.Wrapper;
+   if (MR.WrappedAlloc) {
+     std::string Name = (W->getName() + ".hbm").str();
+     Function *Clone = M.getFunction(Name);
+     if (!Clone) {
+       ValueToValueMapTy VMap;
+       Clone = CloneFunction(W, VMap);
+       Clone->setName(Name);
+       Clone->setLinkage(GlobalValue::InternalLinkage);
+       cast<CallInst>(VMap[MR.WrappedAlloc])->setCalledFunction(hbmEntry(M, MR.WrappedAlloc, MR.Kind));
+     }
+     MR.MallocCall->setCalledFunction(Clone);
+     return;
+   }
+   IRBuilder<> B(MR.MallocCall);
+   Value *Size = B.CreateZExtOrTrunc(MR.MallocCall->getArgOperand(MR.SizeArg), B.getInt64Ty());
+   CallInst *New = B.CreateCall(HBMAlloc, {Size});
+   New->copyMetadata(*MR.MallocCall);
+   New->takeName(MR.MallocCall);
+   MR.MallocCall->replaceAllUsesWith(B.CreateBitCast(New, MR.MallocCall->getType()));
+   MR.MallocCall->eraseFromParent();
+   MR.MallocCall = New;
+ }
+ 
+ /// free / operator delete 直接改调运行时的对应入口, 没有放入的 realloc
+ /// 改调 hbm_dram_realloc (新块在 DRAM); 定义在本模块的释放包装改写其内部的
+ /// 释放; 选项给出的外部释放包装换成对 hbm_free 的调用
+ void MyModuleTransformPass::rewriteFree(Module &M, CallInst *FC, FunctionCallee HBMFree,
+                                         const StringMap<unsigned> &FreeWrappers,
+                                         FunctionAnalysisManager &FAM) {
+   Function *Callee = FC->getCalledFunction();
+   HBMAllocKind K = allocKind(FC, FAM.getResult<TargetLibraryAnalysis>(*FC->getFunction()));
+   if (K == HBMAllocKind::Realloc) {
+     FC->setCalledFunction(M.getOrInsertFunction("hbm_dram_realloc", FC->getFunctionType()));
+   } else if (isRelease(K)) {
+     FC->setCalledFunction(hbmEntry(M, FC, K));
+   } else if (Callee && !Callee->isDeclaration()) {
+     auto &TLI = FAM.getResult<TargetLibraryAnalysis>(*Callee);
+     for (auto &I : instructions(*Callee))
+       if (auto *CI = dyn_cast<CallInst>(&I)) {
+         HBMAllocKind IK = allocKind(CI, TLI);
+         if (isRelease(IK) && IK != HBMAllocKind::Realloc)
+           CI->setCalledFunction(hbmEntry(M, CI, IK));
+       }
+   } else if (Callee && FreeWrappers.count(Callee->getName())) {
+     IRBuilder<> B(FC);
+     Value *Ptr = FC->getArgOperand(FreeWrappers.lookup(Callee->getName()));
+     B.CreateCall(HBMFree, {B.CreateBitCast(Ptr, B.getInt8PtrTy())});
+     FC->eraseFromParent();
+   }
+ }
+ 
+ PreservedAnalyses
+ HBMProfileLoaderPass::run(Module &M, ModuleAnalysisManager &MAM) {
+   HBMProfile P;
+   if (HBMProfileFiles.empty() || !loadHBMProfile(HBMProfileFiles, P))
+     return PreservedAnalyses::all();
+   auto &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+   unsigned N = annotateWithProfile(M, P, findWrappers(M, FAM).Alloc, FAM);
+   errs() << "hbm-profile: " << P.Sites.size() << " 个调用点, 本模块标注 " << N
+          << " 个, 总采样 " << P.TotalSamples << "\n";
+   return N ? PreservedAnalyses::none() : PreservedAnalyses::all();
+ }
  
-     // 替换
-     MR.MallocCall->setCalledFunction(HBMAlloc);
-     used += MR.AllocSize;
+ PreservedAnalyses
+ HBMInstrumentPass::run(Module &M, ModuleAnalysisManager &MAM) {
+   auto &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+   LLVMContext &Ctx = M.getContext();
+   auto *Int64Ty   = Type::getInt64Ty(Ctx);
+   auto *Int8PtrTy = Type::getInt8PtrTy(Ctx);
+   auto *VoidTy    = Type::getVoidTy(Ctx);
  
-     // free -> hbm_free
-     for (auto *fc : MR.FreeCalls) {
-       fc->setCalledFunction(HBMFree);
+   FunctionCallee ProfAlloc =
+       M.getOrInsertFunction("hbm_prof_malloc",
+         FunctionType::get(Int8PtrTy, {Int64Ty, Int64Ty}, false));
+   FunctionCallee ProfFree =
+       M.getOrInsertFunction("hbm_prof_free",
+         FunctionType::get(VoidTy, {Int8PtrTy}, false));
+   FunctionCallee ProfTrack =
+       M.getOrInsertFunction("hbm_prof_track",
+         FunctionType::get(VoidTy, {Int8PtrTy, Int64Ty, Int64Ty}, false));
+   FunctionCallee ProfUntrack =
+       M.getOrInsertFunction("hbm_prof_untrack",
+         FunctionType::get(VoidTy, {Int8PtrTy}, false));
+   bool Changed = false;
+ 
+   // 分配包装的调用点各自编号: 自动识别的包装克隆为多带一个编号实参的
+   // <包装>.hbm.prof, 调用点改调克隆并传入自己的编号, 克隆内的分配按传入的
+   // 编号登记; 选项给出的外部包装在调用之后登记, 外部释放包装在调用之前
+   // 取消。间接调用与模块外的调用仍走原包装, 记在包装内部分配的编号下
+   HBMWrappers W = findWrappers(M, FAM);
+   DenseMap<Function*, Function*> ProfClone;
+   SmallPtrSet<Function*, 8> Clones;
+   DenseMap<CallBase*, Value*> CloneSiteArg;   // 克隆内的分配 -> 编号实参
+   SmallVector<Function*, 8> Wrappers;
+   for (Function &F : M)
+     if (W.Inner.count(&F))
+       Wrappers.push_back(&F);
+   for (Function *Wr : Wrappers) {
+     SmallVector<Type*, 8> Params(Wr->getFunctionType()->params().begin(),
+                                  Wr->getFunctionType()->params().end());
+     Params.push_back(Int64Ty);
+     Function *Clone = Function::Create(
+         FunctionType::get(Wr->getReturnType(), Params, Wr->isVarArg()),
+         GlobalValue::InternalLinkage, Wr->getName() + ".hbm.prof", M);
+     ValueToValueMapTy VMap;
+     for (Argument &A : Wr->args()) {
+       VMap[&A] = Clone->getArg(A.getArgNo());
+       Clone->getArg(A.getArgNo())->setName(A.getName());
      }
+     SmallVector<ReturnInst*, 4> Returns;
+     CloneFunctionInto(Clone, Wr, VMap, CloneFunctionChangeType::LocalChangesOnly, Returns);
+     Clone->setLinkage(GlobalValue::InternalLinkage);
+     Clone->getArg(Wr->arg_size())->setName("hbm.site");
+     ProfClone[Wr] = Clone;
+     Clones.insert(Clone);
+     CloneSiteArg[cast<CallBase>(VMap[W.Inner.lookup(Wr)])] = Clone->getArg(Wr->arg_size());
    }
+   for (Function &F : M) {
+     if (F.isDeclaration() || Clones.count(&F)) continue;
+     unsigned Ordinal = 0;
+     for (CallInst *CI : wrapperCalls(F, W.Alloc)) {
+       Function *Callee = CI->getCalledFunction();
+       uint64_t ID = wrapperSiteID(F, Ordinal++);
+       if (Function *Clone = ProfClone.lookup(Callee)) {
+         SmallVector<Value*, 8> Args(CI->args());
+         Args.push_back(ConstantInt::get(Int64Ty, ID));
+         CallInst *New = CallInst::Create(Clone, Args, "", CI);
+         New->copyMetadata(*CI);
+         New->setCallingConv(CI->getCallingConv());
+         New->setAttributes(CI->getAttributes());
+         New->takeName(CI);
+         CI->replaceAllUsesWith(New);
+         CI->eraseFromParent();
+       } else if (Callee->isDeclaration()) {
+         unsigned SizeArg = W.Alloc.lookup(Callee->getName());
+         if (SizeArg >= CI->arg_size())
+           continue;
+         IRBuilder<> B(CI->getNextNode());
+         Value *Size = B.CreateZExtOrTrunc(CI->getArgOperand(SizeArg), Int64Ty);
+         B.CreateCall(ProfTrack, {B.CreateBitCast(CI, Int8PtrTy), Size, B.getInt64(ID)});
+       }
+       Changed = true;
+     }
+     for (auto &I : instructions(F)) {
+       auto *CI = dyn_cast<CallInst>(&I);
+       Function *Callee = CI ? CI->getCalledFunction() : nullptr;
+       if (!Callee || !Callee->isDeclaration() || !W.Free.count(Callee->getName()))
+         continue;
+       unsigned ArgNo = W.Free.lookup(Callee->getName());
+       if (ArgNo >= CI->arg_size())
+         continue;
+       IRBuilder<> B(CI);
+       B.CreateCall(ProfUntrack, {B.CreateBitCast(CI->getArgOperand(ArgNo), Int8PtrTy)});
+       Changed = true;
+     }
+   }
+ 
+   for (Function &F : M) {
+     if (F.isDeclaration()) continue;
+     auto &TLI = FAM.getResult<TargetLibraryAnalysis>(F);
+     SmallVector<std::pair<CallBase*, HBMAllocKind>, 8> Allocs, Frees;
+     for (auto &I : instructions(F)) {
+       if (auto *CI = dyn_cast<CallBase>(&I)) {
+         HBMAllocKind K = allocKind(CI, TLI);
+         if (isAllocation(K))
+           Allocs.push_back({CI, K});
+         if (isRelease(K))
+           Frees.push_back({CI, K});
+       }
+     }
+ 
+     // 释放之前取消跟踪; realloc 的旧块也在这里取消 (realloc 失败时旧块此后
+     // 不再统计)
+     for (auto &FK : Frees) {
+       CallBase *CI = FK.first;
+       IRBuilder<> B(CI);
+       Value *Ptr = B.CreateBitCast(CI->getArgOperand(0), Int8PtrTy);
+       if (FK.second != HBMAllocKind::Free) {
+         B.CreateCall(ProfUntrack, {Ptr});
+         continue;
+       }
+       CallInst *New = B.CreateCall(ProfFree, {Ptr});
+       New->copyMetadata(*CI);
+       CI->eraseFromParent();
+     }
+ 
+     // 编号与 MyFunctionAnalysisPass 中的计数顺序一致
+     unsigned Ordinal = 0;
+     for (auto &AK : Allocs) {
+       CallBase *CI = AK.first;
+       HBMAllocKind K = AK.second;
+       uint64_t ID = hbmSiteID(F, Ordinal++);
+       Value *IDV = CloneSiteArg.lookup(CI);
+       if (!IDV)
+         IDV = ConstantInt::get(Int64Ty, ID);
+       // 编号来自克隆的实参时不挂元数据
+       MDNode *SiteMD = isa<Constant>(IDV)
+           ? MDNode::get(Ctx, ConstantAsMetadata::get(cast<Constant>(IDV))) : nullptr;
+       if (K == HBMAllocKind::Malloc) {
+         IRBuilder<> B(CI);
+         Value *Size = B.CreateZExtOrTrunc(CI->getArgOperand(0), Int64Ty);
+         CallInst *New = B.CreateCall(ProfAlloc, {Size, IDV});
+         New->copyMetadata(*CI);
+         New->setMetadata("hbm.site", SiteMD);
+         New->takeName(CI);
+         CI->replaceAllUsesWith(B.CreateBitCast(New, CI->getType()));
+         CI->eraseFromParent();
+         continue;
+       }
  
-   // 可以在这里打印日志:
-   // errs() << "[MyModuleTransformPass] Used " << used << "/" << capacity << " bytes in HBM.\n";
+       // 其余分配函数保持原样, 在得到指针之后登记; invoke 只在正常出口
+       // 只有这一个前驱时登记 (否则出口处指针不一定来自这次调用)
+       Instruction *After = CI->getNextNode();
+       if (auto *II = dyn_cast<InvokeInst>(CI)) {
+         BasicBlock *Normal = II->getNormalDest();
+         if (!Normal->getSinglePredecessor())
+           continue;
+         After = &*Normal->getFirstInsertionPt();
+       }
+       CI->setMetadata("hbm.site", SiteMD);
+       IRBuilder<> B(After);
+       Value *Size = B.CreateZExtOrTrunc(CI->getArgOperand(allocSizeArg(K)), Int64Ty);
+       if (allocCountArg(K) != ~0u)
+         Size = B.CreateMul(Size, B.CreateZExtOrTrunc(CI->getArgOperand(allocCountArg(K)), Int64Ty));
+       Value *Ptr;
+       if (K == HBMAllocKind::PosixMemalign) {
+         // 失败时 *memptr 未定义, 登记空指针 (运行时忽略)
+         Value *Slot = B.CreateBitCast(CI->getArgOperand(0), Int8PtrTy->getPointerTo());
+         Value *Ok = B.CreateICmpEQ(CI, ConstantInt::get(CI->getType(), 0));
+         Ptr = B.CreateSelect(Ok, B.CreateLoad(Int8PtrTy, Slot),
+                              ConstantPointerNull::get(Int8PtrTy));
+       } else {
+         Ptr = B.CreateBitCast(CI, Int8PtrTy);
+       }
+       B.CreateCall(ProfTrack, {Ptr, Size, IDV});
+     }
+     Changed |= !Allocs.empty() || !Frees.empty();
+   }
+   return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
  }
  
  /******************************************************************************
@@ -483,6 +1877,11 @@
            FAM.registerPass([&](){ return MyFunctionAnalysisPass(); });
          }
        );
+       PB.registerAnalysisRegistrationCallback(
+         [&](ModuleAnalysisManager &MAM) {
+           MAM.registerPass([&](){ return HBMSiteTrackingAnalysis(); });
+         }
+       );
  
        // 注册模块级转换：用户可通过 -passes="my-module-transform" 启用
        PB.registerPipelineParsingCallback(
@@ -492,6 +1891,14 @@
              MPM.addPass(MyModuleTransformPass());
              return true;
            }
+           if (Name == "hbm-instrument") {
+             MPM.addPass(HBMInstrumentPass());
+             return true;
+           }
+           if (Name == "hbm-profile-load") {
+             MPM.addPass(HBMProfileLoaderPass());
+             return true;
+           }
            return false;
          }
        );